@@ -0,0 +1,375 @@
+//! Benchmarks for the ECS.
+//!
+//! Run with `zig build bench-ecs`, which always builds in ReleaseFast.
+//!
+//! Every measurement is printed as one JSON object per line, e.g.
+//! ```
+//! {"op":"add","entities":100000,"component_bytes":64,"pattern":"random","ns_per_op":11.82}
+//! ```
+//! so that runs before and after a storage change can be compared with standard tools. Each
+//! number is the best of several runs.
+//!
+//! Operations:
+//! - `create`: creating the entities.
+//! - `add`, `get`, `remove`: adding, reading and removing one component per entity, visiting the
+//!   entities in creation order (`sequential`) or in a shuffled order (`random`).
+//! - `iterate`: a two-component query, where every entity has the measured component and every
+//!   other entity has a small tag component. `ns_per_op` is per matching entity.
+//!
+//! The component storage is also measured on its own, outside of `Ecs`, for 100k and 1M entities:
+//! the current `ComponentArray` (`"storage":"sparse_set"`) against the hash map based storage it
+//! replaced (`"storage":"hash_map"`), which is kept here for that. Those lines have a `storage`
+//! field, and `iterate` visits the components of one array and looks the tag up in the other.
+
+const std = @import("std");
+const r4_ecs = @import("ecs");
+
+const entity_counts = [_]usize{ 1_000, 100_000, 1_000_000 };
+const num_runs = 5;
+
+fn Component(comptime size_in_bytes: usize) type {
+    return struct {
+        data: [size_in_bytes / @sizeOf(f32)]f32,
+
+        const Self = @This();
+
+        fn init(value: f32) Self {
+            var self: Self = undefined;
+            @memset(&self.data, value);
+            return self;
+        }
+    };
+}
+
+const component_types = .{ Component(4), Component(64), Component(128) };
+
+const Tag = struct {
+    value: u32,
+};
+
+const Pattern = enum {
+    sequential,
+    random,
+};
+
+const Op = enum {
+    create,
+    add,
+    get,
+    iterate,
+    remove,
+};
+
+const num_ops = @typeInfo(Op).Enum.fields.len;
+
+/// Best time per operation, in nanoseconds.
+const Results = [num_ops]f64;
+
+fn record(results: *Results, op: Op, timer: *std.time.Timer, num_ops_done: usize) void {
+    const elapsed_ns: f64 = @floatFromInt(timer.lap());
+    const ns_per_op = elapsed_ns / @as(f64, @floatFromInt(num_ops_done));
+    results[@intFromEnum(op)] = @min(results[@intFromEnum(op)], ns_per_op);
+}
+
+fn run_once(
+    allocator: std.mem.Allocator,
+    comptime T: type,
+    num_entities: usize,
+    pattern: Pattern,
+    results: *Results,
+) !void {
+    var ecs = r4_ecs.Ecs.init(allocator);
+    defer ecs.deinit();
+    try ecs.register_component(T);
+    try ecs.register_component(Tag);
+
+    const entities = try allocator.alloc(r4_ecs.Entity, num_entities);
+    defer allocator.free(entities);
+
+    var timer = try std.time.Timer.start();
+
+    for (entities) |*entity| {
+        entity.* = try ecs.create_entity();
+    }
+    record(results, .create, &timer, num_entities);
+
+    // The order in which entities are visited by `add`, `get` and `remove`.
+    if (pattern == .random) {
+        var prng = std.rand.DefaultPrng.init(0x42);
+        prng.random().shuffle(r4_ecs.Entity, entities);
+    }
+
+    _ = timer.lap();
+    for (entities) |entity| {
+        try ecs.add_component_for_entity(entity, T.init(1));
+    }
+    record(results, .add, &timer, num_entities);
+
+    var sum: f32 = 0;
+    _ = timer.lap();
+    for (entities) |entity| {
+        sum += ecs.get_component_for_entity(entity, T).?.data[0];
+    }
+    record(results, .get, &timer, num_entities);
+    std.mem.doNotOptimizeAway(sum);
+
+    for (entities) |entity| {
+        if (entity.id % 2 == 0) {
+            try ecs.add_component_for_entity(entity, Tag{ .value = entity.id });
+        }
+    }
+
+    var num_matches: usize = 0;
+    _ = timer.lap();
+    var it = try ecs.query(.{ T, Tag });
+    while (it.next()) |item| {
+        sum += item.components[0].data[0];
+        num_matches += 1;
+    }
+    record(results, .iterate, &timer, @max(num_matches, 1));
+    std.mem.doNotOptimizeAway(sum);
+
+    _ = timer.lap();
+    for (entities) |entity| {
+        try ecs.remove_component_for_entity(entity, T);
+    }
+    record(results, .remove, &timer, num_entities);
+}
+
+const storage_entity_counts = [_]usize{ 100_000, 1_000_000 };
+
+const Storage = enum {
+    hash_map,
+    sparse_set,
+};
+
+/// The component storage from before `ComponentArray` was a sparse set: the dense components, and
+/// two hash maps between entities and indices into them.
+fn HashMapComponentArray(comptime T: type) type {
+    return struct {
+        components: std.ArrayList(T),
+        entity_to_idx_map: std.AutoHashMap(r4_ecs.Entity, usize),
+        idx_to_entity_map: std.AutoHashMap(usize, r4_ecs.Entity),
+
+        const Self = @This();
+
+        fn init(allocator: std.mem.Allocator) Self {
+            return .{
+                .components = std.ArrayList(T).init(allocator),
+                .entity_to_idx_map = std.AutoHashMap(r4_ecs.Entity, usize).init(allocator),
+                .idx_to_entity_map = std.AutoHashMap(usize, r4_ecs.Entity).init(allocator),
+            };
+        }
+
+        fn deinit(self: *Self) void {
+            self.components.deinit();
+            self.entity_to_idx_map.deinit();
+            self.idx_to_entity_map.deinit();
+        }
+
+        fn add_component_for_entity(self: *Self, entity: r4_ecs.Entity, component: T) !void {
+            if (self.entity_to_idx_map.get(entity)) |idx| {
+                self.components.items[idx] = component;
+                return;
+            }
+            try self.components.append(component);
+            try self.entity_to_idx_map.put(entity, self.components.items.len - 1);
+            try self.idx_to_entity_map.put(self.components.items.len - 1, entity);
+        }
+
+        fn remove_component_for_entity(self: *Self, entity: r4_ecs.Entity) !void {
+            const idx = self.entity_to_idx_map.get(entity).?;
+            _ = self.entity_to_idx_map.remove(entity);
+            _ = self.idx_to_entity_map.remove(idx);
+
+            const last_idx = self.components.items.len - 1;
+            if (idx == last_idx) {
+                _ = self.components.pop();
+                return;
+            }
+            self.components.items[idx] = self.components.items[last_idx];
+            self.components.items.len -= 1;
+            const moved_entity = self.idx_to_entity_map.get(last_idx).?;
+            try self.entity_to_idx_map.put(moved_entity, idx);
+            try self.idx_to_entity_map.put(idx, moved_entity);
+        }
+
+        fn get_component_for_entity(self: *Self, entity: r4_ecs.Entity) ?*T {
+            const idx = self.entity_to_idx_map.get(entity) orelse return null;
+            return &self.components.items[idx];
+        }
+
+        fn entity_at(self: *const Self, idx: usize) r4_ecs.Entity {
+            return self.idx_to_entity_map.get(idx).?;
+        }
+    };
+}
+
+fn StorageArray(comptime storage: Storage, comptime T: type) type {
+    return switch (storage) {
+        .hash_map => HashMapComponentArray(T),
+        .sparse_set => r4_ecs.ComponentArray(T),
+    };
+}
+
+fn run_storage_once(
+    allocator: std.mem.Allocator,
+    comptime storage: Storage,
+    comptime T: type,
+    entities: []const r4_ecs.Entity,
+    results: *Results,
+) !void {
+    var array = StorageArray(storage, T).init(allocator);
+    defer array.deinit();
+    var tags = StorageArray(storage, Tag).init(allocator);
+    defer tags.deinit();
+
+    var timer = try std.time.Timer.start();
+    for (entities) |entity| {
+        try array.add_component_for_entity(entity, T.init(1));
+    }
+    record(results, .add, &timer, entities.len);
+
+    var sum: f32 = 0;
+    _ = timer.lap();
+    for (entities) |entity| {
+        sum += array.get_component_for_entity(entity).?.data[0];
+    }
+    record(results, .get, &timer, entities.len);
+    std.mem.doNotOptimizeAway(sum);
+
+    for (entities) |entity| {
+        if (entity.id % 2 == 0) {
+            try tags.add_component_for_entity(entity, Tag{ .value = entity.id });
+        }
+    }
+
+    var num_matches: usize = 0;
+    _ = timer.lap();
+    for (array.components.items, 0..) |component, i| {
+        const entity = if (storage == .hash_map) array.entity_at(i) else array.entities.items[i];
+        if (tags.get_component_for_entity(entity)) |tag| {
+            sum += component.data[0] + @as(f32, @floatFromInt(tag.value));
+            num_matches += 1;
+        }
+    }
+    record(results, .iterate, &timer, @max(num_matches, 1));
+    std.mem.doNotOptimizeAway(sum);
+
+    _ = timer.lap();
+    for (entities) |entity| {
+        try array.remove_component_for_entity(entity);
+    }
+    record(results, .remove, &timer, entities.len);
+}
+
+fn print_storage_result(
+    writer: anytype,
+    op: Op,
+    storage: Storage,
+    num_entities: usize,
+    component_bytes: usize,
+    pattern: Pattern,
+    ns_per_op: f64,
+) !void {
+    try writer.print(
+        "{{\"op\":\"{s}\",\"storage\":\"{s}\",\"entities\":{d},\"component_bytes\":{d}," ++
+            "\"pattern\":\"{s}\",\"ns_per_op\":{d:.2}}}\n",
+        .{
+            @tagName(op),
+            @tagName(storage),
+            num_entities,
+            component_bytes,
+            @tagName(pattern),
+            ns_per_op,
+        },
+    );
+}
+
+fn print_result(
+    writer: anytype,
+    op: Op,
+    num_entities: usize,
+    component_bytes: usize,
+    pattern: Pattern,
+    ns_per_op: f64,
+) !void {
+    try writer.print(
+        "{{\"op\":\"{s}\",\"entities\":{d},\"component_bytes\":{d},\"pattern\":\"{s}\"," ++
+            "\"ns_per_op\":{d:.2}}}\n",
+        .{ @tagName(op), num_entities, component_bytes, @tagName(pattern), ns_per_op },
+    );
+}
+
+pub fn main() !void {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+    defer _ = gpa.deinit();
+    const allocator = gpa.allocator();
+
+    var buffered_stdout = std.io.bufferedWriter(std.io.getStdOut().writer());
+    const stdout = buffered_stdout.writer();
+
+    for (entity_counts) |num_entities| {
+        inline for (component_types) |T| {
+            for ([_]Pattern{ .sequential, .random }) |pattern| {
+                var results: Results = [_]f64{std.math.inf(f64)} ** num_ops;
+                for (0..num_runs) |_| {
+                    try run_once(allocator, T, num_entities, pattern, &results);
+                }
+
+                for (results, 0..) |ns_per_op, op_idx| {
+                    const op: Op = @enumFromInt(op_idx);
+                    // These don't depend on the access pattern, so only report them once.
+                    if (pattern == .random and (op == .create or op == .iterate)) {
+                        continue;
+                    }
+                    try print_result(stdout, op, num_entities, @sizeOf(T), pattern, ns_per_op);
+                }
+                try buffered_stdout.flush();
+            }
+        }
+    }
+
+    for (storage_entity_counts) |num_entities| {
+        const entities = try allocator.alloc(r4_ecs.Entity, num_entities);
+        defer allocator.free(entities);
+
+        inline for (component_types) |T| {
+            for ([_]Pattern{ .sequential, .random }) |pattern| {
+                for (entities, 0..) |*entity, i| {
+                    entity.* = .{ .id = @intCast(i) };
+                }
+                if (pattern == .random) {
+                    var prng = std.rand.DefaultPrng.init(0x42);
+                    prng.random().shuffle(r4_ecs.Entity, entities);
+                }
+
+                inline for ([_]Storage{ .hash_map, .sparse_set }) |storage| {
+                    var results: Results = [_]f64{std.math.inf(f64)} ** num_ops;
+                    for (0..num_runs) |_| {
+                        try run_storage_once(allocator, storage, T, entities, &results);
+                    }
+
+                    for (results, 0..) |ns_per_op, op_idx| {
+                        const op: Op = @enumFromInt(op_idx);
+                        // The entities are visited in the order they were added in, so here
+                        // `iterate` depends on the pattern too.
+                        if (op == .create) {
+                            continue;
+                        }
+                        try print_storage_result(
+                            stdout,
+                            op,
+                            storage,
+                            num_entities,
+                            @sizeOf(T),
+                            pattern,
+                            ns_per_op,
+                        );
+                    }
+                    try buffered_stdout.flush();
+                }
+            }
+        }
+    }
+}
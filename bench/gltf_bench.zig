@@ -0,0 +1,281 @@
+//! Benchmarks for decoding glTF vertex and index data, as done for every primitive when loading
+//! a file.
+//!
+//! Run with `zig build bench-gltf`, which always builds in ReleaseFast, and also times whole files
+//! with bench/gltf_file_bench.zig.
+//!
+//! Every measurement is printed as one JSON object per line, e.g.
+//! ```
+//! {"op":"indices","layout":"u16","path":"bulk","count":1000,"ns_per_element":0.15,"gb_per_s":13.1}
+//! ```
+//! where `gb_per_s` is the rate at which the source data is read. Each number is the best of
+//! several runs.
+//!
+//! Operations:
+//! - `vertices`: decoding float32 positions and normals into the vertices of the scene, and
+//!   computing their debug colors, with the positions and normals in separate buffer views
+//!   (`separate`) or interleaved in one (`interleaved`).
+//! - `indices`: decoding 16-bit (`u16`) or 32-bit (`u32`) indices.
+//!
+//! Paths:
+//! - `per_element`: one `cgltf_accessor_read_float` or `cgltf_accessor_read_index` call per
+//!   element, as the loader used to.
+//! - `bulk`: the loader's path through `gltf_accessor`.
+
+const std = @import("std");
+const cgltf = @import("cgltf");
+const gltf_accessor = @import("gltf_accessor");
+
+const counts = [_]usize{ 10_000, 1_000_000 };
+const num_runs = 5;
+
+/// Same layout as the scene's `Vertex`.
+const Vertex = extern struct {
+    position: [3]f32,
+    normal: [3]f32,
+    color: [3]f32,
+};
+
+const VertexLayout = enum {
+    separate,
+    interleaved,
+};
+
+const IndexType = enum {
+    u16,
+    u32,
+};
+
+const Path = enum {
+    per_element,
+    bulk,
+};
+
+/// Stands in for what cgltf makes of a file: one buffer holding all the data, with views and
+/// accessors into it.
+const Source = struct {
+    allocator: std.mem.Allocator,
+    data: []u8,
+    buffer: cgltf.cgltf_buffer,
+    views: [2]cgltf.cgltf_buffer_view,
+    accessors: [2]cgltf.cgltf_accessor,
+
+    /// Positions and normals. `self` must not move once initialized, since accessors point to its
+    /// views, which point to its buffer.
+    fn init_vertices(
+        self: *Source,
+        allocator: std.mem.Allocator,
+        count: usize,
+        layout: VertexLayout,
+    ) !void {
+        const vec3_size = 3 * @sizeOf(f32);
+        self.allocator = allocator;
+        self.data = try allocator.alloc(u8, count * 2 * vec3_size);
+        const floats = std.mem.bytesAsSlice(f32, self.data);
+        var prng = std.rand.DefaultPrng.init(0x42);
+        for (floats) |*value| {
+            value.* = prng.random().float(f32) * 2 - 1;
+        }
+        self.buffer = std.mem.zeroInit(cgltf.cgltf_buffer, .{
+            .size = self.data.len,
+            .data = @as(*anyopaque, @ptrCast(self.data.ptr)),
+        });
+
+        for (&self.views, &self.accessors, 0..) |*view, *accessor, i| {
+            const is_separate = layout == .separate;
+            view.* = std.mem.zeroInit(cgltf.cgltf_buffer_view, .{
+                .buffer = &self.buffer,
+                .offset = if (is_separate) i * count * vec3_size else 0,
+                .size = if (is_separate) count * vec3_size else self.data.len,
+                .stride = if (is_separate) 0 else 2 * vec3_size,
+            });
+            accessor.* = std.mem.zeroInit(cgltf.cgltf_accessor, .{
+                .component_type = cgltf.cgltf_component_type_r_32f,
+                .type = cgltf.cgltf_type_vec3,
+                .offset = if (is_separate) 0 else i * vec3_size,
+                .count = count,
+                .stride = if (is_separate) vec3_size else 2 * vec3_size,
+                .buffer_view = view,
+            });
+        }
+    }
+
+    fn init_indices(
+        self: *Source,
+        allocator: std.mem.Allocator,
+        count: usize,
+        index_type: IndexType,
+    ) !void {
+        const index_size: usize = if (index_type == .u16) 2 else 4;
+        self.allocator = allocator;
+        self.data = try allocator.alloc(u8, count * index_size);
+        var prng = std.rand.DefaultPrng.init(0x42);
+        prng.random().bytes(self.data);
+        self.buffer = std.mem.zeroInit(cgltf.cgltf_buffer, .{
+            .size = self.data.len,
+            .data = @as(*anyopaque, @ptrCast(self.data.ptr)),
+        });
+
+        self.views[0] = std.mem.zeroInit(cgltf.cgltf_buffer_view, .{
+            .buffer = &self.buffer,
+            .size = self.data.len,
+        });
+        self.accessors[0] = std.mem.zeroInit(cgltf.cgltf_accessor, .{
+            .component_type = if (index_type == .u16)
+                cgltf.cgltf_component_type_r_16u
+            else
+                cgltf.cgltf_component_type_r_32u,
+            .type = cgltf.cgltf_type_scalar,
+            .count = count,
+            .stride = index_size,
+            .buffer_view = &self.views[0],
+        });
+    }
+
+    fn deinit(self: *Source) void {
+        self.allocator.free(self.data);
+    }
+};
+
+fn decode_vertices(path: Path, source: *const Source, vertices: []Vertex) void {
+    const position_accessor = &source.accessors[0];
+    const normal_accessor = &source.accessors[1];
+
+    switch (path) {
+        .per_element => {
+            for (vertices, 0..) |*vertex, i| {
+                _ = cgltf.cgltf_accessor_read_float(position_accessor, i, &vertex.position, 3);
+                _ = cgltf.cgltf_accessor_read_float(normal_accessor, i, &vertex.normal, 3);
+                for (&vertex.color, vertex.normal) |*c, n| {
+                    c.* = (n + 1.0) / 2.0;
+                }
+            }
+        },
+        .bulk => {
+            const vertex_bytes = std.mem.sliceAsBytes(vertices);
+            gltf_accessor.unpack_floats(
+                3,
+                gltf_accessor.Layout.from_accessor(position_accessor).?,
+                vertex_bytes[@offsetOf(Vertex, "position")..],
+                @sizeOf(Vertex),
+            );
+            gltf_accessor.unpack_floats(
+                3,
+                gltf_accessor.Layout.from_accessor(normal_accessor).?,
+                vertex_bytes[@offsetOf(Vertex, "normal")..],
+                @sizeOf(Vertex),
+            );
+            const half: @Vector(3, f32) = @splat(0.5);
+            for (vertices) |*vertex| {
+                const normal: @Vector(3, f32) = vertex.normal;
+                vertex.color = normal * half + half;
+            }
+        },
+    }
+}
+
+fn decode_indices(path: Path, source: *const Source, indices: []u32) void {
+    const accessor = &source.accessors[0];
+
+    switch (path) {
+        .per_element => {
+            for (indices, 0..) |*index, i| {
+                index.* = @intCast(cgltf.cgltf_accessor_read_index(accessor, i));
+            }
+        },
+        .bulk => {
+            gltf_accessor.unpack_indices(gltf_accessor.Layout.from_accessor(accessor).?, indices);
+        },
+    }
+}
+
+fn print_result(
+    writer: anytype,
+    op: []const u8,
+    layout: []const u8,
+    path: Path,
+    count: usize,
+    source_bytes: usize,
+    best_ns: u64,
+) !void {
+    const ns: f64 = @floatFromInt(best_ns);
+    try writer.print(
+        "{{\"op\":\"{s}\",\"layout\":\"{s}\",\"path\":\"{s}\",\"count\":{d}," ++
+            "\"ns_per_element\":{d:.2},\"gb_per_s\":{d:.2}}}\n",
+        .{
+            op,
+            layout,
+            @tagName(path),
+            count,
+            ns / @as(f64, @floatFromInt(count)),
+            @as(f64, @floatFromInt(source_bytes)) / ns,
+        },
+    );
+}
+
+pub fn main() !void {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+    defer _ = gpa.deinit();
+    const allocator = gpa.allocator();
+
+    var buffered_stdout = std.io.bufferedWriter(std.io.getStdOut().writer());
+    const stdout = buffered_stdout.writer();
+
+    for (counts) |count| {
+        for ([_]VertexLayout{ .separate, .interleaved }) |layout| {
+            var source: Source = undefined;
+            try source.init_vertices(allocator, count, layout);
+            defer source.deinit();
+            const vertices = try allocator.alloc(Vertex, count);
+            defer allocator.free(vertices);
+
+            for ([_]Path{ .per_element, .bulk }) |path| {
+                var best_ns: u64 = std.math.maxInt(u64);
+                for (0..num_runs) |_| {
+                    var timer = try std.time.Timer.start();
+                    decode_vertices(path, &source, vertices);
+                    best_ns = @min(best_ns, timer.read());
+                    std.mem.doNotOptimizeAway(vertices.ptr);
+                }
+                try print_result(
+                    stdout,
+                    "vertices",
+                    @tagName(layout),
+                    path,
+                    count,
+                    source.data.len,
+                    best_ns,
+                );
+            }
+            try buffered_stdout.flush();
+        }
+
+        for ([_]IndexType{ .u16, .u32 }) |index_type| {
+            var source: Source = undefined;
+            try source.init_indices(allocator, count, index_type);
+            defer source.deinit();
+            const indices = try allocator.alloc(u32, count);
+            defer allocator.free(indices);
+
+            for ([_]Path{ .per_element, .bulk }) |path| {
+                var best_ns: u64 = std.math.maxInt(u64);
+                for (0..num_runs) |_| {
+                    var timer = try std.time.Timer.start();
+                    decode_indices(path, &source, indices);
+                    best_ns = @min(best_ns, timer.read());
+                    std.mem.doNotOptimizeAway(indices.ptr);
+                }
+                try print_result(
+                    stdout,
+                    "indices",
+                    @tagName(index_type),
+                    path,
+                    count,
+                    source.data.len,
+                    best_ns,
+                );
+            }
+            try buffered_stdout.flush();
+        }
+    }
+}
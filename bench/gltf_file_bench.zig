@@ -0,0 +1,72 @@
+//! Times `gltf_loader.load_from_file` on whole glTF files, decoding accessors in bulk and per
+//! element, see `gltf_loader.AccessorPath`. Unlike bench/gltf_bench.zig, this includes parsing
+//! the JSON, reading the buffers and turning strips and fans into lists.
+//!
+//! Run with `zig build bench-gltf -- <file.glb>...`, which always builds in ReleaseFast. Large
+//! files give the most meaningful numbers.
+//!
+//! Every measurement is printed as one JSON object per line, e.g.
+//! ```
+//! {"op":"load_from_file","file":"city.glb","path":"bulk","primitives":10,"vertices":1846,"ms":4.1}
+//! ```
+//! Each number is the best of several runs.
+
+const std = @import("std");
+const r4_core = @import("r4_core");
+
+const gltf_loader = r4_core.gltf_loader;
+
+const num_runs = 5;
+
+pub fn main() !void {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+    defer _ = gpa.deinit();
+    var allocator = gpa.allocator();
+
+    var buffered_stdout = std.io.bufferedWriter(std.io.getStdOut().writer());
+    const stdout = buffered_stdout.writer();
+
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+    if (args.len < 2) {
+        std.debug.print("usage: {s} <file.glb>...\n", .{args[0]});
+        return;
+    }
+
+    for (args[1..]) |path| {
+        for ([_]gltf_loader.AccessorPath{ .per_element, .bulk }) |accessor_path| {
+            gltf_loader.accessor_path = accessor_path;
+
+            var best_ns: u64 = std.math.maxInt(u64);
+            var primitive_count: usize = 0;
+            var vertex_count: usize = 0;
+            for (0..num_runs) |_| {
+                var timer = try std.time.Timer.start();
+                const data = try gltf_loader.load_from_file(&allocator, path.ptr);
+                best_ns = @min(best_ns, timer.read());
+                defer data.deinit(&allocator);
+
+                primitive_count = 0;
+                vertex_count = 0;
+                for (data.primitives) |primitive| {
+                    const p = primitive orelse continue;
+                    primitive_count += 1;
+                    vertex_count += p.mesh_data.vertices.len;
+                }
+            }
+
+            try stdout.print(
+                "{{\"op\":\"load_from_file\",\"file\":\"{s}\",\"path\":\"{s}\"," ++
+                    "\"primitives\":{d},\"vertices\":{d},\"ms\":{d:.2}}}\n",
+                .{
+                    std.fs.path.basename(path),
+                    @tagName(accessor_path),
+                    primitive_count,
+                    vertex_count,
+                    @as(f64, @floatFromInt(best_ns)) / std.time.ns_per_ms,
+                },
+            );
+            try buffered_stdout.flush();
+        }
+    }
+}
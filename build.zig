@@ -144,6 +144,78 @@ pub fn build(b: *std.Build) void {
     // running the unit tests.
     const test_step = b.step("test", "Run unit tests");
     test_step.dependOn(&run_tests.step);
+
+    // The ECS tests live next to the code they test, in the ecs module, so they need their own
+    // test executable: only the tests of the root module of one are run.
+    const ecs_tests = b.addTest(.{
+        .root_source_file = .{ .path = "src/ecs/lib.zig" },
+        .target = target,
+        .optimize = optimize,
+    });
+    ecs_tests.addModule("debug_utils", debug_utils_module);
+
+    const run_ecs_tests = b.addRunArtifact(ecs_tests);
+    test_step.dependOn(&run_ecs_tests.step);
+
+    // ECS benchmarks. These only depend on the ecs module, and are always optimized since
+    // numbers from other modes aren't meaningful.
+    const ecs_bench = b.addExecutable(.{
+        .name = "ecs_bench",
+        .root_source_file = .{ .path = "bench/ecs_bench.zig" },
+        .target = target,
+        .optimize = .ReleaseFast,
+    });
+    ecs_bench.addModule("ecs", ecs_module);
+
+    const run_ecs_bench = b.addRunArtifact(ecs_bench);
+    const ecs_bench_step = b.step("bench-ecs", "Run the ECS benchmarks");
+    ecs_bench_step.dependOn(&run_ecs_bench.step);
+
+    // glTF decoding benchmarks. These only need cgltf and the accessor decoding of the loader,
+    // not the rest of r4_core.
+    const gltf_accessor_module = b.createModule(.{
+        .source_file = .{ .path = "src/core/renderer/gltf_loader/accessor.zig" },
+        .dependencies = &.{
+            .{
+                .name = "cgltf",
+                .module = cgltf_module,
+            },
+        },
+    });
+    const gltf_bench = b.addExecutable(.{
+        .name = "gltf_bench",
+        .root_source_file = .{ .path = "bench/gltf_bench.zig" },
+        .target = target,
+        .optimize = .ReleaseFast,
+    });
+    gltf_bench.linkLibC();
+    gltf_bench.addIncludePath(.{ .path = "./external/cgltf" });
+    gltf_bench.addCSourceFile(.{
+        .file = .{ .path = "./external/cgltf/cgltf_impl.c" },
+        .flags = &[_][]const u8{"-O2"},
+    });
+    gltf_bench.addModule("cgltf", cgltf_module);
+    gltf_bench.addModule("gltf_accessor", gltf_accessor_module);
+
+    const run_gltf_bench = b.addRunArtifact(gltf_bench);
+    const gltf_bench_step = b.step("bench-gltf", "Run the glTF decoding benchmarks");
+    gltf_bench_step.dependOn(&run_gltf_bench.step);
+
+    // Whole-file loading, of the files given after `--`. This goes through the real loader, so
+    // it links all of r4_core.
+    const gltf_file_bench = b.addExecutable(.{
+        .name = "gltf_file_bench",
+        .root_source_file = .{ .path = "bench/gltf_file_bench.zig" },
+        .target = target,
+        .optimize = .ReleaseFast,
+    });
+    link_r4_core(b, target, gltf_file_bench, r4_core_module);
+
+    const run_gltf_file_bench = b.addRunArtifact(gltf_file_bench);
+    if (b.args) |args| {
+        run_gltf_file_bench.addArgs(args);
+    }
+    gltf_bench_step.dependOn(&run_gltf_file_bench.step);
 }
 
 fn build_cimgui(b: *std.Build, target: std.zig.CrossTarget) *std.build.Step.Compile {
@@ -247,10 +319,10 @@ fn link_r4_core(
     exe.linkLibrary(build_cimgui(b, target));
 
     exe.addIncludePath(.{ .path = "./src/c" });
-    // exe.addCSourceFile(.{
-    //     .file = .{ .path = "./src/c/tm42_camera_impl.c" },
-    //     .flags = &[_][]const u8{},
-    // });
+    exe.addCSourceFile(.{
+        .file = .{ .path = "./src/c/tm42_impl.c" },
+        .flags = &[_][]const u8{},
+    });
 
     exe.addModule("r4_core", r4_core);
 }
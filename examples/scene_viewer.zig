@@ -25,27 +25,38 @@ pub const ScenePass = struct {
     scene: *Scene,
 
     pub fn init(core: *Core, window: *Window) !ScenePass {
-        var push_constant_ranges = [_]l0vk.VkPushConstantRange{.{
-            .offset = 0,
-            .size = @sizeOf(Scene.PushConstants),
-            .stageFlags = .{
-                .vertex = true,
-            },
-        }};
+        const system = &core.renderer.system;
         var binding_descriptions = [_]l0vk.VkVertexInputBindingDescription{
-            core.renderer.system.get_binding_description(Scene.Vertex),
+            system.get_binding_description(Scene.GpuVertex),
+            system.get_instance_binding_description(Scene.InstanceData, Scene.instance_binding),
         };
-        const attribute_descriptions = try core.renderer.system.get_attribute_descriptions(
+        const vertex_attribute_descriptions = try system.get_attribute_descriptions(
+            core.allocator,
+            Scene.GpuVertex,
+        );
+        defer core.allocator.free(vertex_attribute_descriptions);
+        const instance_attribute_descriptions = try system.get_instance_attribute_descriptions(
+            core.allocator,
+            Scene.InstanceData,
+            Scene.instance_binding,
+            Scene.instance_first_location,
+        );
+        defer core.allocator.free(instance_attribute_descriptions);
+        const attribute_descriptions = try std.mem.concat(
             core.allocator,
-            Scene.Vertex,
+            l0vk.VkVertexInputAttributeDescription,
+            &.{ vertex_attribute_descriptions, instance_attribute_descriptions },
         );
         defer core.allocator.free(attribute_descriptions);
 
         const pipeline_create_info = r4_core.pipeline.PipelineCreateInfo{
-            .vertex_shader_filename = "shaders/compiled_output/tri_mesh.vert.spv",
+            // The vertex shader has to decode the layout meshes are stored in.
+            .vertex_shader_filename = if (Scene.GpuVertex == Scene.CompactVertex)
+                "shaders/compiled_output/tri_mesh_compact.vert.spv"
+            else
+                "shaders/compiled_output/tri_mesh.vert.spv",
             .fragment_shader_filename = "shaders/compiled_output/tri_mesh.frag.spv",
             .renderpass_name = "scene",
-            .push_constant_ranges = &push_constant_ranges,
             .vertex_binding_descriptions = &binding_descriptions,
             .attribute_descriptions = attribute_descriptions,
             .depth_test_enabled = true,
@@ -87,34 +98,32 @@ pub const ScenePass = struct {
             .normal = math.Vec3f.init(0, 0, 1),
             .color = math.Vec3f.init(0, 0, 1),
         } };
-        const tri_mesh = try scene.mesh_system.register("triangle", &tri_verts);
+        const tri_mesh = try scene.mesh_system.register("triangle", &tri_verts, &.{});
         const tri_scene_obj = try scene.create_object("triangle");
         try scene.assign_mesh_to_object(tri_scene_obj, tri_mesh);
         try scene.assign_material_to_object(tri_scene_obj, material_handle);
 
         // ------ Cube
 
-        const cube_verts = try gltf_loader.load_from_file(
+        _ = try gltf_loader.add_file_to_scene(
             &core.allocator,
+            scene,
             "models/Box.glb",
+            "cube",
+            &.{},
+            material_handle,
         );
-        defer core.allocator.free(cube_verts);
-        const cube_mesh = try scene.mesh_system.register("cube", cube_verts);
-        const cube_scene_obj = try scene.create_object("cube");
-        try scene.assign_mesh_to_object(cube_scene_obj, cube_mesh);
-        try scene.assign_material_to_object(cube_scene_obj, material_handle);
 
         // ------ Duck
 
-        const duck_verts = try gltf_loader.load_from_file(
+        _ = try gltf_loader.add_file_to_scene(
             &core.allocator,
+            scene,
             "models/Duck.glb",
+            "duck",
+            &.{},
+            material_handle,
         );
-        defer core.allocator.free(duck_verts);
-        const duck_mesh = try scene.mesh_system.register("duck", duck_verts);
-        const duck_scene_obj = try scene.create_object("duck");
-        try scene.assign_mesh_to_object(duck_scene_obj, duck_mesh);
-        try scene.assign_material_to_object(duck_scene_obj, material_handle);
 
         // ---
 
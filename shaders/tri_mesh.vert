@@ -3,18 +3,14 @@ layout (location = 0) in vec3 vPosition;
 layout (location = 1) in vec3 vNormal;
 layout (location = 2) in vec3 vColor;
 
-layout (location = 0) out vec3 outColor;
+// Per instance, see `Scene.InstanceData`. A mat4 input takes locations 3 to 6.
+layout (location = 3) in mat4 iRenderMatrix;
 
-//push constants block
-layout( push_constant ) uniform constants
-{
- vec4 data;
- mat4 render_matrix;
-} PushConstants;
+layout (location = 0) out vec3 outColor;
 
 void main() 
 {	
-	gl_Position = PushConstants.render_matrix * vec4(vPosition, 1.0f);
+	gl_Position = iRenderMatrix * vec4(vPosition, 1.0f);
 	// gl_Position = vec4(vPosition, 1.0f);
 	outColor = vColor;
 }
\ No newline at end of file
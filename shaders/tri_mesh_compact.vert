@@ -0,0 +1,28 @@
+#version 450
+// `Scene.CompactVertex`: the position is read from half floats and the color from unorm8s by the
+// vertex input, but the normal is octahedral-encoded and decoded here.
+layout (location = 0) in vec3 vPosition;
+layout (location = 1) in vec2 vNormalOct;
+layout (location = 2) in vec4 vColor;
+
+// Per instance, see `Scene.InstanceData`. A mat4 input takes locations 3 to 6.
+layout (location = 3) in mat4 iRenderMatrix;
+
+layout (location = 0) out vec3 outColor;
+layout (location = 1) out vec3 outNormal;
+
+// See `vertex_formats.NormalOct16.decode`.
+vec3 oct_decode(vec2 f)
+{
+	vec3 n = vec3(f.x, f.y, 1.0f - abs(f.x) - abs(f.y));
+	float t = clamp(-n.z, 0.0f, 1.0f);
+	n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0f)));
+	return normalize(n);
+}
+
+void main() 
+{	
+	gl_Position = iRenderMatrix * vec4(vPosition, 1.0f);
+	outColor = vColor.rgb;
+	outNormal = oct_decode(vNormalOct);
+}
@@ -0,0 +1,451 @@
+/// tm42_math_bench.c
+///
+/// Throughput benchmarks for tm42_math.h and tm42_turntable_camera.h.
+///
+/// Each benchmark runs a primitive over a large array of randomized inputs several times and
+/// reports the best ns/op. The results can be recorded as a JSON baseline, and later runs compared
+/// against it: the program exits with a non-zero status if any benchmark got slower than the
+/// baseline by more than the threshold, or if the baseline was recorded with another SIMD path or
+/// `--count`, which it then doesn't compare against.
+///
+/// # Usage
+///
+/// To compile with xmake:
+/// ```
+/// > xmake -b tm42_math_bench
+/// ```
+///
+/// To record a baseline, and then compare against it after making changes:
+/// ```
+/// > xmake run tm42_math_bench --record
+/// > xmake run tm42_math_bench
+/// ```
+///
+/// Options:
+/// - `--record`: write the results to the baseline file instead of comparing against it
+/// - `--baseline <path>`: baseline file (default: `tm42_math_bench_baseline.json`)
+/// - `--threshold <percent>`: allowed slowdown before failing (default: 10)
+/// - `--count <n>`: number of inputs per benchmark (default: 1048576)
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TM42_MATH_IMPLEMENTATION
+#include "tm42_math.h"
+#undef TM42_MATH_IMPLEMENTATION
+
+#define TM42_CAMERA_IMPLEMENTATION
+#include "tm42_turntable_camera.h"
+
+#define NUM_RUNS 5
+#define MAX_BENCHMARKS 16
+
+// Written to after every benchmark so that the compiler cannot discard the work being measured.
+volatile float bench_sink;
+
+double now_ns() {
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+float random_float( float min, float max ) {
+    return min + ( max - min ) * ( (float)rand() / (float)RAND_MAX );
+}
+
+void fill_random( float* values, size_t count, float min, float max ) {
+    for ( size_t i = 0; i < count; ++i ) {
+        values[i] = random_float( min, max );
+    }
+}
+
+void fill_random_unit_vec3s( float* values, size_t count ) {
+    fill_random( values, count * 3, -1.f, 1.f );
+    for ( size_t i = 0; i < count; ++i ) {
+        tm42_vec3_normalize( values + i * 3 );
+    }
+}
+
+void fill_random_unit_quaternions( float* values, size_t count ) {
+    fill_random( values, count * 4, -1.f, 1.f );
+    for ( size_t i = 0; i < count; ++i ) {
+        tm42_quaternion_normalize( values + i * 4 );
+    }
+}
+
+// --- Inputs
+
+struct BenchInputs {
+    size_t count;
+    float* quaternions;
+    float* vec3s;
+    float* other_vec3s;
+    float* mat4s;
+    float* xs;
+    float* ys;
+    float* zs;
+    float* out;
+};
+
+struct BenchInputs create_bench_inputs( size_t count ) {
+    struct BenchInputs inputs = {
+        .count = count,
+        .quaternions = malloc( count * 4 * sizeof( float ) ),
+        .vec3s = malloc( count * 3 * sizeof( float ) ),
+        .other_vec3s = malloc( count * 3 * sizeof( float ) ),
+        .mat4s = malloc( count * 16 * sizeof( float ) ),
+        .xs = malloc( count * sizeof( float ) ),
+        .ys = malloc( count * sizeof( float ) ),
+        .zs = malloc( count * sizeof( float ) ),
+        .out = malloc( count * 16 * sizeof( float ) ),
+    };
+    if ( !inputs.quaternions || !inputs.vec3s || !inputs.other_vec3s || !inputs.mat4s ||
+         !inputs.xs || !inputs.ys || !inputs.zs || !inputs.out ) {
+        fprintf( stderr, "failed to allocate benchmark inputs\n" );
+        exit( 2 );
+    }
+
+    fill_random_unit_quaternions( inputs.quaternions, count );
+    fill_random_unit_vec3s( inputs.vec3s, count );
+    fill_random_unit_vec3s( inputs.other_vec3s, count );
+    fill_random( inputs.mat4s, count * 16, -2.f, 2.f );
+    fill_random( inputs.xs, count, -10.f, 10.f );
+    fill_random( inputs.ys, count, -10.f, 10.f );
+    fill_random( inputs.zs, count, -10.f, 10.f );
+
+    return inputs;
+}
+
+void destroy_bench_inputs( struct BenchInputs* inputs ) {
+    free( inputs->quaternions );
+    free( inputs->vec3s );
+    free( inputs->other_vec3s );
+    free( inputs->mat4s );
+    free( inputs->xs );
+    free( inputs->ys );
+    free( inputs->zs );
+    free( inputs->out );
+}
+
+/// A transform whose bottom row keeps the homogeneous divide well away from zero.
+struct Tm42Mat4 bench_transform() {
+    struct Tm42Mat4 m = tm42_mat4_create_projection( tm42_deg_to_rad( 60.f ), 1.33f, 0.1f, 100.f );
+    m.m[3][3] = 1.f;
+    return m;
+}
+
+// --- Benchmarks
+//
+// Each benchmark processes every input once and returns the number of operations performed.
+
+size_t bench_quaternion_rotate_vec3( struct BenchInputs* in ) {
+    float acc = 0.f;
+    for ( size_t i = 0; i < in->count; ++i ) {
+        const struct Tm42Vec3 r =
+            tm42_quaternion_rotate_vec3( in->quaternions + i * 4, in->vec3s + i * 3 );
+        acc += r.x + r.y + r.z;
+    }
+    bench_sink = acc;
+    return in->count;
+}
+
+size_t bench_quaternion_rotation_between_vec3s( struct BenchInputs* in ) {
+    float acc = 0.f;
+    for ( size_t i = 0; i < in->count; ++i ) {
+        const struct Tm42Quaternion q =
+            tm42_quaternion_rotation_between_vec3s( in->vec3s + i * 3, in->other_vec3s + i * 3 );
+        acc += q.s + q.x + q.y + q.z;
+    }
+    bench_sink = acc;
+    return in->count;
+}
+
+size_t bench_mat4_mul_mat4( struct BenchInputs* in ) {
+    const struct Tm42Mat4 m = bench_transform();
+    for ( size_t i = 0; i < in->count; ++i ) {
+        const struct Tm42Mat4 r = tm42_mat4_mul_mat4( m.a, in->mat4s + i * 16 );
+        memcpy( in->out + i * 16, r.a, sizeof( r.a ) );
+    }
+    bench_sink = in->out[in->count * 16 - 1];
+    return in->count;
+}
+
+size_t bench_mat4_mul_mat4_batch( struct BenchInputs* in ) {
+    const struct Tm42Mat4 m = bench_transform();
+    tm42_mat4_mul_mat4_batch( m.a, in->mat4s, in->out, in->count );
+    bench_sink = in->out[in->count * 16 - 1];
+    return in->count;
+}
+
+size_t bench_mat4_transform_vec3( struct BenchInputs* in ) {
+    const struct Tm42Mat4 m = bench_transform();
+    for ( size_t i = 0; i < in->count; ++i ) {
+        const struct Tm42Vec3 r = tm42_mat4_transform_vec3( m.a, in->vec3s + i * 3 );
+        memcpy( in->out + i * 3, &r, sizeof( r ) );
+    }
+    bench_sink = in->out[in->count * 3 - 1];
+    return in->count;
+}
+
+size_t bench_mat4_transform_vec3_array( struct BenchInputs* in ) {
+    const struct Tm42Mat4 m = bench_transform();
+    tm42_mat4_transform_vec3_array( m.a, in->vec3s, in->out, in->count );
+    bench_sink = in->out[in->count * 3 - 1];
+    return in->count;
+}
+
+size_t bench_mat4_transform_vec3_array_soa( struct BenchInputs* in ) {
+    const struct Tm42Mat4 m = bench_transform();
+    float* out_xs = in->out;
+    float* out_ys = in->out + in->count;
+    float* out_zs = in->out + in->count * 2;
+    tm42_mat4_transform_vec3_array_soa( m.a, in->xs, in->ys, in->zs, out_xs, out_ys, out_zs,
+                                        in->count );
+    bench_sink = out_zs[in->count - 1];
+    return in->count;
+}
+
+size_t bench_create_turntable_camera( struct BenchInputs* in ) {
+    // Creating a camera allocates, so use fewer iterations to keep the run time reasonable.
+    const size_t count = in->count / 16;
+    float acc = 0.f;
+    for ( size_t i = 0; i < count; ++i ) {
+        struct Tm42CameraCreateInfo create_info = {
+            .look_at = in->vec3s + i * 3,
+            .look_from = in->other_vec3s + i * 3,
+            .vertical_fov = 60.f,
+            .aspect_ratio = 1.33f,
+            .z_near = 0.1f,
+            .z_far = 100.f,
+        };
+        struct Tm42TurntableCamera* camera = tm42_create_turntable_camera( create_info );
+        acc += tm42_turntable_camera_get_view_matrix( camera )[0];
+        tm42_destroy_turntable_camera( camera );
+    }
+    bench_sink = acc;
+    return count;
+}
+
+typedef size_t BenchFn( struct BenchInputs* in );
+
+struct Benchmark {
+    const char* name;
+    BenchFn* fn;
+};
+
+const struct Benchmark benchmarks[] = {
+    { "tm42_quaternion_rotate_vec3", bench_quaternion_rotate_vec3 },
+    { "tm42_quaternion_rotation_between_vec3s", bench_quaternion_rotation_between_vec3s },
+    { "tm42_mat4_mul_mat4", bench_mat4_mul_mat4 },
+    { "tm42_mat4_mul_mat4_batch", bench_mat4_mul_mat4_batch },
+    { "tm42_mat4_transform_vec3", bench_mat4_transform_vec3 },
+    { "tm42_mat4_transform_vec3_array", bench_mat4_transform_vec3_array },
+    { "tm42_mat4_transform_vec3_array_soa", bench_mat4_transform_vec3_array_soa },
+    { "tm42_create_turntable_camera", bench_create_turntable_camera },
+};
+const int num_benchmarks = sizeof( benchmarks ) / sizeof( benchmarks[0] );
+
+/// Returns the best ns/op over `NUM_RUNS` runs, after one warm-up run.
+double run_benchmark( const struct Benchmark* benchmark, struct BenchInputs* inputs ) {
+    benchmark->fn( inputs );
+
+    double best_ns_per_op = -1.0;
+    for ( int run = 0; run < NUM_RUNS; ++run ) {
+        const double start = now_ns();
+        const size_t num_ops = benchmark->fn( inputs );
+        const double ns_per_op = ( now_ns() - start ) / (double)num_ops;
+
+        if ( best_ns_per_op < 0.0 || ns_per_op < best_ns_per_op ) {
+            best_ns_per_op = ns_per_op;
+        }
+    }
+    return best_ns_per_op;
+}
+
+// --- Baseline
+//
+// The baseline is a small JSON document:
+// ```
+// {
+//   "simd": "avx2",
+//   "count": 1048576,
+//   "benchmarks": [
+//     { "name": "tm42_mat4_mul_mat4", "ns_per_op": 3.250 },
+//     ...
+//   ]
+// }
+// ```
+// It is only ever written by this program, so reading it back just scans for the entries rather
+// than implementing a general JSON parser.
+
+bool write_baseline( const char* path, size_t count, const double* results ) {
+    FILE* f = fopen( path, "w" );
+    if ( f == NULL ) {
+        return false;
+    }
+
+    fprintf( f, "{\n" );
+    fprintf( f, "  \"simd\": \"%s\",\n", TM42_MATH_SIMD_NAME );
+    fprintf( f, "  \"count\": %zu,\n", count );
+    fprintf( f, "  \"benchmarks\": [\n" );
+    for ( int i = 0; i < num_benchmarks; ++i ) {
+        fprintf( f, "    { \"name\": \"%s\", \"ns_per_op\": %.4f }%s\n", benchmarks[i].name,
+                 results[i], ( i + 1 < num_benchmarks ) ? "," : "" );
+    }
+    fprintf( f, "  ]\n" );
+    fprintf( f, "}\n" );
+
+    fclose( f );
+    return true;
+}
+
+struct Baseline {
+    // Empty and 0 if missing from the file.
+    char simd[64];
+    size_t count;
+    // The recorded ns/op for each benchmark, or a negative value for benchmarks missing from the
+    // file.
+    double ns_per_op[MAX_BENCHMARKS];
+};
+
+/// Fills `baseline` from the file at `path`. Returns false if the file could not be read.
+bool read_baseline( const char* path, struct Baseline* baseline ) {
+    FILE* f = fopen( path, "r" );
+    if ( f == NULL ) {
+        return false;
+    }
+
+    baseline->simd[0] = '\0';
+    baseline->count = 0;
+    for ( int i = 0; i < num_benchmarks; ++i ) {
+        baseline->ns_per_op[i] = -1.0;
+    }
+
+    char line[512];
+    while ( fgets( line, sizeof( line ), f ) != NULL ) {
+        const char* simd = strstr( line, "\"simd\"" );
+        if ( simd != NULL ) {
+            sscanf( simd, "\"simd\": \"%63[^\"]\"", baseline->simd );
+            continue;
+        }
+        const char* count = strstr( line, "\"count\"" );
+        if ( count != NULL ) {
+            sscanf( count, "\"count\": %zu", &baseline->count );
+            continue;
+        }
+
+        char name[256];
+        double ns_per_op;
+        const char* entry = strstr( line, "\"name\"" );
+        if ( entry == NULL ||
+             sscanf( entry, "\"name\": \"%255[^\"]\", \"ns_per_op\": %lf", name, &ns_per_op ) !=
+                 2 ) {
+            continue;
+        }
+
+        for ( int i = 0; i < num_benchmarks; ++i ) {
+            if ( strcmp( name, benchmarks[i].name ) == 0 ) {
+                baseline->ns_per_op[i] = ns_per_op;
+            }
+        }
+    }
+
+    fclose( f );
+    return true;
+}
+
+// ---
+
+int main( int argc, char** argv ) {
+    bool record = false;
+    const char* baseline_path = "tm42_math_bench_baseline.json";
+    double threshold_percent = 10.0;
+    size_t count = 1 << 20;
+
+    for ( int i = 1; i < argc; ++i ) {
+        if ( strcmp( argv[i], "--record" ) == 0 ) {
+            record = true;
+        } else if ( strcmp( argv[i], "--baseline" ) == 0 && i + 1 < argc ) {
+            baseline_path = argv[++i];
+        } else if ( strcmp( argv[i], "--threshold" ) == 0 && i + 1 < argc ) {
+            threshold_percent = atof( argv[++i] );
+        } else if ( strcmp( argv[i], "--count" ) == 0 && i + 1 < argc ) {
+            count = (size_t)strtoull( argv[++i], NULL, 10 );
+        } else {
+            fprintf( stderr, "unknown argument '%s'\n", argv[i] );
+            return 2;
+        }
+    }
+    if ( count < 16 ) {
+        count = 16;
+    }
+
+    srand( 42 );
+    struct BenchInputs inputs = create_bench_inputs( count );
+
+    struct Baseline baseline;
+    bool have_baseline = !record && read_baseline( baseline_path, &baseline );
+    if ( !record && !have_baseline ) {
+        printf( "No baseline at '%s', run with --record to create one.\n", baseline_path );
+    }
+
+    // Timings from another SIMD path or input count aren't comparable: a baseline recorded with
+    // AVX2 would make a TM42_MATH_NO_SIMD build look like a regression.
+    bool is_baseline_mismatched = false;
+    if ( have_baseline &&
+         ( strcmp( baseline.simd, TM42_MATH_SIMD_NAME ) != 0 || baseline.count != count ) ) {
+        printf( "Baseline at '%s' was recorded with %s and %zu inputs, but this run uses %s and "
+                "%zu inputs: not comparing. Run with --record to replace it.\n",
+                baseline_path, baseline.simd[0] != '\0' ? baseline.simd : "unknown SIMD",
+                baseline.count, TM42_MATH_SIMD_NAME, count );
+        have_baseline = false;
+        is_baseline_mismatched = true;
+    }
+
+    printf( "tm42_math_bench (%s, %zu inputs, best of %d runs)\n\n", TM42_MATH_SIMD_NAME, count,
+            NUM_RUNS );
+    printf( "%-40s %10s %12s %10s\n", "benchmark", "ns/op", "Mops/s", "vs base" );
+
+    double results[MAX_BENCHMARKS];
+    int num_regressions = 0;
+
+    for ( int i = 0; i < num_benchmarks; ++i ) {
+        results[i] = run_benchmark( &benchmarks[i], &inputs );
+        printf( "%-40s %10.3f %12.2f", benchmarks[i].name, results[i], 1e3 / results[i] );
+
+        if ( have_baseline && baseline.ns_per_op[i] > 0.0 ) {
+            const double change_percent = ( results[i] / baseline.ns_per_op[i] - 1.0 ) * 100.0;
+            const bool regressed = change_percent > threshold_percent;
+            printf( " %+9.1f%%%s", change_percent, regressed ? "  REGRESSION" : "" );
+            if ( regressed ) {
+                num_regressions += 1;
+            }
+        }
+        printf( "\n" );
+    }
+
+    destroy_bench_inputs( &inputs );
+
+    if ( record ) {
+        if ( !write_baseline( baseline_path, count, results ) ) {
+            fprintf( stderr, "failed to write baseline '%s'\n", baseline_path );
+            return 2;
+        }
+        printf( "\nRecorded baseline to '%s'.\n", baseline_path );
+        return 0;
+    }
+
+    if ( is_baseline_mismatched ) {
+        return 2;
+    }
+    if ( num_regressions > 0 ) {
+        printf( "\nFAILED: %d benchmark(s) regressed by more than %.1f%%\n", num_regressions,
+                threshold_percent );
+        return 1;
+    }
+
+    return 0;
+}
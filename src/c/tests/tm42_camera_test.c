@@ -129,10 +129,113 @@ void test_create_viewinfo() {
     }
 }
 
+/// Checks that the camera's view matrix maps `look_at` onto the forward ray at `distance`.
+bool look_at_is_forward( struct Tm42TurntableCamera* camera, float* look_at, float distance ) {
+    const float* view_matrix = tm42_turntable_camera_get_view_matrix( camera );
+    const struct Tm42Vec3 transformed = tm42_mat4_transform_vec3( view_matrix, look_at );
+    return fabs( transformed.x ) < 0.0001 && fabs( transformed.y ) < 0.0001 &&
+           fabs( transformed.z + distance ) < 0.0001;
+}
+
+void test_turntable_camera_controls() {
+    int num_tests = 0;
+    int num_failures = 0;
+
+    struct Tm42Point3 look_at = { .x = 0.f, .y = 0.f, .z = 0.f };
+    struct Tm42Point3 look_from = { .x = 0.f, .y = 0.f, .z = -5.f };
+    const struct Tm42CameraCreateInfo create_info = {
+        .look_at = (float*)&look_at,
+        .look_from = (float*)&look_from,
+        .vertical_fov = 60.f,
+        .aspect_ratio = 1.f,
+        .z_near = 0.1f,
+        .z_far = 100.f,
+    };
+    struct Tm42TurntableCamera* camera = tm42_create_turntable_camera( create_info );
+
+    const float* view_matrix = tm42_turntable_camera_get_view_matrix( camera );
+    const float* view_proj_matrix = tm42_turntable_camera_get_view_proj_matrix( camera );
+
+    // Orbiting keeps the camera pointed at `look_at`, at the same distance.
+    num_tests += 1;
+    tm42_turntable_camera_orbit( camera, 0.3f, 0.2f );
+    tm42_turntable_camera_orbit( camera, 0.4f, -0.1f );
+    if ( !look_at_is_forward( camera, (float*)&look_at, 5.f ) ) {
+        num_failures += 1;
+        printf( "ERROR\n  look_at not in front of the camera after orbit\n" );
+    }
+
+    // Ending an orbit doesn't move the camera.
+    num_tests += 1;
+    {
+        const struct Tm42Mat4 before = *(struct Tm42Mat4*)view_matrix;
+        tm42_turntable_camera_end_orbit( camera );
+        tm42_turntable_camera_get_view_matrix( camera );
+        for ( int i = 0; i < 16; ++i ) {
+            if ( !float_eq( before.a[i], view_matrix[i] ) ) {
+                num_failures += 1;
+                printf( "ERROR\n  view matrix changed after ending the orbit\n" );
+                break;
+            }
+        }
+    }
+
+    // Zooming changes the distance to `look_at`.
+    num_tests += 1;
+    tm42_turntable_camera_zoom( camera, 2.f );
+    if ( !look_at_is_forward( camera, (float*)&look_at, 3.f ) ) {
+        num_failures += 1;
+        printf( "ERROR\n  look_at not at the expected distance after zoom\n" );
+    }
+
+    // Panning moves `look_at` along with the camera.
+    num_tests += 1;
+    {
+        const struct Tm42Vec3 before = tm42_mat4_transform_vec3( view_matrix, (float*)&look_at );
+        tm42_turntable_camera_pan( camera, 1.f, 0.f );
+        tm42_turntable_camera_get_view_matrix( camera );
+        const struct Tm42Vec3 after = tm42_mat4_transform_vec3( view_matrix, (float*)&look_at );
+        if ( !( float_eq( after.x, before.x - 1.f ) && float_eq( after.y, before.y ) &&
+                float_eq( after.z, before.z ) ) ) {
+            num_failures += 1;
+            printf( "ERROR\n  panning right did not move the scene left\n" );
+        }
+    }
+
+    // The matrices are rebuilt in place, and the view-projection matrix is kept in sync.
+    num_tests += 1;
+    {
+        tm42_turntable_camera_resize( camera, 1600.f, 900.f );
+        const float* projection_matrix = tm42_turntable_camera_get_projection_matrix( camera );
+        const struct Tm42Mat4 expected = tm42_mat4_mul_mat4( projection_matrix, view_matrix );
+        if ( tm42_turntable_camera_get_view_proj_matrix( camera ) != view_proj_matrix ) {
+            num_failures += 1;
+            printf( "ERROR\n  view-projection matrix moved\n" );
+        }
+        for ( int i = 0; i < 16; ++i ) {
+            if ( !float_eq( expected.a[i], view_proj_matrix[i] ) ) {
+                num_failures += 1;
+                printf( "ERROR\n  view-projection matrix out of date\n" );
+                break;
+            }
+        }
+    }
+
+    tm42_destroy_turntable_camera( camera );
+
+    printf( "%s: ", __func__ );
+    if ( num_failures == 0 ) {
+        printf( "PASSED\n" );
+    } else {
+        printf( "FAILED (%d/%d ok)\n", num_tests - num_failures, num_tests );
+    }
+}
+
 int main( int argc, char** argv ) {
     printf( "Hello, world!\n" );
 
     test_create_viewinfo();
+    test_turntable_camera_controls();
 
     return 0;
 }
@@ -0,0 +1,242 @@
+/// tm42_frustum_test.c
+///
+/// Tests for tm42_frustum.h.
+///
+/// # Usage
+///
+/// To compile with xmake:
+/// ```
+/// > xmake -b tm42_frustum_test
+/// ```
+///
+/// To run with xmake:
+/// ```
+/// > xmake run tm42_frustum_test
+/// ```
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TM42_MATH_IMPLEMENTATION
+#include "tm42_math.h"
+#undef TM42_MATH_IMPLEMENTATION
+
+#define TM42_FRUSTUM_IMPLEMENTATION
+#include "tm42_frustum.h"
+
+float random_float( float min, float max ) {
+    return min + ( max - min ) * ( (float)rand() / (float)RAND_MAX );
+}
+
+void fill_random( float* values, size_t count, float min, float max ) {
+    for ( size_t i = 0; i < count; ++i ) {
+        values[i] = random_float( min, max );
+    }
+}
+
+/// A camera at the origin looking down -z, with a 90 degree vertical field of view, a square
+/// aspect ratio and clipping planes at 1 and 100. The side planes are then the planes x = +-z and
+/// y = +-z.
+struct Tm42Frustum create_test_frustum() {
+    const struct Tm42Mat4 proj =
+        tm42_mat4_create_projection( (float)( M_PI / 2.0 ), 1.f, 1.f, 100.f );
+    return tm42_frustum_from_view_proj( proj.a );
+}
+
+// ---
+
+struct SphereTestCase {
+    struct Tm42Vec3 center;
+    float radius;
+    int expected;
+};
+
+void test_frustum_sphere() {
+    printf( "Running '%s' ... ", __func__ );
+
+    const struct Tm42Frustum frustum = create_test_frustum();
+
+    const struct SphereTestCase cases[] = {
+        // Straight ahead.
+        { .center = { .x = 0.f, .y = 0.f, .z = -10.f }, .radius = 1.f, .expected = 1 },
+        // Behind the camera.
+        { .center = { .x = 0.f, .y = 0.f, .z = 10.f }, .radius = 1.f, .expected = 0 },
+        // Between the camera and the near plane, but overlapping it.
+        { .center = { .x = 0.f, .y = 0.f, .z = -0.5f }, .radius = 1.f, .expected = 1 },
+        // Past the far plane.
+        { .center = { .x = 0.f, .y = 0.f, .z = -102.f }, .radius = 1.f, .expected = 0 },
+        // Past the far plane, but overlapping it.
+        { .center = { .x = 0.f, .y = 0.f, .z = -100.5f }, .radius = 1.f, .expected = 1 },
+        // Left of the left plane (x = z at z = -10), more than a radius away.
+        { .center = { .x = -12.f, .y = 0.f, .z = -10.f }, .radius = 1.f, .expected = 0 },
+        // Left of the left plane, but within a radius (distance is 1/sqrt(2)).
+        { .center = { .x = -11.f, .y = 0.f, .z = -10.f }, .radius = 1.f, .expected = 1 },
+        // Above the top plane.
+        { .center = { .x = 0.f, .y = 12.f, .z = -10.f }, .radius = 1.f, .expected = 0 },
+        // Below the bottom plane.
+        { .center = { .x = 0.f, .y = -12.f, .z = -10.f }, .radius = 1.f, .expected = 0 },
+        // Right of the right plane.
+        { .center = { .x = 12.f, .y = 0.f, .z = -10.f }, .radius = 1.f, .expected = 0 },
+    };
+
+    int num_failures = 0;
+    for ( size_t i = 0; i < sizeof( cases ) / sizeof( cases[0] ); ++i ) {
+        const int actual =
+            tm42_frustum_test_sphere( &frustum, (float*)&cases[i].center, cases[i].radius );
+        if ( actual != cases[i].expected ) {
+            num_failures += 1;
+            printf( "\n  failure at case %zu: got %d, expected %d", i, actual, cases[i].expected );
+        }
+    }
+
+    if ( num_failures == 0 ) {
+        printf( "pass\n" );
+    } else {
+        printf( "\n%s FAILED (%d mismatches)\n", __func__, num_failures );
+    }
+}
+
+void test_frustum_aabb() {
+    printf( "Running '%s' ... ", __func__ );
+
+    const struct Tm42Frustum frustum = create_test_frustum();
+    int num_failures = 0;
+
+    // A box just outside the left plane that a bounding sphere of the same box would overlap.
+    {
+        const struct Tm42Vec3 center = { .x = -12.f, .y = 0.f, .z = -10.f };
+        const struct Tm42Vec3 extents = { .x = 1.f, .y = 1.f, .z = 0.5f };
+        if ( tm42_frustum_test_aabb( &frustum, (float*)&center, (float*)&extents ) != 0 ) {
+            num_failures += 1;
+            printf( "\n  box outside of the left plane reported visible" );
+        }
+    }
+
+    // A large box containing the whole frustum.
+    {
+        const struct Tm42Vec3 center = { .x = 0.f, .y = 0.f, .z = 0.f };
+        const struct Tm42Vec3 extents = { .x = 1000.f, .y = 1000.f, .z = 1000.f };
+        if ( tm42_frustum_test_aabb( &frustum, (float*)&center, (float*)&extents ) != 1 ) {
+            num_failures += 1;
+            printf( "\n  box containing the frustum reported not visible" );
+        }
+    }
+
+    // A box straddling the top plane.
+    {
+        const struct Tm42Vec3 center = { .x = 0.f, .y = 10.5f, .z = -10.f };
+        const struct Tm42Vec3 extents = { .x = 1.f, .y = 1.f, .z = 1.f };
+        if ( tm42_frustum_test_aabb( &frustum, (float*)&center, (float*)&extents ) != 1 ) {
+            num_failures += 1;
+            printf( "\n  box straddling the top plane reported not visible" );
+        }
+    }
+
+    if ( num_failures == 0 ) {
+        printf( "pass\n" );
+    } else {
+        printf( "\n%s FAILED (%d mismatches)\n", __func__, num_failures );
+    }
+}
+
+// --- Batch culling
+//
+// The batch functions are checked against the single-object tests. The count is chosen so that
+// the SIMD main loops and the scalar tails both get exercised.
+
+void test_frustum_cull_spheres_soa() {
+    printf( "Running '%s' (%s) ... ", __func__, TM42_MATH_SIMD_NAME );
+
+    enum { count = 1001 };
+    int num_failures = 0;
+
+    const struct Tm42Frustum frustum = create_test_frustum();
+    static float xs[count], ys[count], zs[count], radii[count];
+    static unsigned char visible[count];
+    fill_random( xs, count, -60.f, 60.f );
+    fill_random( ys, count, -60.f, 60.f );
+    fill_random( zs, count, -120.f, 20.f );
+    fill_random( radii, count, 0.f, 5.f );
+
+    const size_t num_visible =
+        tm42_frustum_cull_spheres_soa( &frustum, xs, ys, zs, radii, visible, count );
+
+    size_t expected_num_visible = 0;
+    for ( size_t i = 0; i < count; ++i ) {
+        const float center[3] = { xs[i], ys[i], zs[i] };
+        const int expected = tm42_frustum_test_sphere( &frustum, center, radii[i] );
+        expected_num_visible += expected;
+        if ( visible[i] != expected ) {
+            num_failures += 1;
+            printf( "\n  failure at sphere %zu: got %d, expected %d", i, visible[i], expected );
+        }
+    }
+
+    if ( num_visible != expected_num_visible ) {
+        num_failures += 1;
+        printf( "\n  got %zu visible, expected %zu", num_visible, expected_num_visible );
+    }
+
+    if ( num_failures == 0 ) {
+        printf( "pass\n" );
+    } else {
+        printf( "\n%s FAILED (%d mismatches)\n", __func__, num_failures );
+    }
+}
+
+void test_frustum_cull_aabbs_soa() {
+    printf( "Running '%s' (%s) ... ", __func__, TM42_MATH_SIMD_NAME );
+
+    enum { count = 1001 };
+    int num_failures = 0;
+
+    const struct Tm42Frustum frustum = create_test_frustum();
+    static float xs[count], ys[count], zs[count];
+    static float exs[count], eys[count], ezs[count];
+    static unsigned char visible[count];
+    fill_random( xs, count, -60.f, 60.f );
+    fill_random( ys, count, -60.f, 60.f );
+    fill_random( zs, count, -120.f, 20.f );
+    fill_random( exs, count, 0.f, 5.f );
+    fill_random( eys, count, 0.f, 5.f );
+    fill_random( ezs, count, 0.f, 5.f );
+
+    const size_t num_visible =
+        tm42_frustum_cull_aabbs_soa( &frustum, xs, ys, zs, exs, eys, ezs, visible, count );
+
+    size_t expected_num_visible = 0;
+    for ( size_t i = 0; i < count; ++i ) {
+        const float center[3] = { xs[i], ys[i], zs[i] };
+        const float extents[3] = { exs[i], eys[i], ezs[i] };
+        const int expected = tm42_frustum_test_aabb( &frustum, center, extents );
+        expected_num_visible += expected;
+        if ( visible[i] != expected ) {
+            num_failures += 1;
+            printf( "\n  failure at box %zu: got %d, expected %d", i, visible[i], expected );
+        }
+    }
+
+    if ( num_visible != expected_num_visible ) {
+        num_failures += 1;
+        printf( "\n  got %zu visible, expected %zu", num_visible, expected_num_visible );
+    }
+
+    if ( num_failures == 0 ) {
+        printf( "pass\n" );
+    } else {
+        printf( "\n%s FAILED (%d mismatches)\n", __func__, num_failures );
+    }
+}
+
+// ---
+
+int main( int argc, char** argv ) {
+    test_frustum_sphere();
+    test_frustum_aabb();
+    test_frustum_cull_spheres_soa();
+    test_frustum_cull_aabbs_soa();
+
+    return 0;
+}
@@ -17,6 +17,7 @@
 #include <assert.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #define TM42_MATH_DEBUG_PRINT
 #define TM42_MATH_IMPLEMENTATION
@@ -402,12 +403,159 @@ void test_projection_matrix() {
     }
 }
 
+// --- Batch kernels
+//
+// The batch kernels are checked against the single-value functions they replace. The counts are
+// chosen so that the SIMD main loops and the scalar tails both get exercised.
+
+float random_float( float min, float max ) {
+    return min + ( max - min ) * ( (float)rand() / (float)RAND_MAX );
+}
+
+void fill_random( float* values, size_t count, float min, float max ) {
+    for ( size_t i = 0; i < count; ++i ) {
+        values[i] = random_float( min, max );
+    }
+}
+
+/// A random matrix whose bottom row is close to (0, 0, 0, 1), so that the homogeneous divide in
+/// `tm42_mat4_transform_vec3` stays well-conditioned for points in [-10, 10]^3.
+struct Tm42Mat4 random_transform_mat4() {
+    struct Tm42Mat4 m;
+    fill_random( m.a, 16, -2.f, 2.f );
+    m.m[0][3] = random_float( -0.01f, 0.01f );
+    m.m[1][3] = random_float( -0.01f, 0.01f );
+    m.m[2][3] = random_float( -0.01f, 0.01f );
+    m.m[3][3] = random_float( 1.f, 2.f );
+    return m;
+}
+
+void test_mat4_mul_mat4_batch() {
+    printf( "Running '%s' (%s) ... ", __func__, TM42_MATH_SIMD_NAME );
+
+    enum { count = 37 };
+    int num_failures = 0;
+
+    struct Tm42Mat4 lhs = random_transform_mat4();
+    static struct Tm42Mat4 rhs[count];
+    static struct Tm42Mat4 batched[count];
+    fill_random( (float*)rhs, count * 16, -2.f, 2.f );
+
+    tm42_mat4_mul_mat4_batch( lhs.a, (float*)rhs, (float*)batched, count );
+
+    for ( size_t i = 0; i < count; ++i ) {
+        const struct Tm42Mat4 expected = tm42_mat4_mul_mat4( lhs.a, rhs[i].a );
+        for ( int j = 0; j < 16; ++j ) {
+            if ( !areFloatsEqual( batched[i].a[j], expected.a[j] ) ) {
+                num_failures += 1;
+                printf( "\n  failure at matrix %zu, element %d: got %f, expected %f", i, j,
+                        batched[i].a[j], expected.a[j] );
+            }
+        }
+    }
+
+    // In place.
+    tm42_mat4_mul_mat4_batch( lhs.a, (float*)rhs, (float*)rhs, count );
+    for ( size_t i = 0; i < count; ++i ) {
+        for ( int j = 0; j < 16; ++j ) {
+            if ( !areFloatsEqual( rhs[i].a[j], batched[i].a[j] ) ) {
+                num_failures += 1;
+                printf( "\n  in-place failure at matrix %zu, element %d", i, j );
+            }
+        }
+    }
+
+    if ( num_failures == 0 ) {
+        printf( "pass\n" );
+    } else {
+        printf( "\n%s FAILED (%d mismatches)\n", __func__, num_failures );
+    }
+}
+
+void test_mat4_transform_vec3_array() {
+    printf( "Running '%s' (%s) ... ", __func__, TM42_MATH_SIMD_NAME );
+
+    enum { count = 1001 };
+    int num_failures = 0;
+
+    const struct Tm42Mat4 m = random_transform_mat4();
+    static struct Tm42Vec3 points[count];
+    static struct Tm42Vec3 transformed[count];
+    fill_random( (float*)points, count * 3, -10.f, 10.f );
+
+    tm42_mat4_transform_vec3_array( m.a, (float*)points, (float*)transformed, count );
+
+    for ( size_t i = 0; i < count; ++i ) {
+        struct Tm42Vec3 expected = tm42_mat4_transform_vec3( m.a, (float*)&points[i] );
+        if ( !are_vec3s_equal( &transformed[i], &expected ) ) {
+            num_failures += 1;
+            printf( "\n  failure at point %zu:\n    got:      ", i );
+            tm42_vec3_fprint( stdout, (float*)&transformed[i] );
+            printf( "\n    expected: " );
+            tm42_vec3_fprint( stdout, (float*)&expected );
+        }
+    }
+
+    // In place.
+    tm42_mat4_transform_vec3_array( m.a, (float*)points, (float*)points, count );
+    for ( size_t i = 0; i < count; ++i ) {
+        if ( !are_vec3s_equal( &points[i], &transformed[i] ) ) {
+            num_failures += 1;
+            printf( "\n  in-place failure at point %zu", i );
+        }
+    }
+
+    if ( num_failures == 0 ) {
+        printf( "pass\n" );
+    } else {
+        printf( "\n%s FAILED (%d mismatches)\n", __func__, num_failures );
+    }
+}
+
+void test_mat4_transform_vec3_array_soa() {
+    printf( "Running '%s' (%s) ... ", __func__, TM42_MATH_SIMD_NAME );
+
+    enum { count = 1001 };
+    int num_failures = 0;
+
+    const struct Tm42Mat4 m = random_transform_mat4();
+    static float xs[count], ys[count], zs[count];
+    static float out_xs[count], out_ys[count], out_zs[count];
+    fill_random( xs, count, -10.f, 10.f );
+    fill_random( ys, count, -10.f, 10.f );
+    fill_random( zs, count, -10.f, 10.f );
+
+    tm42_mat4_transform_vec3_array_soa( m.a, xs, ys, zs, out_xs, out_ys, out_zs, count );
+
+    for ( size_t i = 0; i < count; ++i ) {
+        struct Tm42Vec3 point = { .x = xs[i], .y = ys[i], .z = zs[i] };
+        struct Tm42Vec3 expected = tm42_mat4_transform_vec3( m.a, (float*)&point );
+        struct Tm42Vec3 actual = { .x = out_xs[i], .y = out_ys[i], .z = out_zs[i] };
+        if ( !are_vec3s_equal( &actual, &expected ) ) {
+            num_failures += 1;
+            printf( "\n  failure at point %zu:\n    got:      ", i );
+            tm42_vec3_fprint( stdout, (float*)&actual );
+            printf( "\n    expected: " );
+            tm42_vec3_fprint( stdout, (float*)&expected );
+        }
+    }
+
+    if ( num_failures == 0 ) {
+        printf( "pass\n" );
+    } else {
+        printf( "\n%s FAILED (%d mismatches)\n", __func__, num_failures );
+    }
+}
+
 // ---
 
 int main( int argc, char** argv ) {
     test_cross_product();
     test_quaternion_rotation();
     test_projection_matrix();
+    test_mat4_mul_mat4_batch();
+    test_mat4_transform_vec3_array();
+    test_mat4_transform_vec3_array_soa();
     // foo();
 
     return 0;
@@ -0,0 +1,364 @@
+/// tm42_mesh_test.c
+///
+/// Tests for tm42_mesh.h.
+///
+/// # Usage
+///
+/// To compile with xmake:
+/// ```
+/// > xmake -b tm42_mesh_test
+/// ```
+///
+/// To run with xmake:
+/// ```
+/// > xmake run tm42_mesh_test
+/// ```
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TM42_MESH_IMPLEMENTATION
+#include "tm42_mesh.h"
+
+struct Vertex {
+    float position[3];
+    float uv[2];
+};
+
+/// A grid of `size` x `size` quads, as a non-indexed triangle list: each vertex is repeated for
+/// every triangle that uses it. The quads are in row order, which is what most exporters produce.
+static size_t make_unindexed_grid( struct Vertex* vertices, size_t size ) {
+    size_t count = 0;
+    for ( size_t y = 0; y < size; ++y ) {
+        for ( size_t x = 0; x < size; ++x ) {
+            const size_t corners[6][2] = {
+                { x, y }, { x + 1, y }, { x + 1, y + 1 }, { x, y }, { x + 1, y + 1 }, { x, y + 1 },
+            };
+            for ( size_t i = 0; i < 6; ++i ) {
+                vertices[count++] = ( struct Vertex ){
+                    .position = { (float)corners[i][0], (float)corners[i][1], 0.f },
+                    .uv = { (float)corners[i][0] / size, (float)corners[i][1] / size },
+                };
+            }
+        }
+    }
+    return count;
+}
+
+/// Returns whether both index buffers describe the same set of triangles over the same vertices,
+/// ignoring the order of the triangles (but not of the corners, whose winding must be kept up to
+/// rotation).
+static bool same_triangles( const struct Vertex* vertices_a, const uint32_t* indices_a,
+                            const struct Vertex* vertices_b, const uint32_t* indices_b,
+                            size_t index_count ) {
+    bool* is_matched = calloc( index_count / 3, sizeof( bool ) );
+    bool all_matched = true;
+
+    for ( size_t a = 0; a < index_count / 3 && all_matched; ++a ) {
+        bool found = false;
+        for ( size_t b = 0; b < index_count / 3 && !found; ++b ) {
+            if ( is_matched[b] ) {
+                continue;
+            }
+            for ( size_t rotation = 0; rotation < 3 && !found; ++rotation ) {
+                bool same = true;
+                for ( size_t corner = 0; corner < 3; ++corner ) {
+                    const struct Vertex* va = &vertices_a[indices_a[a * 3 + corner]];
+                    const struct Vertex* vb =
+                        &vertices_b[indices_b[b * 3 + ( corner + rotation ) % 3]];
+                    same = same && memcmp( va, vb, sizeof( struct Vertex ) ) == 0;
+                }
+                if ( same ) {
+                    is_matched[b] = true;
+                    found = true;
+                }
+            }
+        }
+        all_matched = found;
+    }
+
+    free( is_matched );
+    return all_matched;
+}
+
+void test_mesh_weld() {
+    printf( "Running '%s' ... ", __func__ );
+
+    enum { size = 8, vertex_count = size * size * 6 };
+    static struct Vertex vertices[vertex_count];
+    memset( vertices, 0, sizeof( vertices ) );
+    make_unindexed_grid( vertices, size );
+
+    uint32_t remap[vertex_count];
+    const size_t unique_count =
+        tm42_mesh_weld_vertices( vertices, vertex_count, sizeof( struct Vertex ), remap );
+    assert( unique_count == ( size + 1 ) * ( size + 1 ) );
+
+    // Unique vertices are numbered in order of first occurrence.
+    assert( remap[0] == 0 );
+    assert( remap[1] == 1 );
+    assert( remap[2] == 2 );
+    assert( remap[3] == 0 );
+    assert( remap[4] == 2 );
+
+    static struct Vertex welded[vertex_count];
+    tm42_mesh_remap_vertices( welded, vertices, vertex_count, sizeof( struct Vertex ), remap );
+    uint32_t indices[vertex_count];
+    tm42_mesh_remap_indices( indices, NULL, vertex_count, remap );
+
+    for ( size_t i = 0; i < vertex_count; ++i ) {
+        assert( indices[i] < unique_count );
+        assert( memcmp( &welded[indices[i]], &vertices[i], sizeof( struct Vertex ) ) == 0 );
+    }
+
+    // Vertices that only differ in one attribute are kept apart.
+    struct Vertex pair[2] = { { .position = { 1.f, 2.f, 3.f }, .uv = { 0.f, 0.f } },
+                              { .position = { 1.f, 2.f, 3.f }, .uv = { 0.f, 1.f } } };
+    uint32_t pair_remap[2];
+    assert( tm42_mesh_weld_vertices( pair, 2, sizeof( struct Vertex ), pair_remap ) == 2 );
+
+    printf( "pass\n" );
+}
+
+void test_mesh_optimize_vertex_cache() {
+    printf( "Running '%s' ... ", __func__ );
+
+    enum { size = 32, index_count = size * size * 6, cache_size = 16 };
+    static struct Vertex vertices[index_count];
+    memset( vertices, 0, sizeof( vertices ) );
+    make_unindexed_grid( vertices, size );
+
+    static uint32_t remap[index_count];
+    const size_t vertex_count =
+        tm42_mesh_weld_vertices( vertices, index_count, sizeof( struct Vertex ), remap );
+    static struct Vertex welded[index_count];
+    tm42_mesh_remap_vertices( welded, vertices, index_count, sizeof( struct Vertex ), remap );
+    static uint32_t indices[index_count];
+    tm42_mesh_remap_indices( indices, NULL, index_count, remap );
+
+    // The rows are longer than the cache, so every row reloads the vertices shared with the
+    // previous row.
+    const float acmr_before =
+        tm42_mesh_compute_acmr( indices, index_count, vertex_count, cache_size );
+    assert( acmr_before > 0.9f );
+
+    static uint32_t optimized[index_count];
+    tm42_mesh_optimize_vertex_cache( optimized, indices, index_count, vertex_count, cache_size );
+    const float acmr_after =
+        tm42_mesh_compute_acmr( optimized, index_count, vertex_count, cache_size );
+    assert( acmr_after < acmr_before * 0.85f );
+    assert( same_triangles( welded, indices, welded, optimized, index_count ) );
+
+    // In place gives the same result.
+    static uint32_t in_place[index_count];
+    memcpy( in_place, indices, sizeof( indices ) );
+    tm42_mesh_optimize_vertex_cache( in_place, in_place, index_count, vertex_count, cache_size );
+    assert( memcmp( in_place, optimized, sizeof( indices ) ) == 0 );
+
+    // An empty mesh is fine.
+    assert( tm42_mesh_compute_acmr( NULL, 0, 0, cache_size ) == 0.f );
+    tm42_mesh_optimize_vertex_cache( NULL, NULL, 0, 0, cache_size );
+
+    printf( "pass\n" );
+}
+
+void test_mesh_optimize_vertex_fetch() {
+    printf( "Running '%s' ... ", __func__ );
+
+    // Vertex 1 is not used, and the rest are used in reverse order.
+    const struct Vertex vertices[5] = {
+        { .position = { 0.f } }, { .position = { 1.f } }, { .position = { 2.f } },
+        { .position = { 3.f } }, { .position = { 4.f } },
+    };
+    uint32_t indices[6] = { 4, 3, 2, 4, 2, 0 };
+    const uint32_t original_indices[6] = { 4, 3, 2, 4, 2, 0 };
+
+    uint32_t remap[5];
+    const size_t used_count = tm42_mesh_optimize_vertex_fetch_remap( remap, indices, 6, 5 );
+    assert( used_count == 4 );
+    assert( remap[1] == TM42_MESH_UNUSED_VERTEX );
+
+    struct Vertex reordered[4];
+    tm42_mesh_remap_vertices( reordered, vertices, 5, sizeof( struct Vertex ), remap );
+    tm42_mesh_remap_indices( indices, indices, 6, remap );
+
+    const uint32_t expected_indices[6] = { 0, 1, 2, 0, 2, 3 };
+    assert( memcmp( indices, expected_indices, sizeof( indices ) ) == 0 );
+    for ( size_t i = 0; i < 6; ++i ) {
+        assert( reordered[indices[i]].position[0] == vertices[original_indices[i]].position[0] );
+    }
+
+    printf( "pass\n" );
+}
+
+void test_mesh_acmr() {
+    printf( "Running '%s' ... ", __func__ );
+
+    // No reuse at all.
+    const uint32_t separate[6] = { 0, 1, 2, 3, 4, 5 };
+    assert( tm42_mesh_compute_acmr( separate, 6, 6, 16 ) == 3.f );
+
+    // A quad: the second triangle only adds one vertex.
+    const uint32_t quad[6] = { 0, 1, 2, 0, 2, 3 };
+    assert( tm42_mesh_compute_acmr( quad, 6, 4, 16 ) == 2.f );
+
+    // With a cache of 3, vertex 3 evicts vertex 0, which then evicts vertex 1 when it is used
+    // again, and so on.
+    const uint32_t evicting[9] = { 0, 1, 2, 1, 2, 3, 0, 1, 3 };
+    assert( tm42_mesh_compute_acmr( evicting, 9, 4, 3 ) == 2.f );
+    assert( tm42_mesh_compute_acmr( evicting, 9, 4, 4 ) == 4.f / 3.f );
+
+    printf( "pass\n" );
+}
+
+/// A sphere of radius 1 with `rings` x `segments` quads, sharing vertices everywhere (including a
+/// single vertex at each pole), so that it is closed and has no seams.
+static size_t make_sphere( float* positions, uint32_t* indices, size_t rings, size_t segments ) {
+    const float pi = 3.14159265f;
+    // The poles, then the inner rings.
+    positions[0] = 0.f, positions[1] = 1.f, positions[2] = 0.f;
+    positions[3] = 0.f, positions[4] = -1.f, positions[5] = 0.f;
+    for ( size_t ring = 1; ring < rings; ++ring ) {
+        for ( size_t segment = 0; segment < segments; ++segment ) {
+            const float theta = pi * (float)ring / (float)rings;
+            const float phi = 2.f * pi * (float)segment / (float)segments;
+            float* p = &positions[( 2 + ( ring - 1 ) * segments + segment ) * 3];
+            p[0] = sinf( theta ) * cosf( phi );
+            p[1] = cosf( theta );
+            p[2] = sinf( theta ) * sinf( phi );
+        }
+    }
+
+    size_t count = 0;
+    for ( size_t ring = 0; ring < rings; ++ring ) {
+        for ( size_t segment = 0; segment < segments; ++segment ) {
+            const size_t next = ( segment + 1 ) % segments;
+            const uint32_t a = ring == 0 ? 0 : (uint32_t)( 2 + ( ring - 1 ) * segments + segment );
+            const uint32_t b = ring == 0 ? 0 : (uint32_t)( 2 + ( ring - 1 ) * segments + next );
+            const uint32_t c = ring == rings - 1 ? 1 : (uint32_t)( 2 + ring * segments + segment );
+            const uint32_t d = ring == rings - 1 ? 1 : (uint32_t)( 2 + ring * segments + next );
+            // Outward winding: counter-clockwise seen from outside.
+            if ( ring != 0 ) {
+                indices[count++] = a, indices[count++] = b, indices[count++] = d;
+            }
+            if ( ring != rings - 1 ) {
+                indices[count++] = a, indices[count++] = d, indices[count++] = c;
+            }
+        }
+    }
+    return count;
+}
+
+/// Returns the sum of the signed areas of the triangles, in the z = 0 plane.
+static float signed_area_xy( const float* positions, const uint32_t* indices, size_t index_count ) {
+    float area = 0.f;
+    for ( size_t i = 0; i < index_count; i += 3 ) {
+        const float* a = &positions[indices[i] * 3];
+        const float* b = &positions[indices[i + 1] * 3];
+        const float* c = &positions[indices[i + 2] * 3];
+        area += 0.5f * ( ( b[0] - a[0] ) * ( c[1] - a[1] ) - ( c[0] - a[0] ) * ( b[1] - a[1] ) );
+    }
+    return area;
+}
+
+void test_mesh_simplify() {
+    printf( "Running '%s' ... ", __func__ );
+
+    // A flat grid: the inside can be collapsed without any error, but the border has to stay, and
+    // no triangle may flip, so the area stays the same.
+    {
+        enum { size = 16, vertex_count = ( size + 1 ) * ( size + 1 ), index_count = size * size * 6 };
+        static float positions[vertex_count * 3];
+        static uint32_t indices[index_count];
+        size_t count = 0;
+        for ( size_t y = 0; y <= size; ++y ) {
+            for ( size_t x = 0; x <= size; ++x ) {
+                float* p = &positions[( y * ( size + 1 ) + x ) * 3];
+                p[0] = (float)x, p[1] = (float)y, p[2] = 0.f;
+            }
+        }
+        for ( size_t y = 0; y < size; ++y ) {
+            for ( size_t x = 0; x < size; ++x ) {
+                const uint32_t a = (uint32_t)( y * ( size + 1 ) + x );
+                const uint32_t b = a + 1, c = a + size + 2, d = a + size + 1;
+                indices[count++] = a, indices[count++] = b, indices[count++] = c;
+                indices[count++] = a, indices[count++] = c, indices[count++] = d;
+            }
+        }
+
+        static uint32_t simplified[index_count];
+        float error = -1.f;
+        const size_t simplified_count =
+            tm42_mesh_simplify( simplified, indices, index_count, positions, vertex_count,
+                                3 * sizeof( float ), 0, 1e-4f, &error );
+        assert( simplified_count < index_count / 4 );
+        assert( simplified_count % 3 == 0 );
+        assert( error < 1e-4f );
+        assert( fabsf( signed_area_xy( positions, simplified, simplified_count ) - size * size ) <
+                1e-2f );
+        // The border vertices are all still used.
+        for ( size_t x = 0; x <= size; ++x ) {
+            bool is_used = false;
+            for ( size_t i = 0; i < simplified_count; ++i ) {
+                is_used |= simplified[i] == x;
+            }
+            assert( is_used );
+        }
+    }
+
+    // A sphere, down to a quarter of its triangles.
+    {
+        enum { rings = 32, segments = 64 };
+        enum { vertex_count = 2 + ( rings - 1 ) * segments, index_count = segments * rings * 6 };
+        static float positions[vertex_count * 3];
+        static uint32_t indices[index_count];
+        const size_t count = make_sphere( positions, indices, rings, segments );
+
+        static uint32_t simplified[index_count];
+        float error = -1.f;
+        const size_t simplified_count =
+            tm42_mesh_simplify( simplified, indices, count, positions, vertex_count,
+                                3 * sizeof( float ), count / 4, 0.05f, &error );
+        assert( simplified_count <= count / 4 );
+        assert( error > 0.f && error <= 0.05f );
+        for ( size_t i = 0; i < simplified_count; i += 3 ) {
+            assert( simplified[i] != simplified[i + 1] && simplified[i + 1] != simplified[i + 2] &&
+                    simplified[i + 2] != simplified[i] );
+            // Every triangle still faces outwards.
+            const float* a = &positions[simplified[i] * 3];
+            const float* b = &positions[simplified[i + 1] * 3];
+            const float* c = &positions[simplified[i + 2] * 3];
+            const float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            const float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+            const float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2],
+                                 e1[0] * e2[1] - e1[1] * e2[0] };
+            assert( n[0] * ( a[0] + b[0] + c[0] ) + n[1] * ( a[1] + b[1] + c[1] ) +
+                        n[2] * ( a[2] + b[2] + c[2] ) >
+                    0.f );
+        }
+
+        // A tight error budget stops early.
+        const size_t tight_count =
+            tm42_mesh_simplify( simplified, indices, count, positions, vertex_count,
+                                3 * sizeof( float ), 0, 1e-5f, &error );
+        assert( tight_count > count / 2 );
+        assert( error <= 1e-5f );
+    }
+
+    printf( "pass\n" );
+}
+
+int main( int argc, char** argv ) {
+    test_mesh_weld();
+    test_mesh_optimize_vertex_cache();
+    test_mesh_optimize_vertex_fetch();
+    test_mesh_acmr();
+    test_mesh_simplify();
+
+    return 0;
+}
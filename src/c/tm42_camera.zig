@@ -1,7 +1,9 @@
+// The implementations are compiled from `tm42_impl.c`, see `link_r4_core` in `build.zig`.
 pub usingnamespace @cImport({
-    @cDefine("TM42_MATH_IMPLEMENTATION", "");
-    @cDefine("TM42_CAMERA_IMPLEMENTATION", "");
+    @cInclude("tm42_math.h");
     @cInclude("tm42_turntable_camera.h");
+    @cInclude("tm42_frustum.h");
+    @cInclude("tm42_mesh.h");
 });
 
 const std = @import("std");
@@ -0,0 +1,377 @@
+#ifndef TM42_FRUSTUM_H
+#define TM42_FRUSTUM_H
+
+#include "tm42_math.h"
+#include <stddef.h>
+
+/// A plane `a*x + b*y + c*z + d = 0`, with the normal `(a, b, c)` normalized and pointing towards
+/// the inside of the frustum. The signed distance of a point to the plane is `dot(normal, p) + d`.
+struct Tm42Plane {
+    float a;
+    float b;
+    float c;
+    float d;
+};
+
+enum Tm42FrustumPlane {
+    TM42_FRUSTUM_PLANE_LEFT = 0,
+    TM42_FRUSTUM_PLANE_RIGHT,
+    TM42_FRUSTUM_PLANE_BOTTOM,
+    TM42_FRUSTUM_PLANE_TOP,
+    TM42_FRUSTUM_PLANE_NEAR,
+    TM42_FRUSTUM_PLANE_FAR,
+    TM42_FRUSTUM_PLANE_COUNT,
+};
+
+struct Tm42Frustum {
+    struct Tm42Plane planes[TM42_FRUSTUM_PLANE_COUNT];
+};
+
+/// Extracts the six world-space planes from a (column-major) view-projection matrix, assuming
+/// depth is mapped to [0,1] as in `tm42_mat4_create_projection`. Planes that are degenerate (e.g.
+/// the far plane of an infinite projection) are replaced with planes that contain everything.
+struct Tm42Frustum tm42_frustum_from_view_proj( const float* view_proj );
+
+/// Returns whether the sphere intersects or is inside the frustum.
+int tm42_frustum_test_sphere( const struct Tm42Frustum* frustum, const float* center,
+                              float radius );
+/// Returns whether the axis-aligned box given by its center and half-extents intersects or is
+/// inside the frustum.
+int tm42_frustum_test_aabb( const struct Tm42Frustum* frustum, const float* center,
+                            const float* extents );
+
+/// Tests `count` spheres, given as separate coordinate arrays, against the frustum. Writes 1 to
+/// `out_visible[i]` if sphere `i` is (possibly) visible and 0 otherwise, and returns the number of
+/// visible spheres. Uses the same SIMD path as the tm42_math batch functions.
+size_t tm42_frustum_cull_spheres_soa( const struct Tm42Frustum* frustum, const float* xs,
+                                      const float* ys, const float* zs, const float* radii,
+                                      unsigned char* out_visible, size_t count );
+/// Like `tm42_frustum_cull_spheres_soa`, but for axis-aligned boxes given by their centers and
+/// half-extents.
+size_t tm42_frustum_cull_aabbs_soa( const struct Tm42Frustum* frustum, const float* center_xs,
+                                    const float* center_ys, const float* center_zs,
+                                    const float* extent_xs, const float* extent_ys,
+                                    const float* extent_zs, unsigned char* out_visible,
+                                    size_t count );
+
+#endif // TM42_FRUSTUM_H
+
+#ifdef TM42_FRUSTUM_IMPLEMENTATION
+
+#include <math.h>
+#include <stdint.h>
+
+#if defined( TM42_MATH_SIMD_AVX2 )
+#include <immintrin.h>
+#elif defined( TM42_MATH_SIMD_SSE )
+#include <xmmintrin.h>
+#elif defined( TM42_MATH_SIMD_NEON )
+#include <arm_neon.h>
+#endif
+
+struct Tm42Plane tm42_plane_add( struct Tm42Plane p1, struct Tm42Plane p2 ) {
+    return ( struct Tm42Plane ){
+        .a = p1.a + p2.a,
+        .b = p1.b + p2.b,
+        .c = p1.c + p2.c,
+        .d = p1.d + p2.d,
+    };
+}
+
+struct Tm42Plane tm42_plane_sub( struct Tm42Plane p1, struct Tm42Plane p2 ) {
+    return ( struct Tm42Plane ){
+        .a = p1.a - p2.a,
+        .b = p1.b - p2.b,
+        .c = p1.c - p2.c,
+        .d = p1.d - p2.d,
+    };
+}
+
+struct Tm42Plane tm42_plane_normalize( struct Tm42Plane plane ) {
+    const float length = sqrtf( plane.a * plane.a + plane.b * plane.b + plane.c * plane.c );
+    if ( length < 1e-12f ) {
+        return ( struct Tm42Plane ){ .a = 0.f, .b = 0.f, .c = 0.f, .d = 1.f };
+    }
+
+    return ( struct Tm42Plane ){
+        .a = plane.a / length,
+        .b = plane.b / length,
+        .c = plane.c / length,
+        .d = plane.d / length,
+    };
+}
+
+struct Tm42Frustum tm42_frustum_from_view_proj( const float* view_proj ) {
+    // Gribb & Hartmann: a point p is inside the frustum iff its clip coordinates c = M * p satisfy
+    // -c.w <= c.x <= c.w, -c.w <= c.y <= c.w and 0 <= c.z <= c.w. Each of these inequalities is a
+    // plane equation built from the rows of M. With column-major storage, row i is
+    // (m[i], m[4 + i], m[8 + i], m[12 + i]).
+    const float* m = view_proj;
+    struct Tm42Plane rows[4];
+    for ( int i = 0; i < 4; ++i ) {
+        rows[i] = ( struct Tm42Plane ){ .a = m[i], .b = m[4 + i], .c = m[8 + i], .d = m[12 + i] };
+    }
+
+    const struct Tm42Plane w = rows[3];
+    struct Tm42Frustum frustum;
+    frustum.planes[TM42_FRUSTUM_PLANE_LEFT] = tm42_plane_add( w, rows[0] );
+    frustum.planes[TM42_FRUSTUM_PLANE_RIGHT] = tm42_plane_sub( w, rows[0] );
+    frustum.planes[TM42_FRUSTUM_PLANE_BOTTOM] = tm42_plane_add( w, rows[1] );
+    frustum.planes[TM42_FRUSTUM_PLANE_TOP] = tm42_plane_sub( w, rows[1] );
+    frustum.planes[TM42_FRUSTUM_PLANE_NEAR] = rows[2];
+    frustum.planes[TM42_FRUSTUM_PLANE_FAR] = tm42_plane_sub( w, rows[2] );
+
+    for ( int i = 0; i < TM42_FRUSTUM_PLANE_COUNT; ++i ) {
+        frustum.planes[i] = tm42_plane_normalize( frustum.planes[i] );
+    }
+
+    return frustum;
+}
+
+int tm42_frustum_test_sphere( const struct Tm42Frustum* frustum, const float* center,
+                              float radius ) {
+    for ( int i = 0; i < TM42_FRUSTUM_PLANE_COUNT; ++i ) {
+        const struct Tm42Plane p = frustum->planes[i];
+        const float distance = p.a * center[0] + p.b * center[1] + p.c * center[2] + p.d;
+        if ( distance < -radius ) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int tm42_frustum_test_aabb( const struct Tm42Frustum* frustum, const float* center,
+                            const float* extents ) {
+    for ( int i = 0; i < TM42_FRUSTUM_PLANE_COUNT; ++i ) {
+        const struct Tm42Plane p = frustum->planes[i];
+        const float distance = p.a * center[0] + p.b * center[1] + p.c * center[2] + p.d;
+        // The projection of the box's half-extents onto the plane normal.
+        const float radius =
+            fabsf( p.a ) * extents[0] + fabsf( p.b ) * extents[1] + fabsf( p.c ) * extents[2];
+        if ( distance < -radius ) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+size_t tm42_frustum_cull_spheres_soa( const struct Tm42Frustum* frustum, const float* xs,
+                                      const float* ys, const float* zs, const float* radii,
+                                      unsigned char* out_visible, size_t count ) {
+    size_t i = 0;
+    size_t num_visible = 0;
+
+    // Each lane tests a different sphere against all six planes, accumulating a mask of the lanes
+    // that are fully behind at least one plane.
+#if defined( TM42_MATH_SIMD_AVX2 )
+    const struct Tm42Plane* planes = frustum->planes;
+    for ( ; i + 8 <= count; i += 8 ) {
+        const __m256 x = _mm256_loadu_ps( xs + i );
+        const __m256 y = _mm256_loadu_ps( ys + i );
+        const __m256 z = _mm256_loadu_ps( zs + i );
+        const __m256 neg_r = _mm256_sub_ps( _mm256_setzero_ps(), _mm256_loadu_ps( radii + i ) );
+
+        __m256 outside = _mm256_setzero_ps();
+        for ( int p = 0; p < TM42_FRUSTUM_PLANE_COUNT; ++p ) {
+            const __m256 a = _mm256_set1_ps( planes[p].a );
+            const __m256 b = _mm256_set1_ps( planes[p].b );
+            const __m256 c = _mm256_set1_ps( planes[p].c );
+            const __m256 d = _mm256_set1_ps( planes[p].d );
+
+            __m256 distance = _mm256_mul_ps( a, x );
+            distance = _mm256_add_ps( distance, _mm256_mul_ps( b, y ) );
+            distance = _mm256_add_ps( distance, _mm256_mul_ps( c, z ) );
+            distance = _mm256_add_ps( distance, d );
+            outside = _mm256_or_ps( outside, _mm256_cmp_ps( distance, neg_r, _CMP_LT_OQ ) );
+        }
+
+        const int outside_mask = _mm256_movemask_ps( outside );
+        for ( int lane = 0; lane < 8; ++lane ) {
+            out_visible[i + lane] = !( ( outside_mask >> lane ) & 1 );
+            num_visible += out_visible[i + lane];
+        }
+    }
+#elif defined( TM42_MATH_SIMD_SSE )
+    const struct Tm42Plane* planes = frustum->planes;
+    for ( ; i + 4 <= count; i += 4 ) {
+        const __m128 x = _mm_loadu_ps( xs + i );
+        const __m128 y = _mm_loadu_ps( ys + i );
+        const __m128 z = _mm_loadu_ps( zs + i );
+        const __m128 neg_r = _mm_sub_ps( _mm_setzero_ps(), _mm_loadu_ps( radii + i ) );
+
+        __m128 outside = _mm_setzero_ps();
+        for ( int p = 0; p < TM42_FRUSTUM_PLANE_COUNT; ++p ) {
+            __m128 distance = _mm_mul_ps( _mm_set1_ps( planes[p].a ), x );
+            distance = _mm_add_ps( distance, _mm_mul_ps( _mm_set1_ps( planes[p].b ), y ) );
+            distance = _mm_add_ps( distance, _mm_mul_ps( _mm_set1_ps( planes[p].c ), z ) );
+            distance = _mm_add_ps( distance, _mm_set1_ps( planes[p].d ) );
+            outside = _mm_or_ps( outside, _mm_cmplt_ps( distance, neg_r ) );
+        }
+
+        const int outside_mask = _mm_movemask_ps( outside );
+        for ( int lane = 0; lane < 4; ++lane ) {
+            out_visible[i + lane] = !( ( outside_mask >> lane ) & 1 );
+            num_visible += out_visible[i + lane];
+        }
+    }
+#elif defined( TM42_MATH_SIMD_NEON )
+    const struct Tm42Plane* planes = frustum->planes;
+    for ( ; i + 4 <= count; i += 4 ) {
+        const float32x4_t x = vld1q_f32( xs + i );
+        const float32x4_t y = vld1q_f32( ys + i );
+        const float32x4_t z = vld1q_f32( zs + i );
+        const float32x4_t neg_r = vnegq_f32( vld1q_f32( radii + i ) );
+
+        uint32x4_t outside = vdupq_n_u32( 0 );
+        for ( int p = 0; p < TM42_FRUSTUM_PLANE_COUNT; ++p ) {
+            float32x4_t distance = vmulq_n_f32( x, planes[p].a );
+            distance = vmlaq_n_f32( distance, y, planes[p].b );
+            distance = vmlaq_n_f32( distance, z, planes[p].c );
+            distance = vaddq_f32( distance, vdupq_n_f32( planes[p].d ) );
+            outside = vorrq_u32( outside, vcltq_f32( distance, neg_r ) );
+        }
+
+        uint32_t outside_lanes[4];
+        vst1q_u32( outside_lanes, outside );
+        for ( int lane = 0; lane < 4; ++lane ) {
+            out_visible[i + lane] = outside_lanes[lane] == 0;
+            num_visible += out_visible[i + lane];
+        }
+    }
+#endif
+
+    // Scalar tail (or the whole array, without SIMD).
+    for ( ; i < count; ++i ) {
+        const float center[3] = { xs[i], ys[i], zs[i] };
+        out_visible[i] = (unsigned char)tm42_frustum_test_sphere( frustum, center, radii[i] );
+        num_visible += out_visible[i];
+    }
+
+    return num_visible;
+}
+
+size_t tm42_frustum_cull_aabbs_soa( const struct Tm42Frustum* frustum, const float* center_xs,
+                                    const float* center_ys, const float* center_zs,
+                                    const float* extent_xs, const float* extent_ys,
+                                    const float* extent_zs, unsigned char* out_visible,
+                                    size_t count ) {
+    size_t i = 0;
+    size_t num_visible = 0;
+
+    // Same as the sphere test, except that the "radius" depends on the plane: it is the projection
+    // of the half-extents onto the absolute value of the plane normal.
+#if defined( TM42_MATH_SIMD_AVX2 )
+    const struct Tm42Plane* planes = frustum->planes;
+    for ( ; i + 8 <= count; i += 8 ) {
+        const __m256 x = _mm256_loadu_ps( center_xs + i );
+        const __m256 y = _mm256_loadu_ps( center_ys + i );
+        const __m256 z = _mm256_loadu_ps( center_zs + i );
+        const __m256 ex = _mm256_loadu_ps( extent_xs + i );
+        const __m256 ey = _mm256_loadu_ps( extent_ys + i );
+        const __m256 ez = _mm256_loadu_ps( extent_zs + i );
+
+        __m256 outside = _mm256_setzero_ps();
+        for ( int p = 0; p < TM42_FRUSTUM_PLANE_COUNT; ++p ) {
+            const __m256 a = _mm256_set1_ps( planes[p].a );
+            const __m256 b = _mm256_set1_ps( planes[p].b );
+            const __m256 c = _mm256_set1_ps( planes[p].c );
+            const __m256 d = _mm256_set1_ps( planes[p].d );
+            const __m256 abs_a = _mm256_set1_ps( fabsf( planes[p].a ) );
+            const __m256 abs_b = _mm256_set1_ps( fabsf( planes[p].b ) );
+            const __m256 abs_c = _mm256_set1_ps( fabsf( planes[p].c ) );
+
+            __m256 distance = _mm256_mul_ps( a, x );
+            distance = _mm256_add_ps( distance, _mm256_mul_ps( b, y ) );
+            distance = _mm256_add_ps( distance, _mm256_mul_ps( c, z ) );
+            distance = _mm256_add_ps( distance, d );
+
+            __m256 radius = _mm256_mul_ps( abs_a, ex );
+            radius = _mm256_add_ps( radius, _mm256_mul_ps( abs_b, ey ) );
+            radius = _mm256_add_ps( radius, _mm256_mul_ps( abs_c, ez ) );
+
+            const __m256 neg_r = _mm256_sub_ps( _mm256_setzero_ps(), radius );
+            outside = _mm256_or_ps( outside, _mm256_cmp_ps( distance, neg_r, _CMP_LT_OQ ) );
+        }
+
+        const int outside_mask = _mm256_movemask_ps( outside );
+        for ( int lane = 0; lane < 8; ++lane ) {
+            out_visible[i + lane] = !( ( outside_mask >> lane ) & 1 );
+            num_visible += out_visible[i + lane];
+        }
+    }
+#elif defined( TM42_MATH_SIMD_SSE )
+    const struct Tm42Plane* planes = frustum->planes;
+    for ( ; i + 4 <= count; i += 4 ) {
+        const __m128 x = _mm_loadu_ps( center_xs + i );
+        const __m128 y = _mm_loadu_ps( center_ys + i );
+        const __m128 z = _mm_loadu_ps( center_zs + i );
+        const __m128 ex = _mm_loadu_ps( extent_xs + i );
+        const __m128 ey = _mm_loadu_ps( extent_ys + i );
+        const __m128 ez = _mm_loadu_ps( extent_zs + i );
+
+        __m128 outside = _mm_setzero_ps();
+        for ( int p = 0; p < TM42_FRUSTUM_PLANE_COUNT; ++p ) {
+            __m128 distance = _mm_mul_ps( _mm_set1_ps( planes[p].a ), x );
+            distance = _mm_add_ps( distance, _mm_mul_ps( _mm_set1_ps( planes[p].b ), y ) );
+            distance = _mm_add_ps( distance, _mm_mul_ps( _mm_set1_ps( planes[p].c ), z ) );
+            distance = _mm_add_ps( distance, _mm_set1_ps( planes[p].d ) );
+
+            __m128 radius = _mm_mul_ps( _mm_set1_ps( fabsf( planes[p].a ) ), ex );
+            radius = _mm_add_ps( radius, _mm_mul_ps( _mm_set1_ps( fabsf( planes[p].b ) ), ey ) );
+            radius = _mm_add_ps( radius, _mm_mul_ps( _mm_set1_ps( fabsf( planes[p].c ) ), ez ) );
+
+            const __m128 neg_r = _mm_sub_ps( _mm_setzero_ps(), radius );
+            outside = _mm_or_ps( outside, _mm_cmplt_ps( distance, neg_r ) );
+        }
+
+        const int outside_mask = _mm_movemask_ps( outside );
+        for ( int lane = 0; lane < 4; ++lane ) {
+            out_visible[i + lane] = !( ( outside_mask >> lane ) & 1 );
+            num_visible += out_visible[i + lane];
+        }
+    }
+#elif defined( TM42_MATH_SIMD_NEON )
+    const struct Tm42Plane* planes = frustum->planes;
+    for ( ; i + 4 <= count; i += 4 ) {
+        const float32x4_t x = vld1q_f32( center_xs + i );
+        const float32x4_t y = vld1q_f32( center_ys + i );
+        const float32x4_t z = vld1q_f32( center_zs + i );
+        const float32x4_t ex = vld1q_f32( extent_xs + i );
+        const float32x4_t ey = vld1q_f32( extent_ys + i );
+        const float32x4_t ez = vld1q_f32( extent_zs + i );
+
+        uint32x4_t outside = vdupq_n_u32( 0 );
+        for ( int p = 0; p < TM42_FRUSTUM_PLANE_COUNT; ++p ) {
+            float32x4_t distance = vmulq_n_f32( x, planes[p].a );
+            distance = vmlaq_n_f32( distance, y, planes[p].b );
+            distance = vmlaq_n_f32( distance, z, planes[p].c );
+            distance = vaddq_f32( distance, vdupq_n_f32( planes[p].d ) );
+
+            float32x4_t radius = vmulq_n_f32( ex, fabsf( planes[p].a ) );
+            radius = vmlaq_n_f32( radius, ey, fabsf( planes[p].b ) );
+            radius = vmlaq_n_f32( radius, ez, fabsf( planes[p].c ) );
+
+            outside = vorrq_u32( outside, vcltq_f32( distance, vnegq_f32( radius ) ) );
+        }
+
+        uint32_t outside_lanes[4];
+        vst1q_u32( outside_lanes, outside );
+        for ( int lane = 0; lane < 4; ++lane ) {
+            out_visible[i + lane] = outside_lanes[lane] == 0;
+            num_visible += out_visible[i + lane];
+        }
+    }
+#endif
+
+    // Scalar tail (or the whole array, without SIMD).
+    for ( ; i < count; ++i ) {
+        const float center[3] = { center_xs[i], center_ys[i], center_zs[i] };
+        const float extents[3] = { extent_xs[i], extent_ys[i], extent_zs[i] };
+        out_visible[i] = (unsigned char)tm42_frustum_test_aabb( frustum, center, extents );
+        num_visible += out_visible[i];
+    }
+
+    return num_visible;
+}
+
+#endif // TM42_FRUSTUM_IMPLEMENTATION
@@ -0,0 +1,18 @@
+/// tm42_impl.c
+///
+/// Compiles the implementations of the tm42 headers into a single translation unit, so that the
+/// engine links against code built by the C compiler (with its SIMD intrinsics) rather than
+/// translating the implementations through `@cImport`.
+
+#define TM42_MATH_IMPLEMENTATION
+#include "tm42_math.h"
+#undef TM42_MATH_IMPLEMENTATION
+
+#define TM42_CAMERA_IMPLEMENTATION
+#include "tm42_turntable_camera.h"
+
+#define TM42_FRUSTUM_IMPLEMENTATION
+#include "tm42_frustum.h"
+
+#define TM42_MESH_IMPLEMENTATION
+#include "tm42_mesh.h"
@@ -1,10 +1,28 @@
 #ifndef TM42_MATH_H
 #define TM42_MATH_H
 
+#include <stddef.h>
+
 #ifdef TM42_MATH_DEBUG_PRINT
 #include <stdio.h>
 #endif
 
+// The batch functions (`*_batch`, `*_array`) pick a SIMD implementation at compile time based on
+// the target features the compiler advertises. Define `TM42_MATH_NO_SIMD` to force the scalar
+// fallback, e.g. for testing or for front ends that cannot see through intrinsics.
+#if !defined( TM42_MATH_NO_SIMD ) && defined( __AVX2__ )
+#define TM42_MATH_SIMD_AVX2
+#define TM42_MATH_SIMD_NAME "avx2"
+#elif !defined( TM42_MATH_NO_SIMD ) && ( defined( __SSE__ ) || defined( _M_X64 ) )
+#define TM42_MATH_SIMD_SSE
+#define TM42_MATH_SIMD_NAME "sse"
+#elif !defined( TM42_MATH_NO_SIMD ) && defined( __ARM_NEON ) && defined( __aarch64__ )
+#define TM42_MATH_SIMD_NEON
+#define TM42_MATH_SIMD_NAME "neon"
+#else
+#define TM42_MATH_SIMD_NAME "scalar"
+#endif
+
 struct Tm42Point3 {
     float x;
     float y;
@@ -62,6 +80,13 @@ struct Tm42Vec3 tm42_quaternion_rotate_vec3( const float* q, const float* v );
 /// Returns the (normalized) quaternion representing the rotation to go from `src` to `dst`. Both
 /// `src` and `dst` vectors MUST be normalized.
 struct Tm42Quaternion tm42_quaternion_rotation_between_vec3s( const float* src, const float* dst );
+/// Returns the (normalized) quaternion representing a rotation of `angle` radians around `axis`.
+/// The `axis` MUST be normalized.
+struct Tm42Quaternion tm42_quaternion_from_axis_angle( const float* axis, float angle );
+/// Returns `q1 * q2`, i.e. the rotation `q2` followed by the rotation `q1`.
+struct Tm42Quaternion tm42_quaternion_mul( const float* q1, const float* q2 );
+/// For a normalized quaternion, this is the inverse rotation.
+struct Tm42Quaternion tm42_quaternion_conjugate( const float* q );
 #ifdef TM42_MATH_DEBUG_PRINT
 void tm42_quaternion_fprint( FILE* f, const float* q );
 #endif
@@ -85,12 +110,37 @@ struct Tm42Vec3 tm42_mat4_transform_vec3( const float* m, const float* v );
 void tm42_mat4_fprint( FILE* f, const float* m );
 #endif
 
+// [[ Batch ]]
+//
+// These operate on contiguous arrays and produce the same results as calling their single-value
+// counterparts in a loop. Outputs may alias inputs exactly (in-place), but must not partially
+// overlap them.
+
+/// Computes `out[i] = m * ms[i]` for `count` matrices, i.e. the same as `tm42_mat4_mul_mat4( m,
+/// ms[i] )`. `ms` and `out` are arrays of `count` column-major matrices (16 floats each).
+void tm42_mat4_mul_mat4_batch( const float* m, const float* ms, float* out, size_t count );
+/// Applies `tm42_mat4_transform_vec3` to `count` tightly packed (x, y, z) triples.
+void tm42_mat4_transform_vec3_array( const float* m, const float* vs, float* out, size_t count );
+/// Same as `tm42_mat4_transform_vec3_array`, but with the coordinates stored as separate arrays
+/// ("structure of arrays"). This is the layout that vectorizes best.
+void tm42_mat4_transform_vec3_array_soa( const float* m, const float* xs, const float* ys,
+                                         const float* zs, float* out_xs, float* out_ys,
+                                         float* out_zs, size_t count );
+
 #endif // TM42_MATH_H
 
 #ifdef TM42_MATH_IMPLEMENTATION
 
 #include <math.h>
 
+#if defined( TM42_MATH_SIMD_AVX2 )
+#include <immintrin.h>
+#elif defined( TM42_MATH_SIMD_SSE )
+#include <xmmintrin.h>
+#elif defined( TM42_MATH_SIMD_NEON )
+#include <arm_neon.h>
+#endif
+
 float tm42_deg_to_rad( float degrees ) { return ( degrees * M_PI / 180.f ); }
 
 // [[ Point3 ]]
@@ -262,6 +312,29 @@ struct Tm42Quaternion tm42_quaternion_rotation_between_vec3s( const float* src,
     return to_return;
 }
 
+struct Tm42Quaternion tm42_quaternion_from_axis_angle( const float* axis, float angle ) {
+    const float half_sin = sinf( angle / 2.f );
+    return ( struct Tm42Quaternion ){
+        .s = cosf( angle / 2.f ),
+        .x = axis[0] * half_sin,
+        .y = axis[1] * half_sin,
+        .z = axis[2] * half_sin,
+    };
+}
+
+struct Tm42Quaternion tm42_quaternion_mul( const float* q1, const float* q2 ) {
+    return ( struct Tm42Quaternion ){
+        .s = q1[0] * q2[0] - q1[1] * q2[1] - q1[2] * q2[2] - q1[3] * q2[3],
+        .x = q1[0] * q2[1] + q1[1] * q2[0] + q1[2] * q2[3] - q1[3] * q2[2],
+        .y = q1[0] * q2[2] - q1[1] * q2[3] + q1[2] * q2[0] + q1[3] * q2[1],
+        .z = q1[0] * q2[3] + q1[1] * q2[2] - q1[2] * q2[1] + q1[3] * q2[0],
+    };
+}
+
+struct Tm42Quaternion tm42_quaternion_conjugate( const float* q ) {
+    return ( struct Tm42Quaternion ){ .s = q[0], .x = -q[1], .y = -q[2], .z = -q[3] };
+}
+
 #ifdef TM42_MATH_DEBUG_PRINT
 void tm42_quaternion_fprint( FILE* f, const float* q ) {
     fprintf( f, "Quaternion: ( %f + %fi + %fj + %fk )", q[0], q[1], q[2], q[3] );
@@ -385,4 +458,227 @@ void tm42_mat4_fprint( FILE* f, const float* m ) {
 }
 #endif
 
+// [[ Batch ]]
+
+void tm42_mat4_mul_mat4_batch( const float* m, const float* ms, float* out, size_t count ) {
+#if defined( TM42_MATH_SIMD_AVX2 )
+    // Each 256-bit register holds two columns of the result. The columns of `m` are duplicated
+    // into both 128-bit lanes, and `_mm256_permute_ps` broadcasts element k of each right-hand
+    // column within its own lane.
+    const __m256 c0 = _mm256_broadcast_ps( (const __m128*)( m + 0 ) );
+    const __m256 c1 = _mm256_broadcast_ps( (const __m128*)( m + 4 ) );
+    const __m256 c2 = _mm256_broadcast_ps( (const __m128*)( m + 8 ) );
+    const __m256 c3 = _mm256_broadcast_ps( (const __m128*)( m + 12 ) );
+
+    for ( size_t i = 0; i < count; ++i ) {
+        const float* rhs = ms + i * 16;
+        float* dst = out + i * 16;
+
+        for ( int j = 0; j < 16; j += 8 ) {
+            const __m256 cols = _mm256_loadu_ps( rhs + j );
+            __m256 r = _mm256_mul_ps( c0, _mm256_permute_ps( cols, 0x00 ) );
+            r = _mm256_add_ps( r, _mm256_mul_ps( c1, _mm256_permute_ps( cols, 0x55 ) ) );
+            r = _mm256_add_ps( r, _mm256_mul_ps( c2, _mm256_permute_ps( cols, 0xAA ) ) );
+            r = _mm256_add_ps( r, _mm256_mul_ps( c3, _mm256_permute_ps( cols, 0xFF ) ) );
+            _mm256_storeu_ps( dst + j, r );
+        }
+    }
+#elif defined( TM42_MATH_SIMD_SSE )
+    const __m128 c0 = _mm_loadu_ps( m + 0 );
+    const __m128 c1 = _mm_loadu_ps( m + 4 );
+    const __m128 c2 = _mm_loadu_ps( m + 8 );
+    const __m128 c3 = _mm_loadu_ps( m + 12 );
+
+    for ( size_t i = 0; i < count; ++i ) {
+        const float* rhs = ms + i * 16;
+        float* dst = out + i * 16;
+
+        // Load the whole right-hand matrix first so that `out == ms` is safe.
+        const __m128 r0 = _mm_loadu_ps( rhs + 0 );
+        const __m128 r1 = _mm_loadu_ps( rhs + 4 );
+        const __m128 r2 = _mm_loadu_ps( rhs + 8 );
+        const __m128 r3 = _mm_loadu_ps( rhs + 12 );
+        const __m128 cols[4] = { r0, r1, r2, r3 };
+
+        for ( int j = 0; j < 4; ++j ) {
+            const __m128 col = cols[j];
+            const __m128 x = _mm_shuffle_ps( col, col, _MM_SHUFFLE( 0, 0, 0, 0 ) );
+            const __m128 y = _mm_shuffle_ps( col, col, _MM_SHUFFLE( 1, 1, 1, 1 ) );
+            const __m128 z = _mm_shuffle_ps( col, col, _MM_SHUFFLE( 2, 2, 2, 2 ) );
+            const __m128 w = _mm_shuffle_ps( col, col, _MM_SHUFFLE( 3, 3, 3, 3 ) );
+
+            __m128 r = _mm_mul_ps( c0, x );
+            r = _mm_add_ps( r, _mm_mul_ps( c1, y ) );
+            r = _mm_add_ps( r, _mm_mul_ps( c2, z ) );
+            r = _mm_add_ps( r, _mm_mul_ps( c3, w ) );
+            _mm_storeu_ps( dst + j * 4, r );
+        }
+    }
+#elif defined( TM42_MATH_SIMD_NEON )
+    const float32x4_t c0 = vld1q_f32( m + 0 );
+    const float32x4_t c1 = vld1q_f32( m + 4 );
+    const float32x4_t c2 = vld1q_f32( m + 8 );
+    const float32x4_t c3 = vld1q_f32( m + 12 );
+
+    for ( size_t i = 0; i < count; ++i ) {
+        const float* rhs = ms + i * 16;
+        float* dst = out + i * 16;
+
+        float32x4_t r[4];
+        for ( int j = 0; j < 4; ++j ) {
+            const float32x4_t col = vld1q_f32( rhs + j * 4 );
+            r[j] = vmulq_lane_f32( c0, vget_low_f32( col ), 0 );
+            r[j] = vmlaq_lane_f32( r[j], c1, vget_low_f32( col ), 1 );
+            r[j] = vmlaq_lane_f32( r[j], c2, vget_high_f32( col ), 0 );
+            r[j] = vmlaq_lane_f32( r[j], c3, vget_high_f32( col ), 1 );
+        }
+        for ( int j = 0; j < 4; ++j ) {
+            vst1q_f32( dst + j * 4, r[j] );
+        }
+    }
+#else
+    for ( size_t i = 0; i < count; ++i ) {
+        const struct Tm42Mat4 result = tm42_mat4_mul_mat4( m, ms + i * 16 );
+        for ( int j = 0; j < 16; ++j ) {
+            out[i * 16 + j] = result.a[j];
+        }
+    }
+#endif
+}
+
+void tm42_mat4_transform_vec3_array( const float* m, const float* vs, float* out, size_t count ) {
+#if defined( TM42_MATH_SIMD_AVX2 ) || defined( TM42_MATH_SIMD_SSE )
+    // One point per iteration: the point is the weighted sum of the matrix columns, so every lane
+    // does useful work without having to transpose the packed triples.
+    const __m128 c0 = _mm_loadu_ps( m + 0 );
+    const __m128 c1 = _mm_loadu_ps( m + 4 );
+    const __m128 c2 = _mm_loadu_ps( m + 8 );
+    const __m128 c3 = _mm_loadu_ps( m + 12 );
+
+    for ( size_t i = 0; i < count; ++i ) {
+        const float* v = vs + i * 3;
+        float* dst = out + i * 3;
+
+        __m128 r = _mm_mul_ps( c0, _mm_set1_ps( v[0] ) );
+        r = _mm_add_ps( r, _mm_mul_ps( c1, _mm_set1_ps( v[1] ) ) );
+        r = _mm_add_ps( r, _mm_mul_ps( c2, _mm_set1_ps( v[2] ) ) );
+        r = _mm_add_ps( r, c3 );
+        r = _mm_div_ps( r, _mm_shuffle_ps( r, r, _MM_SHUFFLE( 3, 3, 3, 3 ) ) );
+
+        // Only three floats may be written, otherwise we would clobber the next input when
+        // transforming in place.
+        _mm_storel_pi( (__m64*)dst, r );
+        _mm_store_ss( dst + 2, _mm_movehl_ps( r, r ) );
+    }
+#elif defined( TM42_MATH_SIMD_NEON )
+    const float32x4_t c0 = vld1q_f32( m + 0 );
+    const float32x4_t c1 = vld1q_f32( m + 4 );
+    const float32x4_t c2 = vld1q_f32( m + 8 );
+    const float32x4_t c3 = vld1q_f32( m + 12 );
+
+    for ( size_t i = 0; i < count; ++i ) {
+        const float* v = vs + i * 3;
+        float* dst = out + i * 3;
+
+        float32x4_t r = vmulq_n_f32( c0, v[0] );
+        r = vmlaq_n_f32( r, c1, v[1] );
+        r = vmlaq_n_f32( r, c2, v[2] );
+        r = vaddq_f32( r, c3 );
+        r = vdivq_f32( r, vdupq_laneq_f32( r, 3 ) );
+
+        vst1_f32( dst, vget_low_f32( r ) );
+        vst1q_lane_f32( dst + 2, r, 2 );
+    }
+#else
+    for ( size_t i = 0; i < count; ++i ) {
+        const struct Tm42Vec3 result = tm42_mat4_transform_vec3( m, vs + i * 3 );
+        out[i * 3 + 0] = result.x;
+        out[i * 3 + 1] = result.y;
+        out[i * 3 + 2] = result.z;
+    }
+#endif
+}
+
+void tm42_mat4_transform_vec3_array_soa( const float* m, const float* xs, const float* ys,
+                                         const float* zs, float* out_xs, float* out_ys,
+                                         float* out_zs, size_t count ) {
+    size_t i = 0;
+
+    // Each lane handles a different point, and each matrix element is broadcast to all lanes.
+#if defined( TM42_MATH_SIMD_AVX2 )
+    __m256 mm[16];
+    for ( int j = 0; j < 16; ++j ) {
+        mm[j] = _mm256_set1_ps( m[j] );
+    }
+
+    for ( ; i + 8 <= count; i += 8 ) {
+        const __m256 x = _mm256_loadu_ps( xs + i );
+        const __m256 y = _mm256_loadu_ps( ys + i );
+        const __m256 z = _mm256_loadu_ps( zs + i );
+
+        __m256 r[4];
+        for ( int row = 0; row < 4; ++row ) {
+            r[row] = _mm256_mul_ps( mm[0 + row], x );
+            r[row] = _mm256_add_ps( r[row], _mm256_mul_ps( mm[4 + row], y ) );
+            r[row] = _mm256_add_ps( r[row], _mm256_mul_ps( mm[8 + row], z ) );
+            r[row] = _mm256_add_ps( r[row], mm[12 + row] );
+        }
+
+        _mm256_storeu_ps( out_xs + i, _mm256_div_ps( r[0], r[3] ) );
+        _mm256_storeu_ps( out_ys + i, _mm256_div_ps( r[1], r[3] ) );
+        _mm256_storeu_ps( out_zs + i, _mm256_div_ps( r[2], r[3] ) );
+    }
+#elif defined( TM42_MATH_SIMD_SSE )
+    __m128 mm[16];
+    for ( int j = 0; j < 16; ++j ) {
+        mm[j] = _mm_set1_ps( m[j] );
+    }
+
+    for ( ; i + 4 <= count; i += 4 ) {
+        const __m128 x = _mm_loadu_ps( xs + i );
+        const __m128 y = _mm_loadu_ps( ys + i );
+        const __m128 z = _mm_loadu_ps( zs + i );
+
+        __m128 r[4];
+        for ( int row = 0; row < 4; ++row ) {
+            r[row] = _mm_mul_ps( mm[0 + row], x );
+            r[row] = _mm_add_ps( r[row], _mm_mul_ps( mm[4 + row], y ) );
+            r[row] = _mm_add_ps( r[row], _mm_mul_ps( mm[8 + row], z ) );
+            r[row] = _mm_add_ps( r[row], mm[12 + row] );
+        }
+
+        _mm_storeu_ps( out_xs + i, _mm_div_ps( r[0], r[3] ) );
+        _mm_storeu_ps( out_ys + i, _mm_div_ps( r[1], r[3] ) );
+        _mm_storeu_ps( out_zs + i, _mm_div_ps( r[2], r[3] ) );
+    }
+#elif defined( TM42_MATH_SIMD_NEON )
+    for ( ; i + 4 <= count; i += 4 ) {
+        const float32x4_t x = vld1q_f32( xs + i );
+        const float32x4_t y = vld1q_f32( ys + i );
+        const float32x4_t z = vld1q_f32( zs + i );
+
+        float32x4_t r[4];
+        for ( int row = 0; row < 4; ++row ) {
+            r[row] = vmulq_n_f32( x, m[0 + row] );
+            r[row] = vmlaq_n_f32( r[row], y, m[4 + row] );
+            r[row] = vmlaq_n_f32( r[row], z, m[8 + row] );
+            r[row] = vaddq_f32( r[row], vdupq_n_f32( m[12 + row] ) );
+        }
+
+        vst1q_f32( out_xs + i, vdivq_f32( r[0], r[3] ) );
+        vst1q_f32( out_ys + i, vdivq_f32( r[1], r[3] ) );
+        vst1q_f32( out_zs + i, vdivq_f32( r[2], r[3] ) );
+    }
+#endif
+
+    // Scalar tail (or the whole array, without SIMD).
+    for ( ; i < count; ++i ) {
+        const float v[3] = { xs[i], ys[i], zs[i] };
+        const struct Tm42Vec3 result = tm42_mat4_transform_vec3( m, v );
+        out_xs[i] = result.x;
+        out_ys[i] = result.y;
+        out_zs[i] = result.z;
+    }
+}
+
 #endif // TM42_MATH_IMPLEMENTATION
@@ -0,0 +1,691 @@
+#ifndef TM42_MESH_H
+#define TM42_MESH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Marks a vertex that no index refers to in the remap tables below.
+#define TM42_MESH_UNUSED_VERTEX 0xffffffffu
+
+// [[ Welding ]]
+
+/// Finds the vertices that are bitwise identical, comparing all `vertex_size` bytes (so padding
+/// bytes must be zeroed, and -0 and 0 are different vertices). Writes to `remap[i]` the new index
+/// of vertex `i`, such that the unique vertices are numbered in the order of their first
+/// occurrence, and returns the number of unique vertices.
+///
+/// If the scratch hash table can't be allocated, no vertices are welded: `remap` is the identity
+/// and `vertex_count` is returned.
+size_t tm42_mesh_weld_vertices( const void* vertices, size_t vertex_count, size_t vertex_size,
+                                uint32_t* remap );
+
+/// Copies each vertex `i` of `src` to `dst[remap[i]]`, skipping vertices remapped to
+/// `TM42_MESH_UNUSED_VERTEX`. `dst` must not overlap `src`.
+void tm42_mesh_remap_vertices( void* dst, const void* src, size_t vertex_count, size_t vertex_size,
+                               const uint32_t* remap );
+/// Writes `dst[i] = remap[src[i]]`. `src` can be `NULL` for a mesh that isn't indexed, in which
+/// case `dst[i] = remap[i]`. `dst` can be `src`.
+void tm42_mesh_remap_indices( uint32_t* dst, const uint32_t* src, size_t index_count,
+                              const uint32_t* remap );
+
+// [[ Vertex cache ]]
+//
+// The post-transform vertex cache is modelled as a FIFO of `cache_size` vertices, which is close
+// enough to what GPUs do to rank triangle orders.
+
+/// Reorders the triangles of an indexed mesh for the post-transform vertex cache, using Tipsify
+/// (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced
+/// Overdraw", 2007). It runs in time linear in the number of triangles. `index_count` must be a
+/// multiple of 3, and `dst` can be `indices`.
+///
+/// If the scratch memory can't be allocated, the triangles are copied in their original order.
+void tm42_mesh_optimize_vertex_cache( uint32_t* dst, const uint32_t* indices, size_t index_count,
+                                      size_t vertex_count, size_t cache_size );
+
+/// Computes a remap table that numbers the vertices in the order the indices first use them, so
+/// that the vertex fetches of a cache-optimized mesh walk through memory. Vertices that are not
+/// used are remapped to `TM42_MESH_UNUSED_VERTEX`. Returns the number of used vertices.
+///
+/// Apply it with `tm42_mesh_remap_vertices` and `tm42_mesh_remap_indices`.
+size_t tm42_mesh_optimize_vertex_fetch_remap( uint32_t* remap, const uint32_t* indices,
+                                              size_t index_count, size_t vertex_count );
+
+/// Returns the average cache miss ratio: the number of vertices transformed per triangle, from 3
+/// for no reuse at all down to about 0.5 for a large regular grid. Returns 0 for an empty mesh,
+/// and -1 if the scratch memory can't be allocated.
+float tm42_mesh_compute_acmr( const uint32_t* indices, size_t index_count, size_t vertex_count,
+                              size_t cache_size );
+
+// [[ Simplification ]]
+
+/// Simplifies an indexed mesh by collapsing edges, cheapest first by the quadric error metric
+/// (Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics", 1997), until at
+/// most `target_index_count` indices are left or the next collapse would move the surface by more
+/// than `target_error`. Returns the number of indices written to `dst`, which can be `indices`.
+///
+/// A collapse moves a vertex onto one of its neighbours, so the result indexes the same vertices
+/// and can share their vertex buffer. Vertices on a border of the mesh or on an attribute seam (a
+/// position shared by several vertices, e.g. with different normals) never move. This keeps
+/// borders and seams closed, at the cost of simplifying less around them.
+///
+/// `positions` are `vertex_count` float triples, `position_stride` bytes apart. Errors are
+/// relative to the largest extent of the mesh's bounding box. If `out_error` is not `NULL`, the
+/// error of the result is written to it.
+///
+/// If the scratch memory can't be allocated, the indices are copied unchanged.
+size_t tm42_mesh_simplify( uint32_t* dst, const uint32_t* indices, size_t index_count,
+                           const float* positions, size_t vertex_count, size_t position_stride,
+                           size_t target_index_count, float target_error, float* out_error );
+
+#endif // TM42_MESH_H
+
+#ifdef TM42_MESH_IMPLEMENTATION
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// [[ Welding ]]
+
+/// MurmurHash2 over the vertex's bytes, 4 at a time.
+static uint32_t tm42_mesh_hash_vertex( const unsigned char* vertex, size_t vertex_size ) {
+    const uint32_t m = 0x5bd1e995u;
+    uint32_t h = (uint32_t)vertex_size;
+
+    size_t i = 0;
+    for ( ; i + 4 <= vertex_size; i += 4 ) {
+        uint32_t k;
+        memcpy( &k, vertex + i, 4 );
+        k *= m;
+        k ^= k >> 24;
+        k *= m;
+        h *= m;
+        h ^= k;
+    }
+    for ( ; i < vertex_size; ++i ) {
+        h ^= (uint32_t)vertex[i] << ( 8 * ( i & 3 ) );
+        h *= m;
+    }
+
+    h ^= h >> 13;
+    h *= m;
+    h ^= h >> 15;
+    return h;
+}
+
+size_t tm42_mesh_weld_vertices( const void* vertices, size_t vertex_count, size_t vertex_size,
+                                uint32_t* remap ) {
+    const unsigned char* bytes = vertices;
+
+    // Open addressing with linear probing, kept at most half full. The table holds the index of
+    // the first occurrence of each unique vertex.
+    size_t table_size = 16;
+    while ( table_size < vertex_count * 2 ) {
+        table_size *= 2;
+    }
+    const size_t mask = table_size - 1;
+
+    uint32_t* table = malloc( table_size * sizeof( uint32_t ) );
+    if ( table == NULL ) {
+        for ( size_t i = 0; i < vertex_count; ++i ) {
+            remap[i] = (uint32_t)i;
+        }
+        return vertex_count;
+    }
+    memset( table, 0xff, table_size * sizeof( uint32_t ) );
+
+    size_t unique_count = 0;
+    for ( size_t i = 0; i < vertex_count; ++i ) {
+        const unsigned char* vertex = bytes + i * vertex_size;
+
+        size_t slot = tm42_mesh_hash_vertex( vertex, vertex_size ) & mask;
+        while ( table[slot] != TM42_MESH_UNUSED_VERTEX &&
+                memcmp( bytes + table[slot] * vertex_size, vertex, vertex_size ) != 0 ) {
+            slot = ( slot + 1 ) & mask;
+        }
+
+        if ( table[slot] == TM42_MESH_UNUSED_VERTEX ) {
+            table[slot] = (uint32_t)i;
+            remap[i] = (uint32_t)unique_count++;
+        } else {
+            remap[i] = remap[table[slot]];
+        }
+    }
+
+    free( table );
+    return unique_count;
+}
+
+void tm42_mesh_remap_vertices( void* dst, const void* src, size_t vertex_count, size_t vertex_size,
+                               const uint32_t* remap ) {
+    unsigned char* dst_bytes = dst;
+    const unsigned char* src_bytes = src;
+    for ( size_t i = 0; i < vertex_count; ++i ) {
+        if ( remap[i] != TM42_MESH_UNUSED_VERTEX ) {
+            memcpy( dst_bytes + remap[i] * vertex_size, src_bytes + i * vertex_size, vertex_size );
+        }
+    }
+}
+
+void tm42_mesh_remap_indices( uint32_t* dst, const uint32_t* src, size_t index_count,
+                              const uint32_t* remap ) {
+    for ( size_t i = 0; i < index_count; ++i ) {
+        dst[i] = remap[src != NULL ? src[i] : i];
+    }
+}
+
+// [[ Vertex cache ]]
+
+/// Returns the next vertex to fan around: the best of the candidates with triangles left to emit,
+/// or if there is none, the most recently used vertex with triangles left, or the next vertex in
+/// order with triangles left. Returns -1 when all triangles have been emitted.
+static int64_t tm42_mesh_tipsify_next_vertex( const uint32_t* candidates, size_t candidate_count,
+                                              const uint32_t* live_triangles,
+                                              const uint32_t* cache_times, uint32_t time,
+                                              size_t cache_size, const uint32_t* dead_ends,
+                                              size_t* dead_end_count, size_t* cursor,
+                                              size_t vertex_count ) {
+    int64_t best_vertex = -1;
+    int64_t best_priority = -1;
+    for ( size_t i = 0; i < candidate_count; ++i ) {
+        const uint32_t vertex = candidates[i];
+        if ( live_triangles[vertex] == 0 ) {
+            continue;
+        }
+
+        // Prefer the oldest vertex that will still be in the cache after emitting its remaining
+        // triangles (each of which adds at most 2 new vertices), as it is about to be evicted.
+        int64_t priority = 0;
+        const uint32_t age = time - cache_times[vertex];
+        if ( age + 2 * live_triangles[vertex] <= cache_size ) {
+            priority = age;
+        }
+        if ( priority > best_priority ) {
+            best_priority = priority;
+            best_vertex = vertex;
+        }
+    }
+    if ( best_vertex >= 0 ) {
+        return best_vertex;
+    }
+
+    while ( *dead_end_count > 0 ) {
+        const uint32_t vertex = dead_ends[--*dead_end_count];
+        if ( live_triangles[vertex] > 0 ) {
+            return vertex;
+        }
+    }
+
+    while ( *cursor < vertex_count ) {
+        if ( live_triangles[*cursor] > 0 ) {
+            return (int64_t)*cursor;
+        }
+        ++*cursor;
+    }
+
+    return -1;
+}
+
+void tm42_mesh_optimize_vertex_cache( uint32_t* dst, const uint32_t* indices, size_t index_count,
+                                      size_t vertex_count, size_t cache_size ) {
+    const size_t triangle_count = index_count / 3;
+    if ( triangle_count == 0 ) {
+        return;
+    }
+
+    // The triangles around each vertex, as offsets into `adjacency`. `live_triangles` doubles as
+    // the count when building it, and then counts the triangles not emitted yet.
+    uint32_t* live_triangles = calloc( vertex_count, sizeof( uint32_t ) );
+    uint32_t* offsets = malloc( ( vertex_count + 1 ) * sizeof( uint32_t ) );
+    uint32_t* adjacency = malloc( index_count * sizeof( uint32_t ) + 1 );
+    uint32_t* cache_times = calloc( vertex_count, sizeof( uint32_t ) );
+    uint32_t* dead_ends = malloc( index_count * sizeof( uint32_t ) + 1 );
+    unsigned char* is_emitted = calloc( triangle_count + 1, 1 );
+    // The output is built separately, so that `dst` can be `indices`.
+    uint32_t* output = malloc( index_count * sizeof( uint32_t ) + 1 );
+
+    if ( live_triangles == NULL || offsets == NULL || adjacency == NULL || cache_times == NULL ||
+         dead_ends == NULL || is_emitted == NULL || output == NULL ) {
+        memmove( dst, indices, index_count * sizeof( uint32_t ) );
+        goto cleanup;
+    }
+
+    for ( size_t i = 0; i < triangle_count * 3; ++i ) {
+        ++live_triangles[indices[i]];
+    }
+    offsets[0] = 0;
+    for ( size_t vertex = 0; vertex < vertex_count; ++vertex ) {
+        offsets[vertex + 1] = offsets[vertex] + live_triangles[vertex];
+    }
+    // Fill back to front with `offsets[vertex + 1]` as the write position, which leaves
+    // `offsets[vertex]` pointing at the start of the vertex's triangles.
+    for ( size_t triangle = triangle_count; triangle-- > 0; ) {
+        for ( size_t corner = 0; corner < 3; ++corner ) {
+            const uint32_t vertex = indices[triangle * 3 + corner];
+            adjacency[--offsets[vertex + 1]] = (uint32_t)triangle;
+        }
+    }
+    for ( size_t vertex = 0; vertex < vertex_count; ++vertex ) {
+        offsets[vertex + 1] = offsets[vertex] + live_triangles[vertex];
+    }
+
+    // Starting past `cache_size` makes every vertex a miss at first.
+    uint32_t time = (uint32_t)cache_size + 1;
+    size_t dead_end_count = 0;
+    size_t cursor = 0;
+    size_t output_count = 0;
+
+    int64_t fan_vertex = 0;
+    while ( fan_vertex >= 0 ) {
+        // The vertices of the triangles emitted in this fan are pushed onto the dead-end stack,
+        // and are also the candidates for the next fan.
+        const size_t candidates_start = dead_end_count;
+
+        for ( uint32_t i = offsets[fan_vertex]; i < offsets[fan_vertex + 1]; ++i ) {
+            const uint32_t triangle = adjacency[i];
+            if ( is_emitted[triangle] ) {
+                continue;
+            }
+            is_emitted[triangle] = 1;
+
+            for ( size_t corner = 0; corner < 3; ++corner ) {
+                const uint32_t vertex = indices[triangle * 3 + corner];
+                output[output_count++] = vertex;
+                dead_ends[dead_end_count++] = vertex;
+                --live_triangles[vertex];
+                if ( time - cache_times[vertex] > cache_size ) {
+                    cache_times[vertex] = time++;
+                }
+            }
+        }
+
+        fan_vertex = tm42_mesh_tipsify_next_vertex(
+            dead_ends + candidates_start, dead_end_count - candidates_start, live_triangles,
+            cache_times, time, cache_size, dead_ends, &dead_end_count, &cursor, vertex_count );
+    }
+
+    memcpy( dst, output, output_count * sizeof( uint32_t ) );
+
+cleanup:
+    free( live_triangles );
+    free( offsets );
+    free( adjacency );
+    free( cache_times );
+    free( dead_ends );
+    free( is_emitted );
+    free( output );
+}
+
+size_t tm42_mesh_optimize_vertex_fetch_remap( uint32_t* remap, const uint32_t* indices,
+                                              size_t index_count, size_t vertex_count ) {
+    memset( remap, 0xff, vertex_count * sizeof( uint32_t ) );
+
+    size_t used_count = 0;
+    for ( size_t i = 0; i < index_count; ++i ) {
+        if ( remap[indices[i]] == TM42_MESH_UNUSED_VERTEX ) {
+            remap[indices[i]] = (uint32_t)used_count++;
+        }
+    }
+    return used_count;
+}
+
+float tm42_mesh_compute_acmr( const uint32_t* indices, size_t index_count, size_t vertex_count,
+                              size_t cache_size ) {
+    const size_t triangle_count = index_count / 3;
+    if ( triangle_count == 0 ) {
+        return 0.f;
+    }
+
+    // A vertex is in the FIFO iff fewer than `cache_size` misses happened since it was inserted.
+    uint32_t* cache_times = calloc( vertex_count, sizeof( uint32_t ) );
+    if ( cache_times == NULL ) {
+        return -1.f;
+    }
+
+    uint32_t time = (uint32_t)cache_size + 1;
+    size_t miss_count = 0;
+    for ( size_t i = 0; i < triangle_count * 3; ++i ) {
+        const uint32_t vertex = indices[i];
+        if ( time - cache_times[vertex] > cache_size ) {
+            cache_times[vertex] = time++;
+            ++miss_count;
+        }
+    }
+
+    free( cache_times );
+    return (float)miss_count / (float)triangle_count;
+}
+
+// [[ Simplification ]]
+
+/// A quadric `Q(p) = p^T A p + 2 b^T p + c` (A symmetric), summed over planes weighted by the area
+/// of the triangle they come from, so that `Q(p) / weight` is the mean squared distance of `p` to
+/// the planes.
+struct Tm42MeshQuadric {
+    float a00, a01, a02, a11, a12, a22;
+    float b0, b1, b2;
+    float c;
+    float weight;
+};
+
+static void tm42_mesh_quadric_add_plane( struct Tm42MeshQuadric* q, const float* n, float d,
+                                         float weight ) {
+    q->a00 += weight * n[0] * n[0];
+    q->a01 += weight * n[0] * n[1];
+    q->a02 += weight * n[0] * n[2];
+    q->a11 += weight * n[1] * n[1];
+    q->a12 += weight * n[1] * n[2];
+    q->a22 += weight * n[2] * n[2];
+    q->b0 += weight * n[0] * d;
+    q->b1 += weight * n[1] * d;
+    q->b2 += weight * n[2] * d;
+    q->c += weight * d * d;
+    q->weight += weight;
+}
+
+static void tm42_mesh_quadric_add( struct Tm42MeshQuadric* q, const struct Tm42MeshQuadric* o ) {
+    q->a00 += o->a00;
+    q->a01 += o->a01;
+    q->a02 += o->a02;
+    q->a11 += o->a11;
+    q->a12 += o->a12;
+    q->a22 += o->a22;
+    q->b0 += o->b0;
+    q->b1 += o->b1;
+    q->b2 += o->b2;
+    q->c += o->c;
+    q->weight += o->weight;
+}
+
+/// Returns the mean squared distance of `p` to the planes of `q`.
+static float tm42_mesh_quadric_error( const struct Tm42MeshQuadric* q, const float* p ) {
+    if ( q->weight <= 0.f ) {
+        return 0.f;
+    }
+    const float x = p[0], y = p[1], z = p[2];
+    const float r = q->a00 * x * x + q->a11 * y * y + q->a22 * z * z +
+                    2.f * ( q->a01 * x * y + q->a02 * x * z + q->a12 * y * z ) +
+                    2.f * ( q->b0 * x + q->b1 * y + q->b2 * z ) + q->c;
+    return fabsf( r ) / q->weight;
+}
+
+static void tm42_mesh_triangle_normal( const float* p0, const float* p1, const float* p2,
+                                       float* n ) {
+    const float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    const float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+/// Fills `adjacency` with the triangles around each vertex, those of vertex `v` being
+/// `adjacency[offsets[v]]` to `adjacency[offsets[v + 1]]`.
+static void tm42_mesh_build_adjacency( const uint32_t* indices, size_t index_count,
+                                       size_t vertex_count, uint32_t* offsets,
+                                       uint32_t* adjacency ) {
+    memset( offsets, 0, ( vertex_count + 1 ) * sizeof( uint32_t ) );
+    for ( size_t i = 0; i < index_count; ++i ) {
+        ++offsets[indices[i] + 1];
+    }
+    for ( size_t vertex = 0; vertex < vertex_count; ++vertex ) {
+        offsets[vertex + 1] += offsets[vertex];
+    }
+    // Filling advances each `offsets[v]` to the start of the next vertex's triangles, so shift
+    // them back afterwards.
+    for ( size_t i = 0; i < index_count; ++i ) {
+        adjacency[offsets[indices[i]]++] = (uint32_t)( i / 3 );
+    }
+    for ( size_t vertex = vertex_count; vertex > 0; --vertex ) {
+        offsets[vertex] = offsets[vertex - 1];
+    }
+    offsets[0] = 0;
+}
+
+/// Moving `from` onto `to`.
+struct Tm42MeshCollapse {
+    uint32_t from;
+    uint32_t to;
+    /// Squared.
+    float error;
+};
+
+static int tm42_mesh_compare_collapses( const void* a, const void* b ) {
+    const float error_a = ( (const struct Tm42MeshCollapse*)a )->error;
+    const float error_b = ( (const struct Tm42MeshCollapse*)b )->error;
+    return ( error_a > error_b ) - ( error_a < error_b );
+}
+
+size_t tm42_mesh_simplify( uint32_t* dst, const uint32_t* indices, size_t index_count,
+                           const float* positions, size_t vertex_count, size_t position_stride,
+                           size_t target_index_count, float target_error, float* out_error ) {
+    index_count -= index_count % 3;
+    if ( out_error != NULL ) {
+        *out_error = 0.f;
+    }
+    if ( index_count == 0 || vertex_count == 0 ) {
+        return 0;
+    }
+
+    float* points = malloc( vertex_count * 3 * sizeof( float ) );
+    uint32_t* position_remap = malloc( vertex_count * sizeof( uint32_t ) );
+    uint32_t* position_counts = calloc( vertex_count, sizeof( uint32_t ) );
+    unsigned char* is_locked = calloc( vertex_count, 1 );
+    struct Tm42MeshQuadric* quadrics = calloc( vertex_count, sizeof( struct Tm42MeshQuadric ) );
+    uint32_t* offsets = malloc( ( vertex_count + 1 ) * sizeof( uint32_t ) );
+    uint32_t* adjacency = malloc( index_count * sizeof( uint32_t ) );
+    uint32_t* remap = malloc( vertex_count * sizeof( uint32_t ) );
+    unsigned char* is_touched = malloc( vertex_count );
+    struct Tm42MeshCollapse* collapses = malloc( index_count * sizeof( struct Tm42MeshCollapse ) );
+    // The triangles left, compacted after every pass.
+    uint32_t* result = malloc( index_count * sizeof( uint32_t ) );
+    size_t result_count = index_count;
+
+    if ( points == NULL || position_remap == NULL || position_counts == NULL ||
+         is_locked == NULL || quadrics == NULL || offsets == NULL || adjacency == NULL ||
+         remap == NULL || is_touched == NULL || collapses == NULL || result == NULL ) {
+        memmove( dst, indices, index_count * sizeof( uint32_t ) );
+        goto cleanup;
+    }
+    memcpy( result, indices, index_count * sizeof( uint32_t ) );
+
+    // --- Normalize the positions, so that errors are relative to the size of the mesh.
+
+    const unsigned char* position_bytes = (const unsigned char*)positions;
+    float min[3] = { INFINITY, INFINITY, INFINITY };
+    float max[3] = { -INFINITY, -INFINITY, -INFINITY };
+    for ( size_t vertex = 0; vertex < vertex_count; ++vertex ) {
+        const unsigned char* position = position_bytes + vertex * position_stride;
+        memcpy( &points[vertex * 3], position, 3 * sizeof( float ) );
+        for ( size_t axis = 0; axis < 3; ++axis ) {
+            min[axis] = fminf( min[axis], points[vertex * 3 + axis] );
+            max[axis] = fmaxf( max[axis], points[vertex * 3 + axis] );
+        }
+    }
+    const float extent = fmaxf( max[0] - min[0], fmaxf( max[1] - min[1], max[2] - min[2] ) );
+    const float scale = extent > 0.f ? 1.f / extent : 1.f;
+    for ( size_t vertex = 0; vertex < vertex_count; ++vertex ) {
+        for ( size_t axis = 0; axis < 3; ++axis ) {
+            points[vertex * 3 + axis] = ( points[vertex * 3 + axis] - min[axis] ) * scale;
+        }
+    }
+
+    // --- Lock seams and borders.
+
+    tm42_mesh_weld_vertices( points, vertex_count, 3 * sizeof( float ), position_remap );
+    for ( size_t vertex = 0; vertex < vertex_count; ++vertex ) {
+        ++position_counts[position_remap[vertex]];
+    }
+    for ( size_t vertex = 0; vertex < vertex_count; ++vertex ) {
+        is_locked[vertex] = position_counts[position_remap[vertex]] > 1;
+    }
+
+    // A half-edge `a -> b` is on a border if no triangle has the opposite half-edge `b -> a`.
+    tm42_mesh_build_adjacency( result, result_count, vertex_count, offsets, adjacency );
+    for ( size_t i = 0; i < result_count; ++i ) {
+        const uint32_t a = result[i];
+        const uint32_t b = result[i - i % 3 + ( i + 1 ) % 3];
+        int has_opposite = 0;
+        for ( uint32_t j = offsets[b]; j < offsets[b + 1] && !has_opposite; ++j ) {
+            const uint32_t* triangle = &result[adjacency[j] * 3];
+            for ( size_t corner = 0; corner < 3; ++corner ) {
+                has_opposite |= triangle[corner] == b && triangle[( corner + 1 ) % 3] == a;
+            }
+        }
+        if ( !has_opposite ) {
+            is_locked[a] = 1;
+            is_locked[b] = 1;
+        }
+    }
+
+    // --- Quadrics.
+
+    for ( size_t i = 0; i < result_count; i += 3 ) {
+        const float* p0 = &points[result[i] * 3];
+        float n[3];
+        tm42_mesh_triangle_normal( p0, &points[result[i + 1] * 3], &points[result[i + 2] * 3], n );
+        const float length = sqrtf( n[0] * n[0] + n[1] * n[1] + n[2] * n[2] );
+        if ( length <= 0.f ) {
+            continue;
+        }
+        n[0] /= length;
+        n[1] /= length;
+        n[2] /= length;
+        const float d = -( n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2] );
+        for ( size_t corner = 0; corner < 3; ++corner ) {
+            tm42_mesh_quadric_add_plane( &quadrics[result[i + corner]], n, d, length * 0.5f );
+        }
+    }
+
+    // --- Collapse edges, in passes.
+    //
+    // Each pass sorts the possible collapses and applies the cheapest ones that don't touch the
+    // triangles of an earlier collapse of the same pass, so that their errors and the triangles
+    // they check stay valid. The next pass then sees the new triangles.
+
+    const float target_error_squared = target_error * target_error;
+    float result_error_squared = 0.f;
+
+    while ( result_count > target_index_count ) {
+        tm42_mesh_build_adjacency( result, result_count, vertex_count, offsets, adjacency );
+
+        // Each half-edge `a -> b` gives the collapse of `a` onto `b`; the opposite half-edge gives
+        // the opposite collapse.
+        size_t collapse_count = 0;
+        for ( size_t i = 0; i < result_count; ++i ) {
+            const uint32_t a = result[i];
+            const uint32_t b = result[i - i % 3 + ( i + 1 ) % 3];
+            if ( !is_locked[a] ) {
+                collapses[collapse_count++] = ( struct Tm42MeshCollapse ){
+                    .from = a,
+                    .to = b,
+                    .error = tm42_mesh_quadric_error( &quadrics[a], &points[b * 3] ),
+                };
+            }
+        }
+        qsort( collapses, collapse_count, sizeof( struct Tm42MeshCollapse ),
+               tm42_mesh_compare_collapses );
+
+        for ( size_t vertex = 0; vertex < vertex_count; ++vertex ) {
+            remap[vertex] = (uint32_t)vertex;
+        }
+        memset( is_touched, 0, vertex_count );
+
+        size_t removed_count = 0;
+        for ( size_t i = 0; i < collapse_count; ++i ) {
+            const struct Tm42MeshCollapse collapse = collapses[i];
+            if ( collapse.error > target_error_squared ||
+                 result_count - removed_count <= target_index_count ) {
+                break;
+            }
+            if ( is_touched[collapse.from] || is_touched[collapse.to] ) {
+                continue;
+            }
+
+            // The triangles with both vertices disappear. The others must not flip, or turn by
+            // more than about 75 degrees, when `from` moves onto `to`.
+            size_t collapsed_count = 0;
+            int is_valid = 1;
+            for ( uint32_t j = offsets[collapse.from];
+                  j < offsets[collapse.from + 1] && is_valid; ++j ) {
+                const uint32_t* triangle = &result[adjacency[j] * 3];
+                if ( triangle[0] == collapse.to || triangle[1] == collapse.to ||
+                     triangle[2] == collapse.to ) {
+                    ++collapsed_count;
+                    continue;
+                }
+
+                const float* before[3];
+                const float* after[3];
+                for ( size_t corner = 0; corner < 3; ++corner ) {
+                    before[corner] = &points[triangle[corner] * 3];
+                    after[corner] = triangle[corner] == collapse.from ? &points[collapse.to * 3]
+                                                                       : before[corner];
+                }
+                float n_before[3], n_after[3];
+                tm42_mesh_triangle_normal( before[0], before[1], before[2], n_before );
+                tm42_mesh_triangle_normal( after[0], after[1], after[2], n_after );
+                const float dot = n_before[0] * n_after[0] + n_before[1] * n_after[1] +
+                                  n_before[2] * n_after[2];
+                const float length_squared_before = n_before[0] * n_before[0] +
+                                                    n_before[1] * n_before[1] +
+                                                    n_before[2] * n_before[2];
+                const float length_squared_after = n_after[0] * n_after[0] +
+                                                   n_after[1] * n_after[1] +
+                                                   n_after[2] * n_after[2];
+                is_valid = dot > 0.25f * sqrtf( length_squared_before * length_squared_after );
+            }
+            if ( !is_valid ) {
+                continue;
+            }
+
+            remap[collapse.from] = collapse.to;
+            tm42_mesh_quadric_add( &quadrics[collapse.to], &quadrics[collapse.from] );
+            for ( uint32_t j = offsets[collapse.from]; j < offsets[collapse.from + 1]; ++j ) {
+                const uint32_t* triangle = &result[adjacency[j] * 3];
+                is_touched[triangle[0]] = 1;
+                is_touched[triangle[1]] = 1;
+                is_touched[triangle[2]] = 1;
+            }
+            removed_count += collapsed_count * 3;
+            result_error_squared = fmaxf( result_error_squared, collapse.error );
+        }
+
+        if ( removed_count == 0 ) {
+            break;
+        }
+
+        size_t kept_count = 0;
+        for ( size_t i = 0; i < result_count; i += 3 ) {
+            const uint32_t a = remap[result[i]];
+            const uint32_t b = remap[result[i + 1]];
+            const uint32_t c = remap[result[i + 2]];
+            if ( a != b && b != c && c != a ) {
+                result[kept_count++] = a;
+                result[kept_count++] = b;
+                result[kept_count++] = c;
+            }
+        }
+        result_count = kept_count;
+    }
+
+    memcpy( dst, result, result_count * sizeof( uint32_t ) );
+    if ( out_error != NULL ) {
+        *out_error = sqrtf( result_error_squared );
+    }
+
+cleanup:
+    free( points );
+    free( position_remap );
+    free( position_counts );
+    free( is_locked );
+    free( quadrics );
+    free( offsets );
+    free( adjacency );
+    free( remap );
+    free( is_touched );
+    free( collapses );
+    free( result );
+    return result_count;
+}
+
+#endif // TM42_MESH_IMPLEMENTATION
@@ -19,14 +19,46 @@ struct Tm42CameraCreateInfo {
 };
 
 struct Tm42TurntableCamera* tm42_create_turntable_camera( struct Tm42CameraCreateInfo create_info );
+void tm42_destroy_turntable_camera( struct Tm42TurntableCamera* self );
+
+// [[ Controls ]]
+//
+// These only record the change and mark the affected matrices as dirty. The matrices are rebuilt
+// the next time they are requested through one of the getters, so any number of changes in a
+// frame cost a single rebuild.
+
+/// Rotates the camera around the `look_at` point: `delta_yaw` (radians) around the world up axis
+/// and `delta_pitch` (radians) around the camera's horizontal axis. Consecutive calls accumulate
+/// into a single orbit (e.g. one mouse drag) until `tm42_turntable_camera_end_orbit` is called.
+void tm42_turntable_camera_orbit( struct Tm42TurntableCamera* self, float delta_yaw,
+                                  float delta_pitch );
+/// Ends the current orbit, making its rotation the base for the next one.
+void tm42_turntable_camera_end_orbit( struct Tm42TurntableCamera* self );
+/// Moves the camera and its `look_at` point along the camera's horizontal and vertical axes, in
+/// world units.
+void tm42_turntable_camera_pan( struct Tm42TurntableCamera* self, float delta_x, float delta_y );
+/// Moves the camera towards (positive `delta`) or away from the `look_at` point, in world units.
+/// The camera never moves past the `look_at` point.
+void tm42_turntable_camera_zoom( struct Tm42TurntableCamera* self, float delta );
+/// Updates the aspect ratio for a new viewport size.
+void tm42_turntable_camera_resize( struct Tm42TurntableCamera* self, float width, float height );
+
+// [[ Matrices ]]
+//
+// The returned pointers point into the camera and stay valid until it is destroyed; the matrices
+// they point to are only updated by calls to these getters.
+
 float* tm42_turntable_camera_get_view_matrix( struct Tm42TurntableCamera* self );
 float* tm42_turntable_camera_get_projection_matrix( struct Tm42TurntableCamera* self );
+/// The projection matrix times the view matrix, e.g. for `tm42_frustum_from_view_proj`.
+float* tm42_turntable_camera_get_view_proj_matrix( struct Tm42TurntableCamera* self );
 
 #endif // TM42_CAMERA_H
 
 #ifdef TM42_CAMERA_IMPLEMENTATION
 
 #include "tm42_math.h"
+#include <math.h>
 #include <stdbool.h>
 #include <stdlib.h>
 
@@ -45,10 +77,44 @@ struct Tm42ViewInfo {
     /// Whether the horizontal mouse input should be reversed in the turntable camera. This makes it
     /// so that the expected controls aren't reversed when viewing the scene upside down.
     bool should_reverse;
+    /// Whether an orbit is in progress, i.e. whether `rotation_modifier` is in use.
+    bool is_orbiting;
+    /// The yaw and pitch accumulated by the orbit in progress, from which `rotation_modifier` is
+    /// computed.
+    float orbit_yaw;
+    float orbit_pitch;
     /// Transformation for world -> camera space.
     struct Tm42Mat4 view_matrix;
 };
 
+/// The view matrix is `translate(-z_offset) * rotate(current_rotation * rotation_modifier) *
+/// translate(-look_at)`: the scene is moved so that `look_at` is at the origin, rotated, and then
+/// pushed away from the camera.
+void tm42_viewinfo_rebuild_view_matrix( struct Tm42ViewInfo* self ) {
+    const struct Tm42Quaternion rotation =
+        tm42_quaternion_mul( (float*)&self->current_rotation, (float*)&self->rotation_modifier );
+    const struct Tm42Mat4 rotation_matrix = tm42_mat4_from_quaternion( (float*)&rotation );
+
+    const struct Tm42Vec3 negative_look_at = {
+        .x = -self->look_at.x,
+        .y = -self->look_at.y,
+        .z = -self->look_at.z,
+    };
+    struct Tm42Mat4 look_at_matrix = tm42_mat4_create_identity();
+    tm42_mat4_apply_translation( look_at_matrix.a, (float*)&negative_look_at );
+
+    const struct Tm42Vec3 negative_z_offset = {
+        .x = -self->z_offset.x,
+        .y = -self->z_offset.y,
+        .z = -self->z_offset.z,
+    };
+    struct Tm42Mat4 z_offset_matrix = tm42_mat4_create_identity();
+    tm42_mat4_apply_translation( z_offset_matrix.a, (float*)&negative_z_offset );
+
+    const struct Tm42Mat4 rotated = tm42_mat4_mul_mat4( rotation_matrix.a, look_at_matrix.a );
+    self->view_matrix = tm42_mat4_mul_mat4( z_offset_matrix.a, rotated.a );
+}
+
 struct Tm42Mat4 tm42_build_view_matrix_from_rotation_and_offset( float* rotation, float* offset ) {
     const struct Tm42Mat4 rotation_matrix = tm42_mat4_from_quaternion( rotation );
 
@@ -88,31 +154,29 @@ struct Tm42ViewInfo tm42_create_viewinfo( float* look_at, float* look_from ) {
 
     // --- Offset
     //
-    // The offset should transform the look_from point to the origin. Thus it is -look_from.
-
-    const struct Tm42Vec3 offset = { .x = -look_from[0], .y = -look_from[1], .z = -look_from[2] };
-
-    // --- Construct transformation matrix
-    //
-    // First translate, then rotate.
-
-    const struct Tm42Mat4 rotation_matrix = tm42_mat4_from_quaternion( (float*)&current_rotation );
-
-    struct Tm42Mat4 offset_matrix = tm42_mat4_create_identity();
-    tm42_mat4_apply_translation( (float*)&offset_matrix, (float*)&offset );
-
-    struct Tm42Mat4 view_matrix = tm42_mat4_mul_mat4( rotation_matrix.a, offset_matrix.a );
+    // After the rotation, look_from - look_at points along (0,0,1), so pushing the rotated scene
+    // back by the distance between the two points puts look_from at the origin and look_at on the
+    // forward ray.
+
+    const struct Tm42Vec3 z_offset = {
+        .x = 0.f,
+        .y = 0.f,
+        .z = tm42_point3_distance( look_at, look_from ),
+    };
 
     // ---
 
     struct Tm42ViewInfo to_return = {
-        .z_offset = { .x = 0.f, .y = 0.f, .z = 0.f },
+        .z_offset = z_offset,
         .look_at = { .x = look_at[0], .y = look_at[1], .z = look_at[2] },
         .current_rotation = current_rotation,
         .rotation_modifier = tm42_quaternion_create_identity(),
         .should_reverse = false,
-        .view_matrix = view_matrix,
+        .is_orbiting = false,
+        .orbit_yaw = 0.f,
+        .orbit_pitch = 0.f,
     };
+    tm42_viewinfo_rebuild_view_matrix( &to_return );
     return to_return;
 }
 
@@ -148,6 +212,11 @@ struct Tm42TurntableCamera {
     struct Tm42ViewInfo view_info;
     struct Tm42ProjectionInfo proj_info;
     struct Tm42Mat4 view_proj_matrix;
+    /// Set by the controls, cleared when the corresponding matrix is rebuilt.
+    bool is_view_dirty;
+    bool is_proj_dirty;
+    /// Set whenever the view or projection matrix is rebuilt.
+    bool is_view_proj_dirty;
 };
 
 struct Tm42TurntableCamera*
@@ -169,17 +238,159 @@ tm42_create_turntable_camera( struct Tm42CameraCreateInfo create_info ) {
     to_return->view_info = view_info;
     to_return->proj_info = proj_info;
     to_return->view_proj_matrix = view_proj_matrix;
+    to_return->is_view_dirty = false;
+    to_return->is_proj_dirty = false;
+    to_return->is_view_proj_dirty = false;
     return to_return;
 }
 
 void tm42_destroy_turntable_camera( struct Tm42TurntableCamera* self ) { free( self ); }
 
+// [[ Controls ]]
+
+/// The closest the camera gets to its `look_at` point when zooming.
+#define TM42_TURNTABLE_CAMERA_MIN_DISTANCE 1e-3f
+
+void tm42_turntable_camera_orbit( struct Tm42TurntableCamera* self, float delta_yaw,
+                                  float delta_pitch ) {
+    struct Tm42ViewInfo* view_info = &self->view_info;
+
+    if ( !view_info->is_orbiting ) {
+        // Decide once per orbit whether the camera is upside down, i.e. whether its up axis points
+        // downwards in world space. Deciding this continuously would flip the controls mid-drag.
+        const struct Tm42Vec3 up = { .x = 0.f, .y = 1.f, .z = 0.f };
+        const struct Tm42Quaternion inverse_rotation =
+            tm42_quaternion_conjugate( (float*)&view_info->current_rotation );
+        const struct Tm42Vec3 world_up =
+            tm42_quaternion_rotate_vec3( (float*)&inverse_rotation, (float*)&up );
+
+        view_info->should_reverse = world_up.y < 0.f;
+        view_info->is_orbiting = true;
+    }
+
+    view_info->orbit_yaw += view_info->should_reverse ? -delta_yaw : delta_yaw;
+    view_info->orbit_pitch += delta_pitch;
+
+    // The total rotation should be `pitch * current_rotation * yaw`: yaw around the world up axis
+    // before the camera rotation, pitch around the camera's horizontal axis after it. Since the
+    // total rotation is `current_rotation * rotation_modifier`, the modifier is
+    // `current_rotation^-1 * pitch * current_rotation * yaw`.
+    const struct Tm42Vec3 x_axis = { .x = 1.f, .y = 0.f, .z = 0.f };
+    const struct Tm42Vec3 y_axis = { .x = 0.f, .y = 1.f, .z = 0.f };
+    const struct Tm42Quaternion yaw =
+        tm42_quaternion_from_axis_angle( (float*)&y_axis, view_info->orbit_yaw );
+    const struct Tm42Quaternion pitch =
+        tm42_quaternion_from_axis_angle( (float*)&x_axis, view_info->orbit_pitch );
+    const struct Tm42Quaternion inverse_rotation =
+        tm42_quaternion_conjugate( (float*)&view_info->current_rotation );
+
+    const struct Tm42Quaternion pitch_current =
+        tm42_quaternion_mul( (float*)&pitch, (float*)&view_info->current_rotation );
+    const struct Tm42Quaternion pitch_current_yaw =
+        tm42_quaternion_mul( (float*)&pitch_current, (float*)&yaw );
+    view_info->rotation_modifier =
+        tm42_quaternion_mul( (float*)&inverse_rotation, (float*)&pitch_current_yaw );
+
+    self->is_view_dirty = true;
+}
+
+void tm42_turntable_camera_end_orbit( struct Tm42TurntableCamera* self ) {
+    struct Tm42ViewInfo* view_info = &self->view_info;
+    if ( !view_info->is_orbiting ) {
+        return;
+    }
+
+    view_info->current_rotation = tm42_quaternion_mul( (float*)&view_info->current_rotation,
+                                                       (float*)&view_info->rotation_modifier );
+    // Keep rounding errors from accumulating over many orbits.
+    tm42_quaternion_normalize( (float*)&view_info->current_rotation );
+    view_info->rotation_modifier = tm42_quaternion_create_identity();
+    view_info->is_orbiting = false;
+    view_info->orbit_yaw = 0.f;
+    view_info->orbit_pitch = 0.f;
+
+    // The total rotation is unchanged, so the view matrix is still valid.
+}
+
+void tm42_turntable_camera_pan( struct Tm42TurntableCamera* self, float delta_x, float delta_y ) {
+    struct Tm42ViewInfo* view_info = &self->view_info;
+
+    // The camera's axes in world space are the view space axes rotated by the inverse rotation.
+    const struct Tm42Quaternion rotation = tm42_quaternion_mul(
+        (float*)&view_info->current_rotation, (float*)&view_info->rotation_modifier );
+    const struct Tm42Quaternion inverse_rotation = tm42_quaternion_conjugate( (float*)&rotation );
+    const struct Tm42Vec3 delta = { .x = delta_x, .y = delta_y, .z = 0.f };
+    const struct Tm42Vec3 world_delta =
+        tm42_quaternion_rotate_vec3( (float*)&inverse_rotation, (float*)&delta );
+
+    view_info->look_at.x += world_delta.x;
+    view_info->look_at.y += world_delta.y;
+    view_info->look_at.z += world_delta.z;
+
+    self->is_view_dirty = true;
+}
+
+void tm42_turntable_camera_zoom( struct Tm42TurntableCamera* self, float delta ) {
+    struct Tm42ViewInfo* view_info = &self->view_info;
+    view_info->z_offset.z =
+        fmaxf( view_info->z_offset.z - delta, TM42_TURNTABLE_CAMERA_MIN_DISTANCE );
+
+    self->is_view_dirty = true;
+}
+
+void tm42_turntable_camera_resize( struct Tm42TurntableCamera* self, float width, float height ) {
+    if ( width <= 0.f || height <= 0.f ) {
+        // E.g. a minimized window; keep the last valid aspect ratio.
+        return;
+    }
+
+    self->proj_info.aspect_ratio = width / height;
+    self->is_proj_dirty = true;
+}
+
+// [[ Matrices ]]
+
+void tm42_turntable_camera_update_view_matrix( struct Tm42TurntableCamera* self ) {
+    if ( !self->is_view_dirty ) {
+        return;
+    }
+
+    tm42_viewinfo_rebuild_view_matrix( &self->view_info );
+    self->is_view_dirty = false;
+    self->is_view_proj_dirty = true;
+}
+
+void tm42_turntable_camera_update_projection_matrix( struct Tm42TurntableCamera* self ) {
+    if ( !self->is_proj_dirty ) {
+        return;
+    }
+
+    const struct Tm42ProjectionInfo* old = &self->proj_info;
+    self->proj_info = tm42_create_projectioninfo( old->vertical_fov, old->aspect_ratio, old->z_near,
+                                                  old->z_far );
+    self->is_proj_dirty = false;
+    self->is_view_proj_dirty = true;
+}
+
 float* tm42_turntable_camera_get_view_matrix( struct Tm42TurntableCamera* self ) {
+    tm42_turntable_camera_update_view_matrix( self );
     return self->view_info.view_matrix.a;
 }
 
 float* tm42_turntable_camera_get_projection_matrix( struct Tm42TurntableCamera* self ) {
+    tm42_turntable_camera_update_projection_matrix( self );
     return self->proj_info.proj_matrix.a;
 }
 
+float* tm42_turntable_camera_get_view_proj_matrix( struct Tm42TurntableCamera* self ) {
+    tm42_turntable_camera_update_view_matrix( self );
+    tm42_turntable_camera_update_projection_matrix( self );
+    if ( self->is_view_proj_dirty ) {
+        self->view_proj_matrix = tm42_mat4_mul_mat4( self->proj_info.proj_matrix.a,
+                                                     self->view_info.view_matrix.a );
+        self->is_view_proj_dirty = false;
+    }
+    return self->view_proj_matrix.a;
+}
+
 #endif // TM42_CAMERA_IMPLEMENTATION
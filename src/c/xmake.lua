@@ -11,4 +11,25 @@ target("tm42_camera_test")
 	set_kind("binary")
 	add_files("tests/tm42_camera_test.c")
 	add_includedirs(".")
-	add_links("m")
\ No newline at end of file
+	add_links("m")
+
+target("tm42_frustum_test")
+	set_languages("clatest")
+	set_kind("binary")
+	add_files("tests/tm42_frustum_test.c")
+	add_includedirs(".")
+	add_links("m")
+
+target("tm42_mesh_test")
+	set_languages("clatest")
+	set_kind("binary")
+	add_files("tests/tm42_mesh_test.c")
+	add_includedirs(".")
+
+target("tm42_math_bench")
+	set_languages("clatest")
+	set_kind("binary")
+	set_optimize("fastest")
+	add_files("bench/tm42_math_bench.c")
+	add_includedirs(".")
+	add_links("m")
@@ -8,8 +8,15 @@ pub const pipeline = @import("./renderer/vulkan/pipeline.zig");
 
 // tmp for testing
 pub const rendergraph = @import("./renderer/vulkan/rendergraph.zig");
+pub const render_queue = @import("./renderer/render_queue.zig");
+pub const mesh_optimizer = @import("./renderer/mesh_optimizer.zig");
+pub const vertex_formats = @import("./renderer/vertex_formats.zig");
+pub const range_allocator = @import("./renderer/range_allocator.zig");
+pub const texture_format = @import("./renderer/texture_format.zig");
+pub const mesh_cache = @import("./renderer/mesh_cache.zig");
 
 pub const cimgui = @import("cimgui");
 
 pub const math = @import("math");
 pub const gltf_loader = @import("./renderer/gltf_loader/gltf_loader.zig");
+pub const gltf_accessor = @import("./renderer/gltf_loader/accessor.zig");
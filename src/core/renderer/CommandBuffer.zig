@@ -7,7 +7,6 @@ const VirtualPipelineHandle = Renderer.PipelineHandle;
 const Swapchain = @import("vulkan/Swapchain.zig");
 const RenderPassHandle = Renderer.RenderPassHandle;
 const VertexBuffer = @import("vulkan/buffer.zig").VertexBuffer;
-const PushConstants = @import("./Scene.zig").PushConstants;
 
 allocator: std.mem.Allocator,
 commands: std.ArrayList(Command),
@@ -28,11 +27,6 @@ pub fn deinit(self: *CommandBuffer) void {
     self.extra_data.deinit();
 }
 
-pub const UploadPushConstantsCommand = struct {
-    push_constants: PushConstants,
-    pipeline: VirtualPipelineHandle,
-};
-
 const Command = union(enum) {
     bind_pipeline: VirtualPipelineHandle,
     // Number of vertices to draw.
@@ -40,7 +34,6 @@ const Command = union(enum) {
     begin_render_pass: RenderPassHandle,
     end_render_pass: RenderPassHandle,
     bind_vertex_buffer: vulkan.VkBuffer,
-    upload_push_constants: UploadPushConstantsCommand,
 };
 
 pub fn reset(self: *CommandBuffer) void {
@@ -70,44 +63,12 @@ pub fn execute_command(
                 command_buffer,
             );
         },
-        .upload_push_constants => {
-            try execute_upload_push_constants(
-                renderer,
-                command.upload_push_constants,
-                command_buffer,
-            );
-        },
         else => {
             @panic("Unimplemented command");
         },
     }
 }
 
-fn execute_upload_push_constants(
-    renderer: *Renderer,
-    push_constants_data: UploadPushConstantsCommand,
-    command_buffer: vulkan.VkCommandBuffer,
-) !void {
-    const virtual_pipeline = renderer.get_pipeline_from_handle(push_constants_data.pipeline);
-    const virtual_renderpass_handle = virtual_pipeline.render_pass;
-    const vk_renderpass_handle = renderer.render_graph.?.rp_handle_to_real_rp.get(virtual_renderpass_handle).?;
-    const vk_renderpass = renderer.system.get_renderpass_from_handle(vk_renderpass_handle);
-    const pipeline_layout = (try renderer.system.pipeline_system.query(
-        renderer,
-        virtual_pipeline,
-        vk_renderpass,
-    )).pipeline_layout;
-
-    vulkan.vkCmdPushConstants(
-        command_buffer,
-        pipeline_layout,
-        vulkan.VK_SHADER_STAGE_VERTEX_BIT,
-        0,
-        @sizeOf(PushConstants),
-        &push_constants_data.push_constants,
-    );
-}
-
 fn execute_bind_vertex_buffer(
     renderer: *Renderer,
     vertex_buffers: vulkan.VkBuffer,
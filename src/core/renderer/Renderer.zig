@@ -13,7 +13,6 @@ const Ui = @import("./Ui.zig");
 const VulkanRenderPass = VulkanSystem.Renderpass;
 const VulkanRenderPassHandle = VulkanSystem.RenderpassHandle;
 const VertexBuffer = @import("vulkan/buffer.zig").VertexBuffer;
-const PushConstants = @import("./Scene.zig").PushConstants;
 
 allocator: std.mem.Allocator,
 
@@ -322,19 +321,6 @@ pub fn bind_vertex_buffer(
     });
 }
 
-pub fn upload_push_constants(
-    self: *Renderer,
-    pipeline_handle: PipelineHandle,
-    push_constants: PushConstants,
-) !void {
-    try self.command_buffer.commands.append(.{
-        .upload_push_constants = .{
-            .pipeline = pipeline_handle,
-            .push_constants = push_constants,
-        },
-    });
-}
-
 inline fn get_vulkan_rp_from_virtual_rp_handle(
     self: *Renderer,
     virtual_rp_handle: RenderPassHandle,
@@ -6,11 +6,21 @@ const PipelineHandle = @import("./Renderer.zig").PipelineHandle;
 const Renderer = @import("./Renderer.zig");
 const l0vk = @import("./layer0/vulkan/vulkan.zig");
 const vulkan = @import("vulkan");
+const vma = @import("vma");
+const buffer = @import("./vulkan/buffer.zig");
+const Swapchain = @import("./vulkan/Swapchain.zig");
+const render_queue_lib = @import("./render_queue.zig");
+const mesh_optimizer = @import("./mesh_optimizer.zig");
+const TextureStreamer = @import("./vulkan/texture_streaming.zig").TextureStreamer;
+const RenderQueue = render_queue_lib.RenderQueue;
 
 // ---
 
 pub const SceneError = error{
     object_missing_transform,
+    instance_buffer_allocation_failed,
+    /// Making an object the parent of one of its ancestors, or of itself.
+    hierarchy_cycle,
 };
 
 // ---
@@ -19,13 +29,40 @@ _renderer: *Renderer,
 
 mesh_system: MeshSystem,
 material_system: MaterialSystem,
+texture_streamer: TextureStreamer,
 
 objects: std.ArrayList(Object),
+/// Names copied by `create_object_with_name_copy`, freed with the scene.
+object_names: std.heap.ArenaAllocator,
 objects_ecs: r4_ecs.Ecs,
 camera: Camera,
 
+/// Per-frame scratch space for `draw`, kept around so that it isn't reallocated every frame.
+draw_items: std.ArrayList(DrawItem),
+/// Indexed by `DrawItem.model_idx`.
+model_matrices: std.ArrayList(math.Mat4f),
+/// `model_matrices` reordered to match `draw_items` after sorting.
+instance_model_matrices: std.ArrayList(math.Mat4f),
+culler: FrustumCuller,
+/// The order in which `draw_items` are drawn.
+render_queue: RenderQueue,
+instance_buffers: [Swapchain.max_frames_in_flight]InstanceBuffer =
+    [_]InstanceBuffer{.{}} ** Swapchain.max_frames_in_flight,
+
+/// Every object with a `Transform`, ordered so that parents come before their children, for
+/// `propagate_transforms`. Rebuilt when the hierarchy changes.
+transform_order: std.ArrayList(TransformNode),
+is_transform_order_dirty: bool = false,
+/// Parallel to `transform_order`. Scratch space for `propagate_transforms`: whether the world
+/// transform of the node changed this frame.
+transform_changed: std.ArrayList(bool),
+
 frame_number: usize = 0,
 
+/// Each object is drawn with the coarsest LOD of its mesh whose geometric error, projected on the
+/// screen, is at most this many pixels.
+lod_pixel_error: f32 = 1,
+
 // ---
 
 const Self = @This();
@@ -33,13 +70,19 @@ const Self = @This();
 pub fn init(allocator: std.mem.Allocator, renderer: *Renderer) !Self {
     const mesh_system = try MeshSystem.init(renderer);
     const material_system = MaterialSystem.init(allocator);
+    var texture_streamer = try TextureStreamer.init(renderer);
+    errdefer texture_streamer.deinit();
 
     var ecs = r4_ecs.Ecs.init(allocator);
     try ecs.register_component(MeshSystem.Mesh);
     try ecs.register_component(MaterialHandle);
     try ecs.register_component(Transform);
     try ecs.register_component(Translation);
+    try ecs.register_component(Rotation);
     try ecs.register_component(Scale);
+    try ecs.register_component(TransformDirty);
+    try ecs.register_component(Parent);
+    try ecs.register_component(Children);
 
     dutil.log("scene", .info, "scene initialized", .{});
 
@@ -48,14 +91,25 @@ pub fn init(allocator: std.mem.Allocator, renderer: *Renderer) !Self {
 
         .mesh_system = mesh_system,
         .material_system = material_system,
+        .texture_streamer = texture_streamer,
 
         .objects = std.ArrayList(Object).init(allocator),
+        .object_names = std.heap.ArenaAllocator.init(allocator),
         .objects_ecs = ecs,
         .camera = Camera.init(
             math.Vec3f.init(0, 0, -5),
             math.Vec3f.init(0, 0, 0),
             math.Vec3f.init(0, 1, 0),
         ),
+
+        .draw_items = std.ArrayList(DrawItem).init(allocator),
+        .model_matrices = std.ArrayList(math.Mat4f).init(allocator),
+        .instance_model_matrices = std.ArrayList(math.Mat4f).init(allocator),
+        .culler = FrustumCuller.init(allocator),
+        .render_queue = RenderQueue.init(allocator),
+
+        .transform_order = std.ArrayList(TransformNode).init(allocator),
+        .transform_changed = std.ArrayList(bool).init(allocator),
     };
 }
 
@@ -63,8 +117,25 @@ pub fn deinit(self: *Self) void {
     self.camera.deinit();
     self.mesh_system.deinit();
     self.material_system.deinit();
+    self.texture_streamer.deinit();
     self.objects.deinit();
+    self.object_names.deinit();
+    if (self.objects_ecs.get_dense_components(Children)) |all_children| {
+        for (all_children.components) |*children| {
+            children.entities.deinit();
+        }
+    } else |_| {}
     self.objects_ecs.deinit();
+    self.draw_items.deinit();
+    self.model_matrices.deinit();
+    self.instance_model_matrices.deinit();
+    self.culler.deinit();
+    self.render_queue.deinit();
+    for (&self.instance_buffers) |*instance_buffer| {
+        instance_buffer.deinit(self._renderer.system.vma_allocator);
+    }
+    self.transform_order.deinit();
+    self.transform_changed.deinit();
 }
 
 pub fn deinit_generic(self_: *anyopaque) void {
@@ -75,7 +146,7 @@ pub fn deinit_generic(self_: *anyopaque) void {
 }
 
 pub fn create_object(self: *Self, name: [*c]const u8) !r4_ecs.Entity {
-    const entity = self.objects_ecs.create_entity();
+    const entity = try self.objects_ecs.create_entity();
     try self.objects.append(.{ .entity = entity, .name = name });
 
     const default_transform = Transform{
@@ -86,14 +157,93 @@ pub fn create_object(self: *Self, name: [*c]const u8) !r4_ecs.Entity {
         .val = math.Vec3f.init(0, 0, 0),
     };
     try self.objects_ecs.add_component_for_entity(entity, default_translation);
+    const default_rotation = Rotation{
+        .val = math.Vec4f.init(0, 0, 0, 1),
+    };
+    try self.objects_ecs.add_component_for_entity(entity, default_rotation);
     const default_scale = Scale{
         .val = math.Vec3f.init(1, 1, 1),
     };
     try self.objects_ecs.add_component_for_entity(entity, default_scale);
+    try self.objects_ecs.add_component_for_entity(entity, TransformDirty{});
+    self.is_transform_order_dirty = true;
 
     return entity;
 }
 
+/// Like `create_object`, for names that don't outlive the call, e.g. ones read from a file.
+pub fn create_object_with_name_copy(self: *Self, name: []const u8) !r4_ecs.Entity {
+    const name_copy = try self.object_names.allocator().dupeZ(u8, name);
+    return self.create_object(name_copy);
+}
+
+/// Removes the object and all its components. Its entity handle must not be used afterwards.
+/// Its children become root objects, keeping their local transforms.
+pub fn destroy_object(self: *Self, object: r4_ecs.Entity) !void {
+    try self.set_parent_of_object(object, null);
+    if (self.objects_ecs.get_component_for_entity(object, Children)) |children| {
+        for (children.entities.items) |child| {
+            try self.objects_ecs.remove_component_for_entity(child, Parent);
+            self.mark_transform_dirty(child);
+        }
+        children.entities.deinit();
+    }
+
+    for (self.objects.items, 0..) |item, i| {
+        if (item.entity.id == object.id and item.entity.generation == object.generation) {
+            _ = self.objects.swapRemove(i);
+            break;
+        }
+    }
+    try self.objects_ecs.destroy_entity(object);
+    self.is_transform_order_dirty = true;
+}
+
+/// Makes `object` a child of `parent`, or a root object if `parent` is `null`. The object's
+/// translation, rotation and scale are then relative to its parent.
+///
+/// Returns:
+/// - `void` on success
+/// - `.hierarchy_cycle` if `object` is `parent` or one of its ancestors
+pub fn set_parent_of_object(self: *Self, object: r4_ecs.Entity, parent: ?r4_ecs.Entity) !void {
+    const ecs = &self.objects_ecs;
+
+    if (parent) |new_parent| {
+        var ancestor: ?r4_ecs.Entity = new_parent;
+        while (ancestor) |a| {
+            if (a.id == object.id and a.generation == object.generation) {
+                return SceneError.hierarchy_cycle;
+            }
+            ancestor = if (ecs.get_component_for_entity(a, Parent)) |p| p.entity else null;
+        }
+    }
+
+    if (ecs.get_component_for_entity(object, Parent)) |old_parent| {
+        if (ecs.get_component_for_entity(old_parent.entity, Children)) |siblings| {
+            for (siblings.entities.items, 0..) |sibling, i| {
+                if (sibling.id == object.id and sibling.generation == object.generation) {
+                    _ = siblings.entities.orderedRemove(i);
+                    break;
+                }
+            }
+        }
+        try ecs.remove_component_for_entity(object, Parent);
+    }
+
+    if (parent) |new_parent| {
+        if (ecs.get_component_for_entity(new_parent, Children) == null) {
+            try ecs.add_component_for_entity(new_parent, Children{
+                .entities = std.ArrayList(r4_ecs.Entity).init(self._renderer.allocator),
+            });
+        }
+        try ecs.get_component_for_entity(new_parent, Children).?.entities.append(object);
+        try ecs.add_component_for_entity(object, Parent{ .entity = new_parent });
+    }
+
+    self.mark_transform_dirty(object);
+    self.is_transform_order_dirty = true;
+}
+
 pub fn assign_mesh_to_object(self: *Self, object: r4_ecs.Entity, mesh: MeshSystem.Mesh) !void {
     try self.objects_ecs.add_component_for_entity(object, mesh);
 }
@@ -106,6 +256,8 @@ pub fn assign_material_to_object(
     try self.objects_ecs.add_component_for_entity(object, material);
 }
 
+/// Sets the world transform directly. It is overwritten the next time the object or one of its
+/// ancestors is moved or scaled.
 pub fn update_transform_of_object(
     self: *Self,
     object: r4_ecs.Entity,
@@ -114,131 +266,546 @@ pub fn update_transform_of_object(
     try self.objects_ecs.add_component_for_entity(object, transform);
 }
 
-/// Reconstructs the transform from scratch from the following components, in order:
-/// - Translation
-/// (- Rotation, when added)
-/// - Scale
-fn update_entity_transform_from_components(self: *Self, entity: r4_ecs.Entity) !void {
-    var new_transform_val = math.Mat4f.init_identity();
-
-    const translation_ptr = self.objects_ecs.get_component_for_entity(entity, Translation);
-    new_transform_val.apply_translation(&translation_ptr.?.val);
-
-    const scale_ptr = self.objects_ecs.get_component_for_entity(entity, Scale);
-    new_transform_val.apply_scale(&scale_ptr.?.val);
-
-    try self.objects_ecs.add_component_for_entity(entity, Transform{ .val = new_transform_val });
-}
-
+/// The new translation takes effect in the next `draw`.
 pub fn update_translation_of_object(
     self: *Self,
     object: r4_ecs.Entity,
     translation: Translation,
 ) !void {
-    try self.objects_ecs.add_component_for_entity(object, translation);
-    try self.update_entity_transform_from_components(object);
+    const translation_ptr = self.objects_ecs.get_component_for_entity(object, Translation) orelse
+        return SceneError.object_missing_transform;
+    translation_ptr.* = translation;
+    self.mark_transform_dirty(object);
+}
+
+/// The new rotation takes effect in the next `draw`.
+pub fn update_rotation_of_object(
+    self: *Self,
+    object: r4_ecs.Entity,
+    rotation: Rotation,
+) !void {
+    const rotation_ptr = self.objects_ecs.get_component_for_entity(object, Rotation) orelse
+        return SceneError.object_missing_transform;
+    rotation_ptr.* = rotation;
+    self.mark_transform_dirty(object);
 }
 
+/// The new scale takes effect in the next `draw`.
 pub fn update_scale_of_object(
     self: *Self,
     object: r4_ecs.Entity,
     scale: Scale,
 ) !void {
-    try self.objects_ecs.add_component_for_entity(object, scale);
-    try self.update_entity_transform_from_components(object);
+    const scale_ptr = self.objects_ecs.get_component_for_entity(object, Scale) orelse
+        return SceneError.object_missing_transform;
+    scale_ptr.* = scale;
+    self.mark_transform_dirty(object);
+}
+
+fn mark_transform_dirty(self: *Self, object: r4_ecs.Entity) void {
+    if (self.objects_ecs.get_component_for_entity(object, TransformDirty)) |dirty| {
+        dirty.is_dirty = true;
+    }
 }
 
+/// Builds the local transform from the following components, in order:
+/// - Translation
+/// - Rotation
+/// - Scale
+fn compute_local_matrix(self: *Self, entity: r4_ecs.Entity) math.Mat4f {
+    var local_matrix = math.Mat4f.init_identity();
+
+    if (self.objects_ecs.get_component_for_entity(entity, Translation)) |translation| {
+        local_matrix.apply_translation(&translation.val);
+    }
+    if (self.objects_ecs.get_component_for_entity(entity, Rotation)) |rotation| {
+        local_matrix.apply_rotation_quat(&rotation.val);
+    }
+    if (self.objects_ecs.get_component_for_entity(entity, Scale)) |scale| {
+        local_matrix.apply_scale(&scale.val);
+    }
+
+    return local_matrix;
+}
+
+/// Lists every object with a `Transform` breadth first from the roots, so that parents come
+/// before their children.
+fn rebuild_transform_order(self: *Self) !void {
+    const ecs = &self.objects_ecs;
+    self.transform_order.clearRetainingCapacity();
+
+    const transforms = try ecs.get_dense_components(Transform);
+    for (transforms.entities) |entity| {
+        if (ecs.get_component_for_entity(entity, Parent) == null) {
+            try self.transform_order.append(.{ .entity = entity });
+        }
+    }
+
+    var i: usize = 0;
+    while (i < self.transform_order.items.len) : (i += 1) {
+        const entity = self.transform_order.items[i].entity;
+        const children = ecs.get_component_for_entity(entity, Children) orelse continue;
+        for (children.entities.items) |child| {
+            if (ecs.get_component_for_entity(child, Transform) == null) {
+                continue;
+            }
+            try self.transform_order.append(.{ .entity = child, .parent_idx = @intCast(i) });
+        }
+    }
+
+    self.is_transform_order_dirty = false;
+}
+
+/// Recomputes the world transforms of the objects that moved since the last call, and of all
+/// their descendants, in a single pass over `transform_order`. Since parents come first, a
+/// parent's world transform is always up to date by the time its children read it, and a node
+/// only needs to check its own flag and whether its parent changed.
+fn propagate_transforms(self: *Self) !void {
+    if (self.is_transform_order_dirty) {
+        try self.rebuild_transform_order();
+    }
+
+    const ecs = &self.objects_ecs;
+    try self.transform_changed.resize(self.transform_order.items.len);
+
+    for (self.transform_order.items, self.transform_changed.items) |node, *changed| {
+        const dirty = ecs.get_component_for_entity(node.entity, TransformDirty);
+        const is_dirty = if (dirty) |d| d.is_dirty else false;
+        const is_parent_changed = node.parent_idx != TransformNode.no_parent and
+            self.transform_changed.items[node.parent_idx];
+
+        changed.* = is_dirty or is_parent_changed;
+        if (!changed.*) {
+            continue;
+        }
+
+        var local_matrix = self.compute_local_matrix(node.entity);
+        const transform = ecs.get_component_for_entity(node.entity, Transform).?;
+        if (node.parent_idx == TransformNode.no_parent) {
+            transform.val = local_matrix;
+        } else {
+            const parent = self.transform_order.items[node.parent_idx].entity;
+            const parent_transform = ecs.get_component_for_entity(parent, Transform).?;
+            transform.val = math.mat4f_times_mat4f(&parent_transform.val, &local_matrix);
+        }
+
+        if (dirty) |d| {
+            d.is_dirty = false;
+        }
+    }
+}
+
+const TransformNode = struct {
+    entity: r4_ecs.Entity,
+    /// Index of the parent in `transform_order`.
+    parent_idx: u32 = no_parent,
+
+    const no_parent = std.math.maxInt(u32);
+};
+
+/// Drawing happens in five passes, after world transforms are brought up to date with
+/// `propagate_transforms`:
+/// 1. Gather the mesh, material and model matrix of every object that has all three, along with
+///    its world-space bounding sphere.
+/// 2. Cull all the bounding spheres against the camera frustum at once.
+/// 3. Pick the LOD of each object that survived culling from its distance (see `select_lod`),
+///    then sort them by a key of material, mesh and LOD, and view depth (see `SortKey` in
+///    render_queue.zig), so that objects sharing a material and mesh LOD are next to each other
+///    and front to back.
+/// 4. Write the MVP matrices of the sorted objects into this frame's instance buffer, in one
+///    batch.
+/// 5. Record one instanced draw per run of objects with the same material and mesh LOD, only
+///    binding the material, or the vertex and index buffers of a geometry arena block, when they
+///    change. Indexed meshes are drawn with `vkCmdDrawIndexed`, from the index range of the LOD,
+///    offset by where the mesh is in its block.
 pub fn draw(self: *Self, command_buffer: l0vk.VkCommandBuffer) !void {
     self.frame_number += 1;
 
+    try self.propagate_transforms();
+
+    // --- Gather.
+
+    self.draw_items.clearRetainingCapacity();
+    self.model_matrices.clearRetainingCapacity();
+    self.culler.clear();
+
+    var it = try self.objects_ecs.query(.{ MeshSystem.Mesh, MaterialHandle, Transform });
+    while (it.next()) |item| {
+        const mesh = item.components[0];
+        const material = item.components[1];
+        const transform = item.components[2];
+
+        var model_matrix = transform.val;
+        var rotate_axis = math.Vec3f.init(0, 1, 0);
+        model_matrix.apply_rotation(
+            @as(f32, @floatFromInt(self.frame_number)) * 0.01,
+            &rotate_axis,
+        );
+
+        try self.draw_items.append(.{
+            .mesh = mesh,
+            .material = material.*,
+            .model_idx = @intCast(self.model_matrices.items.len),
+            .lod = 0,
+        });
+        try self.model_matrices.append(model_matrix);
+        try self.culler.append_sphere(&model_matrix, &mesh.bounds);
+    }
+
+    // --- Cull.
+
+    const frustum = self.camera.get_frustum();
+    const num_visible = try self.culler.cull(&frustum);
+
+    // Compact the visible objects to the front, so that the following passes don't have to
+    // branch on visibility. The model matrices stay where they are; the draw items point at them.
+    var num_kept: usize = 0;
+    for (self.culler.visible.items, 0..) |visible, j| {
+        if (visible == 0) {
+            continue;
+        }
+        self.draw_items.items[num_kept] = self.draw_items.items[j];
+        num_kept += 1;
+    }
+    std.debug.assert(num_kept == num_visible);
+    self.draw_items.shrinkRetainingCapacity(num_kept);
+
+    // --- Select LODs and sort.
+
+    // An error of one unit at a view depth of one unit covers this many pixels. This assumes the
+    // scene is drawn at the size of the swapchain.
+    const extent = self._renderer.system.swapchain.swapchain_extent;
+    const viewport_height: f32 = @floatFromInt(extent.height);
+    const pixels_per_unit = self.camera.get_projection_matrix().raw[1][1] * viewport_height * 0.5;
+
+    // Opaque objects: grouped by material and mesh LOD, front to back within a group.
+    const view_matrix = self.camera.get_view_matrix();
+    self.render_queue.clear();
+    for (self.draw_items.items, 0..) |*item, j| {
+        const m = view_matrix.raw;
+        const x = self.culler.xs.items[item.model_idx];
+        const y = self.culler.ys.items[item.model_idx];
+        const z = self.culler.zs.items[item.model_idx];
+        // The camera looks down -z in view space.
+        const view_depth = -(m[0][2] * x + m[1][2] * y + m[2][2] * z + m[3][2]);
+
+        item.lod = self.select_lod(
+            item.mesh,
+            self.culler.radii.items[item.model_idx],
+            view_depth,
+            pixels_per_unit,
+        );
+        const geometry_id = item.mesh.id * mesh_optimizer.max_lod_count + item.lod;
+        try self.render_queue.push(
+            render_queue_lib.make_opaque_key(item.material, geometry_id, view_depth),
+            @intCast(j),
+        );
+    }
+    try self.render_queue.sort();
+
+    // --- Prepare.
+
+    // Streaming goes on with nothing visible, so that finished reads are uploaded and retired
+    // images destroyed. Meshes registered since the last frame may still be on their way to the
+    // geometry arena, and streamed textures to their images; the frame waits for those uploads on
+    // the GPU, see `VulkanSystem.submit_command_buffer`, so nothing waits for them here.
+    try self.texture_streamer.update();
+
+    const num_instances = self.render_queue.items.items.len;
+    const vma_allocator = self._renderer.system.vma_allocator;
+    const instance_buffer = &self.instance_buffers[self._renderer.system.swapchain.current_frame];
+    try instance_buffer.reserve(vma_allocator, num_instances);
+    if (num_instances == 0) {
+        return;
+    }
+    try self.prepare_instances(instance_buffer.mapped.?);
+
+    // --- Record.
+
+    var instance_bufs = [_]vulkan.VkBuffer{instance_buffer.buffer.buffer};
+    var instance_offsets = [_]vulkan.VkDeviceSize{0};
+    vulkan.vkCmdBindVertexBuffers(
+        command_buffer,
+        instance_binding,
+        1,
+        instance_bufs[0..].ptr,
+        instance_offsets[0..].ptr,
+    );
+
+    const keys = self.render_queue.keys.items;
+    const arena_blocks = self.mesh_system.arena.blocks.items;
     var prev_material: ?MaterialHandle = null;
+    var prev_block: ?u32 = null;
+
+    var group_start: usize = 0;
+    while (group_start < num_instances) {
+        const batch = render_queue_lib.batch_of(keys[group_start]);
+        var group_end = group_start + 1;
+        while (group_end < num_instances and render_queue_lib.batch_of(keys[group_end]) == batch) {
+            group_end += 1;
+        }
 
-    var i: usize = 0;
-    while (i < self.objects.items.len) : (i += 1) {
-        const object = self.objects.items[i].entity;
-
-        const mesh = self.objects_ecs.get_component_for_entity(
-            object,
-            MeshSystem.Mesh,
-        ) orelse {
-            dutil.log(
-                "scene",
-                .warn,
-                "object {} is missing mesh",
-                .{object},
+        const item = self.draw_items.items[self.render_queue.items.items[group_start]];
+        const geometry = item.mesh.geometry;
+
+        if (item.material != prev_material) {
+            self.material_system.bind(command_buffer, item.material);
+            prev_material = item.material;
+        }
+
+        // All meshes usually share one block of the geometry arena, so this happens once.
+        if (geometry.block != prev_block) {
+            const block = &arena_blocks[geometry.block];
+            var bufs = [_]vulkan.VkBuffer{block.vertex_buffer.buffer};
+            var offsets = [_]vulkan.VkDeviceSize{0};
+            vulkan.vkCmdBindVertexBuffers(
+                command_buffer,
+                0,
+                1,
+                bufs[0..].ptr,
+                offsets[0..].ptr,
             );
-            continue;
-        };
-        const material = self.objects_ecs.get_component_for_entity(
-            object,
-            MaterialHandle,
-        ) orelse {
-            dutil.log(
-                "scene",
-                .warn,
-                "object {} is missing material",
-                .{object},
+            vulkan.vkCmdBindIndexBuffer(
+                command_buffer,
+                block.index_buffer.buffer,
+                0,
+                vulkan.VK_INDEX_TYPE_UINT32,
             );
-            continue;
-        };
-        const transform = self.objects_ecs.get_component_for_entity(
-            object,
-            Transform,
-        ) orelse {
-            dutil.log(
-                "scene",
-                .warn,
-                "object {} is missing transform",
-                .{object},
+            prev_block = geometry.block;
+        }
+
+        // The instances of the group are contiguous in the instance buffer, starting at
+        // `group_start`.
+        if (item.mesh.is_indexed()) {
+            const lod = item.mesh.lods.get(item.lod);
+            vulkan.vkCmdDrawIndexed(
+                command_buffer,
+                lod.index_count,
+                @intCast(group_end - group_start),
+                geometry.first_index + lod.first_index,
+                @intCast(geometry.first_vertex),
+                @intCast(group_start),
             );
-            continue;
+        } else {
+            vulkan.vkCmdDraw(
+                command_buffer,
+                geometry.vertex_count,
+                @intCast(group_end - group_start),
+                geometry.first_vertex,
+                @intCast(group_start),
+            );
+        }
+
+        group_start = group_end;
+    }
+}
+
+/// Returns the coarsest LOD of `mesh` whose error, projected at the near side of the object's
+/// bounding sphere, is at most `lod_pixel_error` pixels. The LODs of a mesh have increasing
+/// errors, so this is the last one that passes.
+fn select_lod(
+    self: *const Self,
+    mesh: *const MeshSystem.Mesh,
+    world_radius: f32,
+    view_depth: f32,
+    pixels_per_unit: f32,
+) u8 {
+    const lods = mesh.lods.constSlice();
+    const distance = view_depth - world_radius;
+    if (lods.len < 2 or distance <= 0 or mesh.bounds.radius <= 0) {
+        return 0;
+    }
+
+    // The errors are in the mesh's units; the bounding spheres tell how much the model matrix
+    // scales them.
+    const world_scale = world_radius / mesh.bounds.radius;
+    const pixels_per_error = world_scale * pixels_per_unit / distance;
+
+    var selected: u8 = 0;
+    for (lods[1..], 1..) |lod, i| {
+        if (lod.geometric_error * pixels_per_error > self.lod_pixel_error) {
+            break;
+        }
+        selected = @intCast(i);
+    }
+    return selected;
+}
+
+/// Fills `instances` from the model matrices, in the order of `render_queue`. The camera math is
+/// done once per frame, and the per-object products are a single `tm42_mat4_mul_mat4_batch` call
+/// over contiguous arrays. Any range of objects can be computed independently, so this can be
+/// split across threads.
+fn prepare_instances(self: *Self, instances: [*]InstanceData) !void {
+    comptime std.debug.assert(@sizeOf(InstanceData) == @sizeOf(math.Mat4f));
+
+    // Vulkan's clip space has y pointing down.
+    var projection_matrix = self.camera.get_projection_matrix().*;
+    projection_matrix.raw[1][1] *= -1;
+    var view_matrix = self.camera.get_view_matrix().*;
+    const view_proj_matrix = math.mat4f_times_mat4f(&projection_matrix, &view_matrix);
+
+    const order = self.render_queue.items.items;
+    try self.instance_model_matrices.resize(order.len);
+    for (order, self.instance_model_matrices.items) |item_idx, *model_matrix| {
+        model_matrix.* = self.model_matrices.items[self.draw_items.items[item_idx].model_idx];
+    }
+
+    tm42_camera.tm42_mat4_mul_mat4_batch(
+        @ptrCast(&view_proj_matrix.raw),
+        @ptrCast(self.instance_model_matrices.items.ptr),
+        @ptrCast(instances),
+        self.instance_model_matrices.items.len,
+    );
+}
+
+const DrawItem = struct {
+    mesh: *MeshSystem.Mesh,
+    material: MaterialHandle,
+    /// Index into `model_matrices`, and into the culler's spheres.
+    model_idx: u32,
+    /// Index into `mesh.lods`, picked after culling.
+    lod: u8,
+};
+
+/// A host-visible vertex buffer of `InstanceData`, kept mapped. There is one per frame in flight,
+/// so that writing the instances of a frame never races with the GPU reading those of the
+/// previous one.
+const InstanceBuffer = struct {
+    buffer: buffer.AllocatedBuffer = undefined,
+    /// `null` until the first `reserve`.
+    mapped: ?[*]InstanceData = null,
+    capacity: usize = 0,
+
+    fn deinit(self: *InstanceBuffer, vma_allocator: vma.VmaAllocator) void {
+        if (self.mapped == null) {
+            return;
+        }
+        vma.vmaUnmapMemory(vma_allocator, self.buffer.allocation);
+        self.buffer.deinit(vma_allocator);
+        self.* = .{};
+    }
+
+    /// Grows the buffer to hold at least `count` instances. The old buffer is destroyed, so this
+    /// must only be called once the GPU is done with the frame that last used it.
+    fn reserve(self: *InstanceBuffer, vma_allocator: vma.VmaAllocator, count: usize) !void {
+        if (count <= self.capacity) {
+            return;
+        }
+        const new_capacity = @max(count, self.capacity * 2, 64);
+        self.deinit(vma_allocator);
+
+        const buffer_info = vulkan.VkBufferCreateInfo{
+            .sType = vulkan.VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = new_capacity * @sizeOf(InstanceData),
+            .usage = vulkan.VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        };
+        const alloc_info = vma.VmaAllocationCreateInfo{
+            .usage = vma.VMA_MEMORY_USAGE_CPU_TO_GPU,
+            .requiredFlags = vma.VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
+                vma.VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
         };
 
-        if (material.* != prev_material) {
-            self.material_system.bind(command_buffer, material.*);
-            prev_material = material.*;
+        var new_buffer: buffer.AllocatedBuffer = undefined;
+        if (vma.vmaCreateBuffer(
+            vma_allocator,
+            @ptrCast(&buffer_info),
+            &alloc_info,
+            @ptrCast(&new_buffer.buffer),
+            &new_buffer.allocation,
+            null,
+        ) != vulkan.VK_SUCCESS) {
+            return SceneError.instance_buffer_allocation_failed;
         }
+        errdefer new_buffer.deinit(vma_allocator);
 
-        var view_matrix = self.camera.view_matrix;
-        var projection_matrix = self.camera.projection_matrix;
-        projection_matrix.raw[1][1] *= -1;
-        var transform_matrix = transform.val;
-        var rotate_axis = math.Vec3f.init(0, 1, 0);
-        transform_matrix.apply_rotation(
-            @as(f32, @floatFromInt(self.frame_number)) * 0.01,
-            &rotate_axis,
-        );
-        var intermediate = math.mat4f_times_mat4f(&view_matrix, &transform_matrix);
-        const mvp_matrix = math.mat4f_times_mat4f(&projection_matrix, &intermediate);
-        var push_constants = PushConstants{
-            .data = undefined,
-            .transform_matrix = mvp_matrix,
+        var data: ?*anyopaque = undefined;
+        if (vma.vmaMapMemory(vma_allocator, new_buffer.allocation, &data) != vulkan.VK_SUCCESS) {
+            return SceneError.instance_buffer_allocation_failed;
+        }
+
+        self.* = .{
+            .buffer = new_buffer,
+            .mapped = @ptrCast(@alignCast(data)),
+            .capacity = new_capacity,
         };
-        self.material_system.upload_push_constants(
-            command_buffer,
-            material.*,
-            &push_constants,
-        );
+    }
+};
 
-        var bufs = [_]vulkan.VkBuffer{mesh.vertex_buffer.buffer};
-        var offsets = [_]vulkan.VkDeviceSize{0};
-        vulkan.vkCmdBindVertexBuffers(
-            command_buffer,
-            0,
-            1,
-            bufs[0..].ptr,
-            offsets[0..].ptr,
-        );
+/// World-space bounding spheres in structure-of-arrays form, so that they can be culled in bulk
+/// by `tm42_frustum_cull_spheres_soa`.
+const FrustumCuller = struct {
+    xs: std.ArrayList(f32),
+    ys: std.ArrayList(f32),
+    zs: std.ArrayList(f32),
+    radii: std.ArrayList(f32),
+    /// After `cull`, `visible.items[i]` is 1 if sphere `i` is (possibly) visible and 0 otherwise.
+    visible: std.ArrayList(u8),
+
+    fn init(allocator: std.mem.Allocator) FrustumCuller {
+        return .{
+            .xs = std.ArrayList(f32).init(allocator),
+            .ys = std.ArrayList(f32).init(allocator),
+            .zs = std.ArrayList(f32).init(allocator),
+            .radii = std.ArrayList(f32).init(allocator),
+            .visible = std.ArrayList(u8).init(allocator),
+        };
+    }
 
-        vulkan.vkCmdDraw(
-            command_buffer,
-            @intCast(mesh.vertices.items.len),
-            1,
-            0,
-            0,
+    fn deinit(self: *FrustumCuller) void {
+        self.xs.deinit();
+        self.ys.deinit();
+        self.zs.deinit();
+        self.radii.deinit();
+        self.visible.deinit();
+    }
+
+    fn clear(self: *FrustumCuller) void {
+        self.xs.clearRetainingCapacity();
+        self.ys.clearRetainingCapacity();
+        self.zs.clearRetainingCapacity();
+        self.radii.clearRetainingCapacity();
+        self.visible.clearRetainingCapacity();
+    }
+
+    /// Appends the local-space bounding sphere of a mesh, transformed by `model_matrix`. The
+    /// radius is scaled by the largest axis scale, so the sphere stays conservative under
+    /// non-uniform scaling.
+    fn append_sphere(
+        self: *FrustumCuller,
+        model_matrix: *const math.Mat4f,
+        bounds: *const MeshBounds,
+    ) !void {
+        const m = model_matrix.raw;
+        const c = bounds.center;
+
+        var max_scale_squared: f32 = 0;
+        inline for (0..3) |col| {
+            const scale_squared = m[col][0] * m[col][0] +
+                m[col][1] * m[col][1] +
+                m[col][2] * m[col][2];
+            max_scale_squared = @max(max_scale_squared, scale_squared);
+        }
+
+        try self.xs.append(m[0][0] * c[0] + m[1][0] * c[1] + m[2][0] * c[2] + m[3][0]);
+        try self.ys.append(m[0][1] * c[0] + m[1][1] * c[1] + m[2][1] * c[2] + m[3][1]);
+        try self.zs.append(m[0][2] * c[0] + m[1][2] * c[1] + m[2][2] * c[2] + m[3][2]);
+        try self.radii.append(bounds.radius * @sqrt(max_scale_squared));
+    }
+
+    /// Returns the number of visible spheres.
+    fn cull(self: *FrustumCuller, frustum: *const tm42_camera.Tm42Frustum) !usize {
+        try self.visible.resize(self.xs.items.len);
+        return tm42_camera.tm42_frustum_cull_spheres_soa(
+            frustum,
+            self.xs.items.ptr,
+            self.ys.items.ptr,
+            self.zs.items.ptr,
+            self.radii.items.ptr,
+            self.visible.items.ptr,
+            self.xs.items.len,
         );
     }
-}
+};
 
 // ---
 
@@ -249,9 +816,6 @@ pub const Camera = struct {
     look_at: math.Vec3f,
     up_direction: math.Vec3f,
 
-    view_matrix: math.Mat4f,
-    projection_matrix: math.Mat4f,
-
     t_camera: *tm42_camera.Tm42TurntableCamera,
 
     pub fn init(
@@ -278,9 +842,6 @@ pub const Camera = struct {
 
         const t_camera = tm42_camera.tm42_create_turntable_camera(tm42_create_info);
 
-        const view_matrix = math.Mat4f.init_from_c_array(tm42_camera.tm42_turntable_camera_get_view_matrix(t_camera));
-        const proj_matrix = math.Mat4f.init_from_c_array(tm42_camera.tm42_turntable_camera_get_projection_matrix(t_camera));
-
         // ---
 
         return .{
@@ -288,11 +849,6 @@ pub const Camera = struct {
             .look_at = look_at,
             .up_direction = up_direction,
 
-            // .view_matrix = math.Mat4f.init_look_at(&look_from_, &look_at_, &up_direction_),
-            .view_matrix = view_matrix,
-            // .projection_matrix = math.Mat4f.init_perspective(70.0, 1700 / 900, 0.1, 200),
-            .projection_matrix = proj_matrix,
-
             .t_camera = t_camera,
         };
     }
@@ -300,18 +856,77 @@ pub const Camera = struct {
     pub fn deinit(self: *Camera) void {
         tm42_camera.tm42_destroy_turntable_camera(self.t_camera);
     }
+
+    // --- Controls
+    //
+    // These only mark the camera as dirty; the matrices are rebuilt on the next `get_*` call.
+
+    /// Angles are in radians. Successive calls accumulate until `end_orbit`.
+    pub fn orbit(self: *Camera, delta_yaw: f32, delta_pitch: f32) void {
+        tm42_camera.tm42_turntable_camera_orbit(self.t_camera, delta_yaw, delta_pitch);
+    }
+
+    pub fn end_orbit(self: *Camera) void {
+        tm42_camera.tm42_turntable_camera_end_orbit(self.t_camera);
+    }
+
+    pub fn pan(self: *Camera, delta_x: f32, delta_y: f32) void {
+        tm42_camera.tm42_turntable_camera_pan(self.t_camera, delta_x, delta_y);
+    }
+
+    pub fn zoom(self: *Camera, delta: f32) void {
+        tm42_camera.tm42_turntable_camera_zoom(self.t_camera, delta);
+    }
+
+    pub fn resize(self: *Camera, width: f32, height: f32) void {
+        tm42_camera.tm42_turntable_camera_resize(self.t_camera, width, height);
+    }
+
+    // --- Matrices
+    //
+    // The returned pointers point into the C camera, so reading them doesn't copy. They stay
+    // valid until `deinit`.
+
+    pub fn get_view_matrix(self: *Camera) *const math.Mat4f {
+        return math.Mat4f.ptr_from_c_array(
+            tm42_camera.tm42_turntable_camera_get_view_matrix(self.t_camera),
+        );
+    }
+
+    pub fn get_projection_matrix(self: *Camera) *const math.Mat4f {
+        return math.Mat4f.ptr_from_c_array(
+            tm42_camera.tm42_turntable_camera_get_projection_matrix(self.t_camera),
+        );
+    }
+
+    pub fn get_view_proj_matrix(self: *Camera) *const math.Mat4f {
+        return math.Mat4f.ptr_from_c_array(
+            tm42_camera.tm42_turntable_camera_get_view_proj_matrix(self.t_camera),
+        );
+    }
+
+    pub fn get_frustum(self: *Camera) tm42_camera.Tm42Frustum {
+        return tm42_camera.tm42_frustum_from_view_proj(
+            tm42_camera.tm42_turntable_camera_get_view_proj_matrix(self.t_camera),
+        );
+    }
 };
 
 // ---
 
-pub const PushConstants = struct {
-    data: math.Vec4f,
-    transform_matrix: math.Mat4f,
+/// Per-instance vertex input of the scene shaders, read from binding `instance_binding` at the
+/// locations after the `GpuVertex` attributes. See
+/// `VulkanSystem.get_instance_attribute_descriptions`.
+pub const InstanceData = extern struct {
+    mvp_matrix: math.Mat4f,
 };
+pub const instance_binding = 1;
+pub const instance_first_location = @typeInfo(GpuVertex).Struct.fields.len;
 
 // ---
 
 const cglm = @import("cglm");
+const vertex_formats = @import("./vertex_formats.zig");
 
 const VertexRaw = extern struct {
     position: cglm.vec3,
@@ -331,7 +946,35 @@ comptime {
     std.debug.assert(@offsetOf(Vertex, "color") == @offsetOf(VertexRaw, "color"));
 }
 
-pub const MeshSystem = @import("vulkan/mesh.zig").MeshSystem(Vertex);
+/// A `Vertex` packed into 16 bytes instead of 36: a half-float position, an octahedral normal and
+/// an unorm8 color. Shaders read it with `shaders/tri_mesh_compact.vert`.
+pub const CompactVertex = extern struct {
+    position: vertex_formats.PositionF16,
+    normal: vertex_formats.NormalOct16,
+    color: vertex_formats.ColorUnorm8,
+
+    pub const Source = Vertex;
+
+    pub fn encode(vertex: Vertex) CompactVertex {
+        return .{
+            .position = vertex_formats.PositionF16.encode(vertex.position),
+            .normal = vertex_formats.NormalOct16.encode(vertex.normal),
+            .color = vertex_formats.ColorUnorm8.encode(vertex.color),
+        };
+    }
+
+    comptime {
+        std.debug.assert(@sizeOf(CompactVertex) == 16);
+    }
+};
+
+/// The layout meshes are stored in on the GPU, either `Vertex` or `CompactVertex`. Meshes are
+/// registered with `Vertex`es either way, and the pipelines drawing them must use the matching
+/// vertex attributes and shader.
+pub const GpuVertex = CompactVertex;
+
+pub const MeshSystem = @import("vulkan/mesh.zig").MeshSystem(GpuVertex);
+const MeshBounds = @import("vulkan/mesh.zig").Bounds;
 
 // ---
 
@@ -346,21 +989,6 @@ pub const Material = struct {
             self.pipeline,
         );
     }
-
-    pub fn upload_push_constants(
-        self: Material,
-        command_buffer: l0vk.VkCommandBuffer,
-        push_constants: *PushConstants,
-    ) void {
-        vulkan.vkCmdPushConstants(
-            command_buffer,
-            self.pipeline_layout,
-            vulkan.VK_SHADER_STAGE_VERTEX_BIT,
-            0,
-            @sizeOf(PushConstants),
-            push_constants,
-        );
-    }
 };
 
 pub const MaterialHandle = usize;
@@ -390,18 +1018,6 @@ pub const MaterialSystem = struct {
     ) void {
         self.materials.items[handle].bind(command_buffer);
     }
-
-    fn upload_push_constants(
-        self: *MaterialSystem,
-        command_buffer: l0vk.VkCommandBuffer,
-        handle: MaterialHandle,
-        push_constants: *PushConstants,
-    ) void {
-        self.materials.items[handle].upload_push_constants(
-            command_buffer,
-            push_constants,
-        );
-    }
 };
 
 // ---
@@ -412,9 +1028,26 @@ pub const Transform = struct {
 pub const Translation = struct {
     val: math.Vec3f,
 };
+/// A unit quaternion, x, y, z, w.
+pub const Rotation = struct {
+    val: math.Vec4f,
+};
 pub const Scale = struct {
     val: math.Vec3f,
 };
+/// Set when the object's translation, rotation or scale changes, or it gets a new parent, so that its world
+/// transform is recomputed on the next `draw`.
+pub const TransformDirty = struct {
+    is_dirty: bool = true,
+};
+/// Objects with a parent have their `Translation`, `Rotation` and `Scale` relative to the parent.
+pub const Parent = struct {
+    entity: r4_ecs.Entity,
+};
+/// Kept in sync with `Parent` by `set_parent_of_object`.
+pub const Children = struct {
+    entities: std.ArrayList(r4_ecs.Entity),
+};
 
 // ---
 
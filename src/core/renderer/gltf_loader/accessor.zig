@@ -0,0 +1,210 @@
+//! Bulk decoding of glTF accessors.
+//!
+//! `cgltf_accessor_read_float` and `cgltf_accessor_read_index` decode one element per call, and
+//! work out its stride, component type and normalization every time. Here a whole accessor is
+//! described once as a `Layout`, and decoded in a single loop specialized for its component type
+//! at compile time. The common case of float32 data going to float32 data is a plain copy, one
+//! `@memcpy` when both sides are tightly packed, and 16-bit indices are widened 8 at a time.
+
+const std = @import("std");
+const cgltf = @import("cgltf");
+
+pub const ComponentType = enum {
+    i8,
+    u8,
+    i16,
+    u16,
+    u32,
+    f32,
+
+    pub fn Type(comptime self: ComponentType) type {
+        return switch (self) {
+            .i8 => i8,
+            .u8 => u8,
+            .i16 => i16,
+            .u16 => u16,
+            .u32 => u32,
+            .f32 => f32,
+        };
+    }
+
+    pub fn size(self: ComponentType) usize {
+        return switch (self) {
+            .i8, .u8 => 1,
+            .i16, .u16 => 2,
+            .u32, .f32 => 4,
+        };
+    }
+};
+
+/// Where the elements of an accessor are: element `i` is `component_count` values of
+/// `component_type`, little-endian, starting at `data[i * stride]`.
+pub const Layout = struct {
+    data: []const u8,
+    count: usize,
+    stride: usize,
+    component_type: ComponentType,
+    component_count: usize,
+    /// Integer components map to [0, 1], or [-1, 1] if signed, instead of their value.
+    is_normalized: bool = false,
+
+    /// `null` for the accessors that this module can't decode directly: sparse ones, ones without
+    /// a buffer view, whose elements are all zero, and ones whose data isn't loaded or doesn't
+    /// fit in their buffer view. Decode those with cgltf.
+    pub fn from_accessor(accessor: *const cgltf.cgltf_accessor) ?Layout {
+        if (accessor.is_sparse != 0 or accessor.buffer_view == null or accessor.count == 0) {
+            return null;
+        }
+        const view = accessor.buffer_view.*;
+        if (view.buffer == null or view.buffer.*.data == null) {
+            return null;
+        }
+
+        const component_type: ComponentType = switch (accessor.component_type) {
+            cgltf.cgltf_component_type_r_8 => .i8,
+            cgltf.cgltf_component_type_r_8u => .u8,
+            cgltf.cgltf_component_type_r_16 => .i16,
+            cgltf.cgltf_component_type_r_16u => .u16,
+            cgltf.cgltf_component_type_r_32u => .u32,
+            cgltf.cgltf_component_type_r_32f => .f32,
+            else => return null,
+        };
+        const component_count = cgltf.cgltf_num_components(accessor.type);
+        const element_size = component_count * component_type.size();
+
+        const end = accessor.offset + (accessor.count - 1) * accessor.stride + element_size;
+        if (end > view.size or view.offset + view.size > view.buffer.*.size) {
+            return null;
+        }
+        const buffer_data: [*]const u8 = @ptrCast(view.buffer.*.data.?);
+
+        return .{
+            .data = buffer_data[view.offset + accessor.offset .. view.offset + end],
+            .count = accessor.count,
+            .stride = accessor.stride,
+            .component_type = component_type,
+            .component_count = component_count,
+            .is_normalized = accessor.normalized != 0,
+        };
+    }
+
+    fn element(self: Layout, i: usize) []const u8 {
+        const element_size = self.component_count * self.component_type.size();
+        return self.data[i * self.stride ..][0..element_size];
+    }
+};
+
+/// Decodes the elements of `layout`, which must have `n` components each, as `[n]f32`. Element
+/// `i` is written to `dst[i * dst_stride..]`, so that it can go straight into a field of an array
+/// of vertices.
+pub fn unpack_floats(comptime n: usize, layout: Layout, dst: []u8, dst_stride: usize) void {
+    std.debug.assert(layout.component_count == n);
+    const element_size = n * @sizeOf(f32);
+    std.debug.assert(layout.count == 0 or
+        dst.len >= (layout.count - 1) * dst_stride + element_size);
+
+    switch (layout.component_type) {
+        .f32 => {
+            if (!is_little_endian) {
+                convert_floats(f32, n, false, layout, dst, dst_stride);
+            } else if (layout.stride == element_size and dst_stride == element_size) {
+                const size = layout.count * element_size;
+                @memcpy(dst[0..size], layout.data[0..size]);
+            } else {
+                for (0..layout.count) |i| {
+                    @memcpy(dst[i * dst_stride ..][0..element_size], layout.element(i));
+                }
+            }
+        },
+        inline else => |component_type| {
+            const T = component_type.Type();
+            if (layout.is_normalized) {
+                convert_floats(T, n, true, layout, dst, dst_stride);
+            } else {
+                convert_floats(T, n, false, layout, dst, dst_stride);
+            }
+        },
+    }
+}
+
+/// Decodes the elements of `layout`, which must have a single unsigned integer component, into
+/// `dst`.
+pub fn unpack_indices(layout: Layout, dst: []u32) void {
+    std.debug.assert(layout.component_count == 1);
+    std.debug.assert(dst.len == layout.count);
+    const is_packed = layout.stride == layout.component_type.size();
+
+    switch (layout.component_type) {
+        .u32 => {
+            if (is_little_endian and is_packed) {
+                @memcpy(std.mem.sliceAsBytes(dst), layout.data[0 .. dst.len * @sizeOf(u32)]);
+                return;
+            }
+            for (dst, 0..) |*index, i| {
+                index.* = read_component(u32, layout.element(i), 0);
+            }
+        },
+        .u16 => {
+            var i: usize = 0;
+            if (is_little_endian and is_packed) {
+                const lanes = 8;
+                while (i + lanes <= dst.len) : (i += lanes) {
+                    const bytes = layout.data[i * @sizeOf(u16) ..][0 .. lanes * @sizeOf(u16)];
+                    const narrow: @Vector(lanes, u16) = @bitCast(bytes.*);
+                    const wide: @Vector(lanes, u32) = @intCast(narrow);
+                    dst[i..][0..lanes].* = wide;
+                }
+            }
+            while (i < dst.len) : (i += 1) {
+                dst[i] = read_component(u16, layout.element(i), 0);
+            }
+        },
+        .u8 => {
+            for (dst, 0..) |*index, i| {
+                index.* = layout.element(i)[0];
+            }
+        },
+        // Not allowed for indices by the glTF spec.
+        .i8, .i16, .f32 => unreachable,
+    }
+}
+
+const is_little_endian = std.mem.littleToNative(u16, 1) == 1;
+
+fn convert_floats(
+    comptime T: type,
+    comptime n: usize,
+    comptime is_normalized: bool,
+    layout: Layout,
+    dst: []u8,
+    dst_stride: usize,
+) void {
+    for (0..layout.count) |i| {
+        const bytes = layout.element(i);
+        var values: [n]f32 = undefined;
+        inline for (&values, 0..) |*value, j| {
+            value.* = to_float(T, is_normalized, read_component(T, bytes, j));
+        }
+        dst[i * dst_stride ..][0 .. n * @sizeOf(f32)].* = std.mem.toBytes(values);
+    }
+}
+
+fn read_component(comptime T: type, bytes: []const u8, i: usize) T {
+    const raw: [@sizeOf(T)]u8 = bytes[i * @sizeOf(T) ..][0..@sizeOf(T)].*;
+    if (T == f32) {
+        return @bitCast(std.mem.littleToNative(u32, @bitCast(raw)));
+    }
+    return std.mem.littleToNative(T, @bitCast(raw));
+}
+
+fn to_float(comptime T: type, comptime is_normalized: bool, value: T) f32 {
+    if (T == f32) {
+        return value;
+    }
+    if (!is_normalized) {
+        return @floatFromInt(value);
+    }
+    // From the glTF spec. Signed values are clamped so that both of the most negative ones are -1.
+    const max: f32 = @floatFromInt(std.math.maxInt(T));
+    return @max(@as(f32, @floatFromInt(value)) / max, -1);
+}
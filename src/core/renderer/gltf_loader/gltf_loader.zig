@@ -2,9 +2,13 @@ const std = @import("std");
 const du = @import("debug_utils");
 const cgltf = @import("cgltf");
 const math = @import("math");
+const r4_ecs = @import("ecs");
+const Scene = @import("../Scene.zig");
+const gltf_accessor = @import("accessor.zig");
+const mesh_cache = @import("../mesh_cache.zig");
+const mesh_optimizer = @import("../mesh_optimizer.zig");
 // In the future this could probably be generic.
-const Vertex = @import("../Scene.zig").Vertex;
-const Mesh = @import("../Scene.zig").Mesh;
+const Vertex = Scene.Vertex;
 
 // We assume the allocator is a `std.mem.Allocator`.
 fn zig_alloc_fn(user: ?*anyopaque, size: cgltf.cgltf_size) callconv(.C) ?*anyopaque {
@@ -87,9 +91,11 @@ fn calculate_num_triangles_to_draw(
 ) usize {
     return switch (topology_type) {
         cgltf.cgltf_primitive_type_triangles => num_verts / 3,
-        else => {
-            @panic("not implemented");
-        },
+        cgltf.cgltf_primitive_type_triangle_strip,
+        cgltf.cgltf_primitive_type_triangle_fan,
+        => if (num_verts >= 3) num_verts - 2 else 0,
+        // Not drawn, see `parse_primitive`.
+        else => 0,
     };
 }
 
@@ -248,24 +254,259 @@ pub fn debug_print_gltf_data(gltf_data: *cgltf.cgltf_data) void {
     std.debug.print("\n}}\n", .{});
 }
 
-fn parse_primitive_verts_type_triangles(
+/// A primitive's vertices and the triangles that index into them. `indices` is empty if the
+/// primitive isn't indexed, in which case every three consecutive vertices are a triangle.
+pub const MeshData = struct {
+    vertices: []Vertex,
+    indices: []u32,
+
+    pub fn deinit(self: MeshData, allocator: *std.mem.Allocator) void {
+        allocator.free(self.vertices);
+        allocator.free(self.indices);
+    }
+};
+
+pub const PrimitiveData = struct {
+    mesh_data: MeshData,
+    /// Index of the glTF material of the primitive, if it has one.
+    material: ?u32,
+};
+
+/// A glTF node. Its transform is relative to its parent.
+pub const Node = struct {
+    name: [:0]const u8,
+    /// Index of the parent node, if any.
+    parent: ?u32,
+    /// Index of the glTF mesh of the node, if it has one.
+    mesh: ?u32,
+    translation: math.Vec3f,
+    /// A unit quaternion, x, y, z, w.
+    rotation: math.Vec4f,
+    scale: math.Vec3f,
+};
+
+/// Everything `add_to_scene` needs from a glTF file: the primitives of all its meshes, and all its
+/// nodes.
+pub const SceneData = struct {
+    /// The primitives of all the meshes, mesh after mesh. `null` for the primitives that
+    /// `parse_primitive` skips.
+    primitives: []?PrimitiveData,
+    /// The primitives of mesh `i` are `primitives[mesh_first_primitive[i]..][0..n]`, where `n` is
+    /// `mesh_first_primitive[i + 1] - mesh_first_primitive[i]`. See `mesh_primitives`.
+    mesh_first_primitive: []u32,
+    mesh_names: [][:0]const u8,
+    nodes: []Node,
+
+    pub fn deinit(self: SceneData, allocator: *std.mem.Allocator) void {
+        for (self.primitives) |primitive| {
+            if (primitive) |p| p.mesh_data.deinit(allocator);
+        }
+        allocator.free(self.primitives);
+        allocator.free(self.mesh_first_primitive);
+        for (self.mesh_names) |name| {
+            allocator.free(name);
+        }
+        allocator.free(self.mesh_names);
+        for (self.nodes) |node| {
+            allocator.free(node.name);
+        }
+        allocator.free(self.nodes);
+    }
+
+    pub fn mesh_primitives(self: *const SceneData, mesh: u32) []const ?PrimitiveData {
+        const first = self.mesh_first_primitive[mesh];
+        return self.primitives[first..self.mesh_first_primitive[mesh + 1]];
+    }
+};
+
+/// The index of `item` in the C array that starts at `first`.
+fn index_in(comptime T: type, first: [*c]const T, item: [*c]const T) u32 {
+    return @intCast((@intFromPtr(item) - @intFromPtr(first)) / @sizeOf(T));
+}
+
+pub const AccessorPath = enum {
+    /// Whole accessors at a time, see accessor.zig.
+    bulk,
+    /// One cgltf call per element, as the loader used to.
+    per_element,
+};
+
+/// How accessors are decoded. Only ever changed by bench/gltf_file_bench.zig, to time whole
+/// files both ways.
+pub var accessor_path: AccessorPath = .bulk;
+
+/// Decodes a VEC3 accessor into `dst`, one element every `@sizeOf(Vertex)` bytes, see
+/// accessor.zig. Accessors it can't decode directly, e.g. sparse ones, are unpacked by cgltf
+/// instead; missing components are zero.
+fn unpack_vec3_to_vertices(
+    allocator: *std.mem.Allocator,
+    accessor: *const cgltf.cgltf_accessor,
+    dst: []u8,
+) !void {
+    if (accessor_path == .per_element and accessor.is_sparse == 0) {
+        for (0..accessor.count) |i| {
+            var values = [3]f32{ 0, 0, 0 };
+            _ = cgltf.cgltf_accessor_read_float(accessor, i, &values, 3);
+            dst[i * @sizeOf(Vertex) ..][0..@sizeOf([3]f32)].* = std.mem.toBytes(values);
+        }
+        return;
+    }
+
+    if (gltf_accessor.Layout.from_accessor(accessor)) |layout| {
+        if (layout.component_count == 3) {
+            gltf_accessor.unpack_floats(3, layout, dst, @sizeOf(Vertex));
+            return;
+        }
+    }
+
+    const component_count = cgltf.cgltf_num_components(accessor.type);
+    const floats = try allocator.alloc(f32, accessor.count * component_count);
+    defer allocator.free(floats);
+    _ = cgltf.cgltf_accessor_unpack_floats(accessor, floats.ptr, floats.len);
+    for (0..accessor.count) |i| {
+        var values = [3]f32{ 0, 0, 0 };
+        for (0..@min(component_count, 3)) |j| {
+            values[j] = floats[i * component_count + j];
+        }
+        dst[i * @sizeOf(Vertex) ..][0..@sizeOf([3]f32)].* = std.mem.toBytes(values);
+    }
+}
+
+fn unpack_indices(accessor: *const cgltf.cgltf_accessor, dst: []u32) void {
+    const layout_or_null = if (accessor_path == .bulk)
+        gltf_accessor.Layout.from_accessor(accessor)
+    else
+        null;
+    if (layout_or_null) |layout| {
+        const is_index_type = switch (layout.component_type) {
+            .u8, .u16, .u32 => true,
+            else => false,
+        };
+        if (layout.component_count == 1 and is_index_type) {
+            gltf_accessor.unpack_indices(layout, dst);
+            return;
+        }
+    }
+
+    for (dst, 0..) |*index, i| {
+        index.* = @intCast(cgltf.cgltf_accessor_read_index(accessor, i));
+    }
+}
+
+fn parse_vertices(
     allocator: *std.mem.Allocator,
-    gltf_data: *cgltf.cgltf_data,
-    primitive: cgltf.cgltf_primitive,
+    position_accessor: *const cgltf.cgltf_accessor,
+    normal_accessor: ?*const cgltf.cgltf_accessor,
 ) ![]Vertex {
-    _ = gltf_data;
-    var i: usize = 0;
+    const vertices = try allocator.alloc(Vertex, position_accessor.count);
+    errdefer allocator.free(vertices);
+    const vertex_bytes = std.mem.sliceAsBytes(vertices);
 
-    var indices_accessor: ?*cgltf.cgltf_accessor = null;
-    if (primitive.indices != null) {
-        indices_accessor = primitive.indices;
+    try unpack_vec3_to_vertices(
+        allocator,
+        position_accessor,
+        vertex_bytes[@offsetOf(Vertex, "position")..],
+    );
+
+    const has_normals = if (normal_accessor) |accessor|
+        accessor.count == vertices.len
+    else
+        false;
+    if (has_normals) {
+        try unpack_vec3_to_vertices(
+            allocator,
+            normal_accessor.?,
+            vertex_bytes[@offsetOf(Vertex, "normal")..],
+        );
+    } else {
+        for (vertices) |*vertex| {
+            vertex.normal = math.Vec3f.init(0, 0, 1);
+        }
     }
 
-    var position_accessor: ?*cgltf.cgltf_accessor = null;
-    var normal_accessor: ?*cgltf.cgltf_accessor = null;
-    i = 0;
-    while (i < primitive.attributes_count) : (i += 1) {
-        const attribute = primitive.attributes[i];
+    // We want to view the normals as a color, so we need to convert them to RGB. (For testing.)
+    const half: @Vector(3, f32) = @splat(0.5);
+    for (vertices) |*vertex| {
+        const normal: @Vector(3, f32) = vertex.normal.raw;
+        vertex.color.raw = normal * half + half;
+    }
+
+    return vertices;
+}
+
+/// The indices of the primitive as a triangle list. Indexed triangle lists are kept as is, so
+/// that vertices shared between triangles are only stored once, and strips and fans are turned
+/// into lists, following the glTF spec so that the winding doesn't change.
+fn parse_indices(
+    allocator: *std.mem.Allocator,
+    primitive: *const cgltf.cgltf_primitive,
+    vertex_count: usize,
+) ![]u32 {
+    const indices_accessor: ?*const cgltf.cgltf_accessor = primitive.indices;
+
+    if (primitive.type == cgltf.cgltf_primitive_type_triangles) {
+        const index_count = if (indices_accessor) |accessor| accessor.count else 0;
+        const indices = try allocator.alloc(u32, index_count);
+        if (indices_accessor) |accessor| {
+            unpack_indices(accessor, indices);
+        }
+        return indices;
+    }
+
+    // Strips and fans: vertex `i` of the strip or fan is `source[i]`.
+    const source_count = if (indices_accessor) |accessor| accessor.count else vertex_count;
+    const source = try allocator.alloc(u32, source_count);
+    defer allocator.free(source);
+    if (indices_accessor) |accessor| {
+        unpack_indices(accessor, source);
+    } else {
+        for (source, 0..) |*index, i| {
+            index.* = @intCast(i);
+        }
+    }
+
+    const triangle_count = calculate_num_triangles_to_draw(source_count, primitive.type);
+    const indices = try allocator.alloc(u32, triangle_count * 3);
+    for (0..triangle_count) |i| {
+        const triangle = indices[i * 3 ..][0..3];
+        if (primitive.type == cgltf.cgltf_primitive_type_triangle_strip) {
+            triangle.* = if (i % 2 == 0)
+                .{ source[i], source[i + 1], source[i + 2] }
+            else
+                .{ source[i], source[i + 2], source[i + 1] };
+        } else {
+            triangle.* = .{ source[i + 1], source[i + 2], source[0] };
+        }
+    }
+    return indices;
+}
+
+/// Returns `null` for primitives that can't be drawn as triangles, i.e. points and lines, that
+/// have no positions, or that have indices past the end of their vertices. Only reads from
+/// `primitive`, so primitives of the same file can be parsed on different threads.
+fn parse_primitive(
+    allocator: *std.mem.Allocator,
+    primitive: *const cgltf.cgltf_primitive,
+) !?MeshData {
+    switch (primitive.type) {
+        cgltf.cgltf_primitive_type_triangles,
+        cgltf.cgltf_primitive_type_triangle_strip,
+        cgltf.cgltf_primitive_type_triangle_fan,
+        => {},
+        else => {
+            du.log(
+                "gltf loader",
+                .warn,
+                "primitive of type {d} skipped, only triangles are supported",
+                .{primitive.type},
+            );
+            return null;
+        },
+    }
+
+    var position_accessor: ?*const cgltf.cgltf_accessor = null;
+    var normal_accessor: ?*const cgltf.cgltf_accessor = null;
+    for (primitive.attributes[0..primitive.attributes_count]) |attribute| {
         switch (attribute.type) {
             cgltf.cgltf_attribute_type_position => {
                 position_accessor = attribute.data;
@@ -275,83 +516,179 @@ fn parse_primitive_verts_type_triangles(
             },
             else => {
                 du.log(
-                    "renderer",
-                    .warn,
-                    "in function {s}: GLTF data includes attribute type '{s}' but the parser doesn't know how to parse it, so it will be ignored",
-                    .{ @src().fn_name, attribute.name },
+                    "gltf loader",
+                    .debug,
+                    "attribute '{s}' ignored, the parser doesn't know how to parse it",
+                    .{attribute.name},
                 );
             },
         }
     }
+    if (position_accessor == null) {
+        du.log("gltf loader", .warn, "primitive without positions skipped", .{});
+        return null;
+    }
 
-    du.production_assert(position_accessor != null);
-    du.production_assert(indices_accessor != null);
-
-    var vertices = try allocator.alloc(Vertex, indices_accessor.?.count);
+    const vertices = try parse_vertices(allocator, position_accessor.?, normal_accessor);
     errdefer allocator.free(vertices);
+    const indices = try parse_indices(allocator, primitive, vertices.len);
+    errdefer allocator.free(indices);
 
-    if (indices_accessor != null) {
-        i = 0;
-        while (i < indices_accessor.?.count) : (i += 1) {
-            const idx_0 = cgltf.cgltf_accessor_read_index(indices_accessor, i);
-
-            var pos: [3]cgltf.cgltf_float = [_]cgltf.cgltf_float{ undefined, undefined, undefined };
-            var res = cgltf.cgltf_accessor_read_float(
-                position_accessor,
-                idx_0,
-                &pos,
-                3,
+    // The accessors are decoded without checking the indices, and the mesh optimizer and the GPU
+    // would read past the end of the vertices.
+    for (indices) |index| {
+        if (index >= vertices.len) {
+            du.log(
+                "gltf loader",
+                .warn,
+                "primitive skipped, index {d} out of range of its {d} vertices",
+                .{ index, vertices.len },
             );
-            if (res == 0) {
-                std.log.err("{s}\tfailed to read position\n", .{@src().fn_name});
-            }
+            allocator.free(indices);
+            allocator.free(vertices);
+            return null;
+        }
+    }
 
-            var normal: [3]cgltf.cgltf_float = [_]cgltf.cgltf_float{
-                undefined,
-                undefined,
-                undefined,
-            };
-            res = cgltf.cgltf_accessor_read_float(
-                normal_accessor,
-                idx_0,
-                &normal,
-                3,
-            );
+    return .{
+        .vertices = vertices,
+        .indices = indices,
+    };
+}
 
-            // We want to view the normals as a color, so we need to convert them to RGB.
-            const normal_color = math.Vec3f.init(
-                (normal[0] + 1.0) / 2.0,
-                (normal[1] + 1.0) / 2.0,
-                (normal[2] + 1.0) / 2.0,
-            );
+const ParseResult = std.mem.Allocator.Error!?MeshData;
+
+fn parse_primitive_job(
+    wait_group: *std.Thread.WaitGroup,
+    allocator: *std.mem.Allocator,
+    primitive: *const cgltf.cgltf_primitive,
+    result: *ParseResult,
+) void {
+    defer wait_group.finish();
+    result.* = parse_primitive(allocator, primitive);
+}
+
+/// Parses all the primitives of `gltf_data` on a thread pool, since big scenes have thousands.
+fn parse_primitives(
+    allocator: *std.mem.Allocator,
+    gltf_data: *const cgltf.cgltf_data,
+    primitives: []?PrimitiveData,
+) !void {
+    const all_primitives = try allocator.alloc(*const cgltf.cgltf_primitive, primitives.len);
+    defer allocator.free(all_primitives);
+    var i: usize = 0;
+    for (gltf_data.meshes[0..gltf_data.meshes_count]) |mesh| {
+        for (mesh.primitives[0..mesh.primitives_count]) |*primitive| {
+            all_primitives[i] = primitive;
+            i += 1;
+        }
+    }
+
+    const results = try allocator.alloc(ParseResult, primitives.len);
+    defer allocator.free(results);
 
-            vertices[i] = Vertex{
-                .position = math.Vec3f.init(pos[0], pos[1], pos[2]),
-                .normal = math.Vec3f.init(normal[0], normal[1], normal[2]),
-                .color = normal_color, // for testing
+    {
+        var pool: std.Thread.Pool = undefined;
+        try pool.init(.{ .allocator = allocator.* });
+        defer pool.deinit();
+
+        var wait_group = std.Thread.WaitGroup{};
+        for (all_primitives, results) |primitive, *result| {
+            wait_group.start();
+            pool.spawn(parse_primitive_job, .{ &wait_group, allocator, primitive, result }) catch {
+                // Couldn't queue the job, so run it here instead.
+                parse_primitive_job(&wait_group, allocator, primitive, result);
             };
         }
+        wait_group.wait();
     }
 
-    return vertices;
+    // Either all the primitives are parsed, or none of them are kept.
+    var first_error: ?std.mem.Allocator.Error = null;
+    for (results) |result| {
+        if (result) |_| {} else |err| {
+            first_error = first_error orelse err;
+        }
+    }
+    if (first_error) |err| {
+        for (results) |result| {
+            const mesh_data = result catch continue;
+            if (mesh_data) |data| data.deinit(allocator);
+        }
+        return err;
+    }
+
+    for (all_primitives, results, primitives) |primitive, result, *out| {
+        const mesh_data = (result catch unreachable) orelse {
+            out.* = null;
+            continue;
+        };
+        out.* = .{
+            .mesh_data = mesh_data,
+            .material = if (primitive.material != null)
+                index_in(cgltf.cgltf_material, gltf_data.materials, primitive.material)
+            else
+                null,
+        };
+    }
 }
 
-fn parse_primitive_verts(
+fn parse_node(
     allocator: *std.mem.Allocator,
-    gltf_data: *cgltf.cgltf_data,
-    primitive: cgltf.cgltf_primitive,
-) ![]Vertex {
-    switch (primitive.type) {
-        cgltf.cgltf_primitive_type_triangles => {
-            return parse_primitive_verts_type_triangles(allocator, gltf_data, primitive);
-        },
-        else => {
-            @panic("not implemented");
-        },
+    gltf_data: *const cgltf.cgltf_data,
+    node: *const cgltf.cgltf_node,
+    index: usize,
+) !Node {
+    const name = if (node.name != null)
+        try allocator.dupeZ(u8, std.mem.span(node.name))
+    else
+        try std.fmt.allocPrintZ(allocator.*, "node {d}", .{index});
+    errdefer allocator.free(name);
+
+    var translation = math.Vec3f.init(0, 0, 0);
+    var rotation = math.Vec4f.init(0, 0, 0, 1);
+    var scale = math.Vec3f.init(1, 1, 1);
+    if (node.has_matrix != 0) {
+        var matrix: math.Mat4f = undefined;
+        @memcpy(std.mem.asBytes(&matrix.raw), std.mem.asBytes(&node.matrix));
+        const parts = matrix.decompose();
+        translation = parts.translation;
+        rotation = parts.rotation;
+        scale = parts.scale;
+    } else {
+        if (node.has_translation != 0) {
+            translation.raw = node.translation;
+        }
+        if (node.has_rotation != 0) {
+            rotation.raw = node.rotation;
+        }
+        if (node.has_scale != 0) {
+            scale.raw = node.scale;
+        }
     }
+
+    return .{
+        .name = name,
+        .parent = if (node.parent != null)
+            index_in(cgltf.cgltf_node, gltf_data.nodes, node.parent)
+        else
+            null,
+        .mesh = if (node.mesh != null)
+            index_in(cgltf.cgltf_mesh, gltf_data.meshes, node.mesh)
+        else
+            null,
+        .translation = translation,
+        .rotation = rotation,
+        .scale = scale,
+    };
 }
 
-pub fn load_from_file(allocator: *std.mem.Allocator, path_to_gltf_file: [*c]const u8) ![]Vertex {
+/// Loads all the meshes and nodes of a glTF file. The returned data is owned by the caller, see
+/// `SceneData.deinit`. `allocator` must be thread-safe, as primitives are parsed in parallel.
+pub fn load_from_file(
+    allocator: *std.mem.Allocator,
+    path_to_gltf_file: [*c]const u8,
+) !SceneData {
     // const cgltf_memory_options = cgltf.cgltf_memory_options{
     //     .alloc_func = &zig_alloc_fn,
     //     .free_func = &zig_free_fn,
@@ -372,18 +709,422 @@ pub fn load_from_file(allocator: *std.mem.Allocator, path_to_gltf_file: [*c]cons
     try handle_cgltf_result(result);
     result = cgltf.cgltf_load_buffers(&cgltf_options, out_data, path_to_gltf_file);
     try handle_cgltf_result(result);
+    const gltf_data: *const cgltf.cgltf_data = out_data;
+
+    // --- Meshes.
+
+    const meshes = gltf_data.meshes[0..gltf_data.meshes_count];
+    const mesh_first_primitive = try allocator.alloc(u32, meshes.len + 1);
+    errdefer allocator.free(mesh_first_primitive);
+    mesh_first_primitive[0] = 0;
+    for (meshes, 0..) |mesh, i| {
+        const primitive_count: u32 = @intCast(mesh.primitives_count);
+        mesh_first_primitive[i + 1] = mesh_first_primitive[i] + primitive_count;
+    }
+
+    const mesh_names = try allocator.alloc([:0]const u8, meshes.len);
+    var mesh_name_count: usize = 0;
+    errdefer {
+        for (mesh_names[0..mesh_name_count]) |name| allocator.free(name);
+        allocator.free(mesh_names);
+    }
+    for (meshes, mesh_names, 0..) |mesh, *name, i| {
+        name.* = if (mesh.name != null)
+            try allocator.dupeZ(u8, std.mem.span(mesh.name))
+        else
+            try std.fmt.allocPrintZ(allocator.*, "mesh {d}", .{i});
+        mesh_name_count += 1;
+    }
+
+    const primitives = try allocator.alloc(?PrimitiveData, mesh_first_primitive[meshes.len]);
+    errdefer allocator.free(primitives);
+    try parse_primitives(allocator, gltf_data, primitives);
+    errdefer for (primitives) |primitive| {
+        if (primitive) |p| p.mesh_data.deinit(allocator);
+    };
+
+    // --- Nodes.
+
+    const nodes = try allocator.alloc(Node, gltf_data.nodes_count);
+    var node_count: usize = 0;
+    errdefer {
+        for (nodes[0..node_count]) |node| allocator.free(node.name);
+        allocator.free(nodes);
+    }
+    for (gltf_data.nodes[0..gltf_data.nodes_count], nodes, 0..) |*gltf_node, *node, i| {
+        node.* = try parse_node(allocator, gltf_data, gltf_node, i);
+        node_count += 1;
+    }
 
     du.log(
-        "renderer",
+        "gltf loader",
         .debug,
-        "Loaded GLTF file {s}; {d} meshes, {d} nodes",
-        .{
-            path_to_gltf_file,
-            out_data.*.meshes_count,
-            out_data.*.nodes_count,
-        },
+        "loaded {s}: {d} meshes, {d} primitives, {d} nodes",
+        .{ path_to_gltf_file, meshes.len, primitives.len, nodes.len },
+    );
+
+    return .{
+        .primitives = primitives,
+        .mesh_first_primitive = mesh_first_primitive,
+        .mesh_names = mesh_names,
+        .nodes = nodes,
+    };
+}
+
+// ---
+
+const GpuVertex = Scene.GpuVertex;
+
+/// Runs the primitives of `data` through `MeshSystem.prepare`, and lays them out with the meshes
+/// and nodes of `data` as a `.r4mesh` file, see mesh_cache.zig, for a source file whose hash is
+/// `source_hash`. The primitives that `data` skips are left out, and so are those that are too
+/// large for the positions of `GpuVertex`. The returned file is owned by the caller.
+pub fn bake(
+    allocator: *std.mem.Allocator,
+    data: *const SceneData,
+    source_hash: u64,
+) ![]align(mesh_cache.data_alignment) u8 {
+    const prepared = try allocator.alloc(Scene.MeshSystem.PreparedMesh, data.primitives.len);
+    var prepared_count: usize = 0;
+    defer {
+        for (prepared[0..prepared_count]) |mesh| mesh.deinit(allocator.*);
+        allocator.free(prepared);
+    }
+    const primitives = try allocator.alloc(mesh_cache.PrimitiveData, data.primitives.len);
+    defer allocator.free(primitives);
+    const meshes = try allocator.alloc(mesh_cache.MeshData, data.mesh_names.len);
+    defer allocator.free(meshes);
+
+    for (meshes, data.mesh_names, 0..) |*mesh, mesh_name, i| {
+        mesh.* = .{
+            .name = mesh_name,
+            .first_primitive = @intCast(prepared_count),
+            .primitive_count = 0,
+        };
+        for (data.mesh_primitives(@intCast(i))) |primitive| {
+            const p = primitive orelse continue;
+            const prepared_mesh = &prepared[prepared_count];
+            prepared_mesh.* = Scene.MeshSystem.prepare(
+                allocator.*,
+                mesh_name,
+                p.mesh_data.vertices,
+                p.mesh_data.indices,
+            ) catch |err| switch (err) {
+                // Logged by `prepare`.
+                error.position_out_of_range => continue,
+                else => |e| return e,
+            };
+            primitives[prepared_count] = .{
+                .vertices = std.mem.sliceAsBytes(prepared_mesh.vertices),
+                .vertex_count = @intCast(prepared_mesh.vertices.len),
+                .indices = prepared_mesh.indices,
+                .lods = prepared_mesh.lods.constSlice(),
+                .bounds = .{
+                    .min = prepared_mesh.bounds.min,
+                    .max = prepared_mesh.bounds.max,
+                    .center = prepared_mesh.bounds.center,
+                    .radius = prepared_mesh.bounds.radius,
+                },
+                .material = p.material,
+            };
+            prepared_count += 1;
+            mesh.primitive_count += 1;
+        }
+    }
+
+    const nodes = try allocator.alloc(mesh_cache.NodeData, data.nodes.len);
+    defer allocator.free(nodes);
+    for (data.nodes, nodes) |node, *out| {
+        out.* = .{
+            .name = node.name,
+            .parent = node.parent,
+            .mesh = node.mesh,
+            .translation = node.translation.raw,
+            .rotation = node.rotation.raw,
+            .scale = node.scale.raw,
+        };
+    }
+
+    return mesh_cache.write(allocator.*, .{
+        .vertex_size = @sizeOf(GpuVertex),
+        .vertex_layout_hash = mesh_cache.layout_hash(GpuVertex),
+        .source_hash = source_hash,
+        .primitives = primitives[0..prepared_count],
+        .meshes = meshes,
+        .nodes = nodes,
+    });
+}
+
+fn open_cache(
+    bytes: []align(mesh_cache.data_alignment) const u8,
+    source_hash: u64,
+) mesh_cache.CacheError!mesh_cache.View {
+    return mesh_cache.View.open(
+        bytes,
+        @sizeOf(GpuVertex),
+        mesh_cache.layout_hash(GpuVertex),
+        source_hash,
     );
-    debug_print_gltf_data(out_data);
+}
+
+/// Registers the meshes of `data` with the `MeshSystem` of `scene`, and creates an object for each
+/// node, with the node's transform and parent. The nodes without a parent are made children of a
+/// new object named `name`, which is returned, so that the whole model can be moved at once.
+///
+/// A node whose mesh has a single primitive gets it as its mesh; otherwise each primitive goes to
+/// its own child of the node. The glTF material `i` of a primitive becomes `materials[i]`, and
+/// primitives without a material, or with one past the end of `materials`, get
+/// `default_material`.
+///
+/// Mesh names are prefixed with `name`, which must be unique among the models of the scene.
+///
+/// This goes through `bake` in memory, so that a model is added the same way whether it comes
+/// from a file or from its cache, see `add_file_to_scene`.
+pub fn add_to_scene(
+    allocator: *std.mem.Allocator,
+    scene: *Scene,
+    data: *const SceneData,
+    name: []const u8,
+    materials: []const Scene.MaterialHandle,
+    default_material: Scene.MaterialHandle,
+) !r4_ecs.Entity {
+    const file = try bake(allocator, data, 0);
+    defer allocator.free(file);
+    const view = open_cache(file, 0) catch unreachable;
+    return add_cache_to_scene(allocator, scene, &view, name, materials, default_material);
+}
+
+/// The `source_hash` of the glTF file at `path`, see `mesh_cache.hash_files`: of the file and of
+/// the buffers it loads from other files, so that editing e.g. only the `.bin` of a `.gltf` is
+/// noticed too. Only the JSON is parsed, no buffer is loaded.
+pub fn hash_source(allocator: *std.mem.Allocator, path: [:0]const u8) !u64 {
+    const cgltf_options = std.mem.zeroInit(cgltf.cgltf_options, .{});
+    var out_data: [*c]cgltf.cgltf_data = null;
+    const result = cgltf.cgltf_parse_file(&cgltf_options, path.ptr, &out_data);
+    defer cgltf.cgltf_free(out_data);
+    try handle_cgltf_result(result);
+    const gltf_data: *const cgltf.cgltf_data = out_data;
+
+    const buffers = gltf_data.buffers[0..gltf_data.buffers_count];
+    var paths = try std.ArrayList([]const u8).initCapacity(allocator.*, 1 + buffers.len);
+    defer {
+        for (paths.items[1..]) |buffer_path| allocator.free(buffer_path);
+        paths.deinit();
+    }
+    paths.appendAssumeCapacity(path);
+
+    // Relative URIs are relative to the glTF file, as cgltf_load_buffers resolves them.
+    const dir = std.fs.path.dirname(path) orelse ".";
+    for (buffers) |buffer| {
+        // No URI is the binary chunk of a .glb, and data URIs are in the JSON: both are hashed
+        // with the file.
+        if (buffer.uri == null) {
+            continue;
+        }
+        const uri = std.mem.span(buffer.uri);
+        if (std.mem.startsWith(u8, uri, "data:")) {
+            continue;
+        }
+        const relative_path = try std.Uri.unescapeString(allocator.*, uri);
+        defer allocator.free(relative_path);
+        paths.appendAssumeCapacity(try std.fs.path.join(allocator.*, &.{ dir, relative_path }));
+    }
+
+    return mesh_cache.hash_files(paths.items);
+}
+
+/// Like `load_from_file` then `add_to_scene`, through a cache: the first time, the model is baked
+/// (see `bake`) to `<path>.r4mesh`, and from then on it is loaded from there for as long as the
+/// contents of `path` and of its buffers don't change (see `hash_source`), which skips loading
+/// the buffers and preparing the meshes. The cache is mapped into memory, and its vertices and
+/// indices are copied as they are to staging memory. Failing to write the cache isn't an error,
+/// it only means the next load imports again.
+pub fn add_file_to_scene(
+    allocator: *std.mem.Allocator,
+    scene: *Scene,
+    path: [:0]const u8,
+    name: []const u8,
+    materials: []const Scene.MaterialHandle,
+    default_material: Scene.MaterialHandle,
+) !r4_ecs.Entity {
+    const source_hash = try hash_source(allocator, path);
+    const cache_path = try std.fmt.allocPrint(allocator.*, "{s}.r4mesh", .{path});
+    defer allocator.free(cache_path);
+
+    if (map_file(cache_path)) |mapped| {
+        defer std.os.munmap(mapped);
+        if (open_cache(mapped, source_hash)) |view| {
+            du.log("gltf loader", .debug, "loading {s} from {s}", .{ path, cache_path });
+            return add_cache_to_scene(allocator, scene, &view, name, materials, default_material);
+        } else |err| {
+            du.log("gltf loader", .info, "ignoring {s}: {s}", .{ cache_path, @errorName(err) });
+        }
+    } else |err| {
+        if (err != error.FileNotFound) {
+            du.log("gltf loader", .warn, "can't map {s}: {s}", .{ cache_path, @errorName(err) });
+        }
+    }
+
+    const data = try load_from_file(allocator, path.ptr);
+    defer data.deinit(allocator);
+    const file = try bake(allocator, &data, source_hash);
+    defer allocator.free(file);
+    write_file(cache_path, file) catch |err| {
+        du.log("gltf loader", .warn, "can't write {s}: {s}", .{ cache_path, @errorName(err) });
+    };
+
+    const view = open_cache(file, source_hash) catch unreachable;
+    return add_cache_to_scene(allocator, scene, &view, name, materials, default_material);
+}
+
+/// Maps the whole file at `path` into memory, read-only. Unmap it with `std.os.munmap`.
+fn map_file(path: []const u8) ![]align(std.mem.page_size) const u8 {
+    const file = try std.fs.cwd().openFile(path, .{});
+    defer file.close();
+    const size = try file.getEndPos();
+    if (size == 0) {
+        // Can't be mapped, and isn't a cache anyway.
+        return mesh_cache.CacheError.corrupt;
+    }
+    return std.os.mmap(null, size, std.os.PROT.READ, std.os.MAP.PRIVATE, file.handle, 0);
+}
+
+/// Replaces the file at `path` at once, so that an interrupted write doesn't leave a truncated
+/// cache behind.
+fn write_file(path: []const u8, bytes: []const u8) !void {
+    var atomic_file = try std.fs.cwd().atomicFile(path, .{});
+    defer atomic_file.deinit();
+    try atomic_file.file.writeAll(bytes);
+    try atomic_file.finish();
+}
+
+/// `add_to_scene` for a model in the `.r4mesh` format, e.g. a mapped cache. Nothing is kept
+/// pointing into `view`.
+pub fn add_cache_to_scene(
+    allocator: *std.mem.Allocator,
+    scene: *Scene,
+    view: *const mesh_cache.View,
+    name: []const u8,
+    materials: []const Scene.MaterialHandle,
+    default_material: Scene.MaterialHandle,
+) !r4_ecs.Entity {
+    const context = AddContext{
+        .scene = scene,
+        .view = view,
+        .materials = materials,
+        .default_material = default_material,
+        .meshes = try allocator.alloc(Scene.MeshSystem.Mesh, view.primitives.len),
+    };
+    defer allocator.free(context.meshes);
+
+    // --- Meshes.
+
+    for (view.meshes, 0..) |mesh, mesh_index| {
+        const mesh_name = view.name(mesh.name);
+        for (view.mesh_primitives(mesh), 0..) |primitive, i| {
+            const primitive_name = try std.fmt.allocPrint(
+                allocator.*,
+                "{s}/{d}:{s}/{d}",
+                .{ name, mesh_index, mesh_name, i },
+            );
+            defer allocator.free(primitive_name);
 
-    return parse_primitive_verts(allocator, out_data, out_data.*.meshes[0].primitives[0]);
+            var lods = std.BoundedArray(mesh_optimizer.Lod, mesh_optimizer.max_lod_count){};
+            for (primitive.lods[0..primitive.lod_count]) |lod| {
+                lods.appendAssumeCapacity(.{
+                    .first_index = lod.first_index,
+                    .index_count = lod.index_count,
+                    .geometric_error = lod.geometric_error,
+                });
+            }
+
+            context.meshes[mesh.first_primitive + i] = try scene.mesh_system.register_prepared(
+                primitive_name,
+                std.mem.bytesAsSlice(GpuVertex, view.vertices(primitive)),
+                view.indices(primitive),
+                lods.constSlice(),
+                .{
+                    .min = primitive.bounds.min,
+                    .max = primitive.bounds.max,
+                    .center = primitive.bounds.center,
+                    .radius = primitive.bounds.radius,
+                },
+            );
+        }
+    }
+
+    // --- Objects.
+
+    const root = try scene.create_object_with_name_copy(name);
+
+    // A file without nodes is just its meshes.
+    if (view.nodes.len == 0) {
+        for (view.meshes, 0..) |mesh, mesh_index| {
+            const mesh_name = view.name(mesh.name);
+            const object = try scene.create_object_with_name_copy(mesh_name);
+            try scene.set_parent_of_object(object, root);
+            try context.assign_mesh(allocator, object, mesh_name, @intCast(mesh_index));
+        }
+        return root;
+    }
+
+    const objects = try allocator.alloc(r4_ecs.Entity, view.nodes.len);
+    defer allocator.free(objects);
+    for (view.nodes, objects) |node, *object| {
+        const node_name = view.name(node.name);
+        object.* = try scene.create_object_with_name_copy(node_name);
+        try scene.update_translation_of_object(object.*, .{ .val = .{ .raw = node.translation } });
+        try scene.update_rotation_of_object(object.*, .{ .val = .{ .raw = node.rotation } });
+        try scene.update_scale_of_object(object.*, .{ .val = .{ .raw = node.scale } });
+        if (node.mesh != mesh_cache.no_index) {
+            try context.assign_mesh(allocator, object.*, node_name, node.mesh);
+        }
+    }
+    for (view.nodes, objects) |node, object| {
+        const parent = if (node.parent != mesh_cache.no_index) objects[node.parent] else root;
+        try scene.set_parent_of_object(object, parent);
+    }
+
+    return root;
 }
+
+const AddContext = struct {
+    scene: *Scene,
+    view: *const mesh_cache.View,
+    materials: []const Scene.MaterialHandle,
+    default_material: Scene.MaterialHandle,
+    /// Parallel to `view.primitives`.
+    meshes: []Scene.MeshSystem.Mesh,
+
+    fn material_of(self: *const AddContext, primitive: mesh_cache.Primitive) Scene.MaterialHandle {
+        if (primitive.material >= self.materials.len) {
+            return self.default_material;
+        }
+        return self.materials[primitive.material];
+    }
+
+    fn assign_mesh(
+        self: *const AddContext,
+        allocator: *std.mem.Allocator,
+        object: r4_ecs.Entity,
+        object_name: []const u8,
+        mesh_index: u32,
+    ) !void {
+        const mesh = self.view.meshes[mesh_index];
+        for (self.view.mesh_primitives(mesh), 0..) |primitive, i| {
+            const target = if (mesh.primitive_count == 1) object else blk: {
+                const child_name = try std.fmt.allocPrint(
+                    allocator.*,
+                    "{s}/{d}",
+                    .{ object_name, i },
+                );
+                defer allocator.free(child_name);
+                const child = try self.scene.create_object_with_name_copy(child_name);
+                try self.scene.set_parent_of_object(child, object);
+                break :blk child;
+            };
+            try self.scene.assign_mesh_to_object(target, self.meshes[mesh.first_primitive + i]);
+            try self.scene.assign_material_to_object(target, self.material_of(primitive));
+        }
+    }
+};
@@ -0,0 +1,420 @@
+//! The `.r4mesh` format: a cache of a model as the renderer uses it, i.e. its meshes already
+//! encoded to the vertex layout of the GPU, optimized and with their LODs, along with the nodes
+//! that place them. Loading a model from its cache skips parsing, decoding and optimizing the
+//! source file: the file is mapped into memory and its vertices and indices are copied straight
+//! to staging memory.
+//!
+//! A file is a `Header`, then `header.primitive_count` `Primitive`s, `header.mesh_count` `Mesh`es
+//! and `header.node_count` `Node`s, then the names of the meshes and nodes, then the vertices and
+//! indices of every primitive, each starting at a multiple of `data_alignment`. A cache is only
+//! valid for the source file whose hash it records, and for the vertex layout it was written
+//! with; it is in the byte order of the machine that wrote it.
+
+const std = @import("std");
+const mesh_optimizer = @import("mesh_optimizer.zig");
+
+pub const magic = "R4MS".*;
+/// Bump when the format, or the way meshes are prepared (see `MeshSystem.prepare`), changes, so
+/// that existing caches are rebuilt.
+pub const version = 1;
+/// The offset of every vertex and index blob is a multiple of this, so that they can be used in
+/// place once the file is mapped.
+pub const data_alignment = 16;
+/// In place of an index, for none.
+pub const no_index = std.math.maxInt(u32);
+
+pub const Header = extern struct {
+    magic: [4]u8 = magic,
+    version: u32 = version,
+    vertex_size: u32,
+    primitive_count: u32,
+    /// See `layout_hash`.
+    vertex_layout_hash: u64,
+    /// See `hash_files`.
+    source_hash: u64,
+    mesh_count: u32,
+    node_count: u32,
+    names_offset: u64,
+    names_size: u64,
+    file_size: u64,
+};
+
+pub const Lod = extern struct {
+    first_index: u32,
+    index_count: u32,
+    geometric_error: f32,
+};
+
+pub const Bounds = extern struct {
+    min: [3]f32,
+    max: [3]f32,
+    center: [3]f32,
+    radius: f32,
+};
+
+pub const Primitive = extern struct {
+    /// From the start of the file.
+    vertex_offset: u64,
+    index_offset: u64,
+    vertex_count: u32,
+    index_count: u32,
+    /// Index of the glTF material, or `no_index`.
+    material: u32,
+    lod_count: u32,
+    lods: [mesh_optimizer.max_lod_count]Lod,
+    bounds: Bounds,
+};
+
+/// A range of the names, which follow the tables.
+pub const Name = extern struct {
+    offset: u32,
+    len: u32,
+};
+
+pub const Mesh = extern struct {
+    name: Name,
+    first_primitive: u32,
+    primitive_count: u32,
+};
+
+pub const Node = extern struct {
+    name: Name,
+    /// Index of the parent node, or `no_index`.
+    parent: u32,
+    /// Index of the mesh, or `no_index`.
+    mesh: u32,
+    translation: [3]f32,
+    /// A unit quaternion, x, y, z, w.
+    rotation: [4]f32,
+    scale: [3]f32,
+};
+
+pub const CacheError = error{
+    invalid_magic,
+    unsupported_version,
+    /// The cache was written with another vertex layout.
+    vertex_layout_mismatch,
+    /// The cache was written for another version of the source file.
+    stale,
+    /// Offsets or counts out of bounds.
+    corrupt,
+};
+
+/// Identifies `VertexType` from its name, size and fields, so that a cache written with another
+/// vertex layout isn't used.
+pub fn layout_hash(comptime VertexType: type) u64 {
+    comptime {
+        @setEvalBranchQuota(100_000);
+        var hasher = std.hash.Wyhash.init(0);
+        hasher.update(@typeName(VertexType));
+        hasher.update(std.mem.asBytes(&@as(u64, @sizeOf(VertexType))));
+        for (@typeInfo(VertexType).Struct.fields) |field| {
+            hasher.update(field.name);
+            hasher.update(@typeName(field.type));
+            hasher.update(std.mem.asBytes(&@as(u64, @offsetOf(VertexType, field.name))));
+        }
+        return hasher.final();
+    }
+}
+
+/// The `source_hash` of a model read from the files at `paths`, e.g. a glTF file and its
+/// buffers: a hash of all their contents, in order, read in chunks.
+pub fn hash_files(paths: []const []const u8) !u64 {
+    var hasher = std.hash.Wyhash.init(0);
+    var buffer: [64 * 1024]u8 = undefined;
+    for (paths) |path| {
+        const file = try std.fs.cwd().openFile(path, .{});
+        defer file.close();
+
+        // So that moving bytes from the end of one file to the start of the next is noticed.
+        const size: u64 = try file.getEndPos();
+        hasher.update(std.mem.asBytes(&size));
+        while (true) {
+            const len = try file.read(&buffer);
+            if (len == 0) {
+                break;
+            }
+            hasher.update(buffer[0..len]);
+        }
+    }
+    return hasher.final();
+}
+
+// ---
+
+pub const PrimitiveData = struct {
+    /// `vertex_count` vertices of `Model.vertex_size` bytes.
+    vertices: []const u8,
+    vertex_count: u32,
+    indices: []const u32,
+    lods: []const mesh_optimizer.Lod,
+    bounds: Bounds,
+    material: ?u32,
+};
+
+pub const MeshData = struct {
+    name: []const u8,
+    first_primitive: u32,
+    primitive_count: u32,
+};
+
+pub const NodeData = struct {
+    name: []const u8,
+    parent: ?u32,
+    mesh: ?u32,
+    translation: [3]f32,
+    rotation: [4]f32,
+    scale: [3]f32,
+};
+
+/// What `write` writes.
+pub const Model = struct {
+    vertex_size: u32,
+    vertex_layout_hash: u64,
+    source_hash: u64,
+    primitives: []const PrimitiveData,
+    meshes: []const MeshData,
+    nodes: []const NodeData,
+};
+
+/// Returns the contents of a `.r4mesh` file for `model`, owned by the caller.
+pub fn write(allocator: std.mem.Allocator, model: Model) ![]align(data_alignment) u8 {
+    // --- Layout.
+
+    const tables_size = model.primitives.len * @sizeOf(Primitive) +
+        model.meshes.len * @sizeOf(Mesh) + model.nodes.len * @sizeOf(Node);
+    const names_offset = @sizeOf(Header) + tables_size;
+    var names_size: usize = 0;
+    for (model.meshes) |mesh| {
+        names_size += mesh.name.len;
+    }
+    for (model.nodes) |node| {
+        names_size += node.name.len;
+    }
+
+    var end: u64 = names_offset + names_size;
+    const primitives = try allocator.alloc(Primitive, model.primitives.len);
+    defer allocator.free(primitives);
+    for (model.primitives, primitives) |data, *primitive| {
+        std.debug.assert(data.vertices.len == @as(usize, data.vertex_count) * model.vertex_size);
+        std.debug.assert(data.lods.len <= mesh_optimizer.max_lod_count);
+
+        const vertex_offset = std.mem.alignForward(u64, end, data_alignment);
+        const index_offset = std.mem.alignForward(
+            u64,
+            vertex_offset + data.vertices.len,
+            data_alignment,
+        );
+        end = index_offset + data.indices.len * @sizeOf(u32);
+
+        primitive.* = .{
+            .vertex_offset = vertex_offset,
+            .index_offset = index_offset,
+            .vertex_count = data.vertex_count,
+            .index_count = @intCast(data.indices.len),
+            .material = data.material orelse no_index,
+            .lod_count = @intCast(data.lods.len),
+            .lods = std.mem.zeroes([mesh_optimizer.max_lod_count]Lod),
+            .bounds = data.bounds,
+        };
+        for (data.lods, primitive.lods[0..data.lods.len]) |lod, *out| {
+            out.* = .{
+                .first_index = lod.first_index,
+                .index_count = lod.index_count,
+                .geometric_error = lod.geometric_error,
+            };
+        }
+    }
+
+    const file = try allocator.alignedAlloc(u8, data_alignment, end);
+    errdefer allocator.free(file);
+    @memset(file, 0);
+
+    // --- Header and tables.
+
+    var stream = std.io.fixedBufferStream(file);
+    const writer = stream.writer();
+    try writer.writeStruct(Header{
+        .vertex_size = model.vertex_size,
+        .primitive_count = @intCast(model.primitives.len),
+        .vertex_layout_hash = model.vertex_layout_hash,
+        .source_hash = model.source_hash,
+        .mesh_count = @intCast(model.meshes.len),
+        .node_count = @intCast(model.nodes.len),
+        .names_offset = names_offset,
+        .names_size = names_size,
+        .file_size = end,
+    });
+    for (primitives) |primitive| {
+        try writer.writeStruct(primitive);
+    }
+
+    var name_offset: u32 = 0;
+    for (model.meshes) |mesh| {
+        try writer.writeStruct(Mesh{
+            .name = .{ .offset = name_offset, .len = @intCast(mesh.name.len) },
+            .first_primitive = mesh.first_primitive,
+            .primitive_count = mesh.primitive_count,
+        });
+        name_offset += @intCast(mesh.name.len);
+    }
+    for (model.nodes) |node| {
+        try writer.writeStruct(Node{
+            .name = .{ .offset = name_offset, .len = @intCast(node.name.len) },
+            .parent = node.parent orelse no_index,
+            .mesh = node.mesh orelse no_index,
+            .translation = node.translation,
+            .rotation = node.rotation,
+            .scale = node.scale,
+        });
+        name_offset += @intCast(node.name.len);
+    }
+    for (model.meshes) |mesh| {
+        try writer.writeAll(mesh.name);
+    }
+    for (model.nodes) |node| {
+        try writer.writeAll(node.name);
+    }
+
+    // --- Vertices and indices.
+
+    for (model.primitives, primitives) |data, primitive| {
+        @memcpy(file[primitive.vertex_offset..][0..data.vertices.len], data.vertices);
+        const index_bytes = std.mem.sliceAsBytes(data.indices);
+        @memcpy(file[primitive.index_offset..][0..index_bytes.len], index_bytes);
+    }
+
+    return file;
+}
+
+// ---
+
+/// A `.r4mesh` file in memory, e.g. mapped, checked by `open`. Everything returned points into
+/// `bytes`.
+pub const View = struct {
+    bytes: []align(data_alignment) const u8,
+    header: Header,
+    primitives: []align(1) const Primitive,
+    meshes: []align(1) const Mesh,
+    nodes: []align(1) const Node,
+
+    /// Checks that `bytes` is a cache for a source file hashing to `source_hash`, with vertices of
+    /// `vertex_size` bytes whose `layout_hash` is `vertex_layout_hash`, and that everything in it
+    /// is in bounds, down to the indices of every primitive.
+    pub fn open(
+        bytes: []align(data_alignment) const u8,
+        vertex_size: u32,
+        vertex_layout_hash: u64,
+        source_hash: u64,
+    ) CacheError!View {
+        if (bytes.len < @sizeOf(Header)) {
+            return CacheError.corrupt;
+        }
+        const header = std.mem.bytesToValue(Header, bytes[0..@sizeOf(Header)]);
+        if (!std.mem.eql(u8, &header.magic, &magic)) {
+            return CacheError.invalid_magic;
+        }
+        if (header.version != version) {
+            return CacheError.unsupported_version;
+        }
+        if (header.vertex_size != vertex_size or header.vertex_layout_hash != vertex_layout_hash) {
+            return CacheError.vertex_layout_mismatch;
+        }
+        if (header.source_hash != source_hash) {
+            return CacheError.stale;
+        }
+
+        // --- Tables.
+
+        const primitives_offset: u64 = @sizeOf(Header);
+        const meshes_offset = primitives_offset +
+            @as(u64, header.primitive_count) * @sizeOf(Primitive);
+        const nodes_offset = meshes_offset + @as(u64, header.mesh_count) * @sizeOf(Mesh);
+        const tables_end = nodes_offset + @as(u64, header.node_count) * @sizeOf(Node);
+        if (header.file_size != bytes.len or header.names_offset < tables_end or
+            !fits(header.names_offset, header.names_size, bytes.len))
+        {
+            return CacheError.corrupt;
+        }
+
+        const view = View{
+            .bytes = bytes,
+            .header = header,
+            .primitives = std.mem.bytesAsSlice(Primitive, bytes[primitives_offset..meshes_offset]),
+            .meshes = std.mem.bytesAsSlice(Mesh, bytes[meshes_offset..nodes_offset]),
+            .nodes = std.mem.bytesAsSlice(Node, bytes[nodes_offset..tables_end]),
+        };
+
+        // --- Contents.
+
+        for (view.primitives) |primitive| {
+            const vertices_size = @as(u64, primitive.vertex_count) * vertex_size;
+            const indices_size = @as(u64, primitive.index_count) * @sizeOf(u32);
+            if (primitive.vertex_offset % data_alignment != 0 or
+                primitive.index_offset % data_alignment != 0 or
+                !fits(primitive.vertex_offset, vertices_size, bytes.len) or
+                !fits(primitive.index_offset, indices_size, bytes.len) or
+                primitive.lod_count > mesh_optimizer.max_lod_count)
+            {
+                return CacheError.corrupt;
+            }
+            for (primitive.lods[0..primitive.lod_count]) |lod| {
+                if (@as(u64, lod.first_index) + lod.index_count > primitive.index_count) {
+                    return CacheError.corrupt;
+                }
+            }
+            // So that nothing reads past the vertices of a primitive on the GPU.
+            for (view.indices(primitive)) |index| {
+                if (index >= primitive.vertex_count) {
+                    return CacheError.corrupt;
+                }
+            }
+        }
+        for (view.meshes) |mesh| {
+            if (!view.is_name_valid(mesh.name) or
+                @as(u64, mesh.first_primitive) + mesh.primitive_count > header.primitive_count)
+            {
+                return CacheError.corrupt;
+            }
+        }
+        for (view.nodes) |node| {
+            if (!view.is_name_valid(node.name) or
+                (node.parent != no_index and node.parent >= header.node_count) or
+                (node.mesh != no_index and node.mesh >= header.mesh_count))
+            {
+                return CacheError.corrupt;
+            }
+        }
+
+        return view;
+    }
+
+    fn is_name_valid(self: *const View, range: Name) bool {
+        return fits(range.offset, range.len, self.header.names_size);
+    }
+
+    pub fn name(self: *const View, range: Name) []const u8 {
+        return self.bytes[self.header.names_offset + range.offset ..][0..range.len];
+    }
+
+    pub fn vertices(self: *const View, primitive: Primitive) []align(data_alignment) const u8 {
+        const size = @as(usize, primitive.vertex_count) * self.header.vertex_size;
+        return @alignCast(self.bytes[primitive.vertex_offset..][0..size]);
+    }
+
+    pub fn indices(self: *const View, primitive: Primitive) []const u32 {
+        const size = @as(usize, primitive.index_count) * @sizeOf(u32);
+        const index_bytes: []align(data_alignment) const u8 =
+            @alignCast(self.bytes[primitive.index_offset..][0..size]);
+        return std.mem.bytesAsSlice(u32, index_bytes);
+    }
+
+    pub fn mesh_primitives(self: *const View, mesh: Mesh) []align(1) const Primitive {
+        return self.primitives[mesh.first_primitive..][0..mesh.primitive_count];
+    }
+};
+
+/// Whether `size` bytes at `offset` are within `len` bytes, without overflowing.
+fn fits(offset: u64, size: u64, len: u64) bool {
+    return offset <= len and size <= len - offset;
+}
@@ -0,0 +1,245 @@
+const std = @import("std");
+const tm42 = @import("tm42_camera");
+const vertex_formats = @import("vertex_formats.zig");
+
+/// Triangles are ordered for a FIFO vertex cache of this many vertices. The post-transform caches
+/// of current GPUs don't quite work like that, but orders that are good for such a cache are good
+/// for them too.
+pub const vertex_cache_size = 16;
+
+pub fn OptimizedMesh(comptime VertexType: type) type {
+    return struct {
+        const Self = @This();
+
+        vertices: []VertexType,
+        /// Three per triangle. Always set, even if the input wasn't indexed.
+        indices: []u32,
+        /// The average number of vertices transformed per triangle, with `vertex_cache_size`,
+        /// of the input and of the output. 3 for a mesh that isn't indexed.
+        acmr_before: f32,
+        acmr_after: f32,
+
+        pub fn deinit(self: *const Self, allocator: std.mem.Allocator) void {
+            allocator.free(self.vertices);
+            allocator.free(self.indices);
+        }
+    };
+}
+
+/// Prepares a mesh for upload:
+/// 1. welds the vertices that are bitwise identical, which turns a mesh that isn't indexed (empty
+///    `indices`) into an indexed one,
+/// 2. reorders the triangles for the post-transform vertex cache (Tipsify),
+/// 3. reorders the vertices in the order the triangles first use them, for fetch locality, and
+///    drops the vertices that no triangle uses.
+///
+/// The triangles and their winding are unchanged. Since vertices are compared byte for byte,
+/// `VertexType` should have no padding: its bytes are undefined and would keep identical vertices
+/// apart.
+pub fn optimize(
+    comptime VertexType: type,
+    allocator: std.mem.Allocator,
+    vertices: []const VertexType,
+    indices: []const u32,
+) !OptimizedMesh(VertexType) {
+    const index_count = if (indices.len > 0) indices.len else vertices.len;
+    std.debug.assert(index_count % 3 == 0);
+
+    const remap = try allocator.alloc(u32, vertices.len);
+    defer allocator.free(remap);
+
+    // --- Weld.
+
+    const welded_count = tm42.tm42_mesh_weld_vertices(
+        @ptrCast(vertices.ptr),
+        vertices.len,
+        @sizeOf(VertexType),
+        remap.ptr,
+    );
+    const welded_vertices = try allocator.alloc(VertexType, welded_count);
+    defer allocator.free(welded_vertices);
+    tm42.tm42_mesh_remap_vertices(
+        @ptrCast(welded_vertices.ptr),
+        @ptrCast(vertices.ptr),
+        vertices.len,
+        @sizeOf(VertexType),
+        remap.ptr,
+    );
+
+    const optimized_indices = try allocator.alloc(u32, index_count);
+    errdefer allocator.free(optimized_indices);
+    const src_indices: [*c]const u32 = if (indices.len > 0) indices.ptr else null;
+    tm42.tm42_mesh_remap_indices(optimized_indices.ptr, src_indices, index_count, remap.ptr);
+
+    // Without indices, every corner of every triangle is transformed.
+    const acmr_before = if (indices.len > 0)
+        tm42.tm42_mesh_compute_acmr(indices.ptr, index_count, vertices.len, vertex_cache_size)
+    else
+        3;
+
+    // --- Reorder triangles.
+
+    tm42.tm42_mesh_optimize_vertex_cache(
+        optimized_indices.ptr,
+        optimized_indices.ptr,
+        index_count,
+        welded_count,
+        vertex_cache_size,
+    );
+
+    // --- Reorder vertices.
+
+    // There are no more welded vertices than input vertices, so `remap` can be reused.
+    const fetch_remap = remap[0..welded_count];
+    const used_count = tm42.tm42_mesh_optimize_vertex_fetch_remap(
+        fetch_remap.ptr,
+        optimized_indices.ptr,
+        index_count,
+        welded_count,
+    );
+    const optimized_vertices = try allocator.alloc(VertexType, used_count);
+    errdefer allocator.free(optimized_vertices);
+    tm42.tm42_mesh_remap_vertices(
+        @ptrCast(optimized_vertices.ptr),
+        @ptrCast(welded_vertices.ptr),
+        welded_count,
+        @sizeOf(VertexType),
+        fetch_remap.ptr,
+    );
+    tm42.tm42_mesh_remap_indices(
+        optimized_indices.ptr,
+        optimized_indices.ptr,
+        index_count,
+        fetch_remap.ptr,
+    );
+
+    return .{
+        .vertices = optimized_vertices,
+        .indices = optimized_indices,
+        .acmr_before = acmr_before,
+        .acmr_after = tm42.tm42_mesh_compute_acmr(
+            optimized_indices.ptr,
+            index_count,
+            used_count,
+            vertex_cache_size,
+        ),
+    };
+}
+
+// ---
+
+/// Including LOD 0, the full mesh.
+pub const max_lod_count = 4;
+/// Each LOD aims for this fraction of the indices of the previous one.
+pub const lod_index_ratio = 0.5;
+/// The chain stops at the first LOD that can't get below this fraction of the indices of the
+/// previous one, e.g. because most vertices are on seams, since it would hardly be cheaper to draw.
+pub const lod_min_reduction = 0.8;
+/// LODs whose surface is further than this from that of LOD 0, relative to the size of the mesh,
+/// are not built: they would only be usable when the mesh covers a few pixels.
+pub const lod_max_relative_error = 0.05;
+
+pub const Lod = struct {
+    first_index: u32,
+    index_count: u32,
+    /// How far the surface of this LOD can be from that of LOD 0, in the units of the vertex
+    /// positions. 0 for LOD 0.
+    geometric_error: f32,
+};
+
+/// The LODs of a mesh, as ranges of one index buffer over the same vertices, from LOD 0 (the full
+/// mesh) to the coarsest.
+pub const LodChain = struct {
+    indices: []u32,
+    lods: std.BoundedArray(Lod, max_lod_count),
+
+    pub fn deinit(self: *const LodChain, allocator: std.mem.Allocator) void {
+        allocator.free(self.indices);
+    }
+};
+
+/// Builds the LODs of an indexed mesh by quadric-error edge collapse (`tm42_mesh_simplify`), each
+/// from the previous one, and orders the triangles of each for the vertex cache. LOD 0 is
+/// `indices` unchanged, so run `optimize` first.
+pub fn build_lod_chain(
+    comptime VertexType: type,
+    allocator: std.mem.Allocator,
+    vertices: []const VertexType,
+    indices: []const u32,
+) !LodChain {
+    const positions = try allocator.alloc([3]f32, vertices.len);
+    defer allocator.free(positions);
+    var min = [3]f32{ std.math.inf(f32), std.math.inf(f32), std.math.inf(f32) };
+    var max = [3]f32{ -std.math.inf(f32), -std.math.inf(f32), -std.math.inf(f32) };
+    for (vertices, positions) |vertex, *position| {
+        position.* = vertex_formats.decode_position(vertex);
+        inline for (0..3) |axis| {
+            min[axis] = @min(min[axis], position[axis]);
+            max[axis] = @max(max[axis], position[axis]);
+        }
+    }
+    // `tm42_mesh_simplify` errors are relative to this.
+    const extent = @max(max[0] - min[0], @max(max[1] - min[1], max[2] - min[2]));
+
+    // No LOD has more indices than LOD 0, so this is enough for all of them.
+    var chain_indices = try std.ArrayList(u32).initCapacity(allocator, indices.len * max_lod_count);
+    errdefer chain_indices.deinit();
+    var lods = std.BoundedArray(Lod, max_lod_count){};
+
+    chain_indices.appendSliceAssumeCapacity(indices);
+    lods.appendAssumeCapacity(.{
+        .first_index = 0,
+        .index_count = @intCast(indices.len),
+        .geometric_error = 0,
+    });
+
+    while (lods.len < max_lod_count and vertices.len > 0) {
+        const previous = lods.get(lods.len - 1);
+        // The errors of successive LODs add up, at most.
+        const previous_relative_error = if (extent > 0) previous.geometric_error / extent else 0;
+        const error_budget = lod_max_relative_error - previous_relative_error;
+        if (error_budget <= 0) {
+            break;
+        }
+
+        const first_index = chain_indices.items.len;
+        const target_index_count = @as(usize, @intFromFloat(
+            @as(f32, @floatFromInt(previous.index_count)) * lod_index_ratio,
+        )) / 3 * 3;
+        var relative_error: f32 = 0;
+        const index_count = tm42.tm42_mesh_simplify(
+            chain_indices.items.ptr + first_index,
+            chain_indices.items.ptr + previous.first_index,
+            previous.index_count,
+            @ptrCast(positions.ptr),
+            positions.len,
+            @sizeOf([3]f32),
+            target_index_count,
+            error_budget,
+            &relative_error,
+        );
+        const min_reduced_count = @as(f32, @floatFromInt(previous.index_count)) * lod_min_reduction;
+        if (index_count == 0 or @as(f32, @floatFromInt(index_count)) > min_reduced_count) {
+            break;
+        }
+
+        chain_indices.items.len += index_count;
+        tm42.tm42_mesh_optimize_vertex_cache(
+            chain_indices.items.ptr + first_index,
+            chain_indices.items.ptr + first_index,
+            index_count,
+            vertices.len,
+            vertex_cache_size,
+        );
+        lods.appendAssumeCapacity(.{
+            .first_index = @intCast(first_index),
+            .index_count = @intCast(index_count),
+            .geometric_error = previous.geometric_error + relative_error * extent,
+        });
+    }
+
+    return .{
+        .indices = try chain_indices.toOwnedSlice(),
+        .lods = lods,
+    };
+}
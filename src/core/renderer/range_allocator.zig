@@ -0,0 +1,121 @@
+//! Sub-allocates ranges of a fixed capacity, e.g. of vertices or indices of a big GPU buffer. It
+//! only does the bookkeeping; the memory is whatever the offsets index into.
+
+const std = @import("std");
+
+pub const Range = struct {
+    offset: u32,
+    count: u32,
+};
+
+/// A best-fit free list. The free ranges are kept sorted by offset and merged with their
+/// neighbours when freed, so the list stays as short as the number of holes. `alloc` and `free`
+/// are linear in that number, which is small for the few thousand meshes a scene has.
+///
+/// There is at most one hole more than there are allocated ranges, so `alloc` makes room for
+/// that many free ranges up front, and `free` can't fail: a range is never lost.
+pub const RangeAllocator = struct {
+    free_ranges: std.ArrayList(Range),
+    capacity: u32,
+    /// Sum of the counts of `free_ranges`.
+    free_count: u32,
+    /// Ranges returned by `alloc` and not freed yet, not counting empty ones.
+    allocation_count: u32 = 0,
+
+    pub fn init(allocator: std.mem.Allocator, capacity: u32) !RangeAllocator {
+        var free_ranges = std.ArrayList(Range).init(allocator);
+        if (capacity > 0) {
+            try free_ranges.append(.{ .offset = 0, .count = capacity });
+        }
+        return .{
+            .free_ranges = free_ranges,
+            .capacity = capacity,
+            .free_count = capacity,
+        };
+    }
+
+    pub fn deinit(self: *RangeAllocator) void {
+        self.free_ranges.deinit();
+    }
+
+    /// Returns the offset of `count` free elements, or `null` if there is no range that long.
+    /// Picks the shortest range that fits, so that long ranges are kept for big requests.
+    pub fn alloc(self: *RangeAllocator, count: u32) !?u32 {
+        if (count == 0) {
+            return 0;
+        }
+        // For the holes that freeing this range and all the others could leave.
+        try self.free_ranges.ensureTotalCapacity(@as(usize, self.allocation_count) + 2);
+
+        var best: ?usize = null;
+        for (self.free_ranges.items, 0..) |range, i| {
+            if (range.count < count) {
+                continue;
+            }
+            if (best == null or range.count < self.free_ranges.items[best.?].count) {
+                best = i;
+                if (range.count == count) {
+                    break;
+                }
+            }
+        }
+
+        const i = best orelse return null;
+        const range = &self.free_ranges.items[i];
+        const offset = range.offset;
+        if (range.count == count) {
+            _ = self.free_ranges.orderedRemove(i);
+        } else {
+            range.offset += count;
+            range.count -= count;
+        }
+        self.free_count -= count;
+        self.allocation_count += 1;
+        return offset;
+    }
+
+    /// Gives back a range returned by `alloc`. Freeing the same range twice is not detected.
+    pub fn free(self: *RangeAllocator, offset: u32, count: u32) void {
+        if (count == 0) {
+            return;
+        }
+        std.debug.assert(offset + count <= self.capacity);
+
+        // Index of the first free range after the freed one.
+        var i: usize = 0;
+        while (i < self.free_ranges.items.len and self.free_ranges.items[i].offset < offset) {
+            i += 1;
+        }
+
+        const ranges = self.free_ranges.items;
+        const merges_previous = i > 0 and ranges[i - 1].offset + ranges[i - 1].count == offset;
+        const merges_next = i < ranges.len and offset + count == ranges[i].offset;
+
+        if (merges_previous and merges_next) {
+            ranges[i - 1].count += count + ranges[i].count;
+            _ = self.free_ranges.orderedRemove(i);
+        } else if (merges_previous) {
+            ranges[i - 1].count += count;
+        } else if (merges_next) {
+            ranges[i].offset = offset;
+            ranges[i].count += count;
+        } else {
+            // A new hole, which `alloc` made room for.
+            self.free_ranges.appendAssumeCapacity(undefined);
+            const shifted = self.free_ranges.items;
+            std.mem.copyBackwards(Range, shifted[i + 1 ..], shifted[i .. shifted.len - 1]);
+            shifted[i] = .{ .offset = offset, .count = count };
+        }
+        self.free_count += count;
+        self.allocation_count -= 1;
+    }
+
+    /// The count of the longest range `alloc` could return now.
+    pub fn largest_free(self: *const RangeAllocator) u32 {
+        var largest: u32 = 0;
+        for (self.free_ranges.items) |range| {
+            largest = @max(largest, range.count);
+        }
+        return largest;
+    }
+};
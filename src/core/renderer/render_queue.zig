@@ -0,0 +1,153 @@
+const std = @import("std");
+
+/// Draws are ordered by a 64-bit key, most significant bits first:
+///
+/// | bits    | field    |
+/// |---------|----------|
+/// | 63 - 48 | material |
+/// | 47 - 24 | mesh     |
+/// | 23 - 0  | depth    |
+///
+/// so that sorting the keys groups draws by material (the most expensive state to change), then
+/// by mesh, and orders each group front to back. Draws whose keys agree above `depth_bits` can be
+/// batched together.
+pub const SortKey = u64;
+
+pub const material_bits = 16;
+pub const mesh_bits = 24;
+pub const depth_bits = 24;
+
+comptime {
+    std.debug.assert(material_bits + mesh_bits + depth_bits == @bitSizeOf(SortKey));
+}
+
+/// `material` and `mesh` must fit in `material_bits` and `mesh_bits`. `mesh` identifies the
+/// geometry drawn, e.g. a mesh and one of its LODs. `view_depth` is the distance in front of the
+/// camera; negative depths are treated as 0.
+pub fn make_opaque_key(material: usize, mesh: u32, view_depth: f32) SortKey {
+    std.debug.assert(material < (1 << material_bits));
+    std.debug.assert(mesh < (1 << mesh_bits));
+
+    return (@as(SortKey, @intCast(material)) << (mesh_bits + depth_bits)) |
+        (@as(SortKey, mesh) << depth_bits) |
+        quantize_depth(view_depth);
+}
+
+/// The bit pattern of a non-negative float increases with its value, so its top bits are an
+/// order-preserving quantization that needs no near and far planes: relative precision is the
+/// same at every distance. The sign bit is always 0 and dropped.
+pub fn quantize_depth(view_depth: f32) SortKey {
+    const bits: u32 = @bitCast(@max(view_depth, 0));
+    return bits >> (31 - depth_bits);
+}
+
+/// Returns the part of the key that draws must share to be batched together.
+pub fn batch_of(key: SortKey) SortKey {
+    return key >> depth_bits;
+}
+
+/// Sorts `keys` and applies the same permutation to `values`, using the scratch slices (of the
+/// same length) as the second buffer. The sort is a stable least-significant-digit radix sort
+/// with 8-bit digits, which is linear in the number of keys. Digits that are the same for all
+/// keys, e.g. the high bits when there are only a few materials, are skipped.
+pub fn radix_sort(
+    keys: []SortKey,
+    values: []u32,
+    keys_scratch: []SortKey,
+    values_scratch: []u32,
+) void {
+    std.debug.assert(values.len == keys.len);
+    std.debug.assert(keys_scratch.len == keys.len);
+    std.debug.assert(values_scratch.len == keys.len);
+
+    if (keys.len < 2) {
+        return;
+    }
+
+    var src_keys = keys;
+    var src_values = values;
+    var dst_keys = keys_scratch;
+    var dst_values = values_scratch;
+
+    const num_digits = @sizeOf(SortKey);
+    var digit: usize = 0;
+    while (digit < num_digits) : (digit += 1) {
+        const shift: u6 = @intCast(digit * 8);
+
+        var counts = [_]usize{0} ** 256;
+        for (src_keys) |key| {
+            counts[@as(u8, @truncate(key >> shift))] += 1;
+        }
+        if (counts[@as(u8, @truncate(src_keys[0] >> shift))] == src_keys.len) {
+            continue;
+        }
+
+        var offset: usize = 0;
+        for (&counts) |*count| {
+            const bucket_len = count.*;
+            count.* = offset;
+            offset += bucket_len;
+        }
+
+        for (src_keys, src_values) |key, value| {
+            const bucket = &counts[@as(u8, @truncate(key >> shift))];
+            dst_keys[bucket.*] = key;
+            dst_values[bucket.*] = value;
+            bucket.* += 1;
+        }
+
+        std.mem.swap([]SortKey, &src_keys, &dst_keys);
+        std.mem.swap([]u32, &src_values, &dst_values);
+    }
+
+    if (src_keys.ptr != keys.ptr) {
+        @memcpy(keys, src_keys);
+        @memcpy(values, src_values);
+    }
+}
+
+/// The draws of a frame, as sort keys and indices into the caller's draw items.
+pub const RenderQueue = struct {
+    keys: std.ArrayList(SortKey),
+    /// Parallel to `keys`. After `sort`, the draw items in the order they should be drawn.
+    items: std.ArrayList(u32),
+    keys_scratch: std.ArrayList(SortKey),
+    items_scratch: std.ArrayList(u32),
+
+    pub fn init(allocator: std.mem.Allocator) RenderQueue {
+        return .{
+            .keys = std.ArrayList(SortKey).init(allocator),
+            .items = std.ArrayList(u32).init(allocator),
+            .keys_scratch = std.ArrayList(SortKey).init(allocator),
+            .items_scratch = std.ArrayList(u32).init(allocator),
+        };
+    }
+
+    pub fn deinit(self: *RenderQueue) void {
+        self.keys.deinit();
+        self.items.deinit();
+        self.keys_scratch.deinit();
+        self.items_scratch.deinit();
+    }
+
+    pub fn clear(self: *RenderQueue) void {
+        self.keys.clearRetainingCapacity();
+        self.items.clearRetainingCapacity();
+    }
+
+    pub fn push(self: *RenderQueue, key: SortKey, item: u32) !void {
+        try self.keys.append(key);
+        try self.items.append(item);
+    }
+
+    pub fn sort(self: *RenderQueue) !void {
+        try self.keys_scratch.resize(self.keys.items.len);
+        try self.items_scratch.resize(self.items.items.len);
+        radix_sort(
+            self.keys.items,
+            self.items.items,
+            self.keys_scratch.items,
+            self.items_scratch.items,
+        );
+    }
+};
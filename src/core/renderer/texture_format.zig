@@ -0,0 +1,271 @@
+//! The `.r4tex` texture format: an RGBA8 image with its whole mip chain precomputed, laid out so
+//! that any range of mips from some level down to the coarsest is one contiguous read that can go
+//! straight into staging memory.
+//!
+//! A file is a `Header`, then `header.mip_count` `Mip` entries from the finest (mip 0) to the
+//! coarsest, then the pixel data of the mips from the coarsest to the finest, each tightly packed
+//! and starting at a multiple of `data_alignment`. Everything is little-endian.
+
+const std = @import("std");
+
+pub const magic = "R4TX".*;
+pub const version = 1;
+/// The offset of the data of each mip is a multiple of this, which is enough for copies from
+/// staging memory to images of any format.
+pub const data_alignment = 16;
+pub const bytes_per_pixel = 4;
+
+pub const Format = enum(u32) {
+    /// Color, with the RGB channels in sRGB and alpha linear. Mips are averaged in linear space.
+    rgba8_srgb,
+    /// Non-color data, e.g. normal maps, averaged as is.
+    rgba8_unorm,
+};
+
+pub const Header = extern struct {
+    magic: [4]u8 = magic,
+    version: u32 = version,
+    format: Format,
+    width: u32,
+    height: u32,
+    mip_count: u32,
+    _reserved: [2]u32 = .{ 0, 0 },
+};
+
+pub const Mip = extern struct {
+    /// From the start of the file.
+    offset: u64,
+    size: u64,
+    width: u32,
+    height: u32,
+};
+
+pub const FormatError = error{
+    invalid_magic,
+    unsupported_version,
+    invalid_mips,
+};
+
+/// The number of mips down to 1x1, both included.
+pub fn mip_count_for(width: u32, height: u32) u32 {
+    return std.math.log2_int(u32, @max(width, height, 1)) + 1;
+}
+
+/// The header and mip table of a file.
+pub const TextureInfo = struct {
+    header: Header,
+    mips: []Mip,
+
+    pub fn deinit(self: *const TextureInfo, allocator: std.mem.Allocator) void {
+        allocator.free(self.mips);
+    }
+
+    /// Reads and validates the header and mip table from the start of `reader`, a file of
+    /// `file_size` bytes: every mip must be where `bake` puts it, aligned, after the table,
+    /// coarsest first, and within the file.
+    pub fn read(allocator: std.mem.Allocator, reader: anytype, file_size: u64) !TextureInfo {
+        const header = try reader.readStruct(Header);
+        if (!std.mem.eql(u8, &header.magic, &magic)) {
+            return FormatError.invalid_magic;
+        }
+        if (header.version != version) {
+            return FormatError.unsupported_version;
+        }
+        if (header.width == 0 or header.height == 0 or header.mip_count == 0 or
+            header.mip_count > mip_count_for(header.width, header.height))
+        {
+            return FormatError.invalid_mips;
+        }
+
+        const mips = try allocator.alloc(Mip, header.mip_count);
+        errdefer allocator.free(mips);
+        for (mips, 0..) |*mip, level| {
+            mip.* = try reader.readStruct(Mip);
+            const width = @max(header.width >> @intCast(level), 1);
+            const height = @max(header.height >> @intCast(level), 1);
+            if (mip.width != width or mip.height != height or
+                mip.size != @as(u64, width) * height * bytes_per_pixel)
+            {
+                return FormatError.invalid_mips;
+            }
+        }
+
+        // From the coarsest, each mip starts after the end of the previous one.
+        var end: u64 = @sizeOf(Header) + @as(u64, header.mip_count) * @sizeOf(Mip);
+        var level = mips.len;
+        while (level > 0) {
+            level -= 1;
+            const mip = mips[level];
+            if (mip.offset % data_alignment != 0 or mip.offset < end or mip.offset > file_size or
+                mip.size > file_size - mip.offset)
+            {
+                return FormatError.invalid_mips;
+            }
+            end = mip.offset + mip.size;
+        }
+
+        return .{ .header = header, .mips = mips };
+    }
+
+    /// The finest mip that is at most `max_size` texels wide and high, or the coarsest mip if
+    /// none is.
+    pub fn first_mip_within(self: *const TextureInfo, max_size: u32) u32 {
+        for (self.mips, 0..) |mip, level| {
+            if (@max(mip.width, mip.height) <= max_size) {
+                return @intCast(level);
+            }
+        }
+        return @intCast(self.mips.len - 1);
+    }
+
+    /// Where the data of mips `first` to the coarsest is in the file, as one range. The data of
+    /// mip `level` is at `mips[level].offset - span.offset` in it.
+    pub fn span_from(self: *const TextureInfo, first: u32) struct { offset: u64, size: u64 } {
+        const coarsest = self.mips[self.mips.len - 1];
+        const finest = self.mips[first];
+        return .{
+            .offset = coarsest.offset,
+            .size = finest.offset + finest.size - coarsest.offset,
+        };
+    }
+
+    /// The memory that mips `first` to the coarsest take once uploaded.
+    pub fn resident_size_from(self: *const TextureInfo, first: u32) u64 {
+        var size: u64 = 0;
+        for (self.mips[first..]) |mip| {
+            size += mip.size;
+        }
+        return size;
+    }
+};
+
+/// Builds the mip chain of `pixels`, `width` x `height` RGBA8 texels in row order, and returns the
+/// contents of a `.r4tex` file. Each mip is a 2x2 box filter of the previous one; odd sizes
+/// repeat the last row or column.
+pub fn bake(
+    allocator: std.mem.Allocator,
+    format: Format,
+    width: u32,
+    height: u32,
+    pixels: []const u8,
+) ![]u8 {
+    std.debug.assert(width > 0 and height > 0);
+    std.debug.assert(pixels.len == @as(usize, width) * height * bytes_per_pixel);
+
+    const mip_count = mip_count_for(width, height);
+    const table_end = @sizeOf(Header) + mip_count * @sizeOf(Mip);
+
+    // --- Lay out the mips, coarsest first.
+
+    const mips = try allocator.alloc(Mip, mip_count);
+    defer allocator.free(mips);
+    for (mips, 0..) |*mip, level| {
+        const mip_width = @max(width >> @intCast(level), 1);
+        const mip_height = @max(height >> @intCast(level), 1);
+        mip.* = .{
+            .offset = 0,
+            .size = @as(u64, mip_width) * mip_height * bytes_per_pixel,
+            .width = mip_width,
+            .height = mip_height,
+        };
+    }
+    var end: u64 = table_end;
+    var level = mip_count;
+    while (level > 0) {
+        level -= 1;
+        mips[level].offset = std.mem.alignForward(u64, end, data_alignment);
+        end = mips[level].offset + mips[level].size;
+    }
+
+    const file = try allocator.alloc(u8, end);
+    errdefer allocator.free(file);
+    @memset(file, 0);
+
+    // --- Header and mip table.
+
+    var stream = std.io.fixedBufferStream(file);
+    const writer = stream.writer();
+    try writer.writeStruct(Header{
+        .format = format,
+        .width = width,
+        .height = height,
+        .mip_count = mip_count,
+    });
+    for (mips) |mip| {
+        try writer.writeStruct(mip);
+    }
+
+    // --- Pixels.
+
+    @memcpy(file[mips[0].offset..][0..mips[0].size], pixels);
+    for (1..mip_count) |i| {
+        const src = mips[i - 1];
+        const dst = mips[i];
+        downsample(
+            format,
+            file[src.offset..][0..src.size],
+            src.width,
+            src.height,
+            file[dst.offset..][0..dst.size],
+            dst.width,
+            dst.height,
+        );
+    }
+
+    return file;
+}
+
+fn downsample(
+    format: Format,
+    src: []const u8,
+    src_width: u32,
+    src_height: u32,
+    dst: []u8,
+    dst_width: u32,
+    dst_height: u32,
+) void {
+    for (0..dst_height) |y| {
+        const y0 = @min(2 * y, src_height - 1);
+        const y1 = @min(2 * y + 1, src_height - 1);
+        for (0..dst_width) |x| {
+            const x0 = @min(2 * x, src_width - 1);
+            const x1 = @min(2 * x + 1, src_width - 1);
+            const corners = [4]usize{
+                (y0 * src_width + x0) * bytes_per_pixel,
+                (y0 * src_width + x1) * bytes_per_pixel,
+                (y1 * src_width + x0) * bytes_per_pixel,
+                (y1 * src_width + x1) * bytes_per_pixel,
+            };
+            const out = (y * dst_width + x) * bytes_per_pixel;
+            for (0..bytes_per_pixel) |channel| {
+                const is_srgb = format == .rgba8_srgb and channel < 3;
+                var sum: f32 = 0;
+                for (corners) |corner| {
+                    const value = src[corner + channel];
+                    sum += if (is_srgb) srgb_to_linear_table[value] else @floatFromInt(value);
+                }
+                const average = sum * 0.25;
+                dst[out + channel] = if (is_srgb)
+                    linear_to_srgb8(average)
+                else
+                    @intFromFloat(@round(average));
+            }
+        }
+    }
+}
+
+const srgb_to_linear_table = blk: {
+    @setEvalBranchQuota(1_000_000);
+    var table: [256]f32 = undefined;
+    for (&table, 0..) |*value, i| {
+        const c = @as(f32, @floatFromInt(i)) / 255;
+        value.* = if (c <= 0.04045) c / 12.92 else std.math.pow(f32, (c + 0.055) / 1.055, 2.4);
+    }
+    break :blk table;
+};
+
+fn linear_to_srgb8(linear: f32) u8 {
+    const c = std.math.clamp(linear, 0, 1);
+    const srgb = if (c <= 0.0031308) c * 12.92 else 1.055 * std.math.pow(f32, c, 1 / 2.4) - 0.055;
+    return @intFromFloat(@round(srgb * 255));
+}
@@ -0,0 +1,135 @@
+//! Packed vertex attribute types, for vertex layouts that take less memory and bandwidth than
+//! plain `math.Vec3f`s. Each type declares the `format` the GPU reads it with, which
+//! `get_attribute_descriptions` picks up, and encodes from and decodes to full precision.
+
+const std = @import("std");
+const math = @import("math");
+const l0vk = @import("layer0/vulkan/vulkan.zig");
+
+/// A position as half floats, in 8 bytes instead of 12. The fourth component is 1, since 3
+/// component 16-bit formats are poorly supported, and shaders can read it as a `vec3` or `vec4`.
+///
+/// Half floats have 11 significant bits, so a mesh that extends 10 units from its origin is
+/// precise to about 5 mm at its far end. That is fine for meshes modelled around their origin and
+/// placed with a transform, but not for large meshes in world space, which `MeshSystem.prepare`
+/// rejects, see `max_coordinate`.
+pub const PositionF16 = extern struct {
+    raw: [4]f16,
+
+    pub const format: l0vk.VkFormat = .r16g16b16a16_sfloat;
+
+    /// The largest coordinate, in absolute value, of a position that can be encoded. Past it,
+    /// half floats are a whole unit or more apart, and past 65504 they are infinite.
+    pub const max_coordinate: f32 = 1024;
+
+    pub fn encode(position: math.Vec3f) PositionF16 {
+        return .{ .raw = .{
+            @floatCast(position.raw[0]),
+            @floatCast(position.raw[1]),
+            @floatCast(position.raw[2]),
+            1,
+        } };
+    }
+
+    pub fn decode(self: PositionF16) [3]f32 {
+        return .{ self.raw[0], self.raw[1], self.raw[2] };
+    }
+};
+
+/// A unit normal in octahedral encoding (Cigolle et al., "A Survey of Efficient Representations
+/// for Independent Unit Vectors", 2014), as two snorm16s in 4 bytes instead of 12. The error is
+/// below 0.01 degrees. Shaders decode it with `oct_decode`, see `shaders/tri_mesh_compact.vert`.
+pub const NormalOct16 = extern struct {
+    raw: [2]i16,
+
+    pub const format: l0vk.VkFormat = .r16g16_snorm;
+
+    /// `normal` doesn't need to be normalized, but must not be zero.
+    pub fn encode(normal: math.Vec3f) NormalOct16 {
+        const n = normal.raw;
+        const l1_norm = @abs(n[0]) + @abs(n[1]) + @abs(n[2]);
+        var x = n[0] / l1_norm;
+        var y = n[1] / l1_norm;
+        // Fold the lower hemisphere over the diagonals of the square.
+        if (n[2] < 0) {
+            const folded_x = (1 - @abs(y)) * sign_not_zero(x);
+            y = (1 - @abs(x)) * sign_not_zero(y);
+            x = folded_x;
+        }
+        return .{ .raw = .{ to_snorm16(x), to_snorm16(y) } };
+    }
+
+    pub fn decode(self: NormalOct16) [3]f32 {
+        const x = from_snorm16(self.raw[0]);
+        const y = from_snorm16(self.raw[1]);
+        var n = [3]f32{ x, y, 1 - @abs(x) - @abs(y) };
+        const t = std.math.clamp(-n[2], 0, 1);
+        n[0] += if (n[0] >= 0) -t else t;
+        n[1] += if (n[1] >= 0) -t else t;
+        const length = @sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        return .{ n[0] / length, n[1] / length, n[2] / length };
+    }
+
+    fn sign_not_zero(value: f32) f32 {
+        return if (value >= 0) 1 else -1;
+    }
+
+    fn to_snorm16(value: f32) i16 {
+        return @intFromFloat(@round(std.math.clamp(value, -1, 1) * 32767));
+    }
+
+    fn from_snorm16(value: i16) f32 {
+        return @max(@as(f32, @floatFromInt(value)) / 32767, -1);
+    }
+};
+
+/// An RGB color in [0, 1] as unorm8s, in 4 bytes instead of 12. Alpha is 1.
+pub const ColorUnorm8 = extern struct {
+    raw: [4]u8,
+
+    pub const format: l0vk.VkFormat = .r8g8b8a8_unorm;
+
+    pub fn encode(color: math.Vec3f) ColorUnorm8 {
+        return .{ .raw = .{
+            to_unorm8(color.raw[0]),
+            to_unorm8(color.raw[1]),
+            to_unorm8(color.raw[2]),
+            255,
+        } };
+    }
+
+    pub fn decode(self: ColorUnorm8) [3]f32 {
+        return .{
+            @as(f32, @floatFromInt(self.raw[0])) / 255,
+            @as(f32, @floatFromInt(self.raw[1])) / 255,
+            @as(f32, @floatFromInt(self.raw[2])) / 255,
+        };
+    }
+
+    fn to_unorm8(value: f32) u8 {
+        return @intFromFloat(@round(std.math.clamp(value, 0, 1) * 255));
+    }
+};
+
+/// The format of a vertex attribute of type `attribute_type`: the declared `format` of the packed
+/// types above, or the matching 32-bit float format of a `math` vector.
+pub fn attribute_format(comptime attribute_type: type) l0vk.VkFormat {
+    if (@hasDecl(attribute_type, "format")) {
+        return attribute_type.format;
+    }
+    return switch (attribute_type) {
+        math.Vec2f => .r32g32_sfloat,
+        math.Vec3f => .r32g32b32_sfloat,
+        math.Vec4f => .r32g32b32a32_sfloat,
+        else => @compileError("unsupported type"),
+    };
+}
+
+/// The position of `vertex` as it will be read on the GPU, whether it is packed or not.
+pub fn decode_position(vertex: anytype) [3]f32 {
+    const position = vertex.position;
+    if (@hasDecl(@TypeOf(position), "decode")) {
+        return position.decode();
+    }
+    return position.raw;
+}
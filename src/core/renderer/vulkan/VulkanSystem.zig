@@ -25,6 +25,7 @@ pub const VulkanImage = buffer.VulkanImage;
 const Renderer = @import("../Renderer.zig");
 const resource = @import("./resource.zig");
 const RenderGraph = @import("./RenderGraph.zig");
+const UploadSystem = @import("./upload.zig").UploadSystem;
 
 allocator: std.mem.Allocator,
 
@@ -47,6 +48,7 @@ renderpass_system: RenderpassSystem,
 sync_system: SyncSystem,
 
 vma_allocator: vma.VmaAllocator,
+upload_system: UploadSystem,
 
 tmp_image: ?buffer.ColorImage = null,
 tmp_renderer: ?*Renderer = null,
@@ -252,6 +254,20 @@ pub fn init(allocator_: std.mem.Allocator) !VulkanSystem {
 
     // ---
 
+    // Uploads go to the transfer-only queue family if there is one.
+    const upload_family = queue_family_indices.transfer_family orelse
+        queue_family_indices.graphics_family.?;
+    const upload_queue = l0vk.vkGetDeviceQueue(logical_device, upload_family, 0);
+    const upload_system = try UploadSystem.init(
+        logical_device,
+        vma_allocator,
+        upload_queue,
+        upload_family,
+        queue_family_indices.graphics_family.?,
+    );
+
+    // ---
+
     const resource_system = resource.ResourceSystem.init(allocator_);
 
     // ---
@@ -288,6 +304,7 @@ pub fn init(allocator_: std.mem.Allocator) !VulkanSystem {
         .sync_system = sync_system,
 
         .vma_allocator = vma_allocator,
+        .upload_system = upload_system,
 
         .resource_system = resource_system,
 
@@ -316,6 +333,8 @@ pub fn deinit(self: *VulkanSystem, allocator_: std.mem.Allocator) void {
 
     self.resource_system.deinit(self);
 
+    self.upload_system.deinit(self);
+
     vma.vmaDestroyAllocator(self.vma_allocator);
 
     l0vk.vkDestroyCommandPool(self.logical_device, self.command_pool, null);
@@ -529,11 +548,15 @@ fn is_device_suitable(
 const QueueFamilyIndices = struct {
     graphics_family: ?u32,
     present_family: ?u32,
+    /// A family that can transfer but not do graphics or compute, which usually means it is
+    /// backed by a DMA engine that runs alongside rendering. Optional.
+    transfer_family: ?u32,
 
     fn init_null() QueueFamilyIndices {
         return .{
             .graphics_family = null,
             .present_family = null,
+            .transfer_family = null,
         };
     }
 
@@ -572,6 +595,14 @@ pub fn find_queue_families(
         }
     }
 
+    for (queue_families, 0..) |queue_family, j| {
+        const flags = queue_family.queueFlags;
+        if (flags.transfer and !flags.graphics and !flags.compute) {
+            indices.transfer_family = @intCast(j);
+            break;
+        }
+    }
+
     return indices;
 }
 
@@ -647,7 +678,11 @@ fn create_logical_device(
 
     var unique_queue_families = std.ArrayList(u32).init(allocator_);
     defer unique_queue_families.deinit();
-    const indices = [_]u32{ queue_family_indices.graphics_family.?, queue_family_indices.present_family.? };
+    const indices = [_]u32{
+        queue_family_indices.graphics_family.?,
+        queue_family_indices.present_family.?,
+        queue_family_indices.transfer_family orelse queue_family_indices.graphics_family.?,
+    };
     for (indices) |index| {
         var should_insert = true;
 
@@ -680,8 +715,15 @@ fn create_logical_device(
         .samplerAnisotropy = true,
     };
 
+    // For the `UploadSystem`, whose batches the frames wait for on the GPU.
+    const timeline_semaphore_feature: vulkan.VkPhysicalDeviceTimelineSemaphoreFeatures = .{
+        .sType = vulkan.VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES,
+        .timelineSemaphore = vulkan.VK_TRUE,
+    };
+
     const dynamic_rendering_feature: vulkan.VkPhysicalDeviceDynamicRenderingFeaturesKHR = .{
         .sType = vulkan.VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR,
+        .pNext = @constCast(&timeline_semaphore_feature),
         .dynamicRendering = vulkan.VK_TRUE,
     };
 
@@ -915,6 +957,9 @@ pub fn end_command_buffer(self: *VulkanSystem, command_buffer: l0vk.VkCommandBuf
     try l0vk.vkEndCommandBuffer(command_buffer);
 }
 
+/// Also submits what the `UploadSystem` has queued, and makes the command buffer wait for all of
+/// it on the GPU before reading vertices, indices or textures, so that everything uploaded before
+/// the command buffer was recorded can be drawn without waiting on the CPU.
 pub fn submit_command_buffer(
     self: *VulkanSystem,
     p_command_buffer: *l0vk.VkCommandBuffer,
@@ -922,24 +967,39 @@ pub fn submit_command_buffer(
     signal_semaphore: SemaphoreHandle,
     fence: ?FenceHandle,
 ) !void {
-    var wait_semaphores = [_]l0vk.VkSemaphore{
+    const upload_value = try self.upload_system.flush_for_graphics(self);
+
+    // Raw Vulkan types, since `l0vk.VkSubmitInfo` has a single wait stage mask.
+    const wait_semaphores = [_]vulkan.VkSemaphore{
         self.sync_system.get_semaphore_from_handle(wait_semaphore).*,
+        self.upload_system.timeline,
     };
-    var wait_stages = l0vk.VkPipelineStageFlags{
-        .color_attachment_output = true,
+    const wait_stages = [_]vulkan.VkPipelineStageFlags{
+        vulkan.VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        vulkan.VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | vulkan.VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+            vulkan.VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
     };
-    var signal_semaphores = [_]l0vk.VkSemaphore{
+    // The value for the binary semaphore is ignored.
+    const wait_values = [_]u64{ 0, upload_value };
+    const signal_semaphores = [_]vulkan.VkSemaphore{
         self.sync_system.get_semaphore_from_handle(signal_semaphore).*,
     };
-    var command_buffers = [_]l0vk.VkCommandBuffer{
-        p_command_buffer.*,
-    };
 
-    const submit_info = l0vk.VkSubmitInfo{
-        .waitSemaphores = &wait_semaphores,
+    const timeline_info = vulkan.VkTimelineSemaphoreSubmitInfo{
+        .sType = vulkan.VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .waitSemaphoreValueCount = wait_values.len,
+        .pWaitSemaphoreValues = &wait_values,
+    };
+    const submit_info = vulkan.VkSubmitInfo{
+        .sType = vulkan.VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = &timeline_info,
+        .waitSemaphoreCount = wait_semaphores.len,
+        .pWaitSemaphores = &wait_semaphores,
         .pWaitDstStageMask = &wait_stages,
-        .commandBuffers = &command_buffers,
-        .signalSemaphores = &signal_semaphores,
+        .commandBufferCount = 1,
+        .pCommandBuffers = p_command_buffer,
+        .signalSemaphoreCount = signal_semaphores.len,
+        .pSignalSemaphores = &signal_semaphores,
     };
 
     var submit_fence: l0vk.VkFence = null;
@@ -947,12 +1007,15 @@ pub fn submit_command_buffer(
         submit_fence = self.sync_system.get_fence_from_handle(fence.?).*;
     }
 
-    try l0vk.vkQueueSubmit(
-        self.graphics_queue,
-        1,
-        &submit_info,
-        submit_fence,
-    );
+    const result = vulkan.vkQueueSubmit(self.graphics_queue, 1, &submit_info, submit_fence);
+    if (result != vulkan.VK_SUCCESS) {
+        switch (result) {
+            vulkan.VK_ERROR_OUT_OF_HOST_MEMORY => return VulkanError.vk_error_out_of_host_memory,
+            vulkan.VK_ERROR_OUT_OF_DEVICE_MEMORY => return VulkanError.vk_error_out_of_device_memory,
+            vulkan.VK_ERROR_DEVICE_LOST => return VulkanError.vk_error_device_lost,
+            else => unreachable,
+        }
+    }
 }
 
 pub const DeletionQueue = struct {
@@ -1008,3 +1071,28 @@ pub fn get_attribute_descriptions(
     _ = self;
     return buffer.get_attribute_descriptions(allocator, vertex_type);
 }
+
+pub fn get_instance_binding_description(
+    self: *VulkanSystem,
+    comptime instance_type: type,
+    binding: u32,
+) l0vk.VkVertexInputBindingDescription {
+    _ = self;
+    return buffer.get_instance_binding_description(instance_type, binding);
+}
+
+pub fn get_instance_attribute_descriptions(
+    self: *VulkanSystem,
+    allocator: std.mem.Allocator,
+    comptime instance_type: type,
+    binding: u32,
+    first_location: u32,
+) ![]l0vk.VkVertexInputAttributeDescription {
+    _ = self;
+    return buffer.get_instance_attribute_descriptions(
+        allocator,
+        instance_type,
+        binding,
+        first_location,
+    );
+}
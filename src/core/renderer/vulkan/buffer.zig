@@ -11,6 +11,7 @@ const VulkanError = @import("./VulkanSystem.zig").VulkanError;
 const vertex = @import("../../../vertex.zig");
 const l0vk = @import("../layer0/vulkan/vulkan.zig");
 const math = @import("math");
+const vertex_formats = @import("../vertex_formats.zig");
 
 fn find_memory_type(
     physical_device: l0vk.VkPhysicalDevice,
@@ -1167,6 +1168,8 @@ pub fn get_binding_description(comptime vertex_type: type) l0vk.VkVertexInputBin
     return binding_description;
 }
 
+/// One attribute per field of `vertex_type`, in order. Fields can be `math` vectors or the packed
+/// types of `vertex_formats.zig`.
 pub fn get_attribute_descriptions(
     allocator: std.mem.Allocator,
     comptime vertex_type: type,
@@ -1186,11 +1189,7 @@ pub fn get_attribute_descriptions(
         to_return[i] = .{
             .location = @intCast(i),
             .binding = 0,
-            .format = switch (field.type) {
-                math.Vec2f => .r32g32_sfloat,
-                math.Vec3f => .r32g32b32_sfloat,
-                else => @compileError("unsupported type"),
-            },
+            .format = comptime vertex_formats.attribute_format(field.type),
             .offset = @offsetOf(vertex_type, field.name),
         };
         i += 1;
@@ -1201,6 +1200,68 @@ pub fn get_attribute_descriptions(
     return to_return;
 }
 
+/// Like `get_binding_description`, for per-instance data read from binding `binding`.
+pub fn get_instance_binding_description(
+    comptime instance_type: type,
+    binding: u32,
+) l0vk.VkVertexInputBindingDescription {
+    return .{
+        .binding = binding,
+        .stride = @sizeOf(instance_type),
+        .inputRate = .instance,
+    };
+}
+
+/// Like `get_attribute_descriptions`, for per-instance data read from binding `binding`, with
+/// locations starting at `first_location` so that they follow the vertex attributes. A
+/// `math.Mat4f` field takes four locations, one per column, like a `mat4` input in GLSL.
+pub fn get_instance_attribute_descriptions(
+    allocator: std.mem.Allocator,
+    comptime instance_type: type,
+    binding: u32,
+    first_location: u32,
+) ![]l0vk.VkVertexInputAttributeDescription {
+    // --- How many locations.
+
+    comptime var location_count: usize = 0;
+    inline for (std.meta.fields(instance_type)) |field| {
+        location_count += if (field.type == math.Mat4f) 4 else 1;
+    }
+    var to_return = try allocator.alloc(
+        l0vk.VkVertexInputAttributeDescription,
+        location_count,
+    );
+
+    // --- For each field/attribute.
+
+    var i: usize = 0;
+    inline for (std.meta.fields(instance_type)) |field| {
+        if (field.type == math.Mat4f) {
+            inline for (0..4) |column| {
+                to_return[i] = .{
+                    .location = first_location + @as(u32, @intCast(i)),
+                    .binding = binding,
+                    .format = .r32g32b32a32_sfloat,
+                    .offset = @offsetOf(instance_type, field.name) + column * 4 * @sizeOf(f32),
+                };
+                i += 1;
+            }
+        } else {
+            to_return[i] = .{
+                .location = first_location + @as(u32, @intCast(i)),
+                .binding = binding,
+                .format = comptime vertex_formats.attribute_format(field.type),
+                .offset = @offsetOf(instance_type, field.name),
+            };
+            i += 1;
+        }
+    }
+
+    // ---
+
+    return to_return;
+}
+
 // ---
 
 pub const AllocatedBuffer = struct {
@@ -0,0 +1,218 @@
+const std = @import("std");
+const vulkan = @import("vulkan");
+const vma = @import("vma");
+const dutil = @import("debug_utils");
+const buffer = @import("buffer.zig");
+const RangeAllocator = @import("../range_allocator.zig").RangeAllocator;
+const UploadSystem = @import("upload.zig").UploadSystem;
+const Renderer = @import("../Renderer.zig");
+
+pub const GeometryArenaError = error{
+    buffer_allocation_failed,
+};
+
+/// Capacity of a block, in vertices and in indices. With 16-byte vertices, that is 16 MiB of each
+/// per block, so a scene of a few million triangles fits in one.
+pub const block_vertex_capacity = 1 << 20;
+pub const block_index_capacity = 1 << 22;
+
+/// Where a mesh lives in a `GeometryArena`. The indices are relative to `first_vertex`, which is
+/// passed as the vertex offset of draws.
+pub const Allocation = struct {
+    block: u32,
+    first_vertex: u32,
+    vertex_count: u32,
+    first_index: u32,
+    index_count: u32,
+};
+
+/// The vertices and indices of all meshes, in a few big device-local buffers instead of one
+/// host-visible buffer per mesh: vertex fetch reads from video memory, draws of different meshes
+/// don't need to rebind buffers, and the number of allocations stays bounded.
+///
+/// The buffers are allocated in blocks of a vertex buffer and an index buffer, whose ranges are
+/// handed out by a `RangeAllocator` each. A new block is only made when no existing block has
+/// room for a mesh, and is made bigger than `block_vertex_capacity` or `block_index_capacity` if
+/// the mesh needs it. Data gets into the blocks through the `UploadSystem` of the renderer.
+pub fn GeometryArena(comptime VertexType: type) type {
+    return struct {
+        const Self = @This();
+
+        pub const Block = struct {
+            vertex_buffer: buffer.AllocatedBuffer,
+            index_buffer: buffer.AllocatedBuffer,
+            vertex_ranges: RangeAllocator,
+            index_ranges: RangeAllocator,
+
+            fn deinit(self: *Block, vma_allocator: vma.VmaAllocator) void {
+                self.vertex_buffer.deinit(vma_allocator);
+                self.index_buffer.deinit(vma_allocator);
+                self.vertex_ranges.deinit();
+                self.index_ranges.deinit();
+            }
+        };
+
+        renderer: *Renderer,
+        blocks: std.ArrayList(Block),
+
+        pub fn init(renderer: *Renderer) Self {
+            return .{
+                .renderer = renderer,
+                .blocks = std.ArrayList(Block).init(renderer.allocator),
+            };
+        }
+
+        /// The GPU must be done with all draws from the arena.
+        pub fn deinit(self: *Self) void {
+            for (self.blocks.items) |*block| {
+                block.deinit(self.renderer.system.vma_allocator);
+            }
+            self.blocks.deinit();
+        }
+
+        /// Allocates room for a mesh and queues the copy of its data there with the
+        /// `UploadSystem`. Frames submitted with `VulkanSystem.submit_command_buffer` wait for the
+        /// copy on the GPU before drawing the mesh.
+        pub fn upload(self: *Self, vertices: []const VertexType, indices: []const u32) !Allocation {
+            const vertex_count: u32 = @intCast(vertices.len);
+            const index_count: u32 = @intCast(indices.len);
+
+            const block_index: u32 = for (self.blocks.items, 0..) |*block, i| {
+                if (block.vertex_ranges.largest_free() >= vertex_count and
+                    block.index_ranges.largest_free() >= index_count)
+                {
+                    break @intCast(i);
+                }
+            } else blk: {
+                try self.add_block(
+                    @max(vertex_count, block_vertex_capacity),
+                    @max(index_count, block_index_capacity),
+                );
+                break :blk @intCast(self.blocks.items.len - 1);
+            };
+            const block = &self.blocks.items[block_index];
+            const first_vertex = (try block.vertex_ranges.alloc(vertex_count)).?;
+            errdefer block.vertex_ranges.free(first_vertex, vertex_count);
+            const first_index = (try block.index_ranges.alloc(index_count)).?;
+            errdefer block.index_ranges.free(first_index, index_count);
+            const allocation = Allocation{
+                .block = block_index,
+                .first_vertex = first_vertex,
+                .vertex_count = vertex_count,
+                .first_index = first_index,
+                .index_count = index_count,
+            };
+
+            try self.copy_to_block(allocation, vertices, indices);
+
+            return allocation;
+        }
+
+        /// Gives back the ranges of `allocation`. The GPU must be done with the draws that use
+        /// them.
+        pub fn free(self: *Self, allocation: *const Allocation) void {
+            const block = &self.blocks.items[allocation.block];
+            block.vertex_ranges.free(allocation.first_vertex, allocation.vertex_count);
+            block.index_ranges.free(allocation.first_index, allocation.index_count);
+        }
+
+        fn add_block(self: *Self, vertex_capacity: u32, index_capacity: u32) !void {
+            const vma_allocator = self.renderer.system.vma_allocator;
+
+            var vertex_buffer = try create_device_local_buffer(
+                vma_allocator,
+                &self.renderer.system.upload_system,
+                @as(usize, vertex_capacity) * @sizeOf(VertexType),
+                vulkan.VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            );
+            errdefer vertex_buffer.deinit(vma_allocator);
+            var index_buffer = try create_device_local_buffer(
+                vma_allocator,
+                &self.renderer.system.upload_system,
+                @as(usize, index_capacity) * @sizeOf(u32),
+                vulkan.VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+            );
+            errdefer index_buffer.deinit(vma_allocator);
+
+            var vertex_ranges = try RangeAllocator.init(self.renderer.allocator, vertex_capacity);
+            errdefer vertex_ranges.deinit();
+            var index_ranges = try RangeAllocator.init(self.renderer.allocator, index_capacity);
+            errdefer index_ranges.deinit();
+
+            try self.blocks.append(.{
+                .vertex_buffer = vertex_buffer,
+                .index_buffer = index_buffer,
+                .vertex_ranges = vertex_ranges,
+                .index_ranges = index_ranges,
+            });
+
+            dutil.log(
+                "geometry arena",
+                .info,
+                "added block {}: {} vertices, {} indices",
+                .{ self.blocks.items.len - 1, vertex_capacity, index_capacity },
+            );
+        }
+
+        fn copy_to_block(
+            self: *Self,
+            allocation: Allocation,
+            vertices: []const VertexType,
+            indices: []const u32,
+        ) !void {
+            const system = &self.renderer.system;
+            const block = &self.blocks.items[allocation.block];
+            try system.upload_system.upload_buffer(
+                system,
+                block.vertex_buffer.buffer,
+                @as(u64, allocation.first_vertex) * @sizeOf(VertexType),
+                std.mem.sliceAsBytes(vertices),
+            );
+            try system.upload_system.upload_buffer(
+                system,
+                block.index_buffer.buffer,
+                @as(u64, allocation.first_index) * @sizeOf(u32),
+                std.mem.sliceAsBytes(indices),
+            );
+        }
+    };
+}
+
+/// The buffer is shared by the queue families of `upload_system`, so that it can be written on
+/// the transfer queue and read on the graphics queue.
+fn create_device_local_buffer(
+    vma_allocator: vma.VmaAllocator,
+    upload_system: *const UploadSystem,
+    size: usize,
+    usage: vulkan.VkBufferUsageFlags,
+) !buffer.AllocatedBuffer {
+    const is_shared = upload_system.queue_family_count > 1;
+    const buffer_info = vulkan.VkBufferCreateInfo{
+        .sType = vulkan.VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = size,
+        .usage = usage | vulkan.VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        .sharingMode = if (is_shared)
+            vulkan.VK_SHARING_MODE_CONCURRENT
+        else
+            vulkan.VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = if (is_shared) upload_system.queue_family_count else 0,
+        .pQueueFamilyIndices = &upload_system.queue_family_indices,
+    };
+    const alloc_info = vma.VmaAllocationCreateInfo{
+        .usage = vma.VMA_MEMORY_USAGE_GPU_ONLY,
+        .requiredFlags = vma.VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+    };
+
+    var allocated_buffer: buffer.AllocatedBuffer = undefined;
+    if (vma.vmaCreateBuffer(
+        vma_allocator,
+        @ptrCast(&buffer_info),
+        &alloc_info,
+        @ptrCast(&allocated_buffer.buffer),
+        &allocated_buffer.allocation,
+        null,
+    ) != vulkan.VK_SUCCESS) {
+        return GeometryArenaError.buffer_allocation_failed;
+    }
+    return allocated_buffer;
+}
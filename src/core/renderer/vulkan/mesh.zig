@@ -1,131 +1,283 @@
 const std = @import("std");
-const c_string = @cImport({
-    @cInclude("string.h");
-});
-const vulkan = @import("vulkan");
-const vma = @import("vma");
-const buffer = @import("buffer.zig");
+const dutil = @import("debug_utils");
+const geometry_arena = @import("geometry_arena.zig");
+const mesh_optimizer = @import("../mesh_optimizer.zig");
+const vertex_formats = @import("../vertex_formats.zig");
 const Renderer = @import("../Renderer.zig");
 
-pub fn _Mesh(comptime _VertexType: type) type {
-    return struct {
-        const Self = @This();
-        const VertexType = _VertexType;
+pub const MeshSystemError = error{
+    /// Another mesh was registered with the same name.
+    name_taken,
+    /// The mesh has a position that its packed position type can't hold, see `max_coordinate` in
+    /// vertex_formats.zig.
+    position_out_of_range,
+};
 
-        vertices: std.ArrayList(VertexType),
-        vertex_buffer: buffer.AllocatedBuffer,
+/// Local-space bounding volumes of a mesh, used for culling.
+pub const Bounds = struct {
+    min: [3]f32 = .{ 0, 0, 0 },
+    max: [3]f32 = .{ 0, 0, 0 },
+    /// Center of the axis-aligned box, which is also the center of the bounding sphere.
+    center: [3]f32 = .{ 0, 0, 0 },
+    radius: f32 = 0,
+};
 
-        /// After calling this, the `vertices` field is valid and can
-        /// be used but the `vertex_buffer` field is invalid. Once you
-        /// have set the `vertices`, you should call the `upload` method
-        /// to set the `vertex_buffer`.
-        pub fn init(allocator: std.mem.Allocator) !Self {
-            return .{
-                .vertices = std.ArrayList(VertexType).init(allocator),
-                .vertex_buffer = std.mem.zeroInit(buffer.AllocatedBuffer, .{}),
-            };
-        }
+/// The bounds of `vertices`, from their positions as the GPU reads them. The sphere is centered on
+/// the box rather than being minimal, which is cheap and tight enough for culling.
+pub fn bounds_of(comptime VertexType: type, vertices: []const VertexType) Bounds {
+    if (vertices.len == 0) {
+        return .{};
+    }
 
-        pub fn deinit(self: *Self, vma_allocator: vma.VmaAllocator) void {
-            self.vertices.deinit();
-            self.vertex_buffer.deinit(vma_allocator);
+    var min = vertex_formats.decode_position(vertices[0]);
+    var max = min;
+    for (vertices[1..]) |vertex| {
+        const position = vertex_formats.decode_position(vertex);
+        inline for (0..3) |axis| {
+            min[axis] = @min(min[axis], position[axis]);
+            max[axis] = @max(max[axis], position[axis]);
         }
+    }
 
-        pub fn upload(
-            self: *Self,
-            vma_allocator: vma.VmaAllocator,
-        ) !void {
-            // --- Allocate vertex buffer.
-
-            const buffer_info = vulkan.VkBufferCreateInfo{
-                .sType = vulkan.VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-                .size = self.vertices.items.len * @sizeOf(VertexType),
-                .usage = vulkan.VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-            };
-
-            const vmaallocInfo = vma.VmaAllocationCreateInfo{
-                .usage = vma.VMA_MEMORY_USAGE_CPU_TO_GPU,
-                .requiredFlags = vma.VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | vma.VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-            };
+    var center: [3]f32 = undefined;
+    inline for (0..3) |axis| {
+        center[axis] = (min[axis] + max[axis]) * 0.5;
+    }
 
-            var res = vma.vmaCreateBuffer(
-                vma_allocator,
-                @ptrCast(&buffer_info),
-                &vmaallocInfo,
-                @ptrCast(&self.vertex_buffer.buffer),
-                &self.vertex_buffer.allocation,
-                null,
-            );
-            if (res != vulkan.VK_SUCCESS) {
-                std.log.err("Failed to allocate vertex buffer", .{});
-            }
+    var radius_squared: f32 = 0;
+    for (vertices) |vertex| {
+        const position = vertex_formats.decode_position(vertex);
+        var distance_squared: f32 = 0;
+        inline for (0..3) |axis| {
+            const d = position[axis] - center[axis];
+            distance_squared += d * d;
+        }
+        radius_squared = @max(radius_squared, distance_squared);
+    }
 
-            // --- Copy vertex data.
+    return .{
+        .min = min,
+        .max = max,
+        .center = center,
+        .radius = @sqrt(radius_squared),
+    };
+}
 
-            var data: ?*anyopaque = undefined;
-            res = vma.vmaMapMemory(
-                vma_allocator,
-                self.vertex_buffer.allocation,
-                &data,
-            );
-            if (res != vulkan.VK_SUCCESS) {
-                std.log.err("Failed to map vertex buffer", .{});
-            }
+pub fn _Mesh(comptime _VertexType: type) type {
+    return struct {
+        const Self = @This();
+        const VertexType = _VertexType;
 
-            _ = c_string.memcpy(
-                data,
-                @ptrCast(self.vertices.items.ptr),
-                @intCast(self.vertices.items.len * @sizeOf(VertexType)),
-            );
+        /// Dense id assigned by `MeshSystem.register`, e.g. for sort keys. Every object with the
+        /// mesh has its own copy of this struct, so the id is what identifies the mesh.
+        id: u32,
+        /// Ranges of the mesh's indices, from the full mesh to the coarsest. Empty for a mesh
+        /// that isn't indexed.
+        lods: std.BoundedArray(mesh_optimizer.Lod, mesh_optimizer.max_lod_count),
+        /// Where the vertices and indices are on the GPU, the only copy of them the mesh keeps.
+        /// The indices are three per triangle, for all the LODs one after the other, and there
+        /// are none for a mesh that isn't indexed, whose triangles are consecutive vertices. The
+        /// `first_index` of the LODs is relative to `geometry.first_index`.
+        geometry: geometry_arena.Allocation,
+        bounds: Bounds,
 
-            vma.vmaUnmapMemory(
-                vma_allocator,
-                self.vertex_buffer.allocation,
-            );
-            _ = vma.vmaFlushAllocation(
-                vma_allocator,
-                self.vertex_buffer.allocation,
-                0,
-                vulkan.VK_WHOLE_SIZE,
-            );
+        pub fn is_indexed(self: *const Self) bool {
+            return self.geometry.index_count > 0;
         }
     };
 }
 
+/// `VertexType` is the layout vertices are stored in on the GPU. A packed layout can declare the
+/// full-precision vertex type it is encoded from as `Source`, with an `encode` function, in which
+/// case `register` takes `Source` vertices and encodes them.
 pub fn MeshSystem(comptime VertexType: type) type {
     return struct {
         const Self = @This();
         pub const Mesh = _Mesh(VertexType);
+        pub const SourceVertex = if (is_encoded) VertexType.Source else VertexType;
+        pub const Arena = geometry_arena.GeometryArena(VertexType);
+
+        const is_encoded = @hasDecl(VertexType, "Source");
+
+        /// A mesh as `prepare` leaves it. Owned by the caller, see `deinit`.
+        pub const PreparedMesh = struct {
+            vertices: []VertexType,
+            /// For all the LODs one after the other, see `Mesh.geometry`.
+            indices: []u32,
+            lods: std.BoundedArray(mesh_optimizer.Lod, mesh_optimizer.max_lod_count),
+            bounds: Bounds,
+
+            pub fn deinit(self: *const PreparedMesh, allocator: std.mem.Allocator) void {
+                allocator.free(self.vertices);
+                allocator.free(self.indices);
+            }
+        };
 
         renderer: *Renderer,
         meshes: std.StringHashMap(Mesh),
+        next_mesh_id: u32 = 0,
+        /// Holds the vertices and indices of all the meshes on the GPU.
+        arena: Arena,
 
         pub fn init(renderer: *Renderer) !Self {
             return .{
                 .renderer = renderer,
                 .meshes = std.StringHashMap(Mesh).init(renderer.allocator),
+                .arena = Arena.init(renderer),
             };
         }
 
         pub fn deinit(self: *Self) void {
             var it = self.meshes.iterator();
             while (it.next()) |entry| {
-                entry.value_ptr.deinit(self.renderer.system.vma_allocator);
+                self.renderer.allocator.free(entry.key_ptr.*);
             }
             self.meshes.deinit();
+            self.arena.deinit();
         }
 
+        /// `indices` can be empty for a mesh whose triangles are consecutive vertices. The mesh is
+        /// run through `prepare` first, so it is always indexed once registered. `name` is copied,
+        /// and must not be taken by another mesh.
         pub fn register(
             self: *Self,
             name: []const u8,
-            vertices: []VertexType,
+            vertices: []const SourceVertex,
+            indices: []const u32,
+        ) !Mesh {
+            if (self.meshes.contains(name)) {
+                return MeshSystemError.name_taken;
+            }
+
+            const prepared = try prepare(self.renderer.allocator, name, vertices, indices);
+            defer prepared.deinit(self.renderer.allocator);
+            return self.register_prepared(
+                name,
+                prepared.vertices,
+                prepared.indices,
+                prepared.lods.constSlice(),
+                prepared.bounds,
+            );
+        }
+
+        /// Does everything `register` does to a mesh before uploading it: encodes its vertices to
+        /// `VertexType`, runs it through `mesh_optimizer.optimize`, and builds its LODs with
+        /// `mesh_optimizer.build_lod_chain`. Only uses `allocator`, so it can run on any thread,
+        /// and its result can be cached, see mesh_cache.zig. `name` is only used for logging.
+        ///
+        /// Fails with `MeshSystemError.position_out_of_range` if `VertexType` packs positions
+        /// into a type that declares a `max_coordinate`, and the mesh goes past it.
+        pub fn prepare(
+            allocator: std.mem.Allocator,
+            name: []const u8,
+            vertices: []const SourceVertex,
+            indices: []const u32,
+        ) !PreparedMesh {
+            const Position = std.meta.FieldType(VertexType, .position);
+            if (is_encoded and @hasDecl(Position, "max_coordinate")) {
+                var max_coordinate: f32 = 0;
+                for (vertices) |vertex| {
+                    for (vertex.position.raw) |coordinate| {
+                        max_coordinate = @max(max_coordinate, @abs(coordinate));
+                    }
+                }
+                if (max_coordinate > Position.max_coordinate) {
+                    dutil.log(
+                        "mesh system",
+                        .warn,
+                        "mesh '{s}' goes {d} units from its origin, past the {d} its " ++
+                            "positions can hold",
+                        .{ name, max_coordinate, Position.max_coordinate },
+                    );
+                    return MeshSystemError.position_out_of_range;
+                }
+            }
+
+            // Encode before welding, so that vertices that only differ below the precision of
+            // `VertexType` are welded too.
+            const encoded_vertices = if (is_encoded)
+                try allocator.alloc(VertexType, vertices.len)
+            else
+                vertices;
+            defer if (is_encoded) allocator.free(encoded_vertices);
+            if (is_encoded) {
+                for (encoded_vertices, vertices) |*encoded, vertex| {
+                    encoded.* = VertexType.encode(vertex);
+                }
+            }
+
+            const optimized = try mesh_optimizer.optimize(
+                VertexType,
+                allocator,
+                encoded_vertices,
+                indices,
+            );
+            defer allocator.free(optimized.indices);
+            errdefer allocator.free(optimized.vertices);
+            dutil.log(
+                "mesh system",
+                .info,
+                "optimized mesh '{s}': {} -> {} vertices, ACMR {d:.3} -> {d:.3}",
+                .{
+                    name,
+                    vertices.len,
+                    optimized.vertices.len,
+                    optimized.acmr_before,
+                    optimized.acmr_after,
+                },
+            );
+
+            const lod_chain = try mesh_optimizer.build_lod_chain(
+                VertexType,
+                allocator,
+                optimized.vertices,
+                optimized.indices,
+            );
+            for (lod_chain.lods.constSlice(), 0..) |lod, i| {
+                dutil.log(
+                    "mesh system",
+                    .info,
+                    "mesh '{s}' LOD {}: {} triangles, error {d:.4}",
+                    .{ name, i, lod.index_count / 3, lod.geometric_error },
+                );
+            }
+
+            return .{
+                .vertices = optimized.vertices,
+                .indices = lod_chain.indices,
+                .lods = lod_chain.lods,
+                .bounds = bounds_of(VertexType, optimized.vertices),
+            };
+        }
+
+        /// Registers a mesh as `prepare` leaves it, e.g. loaded from a cache, without doing any
+        /// work on its vertices: they are copied as they are to staging memory, and not kept
+        /// afterwards. `name` is copied, and must not be taken by another mesh.
+        pub fn register_prepared(
+            self: *Self,
+            name: []const u8,
+            vertices: []const VertexType,
+            indices: []const u32,
+            lods: []const mesh_optimizer.Lod,
+            bounds: Bounds,
         ) !Mesh {
-            var mesh = try Mesh.init(self.renderer.allocator);
-            try mesh.vertices.appendSlice(vertices);
+            if (self.meshes.contains(name)) {
+                return MeshSystemError.name_taken;
+            }
 
-            try mesh.upload(self.renderer.system.vma_allocator);
+            var mesh = Mesh{
+                .id = self.next_mesh_id,
+                .lods = try std.BoundedArray(mesh_optimizer.Lod, mesh_optimizer.max_lod_count)
+                    .fromSlice(lods),
+                .geometry = try self.arena.upload(vertices, indices),
+                .bounds = bounds,
+            };
+            errdefer self.arena.free(&mesh.geometry);
 
-            try self.meshes.put(name, mesh);
+            const owned_name = try self.renderer.allocator.dupe(u8, name);
+            errdefer self.renderer.allocator.free(owned_name);
+            try self.meshes.put(owned_name, mesh);
+            self.next_mesh_id += 1;
 
             return mesh;
         }
@@ -0,0 +1,617 @@
+const std = @import("std");
+const vulkan = @import("vulkan");
+const vma = @import("vma");
+const dutil = @import("debug_utils");
+const texture_format = @import("../texture_format.zig");
+const Swapchain = @import("Swapchain.zig");
+const Renderer = @import("../Renderer.zig");
+
+pub const TextureStreamingError = error{
+    truncated_file,
+    image_creation_failed,
+};
+
+pub const TextureHandle = u32;
+
+/// Streams the mips of `.r4tex` textures (see texture_format.zig) in and out of video memory.
+///
+/// Loading a texture only reads and uploads its tail, the mips of at most `tail_size` texels,
+/// which are never evicted, so that it can be sampled right away. Finer mips are streamed in when
+/// `request` asks for them: a background thread reads the mips from the wanted one down to the
+/// coarsest, which are one contiguous range of the file, and `update` uploads them into a new
+/// image that replaces the old one. Textures that aren't requested for `eviction_delay` updates
+/// fall back to their tail. Besides the tails and the replaced images on their way out, the mips
+/// in video memory stay within `budget` bytes; when they can't all fit, the textures furthest
+/// from what they want go first.
+///
+/// Each texture has a single view of the mips it has, so sampling is naturally clamped to them.
+/// The view changes when the texture is streamed, and `generation` with it.
+pub const TextureStreamer = struct {
+    /// In texels, see above.
+    pub const tail_size = 64;
+    pub const default_budget = 256 << 20;
+    /// At most about this many bytes are uploaded per `update`, to bound how long the frame waits
+    /// for them. A texture bigger than this still gets uploaded, on its own.
+    pub const max_upload_per_update = 16 << 20;
+    /// Textures that haven't been requested for this many updates can be evicted.
+    pub const eviction_delay = 60;
+
+    pub const Texture = struct {
+        file: std.fs.File,
+        info: texture_format.TextureInfo,
+        image: vulkan.VkImage,
+        allocation: vma.VmaAllocation,
+        view: vulkan.VkImageView,
+        /// Bumped when `view` changes, so that descriptors can be updated.
+        generation: u32 = 0,
+
+        /// The finest mip of the file that is in `image`, as its level 0. Never coarser than
+        /// `tail_mip`.
+        resident_mip: u32,
+        tail_mip: u32,
+        /// The finest mip asked for by `request` in the last update it was called in.
+        wanted_mip: u32,
+        last_requested_update: u64 = 0,
+        /// The finest mip once the pending read, if any, is uploaded.
+        target_mip: u32,
+        is_read_pending: bool = false,
+    };
+
+    const Retired = struct {
+        image: vulkan.VkImage,
+        allocation: vma.VmaAllocation,
+        view: vulkan.VkImageView,
+        update: u64,
+    };
+
+    renderer: *Renderer,
+    allocator: std.mem.Allocator,
+    textures: std.ArrayList(Texture),
+    budget: u64 = default_budget,
+    /// The `streamed_size` of all the textures at their `target_mip`.
+    committed_bytes: u64 = 0,
+    update_count: u64 = 0,
+    /// Reads that are done but not uploaded yet.
+    ready: std.ArrayList(ReadResult),
+    /// Images replaced by streaming, which frames in flight may still sample.
+    retired: std.ArrayList(Retired),
+    reader: *Reader,
+
+    pub fn init(renderer: *Renderer) !TextureStreamer {
+        const allocator = renderer.allocator;
+        const reader = try allocator.create(Reader);
+        errdefer allocator.destroy(reader);
+        reader.* = .{
+            .requests = std.ArrayList(ReadRequest).init(allocator),
+            .results = std.ArrayList(ReadResult).init(allocator),
+            .allocator = allocator,
+            .thread = undefined,
+        };
+        reader.thread = try std.Thread.spawn(.{}, Reader.run, .{reader});
+
+        return .{
+            .renderer = renderer,
+            .allocator = allocator,
+            .textures = std.ArrayList(Texture).init(allocator),
+            .ready = std.ArrayList(ReadResult).init(allocator),
+            .retired = std.ArrayList(Retired).init(allocator),
+            .reader = reader,
+        };
+    }
+
+    /// The GPU must be done with all the textures.
+    pub fn deinit(self: *TextureStreamer) void {
+        self.reader.stop();
+        for (self.reader.results.items) |result| {
+            if (result.data) |data| self.allocator.free(data);
+        }
+        self.reader.requests.deinit();
+        self.reader.results.deinit();
+        self.allocator.destroy(self.reader);
+
+        for (self.ready.items) |result| {
+            if (result.data) |data| self.allocator.free(data);
+        }
+        self.ready.deinit();
+
+        for (self.retired.items) |retired| {
+            destroy_image(self.renderer, retired.image, retired.allocation, retired.view);
+        }
+        self.retired.deinit();
+        for (self.textures.items) |*texture| {
+            destroy_image(self.renderer, texture.image, texture.allocation, texture.view);
+            texture.info.deinit(self.allocator);
+            texture.file.close();
+        }
+        self.textures.deinit();
+    }
+
+    /// Opens a `.r4tex` file and uploads its tail. The file stays open to stream the other mips.
+    pub fn load(self: *TextureStreamer, path: []const u8) !TextureHandle {
+        const file = try std.fs.cwd().openFile(path, .{});
+        errdefer file.close();
+        var buffered_reader = std.io.bufferedReader(file.reader());
+        const info = try texture_format.TextureInfo.read(
+            self.allocator,
+            buffered_reader.reader(),
+            try file.getEndPos(),
+        );
+        errdefer info.deinit(self.allocator);
+
+        const tail_mip = info.first_mip_within(tail_size);
+        const span = info.span_from(tail_mip);
+        const data = try self.allocator.alloc(u8, span.size);
+        defer self.allocator.free(data);
+        if (try file.preadAll(data, span.offset) != data.len) {
+            return TextureStreamingError.truncated_file;
+        }
+
+        var texture = Texture{
+            .file = file,
+            .info = info,
+            .image = undefined,
+            .allocation = undefined,
+            .view = undefined,
+            .resident_mip = tail_mip,
+            .tail_mip = tail_mip,
+            .wanted_mip = tail_mip,
+            .target_mip = tail_mip,
+        };
+        try self.create_image(&texture, tail_mip, data);
+        errdefer destroy_image(self.renderer, texture.image, texture.allocation, texture.view);
+
+        // Each texture has at most one read in flight, so the reader never has to grow this.
+        {
+            self.reader.mutex.lock();
+            defer self.reader.mutex.unlock();
+            try self.reader.results.ensureTotalCapacity(self.textures.items.len + 1);
+        }
+        try self.textures.append(texture);
+
+        return @intCast(self.textures.items.len - 1);
+    }
+
+    pub fn get(self: *const TextureStreamer, handle: TextureHandle) *const Texture {
+        return &self.textures.items[handle];
+    }
+
+    /// Asks for texture `handle` to be sharp when it covers `screen_size` pixels across, e.g. the
+    /// projected size of the objects that use it. Call it every frame the texture is visible; the
+    /// biggest request of the frame wins.
+    pub fn request(self: *TextureStreamer, handle: TextureHandle, screen_size: f32) void {
+        const texture = &self.textures.items[handle];
+        const header = texture.info.header;
+        const texture_size: f32 = @floatFromInt(@max(header.width, header.height));
+
+        // The mip whose texels are about the size of a pixel.
+        const texels_per_pixel = texture_size / @max(screen_size, 1);
+        const mip: u32 = if (texels_per_pixel <= 1)
+            0
+        else
+            @min(@as(u32, @intFromFloat(@log2(texels_per_pixel))), texture.tail_mip);
+
+        if (texture.last_requested_update != self.update_count) {
+            texture.wanted_mip = mip;
+            texture.last_requested_update = self.update_count;
+        } else {
+            texture.wanted_mip = @min(texture.wanted_mip, mip);
+        }
+    }
+
+    /// Uploads the mips that were read since the last call, and starts reading the ones that are
+    /// now wanted. Call once per frame, before anything records draws with the textures; the
+    /// frame waits for the uploads on the GPU, see `VulkanSystem.submit_command_buffer`.
+    pub fn update(self: *TextureStreamer) !void {
+        self.update_count += 1;
+
+        // --- Destroy the images that no frame in flight can use anymore.
+
+        var i: usize = 0;
+        while (i < self.retired.items.len) {
+            const retired = self.retired.items[i];
+            if (retired.update + Swapchain.max_frames_in_flight < self.update_count) {
+                destroy_image(self.renderer, retired.image, retired.allocation, retired.view);
+                _ = self.retired.swapRemove(i);
+            } else {
+                i += 1;
+            }
+        }
+
+        // --- Upload what was read.
+
+        {
+            self.reader.mutex.lock();
+            defer self.reader.mutex.unlock();
+            try self.ready.appendSlice(self.reader.results.items);
+            self.reader.results.clearRetainingCapacity();
+        }
+
+        var uploaded: usize = 0;
+        while (self.ready.items.len > 0 and uploaded < max_upload_per_update) {
+            const result = self.ready.orderedRemove(0);
+            defer if (result.data) |data| self.allocator.free(data);
+
+            const texture = &self.textures.items[result.texture];
+            texture.is_read_pending = false;
+            const data = result.data orelse {
+                dutil.log(
+                    "texture streamer",
+                    .warn,
+                    "failed to read texture {}",
+                    .{result.texture},
+                );
+                self.cancel_target(texture);
+                continue;
+            };
+
+            // Like a failed read, a failed upload leaves the texture as it was, and it is read
+            // again if it is still wanted.
+            try self.retired.ensureUnusedCapacity(1);
+            const old_image = texture.image;
+            const old_allocation = texture.allocation;
+            const old_view = texture.view;
+            self.create_image(texture, result.mip, data) catch |err| {
+                dutil.log(
+                    "texture streamer",
+                    .warn,
+                    "failed to upload mip {} of texture {}: {s}",
+                    .{ result.mip, result.texture, @errorName(err) },
+                );
+                self.cancel_target(texture);
+                continue;
+            };
+            self.retired.appendAssumeCapacity(.{
+                .image = old_image,
+                .allocation = old_allocation,
+                .view = old_view,
+                .update = self.update_count,
+            });
+            texture.resident_mip = result.mip;
+            texture.generation += 1;
+            uploaded += data.len;
+        }
+
+        // --- Pick what to read next.
+
+        try self.evict_unused();
+
+        // Most blurry first.
+        var candidates = std.ArrayList(TextureHandle).init(self.allocator);
+        defer candidates.deinit();
+        for (self.textures.items, 0..) |texture, handle| {
+            if (!texture.is_read_pending and self.is_wanted(&texture) and
+                texture.wanted_mip < texture.target_mip)
+            {
+                try candidates.append(@intCast(handle));
+            }
+        }
+        std.mem.sort(TextureHandle, candidates.items, self, blurrier);
+
+        for (candidates.items) |handle| {
+            const texture = &self.textures.items[handle];
+            // As sharp as the budget allows.
+            const other_bytes = self.committed_bytes - streamed_size(texture, texture.target_mip);
+            var mip = texture.wanted_mip;
+            while (mip < texture.target_mip and
+                other_bytes + streamed_size(texture, mip) > self.budget)
+            {
+                mip += 1;
+            }
+            if (mip < texture.target_mip) {
+                try self.start_read(handle, mip);
+            }
+        }
+    }
+
+    /// Gives up on the mip `texture` was being read at: it stays at its resident mip, and the
+    /// budget only counts that.
+    fn cancel_target(self: *TextureStreamer, texture: *Texture) void {
+        self.committed_bytes -= streamed_size(texture, texture.target_mip);
+        self.committed_bytes += streamed_size(texture, texture.resident_mip);
+        texture.target_mip = texture.resident_mip;
+    }
+
+    fn blurrier(self: *TextureStreamer, a: TextureHandle, b: TextureHandle) bool {
+        const texture_a = &self.textures.items[a];
+        const texture_b = &self.textures.items[b];
+        return texture_a.target_mip - texture_a.wanted_mip >
+            texture_b.target_mip - texture_b.wanted_mip;
+    }
+
+    fn is_wanted(self: *const TextureStreamer, texture: *const Texture) bool {
+        return texture.last_requested_update + eviction_delay >= self.update_count;
+    }
+
+    /// The memory that mips `mip` to the coarsest of `texture` take, besides its tail.
+    fn streamed_size(texture: *const Texture, mip: u32) u64 {
+        return texture.info.resident_size_from(mip) -
+            texture.info.resident_size_from(texture.tail_mip);
+    }
+
+    /// Drops the textures that aren't wanted anymore back to their tail, which they are read
+    /// again with.
+    fn evict_unused(self: *TextureStreamer) !void {
+        for (self.textures.items, 0..) |*texture, handle| {
+            if (texture.is_read_pending or self.is_wanted(texture) or
+                texture.target_mip == texture.tail_mip)
+            {
+                continue;
+            }
+            try self.start_read(@intCast(handle), texture.tail_mip);
+        }
+    }
+
+    fn start_read(self: *TextureStreamer, handle: TextureHandle, mip: u32) !void {
+        const texture = &self.textures.items[handle];
+        const span = texture.info.span_from(mip);
+        try self.reader.push(.{
+            .texture = handle,
+            .mip = mip,
+            .file = texture.file,
+            .offset = span.offset,
+            .size = span.size,
+        });
+
+        self.committed_bytes -= streamed_size(texture, texture.target_mip);
+        self.committed_bytes += streamed_size(texture, mip);
+        texture.target_mip = mip;
+        texture.is_read_pending = true;
+    }
+
+    /// Creates an image holding mips `first_mip` to the coarsest of `texture`, queues the upload
+    /// of `data` into it, and makes it the image of `texture`. `data` is the range of the file
+    /// given by `span_from(first_mip)`.
+    fn create_image(
+        self: *TextureStreamer,
+        texture: *Texture,
+        first_mip: u32,
+        data: []const u8,
+    ) !void {
+        const system = &self.renderer.system;
+        const upload_system = &system.upload_system;
+        const info = &texture.info;
+        const level_count = info.header.mip_count - first_mip;
+        const format: vulkan.VkFormat = switch (info.header.format) {
+            .rgba8_srgb => vulkan.VK_FORMAT_R8G8B8A8_SRGB,
+            .rgba8_unorm => vulkan.VK_FORMAT_R8G8B8A8_UNORM,
+        };
+
+        // --- Image and view.
+
+        const is_shared = upload_system.queue_family_count > 1;
+        const image_info = vulkan.VkImageCreateInfo{
+            .sType = vulkan.VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .imageType = vulkan.VK_IMAGE_TYPE_2D,
+            .extent = .{
+                .width = info.mips[first_mip].width,
+                .height = info.mips[first_mip].height,
+                .depth = 1,
+            },
+            .mipLevels = level_count,
+            .arrayLayers = 1,
+            .format = format,
+            .tiling = vulkan.VK_IMAGE_TILING_OPTIMAL,
+            .initialLayout = vulkan.VK_IMAGE_LAYOUT_UNDEFINED,
+            .usage = vulkan.VK_IMAGE_USAGE_TRANSFER_DST_BIT | vulkan.VK_IMAGE_USAGE_SAMPLED_BIT,
+            .sharingMode = if (is_shared)
+                vulkan.VK_SHARING_MODE_CONCURRENT
+            else
+                vulkan.VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = if (is_shared) upload_system.queue_family_count else 0,
+            .pQueueFamilyIndices = &upload_system.queue_family_indices,
+            .samples = vulkan.VK_SAMPLE_COUNT_1_BIT,
+        };
+        const allocation_info = vma.VmaAllocationCreateInfo{
+            .usage = vma.VMA_MEMORY_USAGE_GPU_ONLY,
+        };
+        var image: vulkan.VkImage = undefined;
+        var allocation: vma.VmaAllocation = undefined;
+        if (vma.vmaCreateImage(
+            system.vma_allocator,
+            @ptrCast(&image_info),
+            &allocation_info,
+            @ptrCast(&image),
+            &allocation,
+            null,
+        ) != vulkan.VK_SUCCESS) {
+            return TextureStreamingError.image_creation_failed;
+        }
+        errdefer vma.vmaDestroyImage(system.vma_allocator, @ptrCast(image), allocation);
+
+        const view_info = vulkan.VkImageViewCreateInfo{
+            .sType = vulkan.VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = image,
+            .viewType = vulkan.VK_IMAGE_VIEW_TYPE_2D,
+            .format = format,
+            .subresourceRange = .{
+                .aspectMask = vulkan.VK_IMAGE_ASPECT_COLOR_BIT,
+                .baseMipLevel = 0,
+                .levelCount = level_count,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            },
+        };
+        var view: vulkan.VkImageView = undefined;
+        if (vulkan.vkCreateImageView(system.logical_device, &view_info, null, &view) !=
+            vulkan.VK_SUCCESS)
+        {
+            return TextureStreamingError.image_creation_failed;
+        }
+        errdefer vulkan.vkDestroyImageView(system.logical_device, view, null);
+
+        // --- Upload.
+
+        var command_buffer = try upload_system.record_commands();
+        transition(
+            command_buffer,
+            image,
+            level_count,
+            vulkan.VK_IMAGE_LAYOUT_UNDEFINED,
+            vulkan.VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        );
+        const span = info.span_from(first_mip);
+        for (info.mips[first_mip..], 0..) |mip, level| {
+            try upload_system.upload_image(
+                system,
+                image,
+                @intCast(level),
+                mip.width,
+                mip.height,
+                data[mip.offset - span.offset ..][0..mip.size],
+            );
+        }
+        // The uploads may have moved on to another batch.
+        command_buffer = try upload_system.record_commands();
+        transition(
+            command_buffer,
+            image,
+            level_count,
+            vulkan.VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            vulkan.VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        );
+
+        texture.image = image;
+        texture.allocation = allocation;
+        texture.view = view;
+    }
+};
+
+/// A layout transition of all of `image` for, or after, transfers. The graphics queue waits for
+/// the upload timeline semaphore before it samples the image, so the transition to shader reads
+/// doesn't need to wait for anything past the transfer.
+fn transition(
+    command_buffer: vulkan.VkCommandBuffer,
+    image: vulkan.VkImage,
+    level_count: u32,
+    old_layout: vulkan.VkImageLayout,
+    new_layout: vulkan.VkImageLayout,
+) void {
+    const is_to_transfer = new_layout == vulkan.VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    const barrier = vulkan.VkImageMemoryBarrier{
+        .sType = vulkan.VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .oldLayout = old_layout,
+        .newLayout = new_layout,
+        .srcQueueFamilyIndex = vulkan.VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = vulkan.VK_QUEUE_FAMILY_IGNORED,
+        .image = image,
+        .subresourceRange = .{
+            .aspectMask = vulkan.VK_IMAGE_ASPECT_COLOR_BIT,
+            .baseMipLevel = 0,
+            .levelCount = level_count,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+        },
+        .srcAccessMask = if (is_to_transfer) 0 else vulkan.VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = if (is_to_transfer) vulkan.VK_ACCESS_TRANSFER_WRITE_BIT else 0,
+    };
+    vulkan.vkCmdPipelineBarrier(
+        command_buffer,
+        if (is_to_transfer)
+            vulkan.VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT
+        else
+            vulkan.VK_PIPELINE_STAGE_TRANSFER_BIT,
+        if (is_to_transfer)
+            vulkan.VK_PIPELINE_STAGE_TRANSFER_BIT
+        else
+            vulkan.VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        0,
+        0,
+        null,
+        0,
+        null,
+        1,
+        &barrier,
+    );
+}
+
+fn destroy_image(
+    renderer: *Renderer,
+    image: vulkan.VkImage,
+    allocation: vma.VmaAllocation,
+    view: vulkan.VkImageView,
+) void {
+    vulkan.vkDestroyImageView(renderer.system.logical_device, view, null);
+    vma.vmaDestroyImage(renderer.system.vma_allocator, @ptrCast(image), allocation);
+}
+
+// --- Background reads.
+
+const ReadRequest = struct {
+    texture: TextureHandle,
+    mip: u32,
+    file: std.fs.File,
+    offset: u64,
+    size: u64,
+};
+
+const ReadResult = struct {
+    texture: TextureHandle,
+    mip: u32,
+    /// `null` if the read failed.
+    data: ?[]u8,
+};
+
+/// A thread that reads ranges of files into memory, so that streaming never waits for the disk.
+/// The reads are independent `pread`s, so the files can be shared with the main thread.
+const Reader = struct {
+    allocator: std.mem.Allocator,
+    thread: std.Thread,
+    mutex: std.Thread.Mutex = .{},
+    condition: std.Thread.Condition = .{},
+    requests: std.ArrayList(ReadRequest),
+    /// Has room for a result per texture, see `TextureStreamer.load`.
+    results: std.ArrayList(ReadResult),
+    should_stop: bool = false,
+
+    fn push(self: *Reader, read_request: ReadRequest) !void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        try self.requests.append(read_request);
+        self.condition.signal();
+    }
+
+    fn stop(self: *Reader) void {
+        {
+            self.mutex.lock();
+            defer self.mutex.unlock();
+            self.should_stop = true;
+            self.condition.signal();
+        }
+        self.thread.join();
+    }
+
+    fn run(self: *Reader) void {
+        while (true) {
+            const read_request = blk: {
+                self.mutex.lock();
+                defer self.mutex.unlock();
+                while (self.requests.items.len == 0 and !self.should_stop) {
+                    self.condition.wait(&self.mutex);
+                }
+                if (self.should_stop) {
+                    return;
+                }
+                break :blk self.requests.orderedRemove(0);
+            };
+
+            const data = self.read(read_request) catch null;
+
+            self.mutex.lock();
+            defer self.mutex.unlock();
+            self.results.appendAssumeCapacity(.{
+                .texture = read_request.texture,
+                .mip = read_request.mip,
+                .data = data,
+            });
+        }
+    }
+
+    fn read(self: *Reader, read_request: ReadRequest) ![]u8 {
+        const data = try self.allocator.alloc(u8, read_request.size);
+        errdefer self.allocator.free(data);
+        if (try read_request.file.preadAll(data, read_request.offset) != data.len) {
+            return TextureStreamingError.truncated_file;
+        }
+        return data;
+    }
+};
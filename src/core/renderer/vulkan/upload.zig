@@ -0,0 +1,397 @@
+const std = @import("std");
+const c_string = @cImport({
+    @cInclude("string.h");
+});
+const vulkan = @import("vulkan");
+const vma = @import("vma");
+const dutil = @import("debug_utils");
+const l0vk = @import("../layer0/vulkan/vulkan.zig");
+const buffer = @import("buffer.zig");
+const VulkanSystem = @import("./VulkanSystem.zig");
+const VulkanError = VulkanSystem.VulkanError;
+
+pub const UploadError = error{
+    staging_buffer_allocation_failed,
+};
+
+/// Copies data from the host into device-local buffers and images, in batches.
+///
+/// Data is written into a persistently mapped staging buffer used as a ring, and the copies out of
+/// it are recorded into the command buffer of the current batch. Nothing is submitted until
+/// `flush`, or until the ring or the batches run out, so loading hundreds of meshes costs a
+/// handful of submits instead of one submit and one queue wait each. Each submitted batch has a
+/// fence; the ring space of a batch is reused once its fence is signaled.
+///
+/// Each submitted batch also signals the next value of `timeline`. The graphics queue waits for
+/// the latest value on the GPU before reading what was uploaded (see `flush_for_graphics`), so
+/// the CPU never waits for uploads to draw. The copies run on a transfer-only queue when the
+/// device has one (see `find_queue_families`), so they can overlap rendering. Buffers written
+/// from that queue and read on the graphics queue must be created with
+/// `VK_SHARING_MODE_CONCURRENT` over `queue_family_indices`, since no queue family ownership
+/// transfer is done.
+pub const UploadSystem = struct {
+    /// Size of the staging ring. Uploads larger than half of it are split.
+    pub const staging_capacity = 64 << 20;
+    /// Number of batches that can be recorded or in flight at once.
+    const max_batches = 4;
+    /// Offsets in the ring are aligned to this, which satisfies `vkCmdCopyBuffer` and
+    /// `vkCmdCopyBufferToImage` for any format.
+    const staging_alignment = 16;
+
+    const Batch = struct {
+        command_buffer: vulkan.VkCommandBuffer,
+        fence: vulkan.VkFence,
+        /// Value of `ring_head` once all the data of the batch was written. The ring's tail
+        /// moves there when the batch is done.
+        ring_end: u64 = 0,
+        copy_count: usize = 0,
+    };
+
+    staging: buffer.AllocatedBuffer,
+    staging_mapped: [*]u8,
+
+    queue: vulkan.VkQueue,
+    command_pool: vulkan.VkCommandPool,
+    batches: [max_batches]Batch,
+    /// A timeline semaphore, whose value is the number of batches that are done.
+    timeline: vulkan.VkSemaphore,
+    /// The number of batches submitted so far, which `timeline` reaches once they are all done.
+    submitted_value: u64 = 0,
+    /// Index of the oldest submitted batch that isn't known to be done.
+    oldest_batch: usize = 0,
+    /// The batches from `oldest_batch` on that are submitted. The next one is being recorded.
+    in_flight_count: usize = 0,
+
+    /// Total bytes ever reserved in, and released from, the ring. Their difference is the space in
+    /// use; either modulo `staging_capacity` is a position in the ring.
+    ring_head: u64 = 0,
+    ring_tail: u64 = 0,
+
+    /// The queue families that use the uploaded buffers: graphics, and transfer if it is
+    /// different.
+    queue_family_indices: [2]u32,
+    queue_family_count: u32,
+
+    pub fn init(
+        logical_device: vulkan.VkDevice,
+        vma_allocator: vma.VmaAllocator,
+        queue: vulkan.VkQueue,
+        queue_family: u32,
+        graphics_family: u32,
+    ) !UploadSystem {
+        // --- Staging ring.
+
+        const buffer_info = vulkan.VkBufferCreateInfo{
+            .sType = vulkan.VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = staging_capacity,
+            .usage = vulkan.VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        };
+        const alloc_info = vma.VmaAllocationCreateInfo{
+            .usage = vma.VMA_MEMORY_USAGE_CPU_ONLY,
+            .requiredFlags = vma.VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
+                vma.VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+        };
+        var staging: buffer.AllocatedBuffer = undefined;
+        if (vma.vmaCreateBuffer(
+            vma_allocator,
+            @ptrCast(&buffer_info),
+            &alloc_info,
+            @ptrCast(&staging.buffer),
+            &staging.allocation,
+            null,
+        ) != vulkan.VK_SUCCESS) {
+            return UploadError.staging_buffer_allocation_failed;
+        }
+        errdefer staging.deinit(vma_allocator);
+
+        var mapped: ?*anyopaque = undefined;
+        if (vma.vmaMapMemory(vma_allocator, staging.allocation, &mapped) != vulkan.VK_SUCCESS) {
+            return UploadError.staging_buffer_allocation_failed;
+        }
+        errdefer vma.vmaUnmapMemory(vma_allocator, staging.allocation);
+
+        // --- Command buffers and fences.
+
+        const command_pool = try l0vk.vkCreateCommandPool(logical_device, &.{
+            .queueFamilyIndex = queue_family,
+            .flags = .{
+                .reset_command_buffer = true,
+            },
+        }, null);
+        errdefer l0vk.vkDestroyCommandPool(logical_device, command_pool, null);
+
+        var command_buffers: [max_batches]vulkan.VkCommandBuffer = undefined;
+        const command_buffer_info = vulkan.VkCommandBufferAllocateInfo{
+            .sType = vulkan.VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = command_pool,
+            .level = vulkan.VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = max_batches,
+        };
+        try check(vulkan.vkAllocateCommandBuffers(
+            logical_device,
+            &command_buffer_info,
+            &command_buffers,
+        ));
+
+        var batches: [max_batches]Batch = undefined;
+        var fence_count: usize = 0;
+        errdefer for (batches[0..fence_count]) |batch| {
+            vulkan.vkDestroyFence(logical_device, batch.fence, null);
+        };
+        for (&batches, command_buffers) |*batch, command_buffer| {
+            batch.* = .{
+                .command_buffer = command_buffer,
+                .fence = try l0vk.vkCreateFence(logical_device, &.{}, null),
+            };
+            fence_count += 1;
+        }
+
+        const timeline_type_info = vulkan.VkSemaphoreTypeCreateInfo{
+            .sType = vulkan.VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+            .semaphoreType = vulkan.VK_SEMAPHORE_TYPE_TIMELINE,
+            .initialValue = 0,
+        };
+        const timeline_info = vulkan.VkSemaphoreCreateInfo{
+            .sType = vulkan.VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            .pNext = &timeline_type_info,
+        };
+        var timeline: vulkan.VkSemaphore = undefined;
+        try check(vulkan.vkCreateSemaphore(logical_device, &timeline_info, null, &timeline));
+
+        if (queue_family != graphics_family) {
+            dutil.log("upload system", .info, "using transfer queue family {}", .{queue_family});
+        }
+
+        return .{
+            .staging = staging,
+            .staging_mapped = @ptrCast(mapped.?),
+            .queue = queue,
+            .command_pool = command_pool,
+            .batches = batches,
+            .timeline = timeline,
+            .queue_family_indices = .{ graphics_family, queue_family },
+            .queue_family_count = if (queue_family != graphics_family) 2 else 1,
+        };
+    }
+
+    /// The device must be idle.
+    pub fn deinit(self: *UploadSystem, system: *VulkanSystem) void {
+        for (self.batches) |batch| {
+            vulkan.vkDestroyFence(system.logical_device, batch.fence, null);
+        }
+        vulkan.vkDestroySemaphore(system.logical_device, self.timeline, null);
+        l0vk.vkDestroyCommandPool(system.logical_device, self.command_pool, null);
+        vma.vmaUnmapMemory(system.vma_allocator, self.staging.allocation);
+        self.staging.deinit(system.vma_allocator);
+    }
+
+    /// Queues a copy of `data` to `dst` at `dst_offset`. `data` can be freed right away, but
+    /// `dst` must not be read before the copy is done, see `flush_for_graphics`.
+    pub fn upload_buffer(
+        self: *UploadSystem,
+        system: *VulkanSystem,
+        dst: vulkan.VkBuffer,
+        dst_offset: u64,
+        data: []const u8,
+    ) !void {
+        var done: usize = 0;
+        while (done < data.len) {
+            const chunk = data[done..][0..@min(data.len - done, staging_capacity / 2)];
+            const staging_offset = try self.reserve(system, chunk.len);
+            _ = c_string.memcpy(self.staging_mapped + staging_offset, chunk.ptr, chunk.len);
+
+            const region = vulkan.VkBufferCopy{
+                .srcOffset = staging_offset,
+                .dstOffset = dst_offset + done,
+                .size = chunk.len,
+            };
+            const batch = try self.current_batch();
+            vulkan.vkCmdCopyBuffer(batch.command_buffer, self.staging.buffer, dst, 1, &region);
+            batch.ring_end = self.ring_head;
+
+            done += chunk.len;
+        }
+    }
+
+    /// Queues a copy of `data`, the tightly packed texels of mip `level` of `image`, which is
+    /// `width` x `height`. The mip must be in `VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL` when the copy
+    /// runs, see `record_commands`. Mips larger than half of the ring are copied in bands of rows.
+    pub fn upload_image(
+        self: *UploadSystem,
+        system: *VulkanSystem,
+        image: vulkan.VkImage,
+        level: u32,
+        width: u32,
+        height: u32,
+        data: []const u8,
+    ) !void {
+        const row_size = data.len / height;
+        std.debug.assert(row_size * height == data.len and row_size <= staging_capacity / 2);
+        const rows_per_chunk: u32 = @intCast(@min(staging_capacity / 2 / row_size, height));
+
+        var row: u32 = 0;
+        while (row < height) {
+            const row_count = @min(height - row, rows_per_chunk);
+            const chunk = data[row * row_size ..][0 .. row_count * row_size];
+            const staging_offset = try self.reserve(system, chunk.len);
+            _ = c_string.memcpy(self.staging_mapped + staging_offset, chunk.ptr, chunk.len);
+
+            const region = vulkan.VkBufferImageCopy{
+                .bufferOffset = staging_offset,
+                .bufferRowLength = 0,
+                .bufferImageHeight = 0,
+                .imageSubresource = .{
+                    .aspectMask = vulkan.VK_IMAGE_ASPECT_COLOR_BIT,
+                    .mipLevel = level,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1,
+                },
+                .imageOffset = .{ .x = 0, .y = @intCast(row), .z = 0 },
+                .imageExtent = .{ .width = width, .height = row_count, .depth = 1 },
+            };
+            const batch = try self.current_batch();
+            vulkan.vkCmdCopyBufferToImage(
+                batch.command_buffer,
+                self.staging.buffer,
+                image,
+                vulkan.VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                1,
+                &region,
+            );
+            batch.ring_end = self.ring_head;
+
+            row += row_count;
+        }
+    }
+
+    /// The command buffer that the next copies go into, to record commands that must run in
+    /// order with them, such as layout transitions. Barriers recorded there also order copies in
+    /// other batches, since those are on the same queue. The queue may be transfer-only, so
+    /// barriers can only use the transfer, top of pipe and bottom of pipe stages.
+    pub fn record_commands(self: *UploadSystem) !vulkan.VkCommandBuffer {
+        return (try self.current_batch()).command_buffer;
+    }
+
+    /// Submits the copies queued so far, without waiting for them.
+    pub fn flush(self: *UploadSystem, system: *VulkanSystem) !void {
+        const batch = &self.batches[(self.oldest_batch + self.in_flight_count) % max_batches];
+        if (batch.copy_count == 0) {
+            return;
+        }
+        if (self.in_flight_count == max_batches - 1) {
+            // The batch after this one would be the oldest, which must be done to be reused.
+            try self.retire_oldest(system);
+        }
+
+        try check(vulkan.vkEndCommandBuffer(batch.command_buffer));
+        const signal_value = self.submitted_value + 1;
+        const timeline_info = vulkan.VkTimelineSemaphoreSubmitInfo{
+            .sType = vulkan.VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .signalSemaphoreValueCount = 1,
+            .pSignalSemaphoreValues = &signal_value,
+        };
+        const submit_info = vulkan.VkSubmitInfo{
+            .sType = vulkan.VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = &timeline_info,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &batch.command_buffer,
+            .signalSemaphoreCount = 1,
+            .pSignalSemaphores = &self.timeline,
+        };
+        try check(vulkan.vkQueueSubmit(self.queue, 1, &submit_info, batch.fence));
+        self.submitted_value = signal_value;
+        self.in_flight_count += 1;
+    }
+
+    /// Submits the copies queued so far, without waiting for them, and returns the value that
+    /// `timeline` reaches once they and all the earlier ones are done. Work on another queue that
+    /// reads uploaded data must wait for that value on the GPU, as
+    /// `VulkanSystem.submit_command_buffer` does for every frame.
+    pub fn flush_for_graphics(self: *UploadSystem, system: *VulkanSystem) !u64 {
+        try self.flush(system);
+        return self.submitted_value;
+    }
+
+    /// Submits the copies queued so far and waits for all of them on the CPU, e.g. before
+    /// reading back or freeing what they write. Cheap when nothing was uploaded since the last
+    /// call.
+    pub fn wait_idle(self: *UploadSystem, system: *VulkanSystem) !void {
+        try self.flush(system);
+        while (self.in_flight_count > 0) {
+            try self.retire_oldest(system);
+        }
+    }
+
+    /// The batch being recorded, begun if it has no copies yet.
+    fn current_batch(self: *UploadSystem) !*Batch {
+        const batch = &self.batches[(self.oldest_batch + self.in_flight_count) % max_batches];
+        if (batch.copy_count == 0) {
+            try check(vulkan.vkResetCommandBuffer(batch.command_buffer, 0));
+            const begin_info = vulkan.VkCommandBufferBeginInfo{
+                .sType = vulkan.VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                .flags = vulkan.VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+            };
+            try check(vulkan.vkBeginCommandBuffer(batch.command_buffer, &begin_info));
+        }
+        batch.copy_count += 1;
+        return batch;
+    }
+
+    /// Waits for the oldest submitted batch and gives its ring space back.
+    fn retire_oldest(self: *UploadSystem, system: *VulkanSystem) !void {
+        std.debug.assert(self.in_flight_count > 0);
+        const batch = &self.batches[self.oldest_batch];
+        try check(vulkan.vkWaitForFences(
+            system.logical_device,
+            1,
+            &batch.fence,
+            vulkan.VK_TRUE,
+            std.math.maxInt(u64),
+        ));
+        try check(vulkan.vkResetFences(system.logical_device, 1, &batch.fence));
+
+        self.ring_tail = @max(self.ring_tail, batch.ring_end);
+        batch.copy_count = 0;
+        self.oldest_batch = (self.oldest_batch + 1) % max_batches;
+        self.in_flight_count -= 1;
+    }
+
+    /// Returns the offset in the ring of `size` free bytes, waiting for batches to be done, and
+    /// submitting the current one, if needed. A reservation never wraps around the end of the
+    /// ring; the space up to the end is skipped instead.
+    fn reserve(self: *UploadSystem, system: *VulkanSystem, size: usize) !usize {
+        std.debug.assert(size <= staging_capacity / 2);
+        while (true) {
+            var start = std.mem.alignForward(u64, self.ring_head, staging_alignment);
+            const position = start % staging_capacity;
+            if (position + size > staging_capacity) {
+                start += staging_capacity - position;
+            }
+
+            if (start + size - self.ring_tail <= staging_capacity) {
+                self.ring_head = start + size;
+                return @intCast(start % staging_capacity);
+            }
+
+            if (self.in_flight_count > 0) {
+                try self.retire_oldest(system);
+            } else if (self.batches[self.oldest_batch].copy_count > 0) {
+                try self.flush(system);
+            } else {
+                // Nothing uses the ring.
+                self.ring_tail = self.ring_head;
+            }
+        }
+    }
+};
+
+fn check(result: vulkan.VkResult) VulkanError!void {
+    if (result != vulkan.VK_SUCCESS) {
+        switch (result) {
+            vulkan.VK_ERROR_OUT_OF_HOST_MEMORY => return VulkanError.vk_error_out_of_host_memory,
+            vulkan.VK_ERROR_OUT_OF_DEVICE_MEMORY => return VulkanError.vk_error_out_of_device_memory,
+            vulkan.VK_ERROR_DEVICE_LOST => return VulkanError.vk_error_device_lost,
+            else => unreachable,
+        }
+    }
+}
@@ -0,0 +1,282 @@
+const std = @import("std");
+const lib = @import("./lib.zig");
+const Ecs = lib.Ecs;
+const EcsError = lib.EcsError;
+const Entity = @import("./entities.zig").Entity;
+const component_lib = @import("./components.zig");
+
+/// Components are copied into a byte buffer aligned to this, so no component type may need more.
+const max_component_alignment = 16;
+
+/// An entity created through a `CommandBuffer`. It only gets an `Entity` when the buffer is
+/// applied, but components can already be added to it through the buffer.
+pub const CreatedEntity = struct {
+    /// Index into the entities created by the buffer, in order.
+    idx: u32,
+};
+
+const Command = struct {
+    kind: Kind,
+    target: Target,
+    /// For `add` and `remove`, see `get_or_assign_component_type_id`.
+    type_id: u32 = 0,
+    /// For `add`, where the component is in `CommandBuffer.payload`.
+    payload_offset: u32 = 0,
+    /// For `add` and `remove`.
+    apply_fn: ?*const fn (ecs: *Ecs, entity: Entity, payload: [*]const u8) EcsError!void = null,
+
+    const Kind = enum {
+        create,
+        add_or_remove,
+        destroy,
+    };
+
+    const Target = union(enum) {
+        entity: Entity,
+        created: CreatedEntity,
+    };
+
+    /// Commands are applied sorted by this: entities are created first, then components are
+    /// added and removed grouped by type, and entities are destroyed last.
+    fn less_than(_: void, a: Command, b: Command) bool {
+        if (a.kind != b.kind) {
+            return @intFromEnum(a.kind) < @intFromEnum(b.kind);
+        }
+        return a.type_id < b.type_id;
+    }
+};
+
+/// Records structural changes to an `Ecs` (creating and destroying entities, adding and removing
+/// components) to be applied later with `apply`, at a point where nothing is iterating over the
+/// component arrays. This is how systems run by a `Scheduler` change structure, each job with its
+/// own buffer.
+///
+/// `apply` sorts the commands by component type, so each component array is reserved once and
+/// then added to or removed from in one go. The sort is stable, so the commands for one component
+/// type keep their recorded order. All creations happen before any other command and all
+/// destructions after, so components can be added to an entity that is destroyed in the same
+/// batch, and destroying an entity twice is not an error.
+///
+/// Component types must be registered with the `Ecs` before they are recorded.
+pub const CommandBuffer = struct {
+    commands: std.ArrayList(Command),
+    /// The components of `add` commands, copied in.
+    payload: std.ArrayListAligned(u8, max_component_alignment),
+    num_created: u32 = 0,
+    /// The entities created by the last `apply`, indexed by `CreatedEntity.idx`.
+    created_entities: std.ArrayList(Entity),
+
+    const Self = @This();
+
+    pub fn init(allocator: std.mem.Allocator) Self {
+        return .{
+            .commands = std.ArrayList(Command).init(allocator),
+            .payload = std.ArrayListAligned(u8, max_component_alignment).init(allocator),
+            .created_entities = std.ArrayList(Entity).init(allocator),
+        };
+    }
+
+    pub fn deinit(self: *Self) void {
+        self.commands.deinit();
+        self.payload.deinit();
+        self.created_entities.deinit();
+    }
+
+    pub fn is_empty(self: *const Self) bool {
+        return self.commands.items.len == 0;
+    }
+
+    /// Drops all recorded commands, keeping the memory for the next frame.
+    pub fn clear(self: *Self) void {
+        self.commands.clearRetainingCapacity();
+        self.payload.clearRetainingCapacity();
+        self.num_created = 0;
+    }
+
+    pub fn create_entity(self: *Self) !CreatedEntity {
+        const created = CreatedEntity{ .idx = self.num_created };
+        try self.commands.append(.{ .kind = .create, .target = .{ .created = created } });
+        self.num_created += 1;
+        return created;
+    }
+
+    pub fn destroy_entity(self: *Self, entity: Entity) !void {
+        try self.commands.append(.{ .kind = .destroy, .target = .{ .entity = entity } });
+    }
+
+    pub fn add_component(self: *Self, entity: Entity, component: anytype) !void {
+        try self.record_add(.{ .entity = entity }, component);
+    }
+
+    pub fn add_component_to_created(
+        self: *Self,
+        created: CreatedEntity,
+        component: anytype,
+    ) !void {
+        try self.record_add(.{ .created = created }, component);
+    }
+
+    pub fn remove_component(self: *Self, entity: Entity, comptime component_ty: type) !void {
+        const Apply = struct {
+            fn apply(ecs: *Ecs, entity_: Entity, payload: [*]const u8) EcsError!void {
+                _ = payload;
+                try ecs.remove_component_for_entity(entity_, component_ty);
+            }
+        };
+        try self.commands.append(.{
+            .kind = .add_or_remove,
+            .target = .{ .entity = entity },
+            .type_id = component_lib.get_or_assign_component_type_id(component_ty),
+            .apply_fn = Apply.apply,
+        });
+    }
+
+    fn record_add(self: *Self, target: Command.Target, component: anytype) !void {
+        const component_ty = @TypeOf(component);
+        comptime std.debug.assert(@alignOf(component_ty) <= max_component_alignment);
+
+        const Apply = struct {
+            fn apply(ecs: *Ecs, entity: Entity, payload: [*]const u8) EcsError!void {
+                const component_ptr: *const component_ty = @ptrCast(@alignCast(payload));
+                try ecs.add_component_for_entity(entity, component_ptr.*);
+            }
+        };
+
+        try self.commands.ensureUnusedCapacity(1);
+        const offset = std.mem.alignForward(usize, self.payload.items.len, @alignOf(component_ty));
+        try self.payload.resize(offset + @sizeOf(component_ty));
+        const bytes = std.mem.asBytes(&component);
+        @memcpy(self.payload.items[offset..][0..bytes.len], bytes);
+
+        self.commands.appendAssumeCapacity(.{
+            .kind = .add_or_remove,
+            .target = target,
+            .type_id = component_lib.get_or_assign_component_type_id(component_ty),
+            .payload_offset = @intCast(offset),
+            .apply_fn = Apply.apply,
+        });
+    }
+
+    fn resolve(self: *const Self, target: Command.Target) Entity {
+        return switch (target) {
+            .entity => |entity| entity,
+            .created => |created| self.created_entities.items[created.idx],
+        };
+    }
+
+    /// Applies and then clears the recorded commands. The entities created by them are in
+    /// `created_entities` afterwards, until the next `apply`.
+    ///
+    /// Returns:
+    /// - `void` on success
+    /// - the first error of an add or remove, e.g. `.entity_not_alive` for an entity destroyed
+    ///   before `apply`. The commands after it are dropped.
+    pub fn apply(self: *Self, ecs: *Ecs) EcsError!void {
+        defer self.clear();
+
+        std.mem.sort(Command, self.commands.items, {}, Command.less_than);
+
+        self.created_entities.clearRetainingCapacity();
+        try self.created_entities.ensureTotalCapacity(self.num_created);
+
+        var i: usize = 0;
+        while (i < self.commands.items.len) {
+            const command = self.commands.items[i];
+            switch (command.kind) {
+                .create => {
+                    self.created_entities.appendAssumeCapacity(try ecs.create_entity());
+                    i += 1;
+                },
+                .add_or_remove => {
+                    // Reserve for the whole run of commands of this type up front, rather than
+                    // growing the arrays one add at a time.
+                    var run_end = i + 1;
+                    while (run_end < self.commands.items.len and
+                        self.commands.items[run_end].kind == .add_or_remove and
+                        self.commands.items[run_end].type_id == command.type_id)
+                    {
+                        run_end += 1;
+                    }
+                    try ecs.component_manager.reserve_components(command.type_id, run_end - i);
+
+                    for (self.commands.items[i..run_end]) |run_command| {
+                        const payload = self.payload.items.ptr + run_command.payload_offset;
+                        try run_command.apply_fn.?(ecs, self.resolve(run_command.target), payload);
+                    }
+                    i = run_end;
+                },
+                .destroy => {
+                    const entity = self.resolve(command.target);
+                    if (ecs.is_alive(entity)) {
+                        try ecs.destroy_entity(entity);
+                    }
+                    i += 1;
+                },
+            }
+        }
+    }
+};
+
+// ---
+
+test "command buffer" {
+    const allocator = std.testing.allocator;
+
+    const Health = struct {
+        hp: u32,
+    };
+    const Position = struct {
+        x: f32,
+        y: f32,
+    };
+    const Tag = struct {};
+
+    var ecs = Ecs.init(allocator);
+    defer ecs.deinit();
+    try ecs.register_component(Health);
+    try ecs.register_component(Position);
+    try ecs.register_component(Tag);
+
+    const existing = try ecs.create_entity();
+    try ecs.add_component_for_entity(existing, Health{ .hp = 10 });
+    const doomed = try ecs.create_entity();
+    try ecs.add_component_for_entity(doomed, Health{ .hp = 20 });
+
+    var commands = CommandBuffer.init(allocator);
+    defer commands.deinit();
+
+    // Interleave types, so that the sort has something to do.
+    const created = try commands.create_entity();
+    try commands.add_component_to_created(created, Position{ .x = 1, .y = 2 });
+    try commands.add_component(existing, Position{ .x = 3, .y = 4 });
+    try commands.add_component_to_created(created, Health{ .hp = 30 });
+    try commands.add_component_to_created(created, Tag{});
+    try commands.destroy_entity(doomed);
+    try commands.remove_component(existing, Health);
+    // Destroying twice is fine.
+    try commands.destroy_entity(doomed);
+    // Adding to an entity destroyed in the same batch is fine too.
+    try commands.add_component(doomed, Position{ .x = 5, .y = 6 });
+
+    // Nothing happens until the buffer is applied.
+    try std.testing.expect(ecs.is_alive(doomed));
+    try std.testing.expect(ecs.get_component_for_entity(existing, Position) == null);
+
+    try commands.apply(&ecs);
+    try std.testing.expect(commands.is_empty());
+
+    try std.testing.expect(!ecs.is_alive(doomed));
+    try std.testing.expect(ecs.get_component_for_entity(existing, Health) == null);
+    try std.testing.expect(ecs.get_component_for_entity(existing, Position).?.x == 3);
+
+    const entity = commands.created_entities.items[created.idx];
+    try std.testing.expect(ecs.is_alive(entity));
+    try std.testing.expect(ecs.get_component_for_entity(entity, Position).?.y == 2);
+    try std.testing.expect(ecs.get_component_for_entity(entity, Health).?.hp == 30);
+    try std.testing.expect(ecs.get_component_for_entity(entity, Tag) != null);
+
+    // A stale entity is reported.
+    try commands.add_component(doomed, Health{ .hp = 40 });
+    try std.testing.expectError(EcsError.entity_not_alive, commands.apply(&ecs));
+    try std.testing.expect(commands.is_empty());
+}
@@ -1,62 +1,145 @@
 const std = @import("std");
 const dutil = @import("debug_utils");
 const Entity = @import("./entities.zig").Entity;
+const EntityManager = @import("./entities.zig").EntityManager;
 const EcsError = @import("./lib.zig").EcsError;
 
-fn ComponentArray(comptime ty: type) type {
+/// Number of entity ids covered by one page of a sparse index.
+const sparse_page_len = 4096;
+const SparsePage = [sparse_page_len]u32;
+/// Marks an entity id without a component in a sparse index.
+const no_component_idx = std.math.maxInt(u32);
+
+/// The components are stored as a sparse set: `components` and `entities` are dense and parallel,
+/// and the sparse index maps an entity id to the position of its component in the dense arrays.
+/// All operations are O(1) and only touch arrays.
+///
+/// The sparse index is split into pages that are only allocated once an entity in their id range
+/// gets a component, so a component type that only a few entities have stays cheap.
+///
+/// Public for bench/ecs_bench.zig, which measures it on its own; use `Ecs` otherwise.
+pub fn ComponentArray(comptime ty: type) type {
     return struct {
+        allocator: std.mem.Allocator,
         components: std.ArrayList(ty),
-        entity_to_idx_map: std.AutoHashMap(Entity, usize),
-        idx_to_entity_map: std.AutoHashMap(usize, Entity),
+        /// `entities.items[i]` is the entity that owns `components.items[i]`.
+        entities: std.ArrayList(Entity),
+        sparse_pages: std.ArrayList(?*SparsePage),
 
         const Self = @This();
 
-        fn init(allocator: std.mem.Allocator) Self {
+        pub fn init(allocator: std.mem.Allocator) Self {
             return .{
+                .allocator = allocator,
                 .components = std.ArrayList(ty).init(allocator),
-                .entity_to_idx_map = std.AutoHashMap(Entity, usize).init(allocator),
-                .idx_to_entity_map = std.AutoHashMap(usize, Entity).init(allocator),
+                .entities = std.ArrayList(Entity).init(allocator),
+                .sparse_pages = std.ArrayList(?*SparsePage).init(allocator),
             };
         }
 
-        fn deinit(self: *Self) void {
+        pub fn deinit(self: *Self) void {
+            for (self.sparse_pages.items) |maybe_page| {
+                if (maybe_page) |page| {
+                    self.allocator.destroy(page);
+                }
+            }
+            self.sparse_pages.deinit();
             self.components.deinit();
-            self.entity_to_idx_map.deinit();
-            self.idx_to_entity_map.deinit();
+            self.entities.deinit();
+        }
+
+        /// Returns the index into the dense arrays of the entity's component, if it has one.
+        fn dense_idx(self: *const Self, entity: Entity) ?u32 {
+            const page_idx = entity.id / sparse_page_len;
+            if (page_idx >= self.sparse_pages.items.len) {
+                return null;
+            }
+            const page = self.sparse_pages.items[page_idx] orelse return null;
+            const idx = page[entity.id % sparse_page_len];
+            if (idx == no_component_idx) {
+                return null;
+            }
+            // A stale handle to a destroyed entity whose id has been reused.
+            if (self.entities.items[idx].generation != entity.generation) {
+                return null;
+            }
+            return idx;
+        }
+
+        /// Returns the sparse index slot for the entity, allocating its page if needed.
+        fn sparse_slot(self: *Self, entity: Entity) !*u32 {
+            const page_idx = entity.id / sparse_page_len;
+            if (page_idx >= self.sparse_pages.items.len) {
+                try self.sparse_pages.appendNTimes(
+                    null,
+                    page_idx + 1 - self.sparse_pages.items.len,
+                );
+            }
+
+            const page = self.sparse_pages.items[page_idx] orelse blk: {
+                const new_page = try self.allocator.create(SparsePage);
+                @memset(new_page, no_component_idx);
+                self.sparse_pages.items[page_idx] = new_page;
+                break :blk new_page;
+            };
+            return &page[entity.id % sparse_page_len];
+        }
+
+        /// Like `sparse_slot`, for an entity that is known to have a component (and so a page).
+        fn existing_sparse_slot(self: *Self, entity: Entity) *u32 {
+            const page = self.sparse_pages.items[entity.id / sparse_page_len].?;
+            return &page[entity.id % sparse_page_len];
+        }
+
+        /// Makes room for `additional` more components, e.g. before adding a batch of them.
+        fn reserve(self: *Self, additional: usize) !void {
+            try self.components.ensureUnusedCapacity(additional);
+            try self.entities.ensureUnusedCapacity(additional);
         }
 
-        fn add_component_for_entity(
+        fn contains(self: *const Self, entity: Entity) bool {
+            return self.dense_idx(entity) != null;
+        }
+
+        pub fn add_component_for_entity(
             self: *Self,
             entity: Entity,
             component: ty,
         ) !void {
-            const component_idx = self.entity_to_idx_map.get(entity);
-            if (component_idx != null) {
+            if (self.dense_idx(entity)) |idx| {
                 // dutil.log(
                 //     "ecs",
                 //     .debug,
                 //     "Component already exists for entity {d}, overriding",
                 //     .{entity.id},
                 // );
-                self.components.items[component_idx.?] = component;
+                self.components.items[idx] = component;
                 return;
             }
 
-            try self.components.append(component);
-            try self.entity_to_idx_map.put(entity, self.components.items.len - 1);
-            try self.idx_to_entity_map.put(self.components.items.len - 1, entity);
+            // Reserve everything up front so that a failed allocation leaves the set unchanged.
+            try self.components.ensureUnusedCapacity(1);
+            try self.entities.ensureUnusedCapacity(1);
+            const slot = try self.sparse_slot(entity);
+            // Otherwise the slot belongs to another generation of the entity, i.e. `entity` is a
+            // stale handle. `Ecs` checks for that before getting here.
+            std.debug.assert(slot.* == no_component_idx);
+
+            slot.* = @intCast(self.components.items.len);
+            self.components.appendAssumeCapacity(component);
+            self.entities.appendAssumeCapacity(entity);
         }
 
-        fn remove_component_for_entity(
+        pub fn remove_component_for_entity(
             self: *Self,
             entity: Entity,
         ) EcsError!void {
             // Removes the item, move the last item in the array to the
-            // position of the removed item, update the entity-index map
+            // position of the removed item, update the sparse index
             // accordingly.
 
-            std.debug.assert(self.entity_to_idx_map.contains(entity));
-            const idx = self.entity_to_idx_map.get(entity) orelse {
+            std.debug.assert(self.contains(entity));
+            const idx = self.dense_idx(entity) orelse {
                 dutil.log(
                     "ecs",
                     .err,
@@ -65,39 +148,77 @@ fn ComponentArray(comptime ty: type) type {
                 );
                 return;
             };
-            _ = self.entity_to_idx_map.remove(entity);
-            std.debug.assert(self.idx_to_entity_map.contains(idx));
-            _ = self.idx_to_entity_map.remove(idx);
+            self.swap_remove(entity, idx);
+        }
 
-            if (idx == self.components.items.len - 1) {
-                _ = self.components.pop();
-            } else {
-                const idx_of_component_to_move = self.components.items.len - 1;
-                self.components.items[idx] = self.components.items[idx_of_component_to_move];
-                self.components.items.len -= 1;
+        /// Used when destroying an entity, which may or may not have this component.
+        fn remove_component_if_present(self: *Self, entity: Entity) void {
+            if (self.dense_idx(entity)) |idx| {
+                self.swap_remove(entity, idx);
+            }
+        }
 
-                const moved_components_entity = self.idx_to_entity_map.get(
-                    idx_of_component_to_move,
-                );
-                std.debug.assert(moved_components_entity != null);
-                try self.entity_to_idx_map.put(moved_components_entity.?, idx);
-                try self.idx_to_entity_map.put(idx, moved_components_entity.?);
+        fn swap_remove(self: *Self, entity: Entity, idx: u32) void {
+            const last_idx = self.components.items.len - 1;
+            if (idx != last_idx) {
+                const moved_entity = self.entities.items[last_idx];
+                self.components.items[idx] = self.components.items[last_idx];
+                self.entities.items[idx] = moved_entity;
+                self.existing_sparse_slot(moved_entity).* = idx;
             }
+
+            _ = self.components.pop();
+            _ = self.entities.pop();
+            self.existing_sparse_slot(entity).* = no_component_idx;
         }
 
-        fn get_component_for_entity(
+        pub fn get_component_for_entity(
             self: *Self,
             entity: Entity,
         ) ?*ty {
-            const idx = self.entity_to_idx_map.get(entity) orelse return null;
+            const idx = self.dense_idx(entity) orelse return null;
             return &self.components.items[idx];
         }
     };
 }
 
+/// Process-wide dense ids for component types, so that a `ComponentManager` can find the array
+/// for a type by indexing instead of hashing its name. Zig has no mutable comptime state, so the
+/// ids are handed out when a type is first registered with any manager; each type then keeps its
+/// id in its own static variable, which is a single load to read.
+///
+/// Registration is not thread-safe.
+var next_component_type_id: u32 = 0;
+
+fn ComponentTypeId(comptime component_ty: type) type {
+    return struct {
+        // Referencing the component type makes the struct distinct per type, so that every type
+        // gets its own `id`.
+        const ty = component_ty;
+        var id: ?u32 = null;
+    };
+}
+
+pub fn get_or_assign_component_type_id(comptime component_ty: type) u32 {
+    const id_ptr = &ComponentTypeId(component_ty).id;
+    if (id_ptr.*) |id| {
+        return id;
+    }
+
+    const id = next_component_type_id;
+    next_component_type_id += 1;
+    id_ptr.* = id;
+    return id;
+}
+
 const TypeErasedComponentArray = struct {
     component_array_ptr: *anyopaque,
     deinit_fn: *const fn (*TypeErasedComponentArray, allocator: std.mem.Allocator) void,
+    remove_component_if_present_fn: *const fn (*TypeErasedComponentArray, entity: Entity) void,
+    reserve_fn: *const fn (
+        *TypeErasedComponentArray,
+        additional: usize,
+    ) std.mem.Allocator.Error!void,
 
     fn init(allocator: std.mem.Allocator, comptime component_ty: type) !TypeErasedComponentArray {
         const component_array_ptr = try allocator.create(ComponentArray(component_ty));
@@ -114,6 +235,22 @@ const TypeErasedComponentArray = struct {
                     allocator_.destroy(ptr);
                 }
             }).deinit,
+            .remove_component_if_present_fn = (struct {
+                fn remove_component_if_present(
+                    self: *TypeErasedComponentArray,
+                    entity: Entity,
+                ) void {
+                    self.cast(component_ty).remove_component_if_present(entity);
+                }
+            }).remove_component_if_present,
+            .reserve_fn = (struct {
+                fn reserve(
+                    self: *TypeErasedComponentArray,
+                    additional: usize,
+                ) std.mem.Allocator.Error!void {
+                    try self.cast(component_ty).reserve(additional);
+                }
+            }).reserve,
         };
     }
 
@@ -125,80 +262,182 @@ const TypeErasedComponentArray = struct {
     }
 };
 
-// const EntityWithComponentsIterator = struct {
-//     component_manager: *ComponentManager,
-//     components: []const type,
-//     entity_iterator: @TypeOf(comptime std.hash_map.AutoHashMap(Entity, u32).KeyIterator),
-
-//     const Self = @This();
-
-//     fn init(
-//         component_manager: *const ComponentManager,
-//         comptime components: []const type,
-//     ) EntityWithComponentsIterator {
-//         std.debug.assert(components.len > 0);
-
-//         const first_component_entity_hash_map = component_manager
-//             .component_arrays.get(@typeName(components[0])).?
-//             .cast(components[0])
-//             .entity_to_idx_map;
-//         const first_compononent_iterator = first_component_entity_hash_map.keyIterator();
-
-//         return .{
-//             .component_manager = component_manager,
-//             .components = components,
-//             .entity_iterator = first_compononent_iterator,
-//         };
-//     }
-
-//     fn next(self: *Self) ?Entity {
-//         while (true) {
-//             const next_entity = self.entity_iterator.next();
-//             if (next_entity == null or self.components.len == 1) {
-//                 return next_entity;
-//             }
-
-//             // Check if the entity has all the components.
-
-//             const it = next_entity.?;
-//             var i: usize = 1;
-//             var has_all_components = true;
-//             while (i < self.components.len) : (i += 1) {
-//                 if (!self.component_manager
-//                     .component_arrays
-//                     .get(@typeName(self.components[i])).?
-//                     .cast(self.components[i])
-//                     .entity_to_idx_map
-//                     .contains(it))
-//                 {
-//                     has_all_components = false;
-//                     break;
-//                 }
-//             }
-
-//             if (has_all_components) {
-//                 return it;
-//             }
-//         }
-//     }
-// };
+/// Turns a tuple of component types, e.g. `.{ A, B, C }`, into a slice of types.
+fn component_types(comptime component_tys: anytype) []const type {
+    const fields = @typeInfo(@TypeOf(component_tys)).Struct.fields;
+    var types: [fields.len]type = undefined;
+    for (&types, 0..) |*ty, i| {
+        ty.* = component_tys[i];
+    }
+    const final_types = types;
+    return &final_types;
+}
+
+/// Iterates over the entities that have all of the given components, e.g. `.{ A, B, C }`.
+///
+/// Iteration is driven by the smallest of the component sets, walking its dense entity array in
+/// order and probing the other sparse sets, so the cost is proportional to the smallest set
+/// rather than to the number of entities.
+///
+/// Component values may be modified during iteration, but components must not be added or
+/// removed: that can reallocate the arrays the query is walking.
+pub fn Query(comptime component_tys: anytype) type {
+    const types = component_types(component_tys);
+    if (types.len == 0) {
+        @compileError("a query needs at least one component type");
+    }
+
+    const ArrayPtrs = blk: {
+        var ptr_types: [types.len]type = undefined;
+        for (types, 0..) |ty, i| {
+            ptr_types[i] = *ComponentArray(ty);
+        }
+        break :blk std.meta.Tuple(&ptr_types);
+    };
+    const ComponentPtrs = blk: {
+        var ptr_types: [types.len]type = undefined;
+        for (types, 0..) |ty, i| {
+            ptr_types[i] = *ty;
+        }
+        break :blk std.meta.Tuple(&ptr_types);
+    };
+
+    return struct {
+        arrays: ArrayPtrs,
+        driver_entities: []const Entity,
+        pos: usize = 0,
+
+        chunk_entities: [chunk_len]Entity = undefined,
+        chunk_indices: [types.len][chunk_len]u32 = undefined,
+
+        const Self = @This();
+        const Arrays = ArrayPtrs;
+
+        pub const Item = struct {
+            entity: Entity,
+            /// Pointers to the components, in the order they were queried in.
+            components: ComponentPtrs,
+        };
+
+        /// The maximum number of entities in a `Chunk`.
+        pub const chunk_len = 256;
+
+        /// A batch of matching entities, for systems that want to process components in tight
+        /// loops rather than one `Item` at a time.
+        pub const Chunk = struct {
+            query: *const Self,
+            entities: []const Entity,
+            /// `indices[i][k]` is the position of the `i`-th queried component of `entities[k]`
+            /// in `dense(i)`. For the component that drives the query, these are increasing.
+            indices: [types.len][]const u32,
+
+            /// All components of the `i`-th queried type, packed.
+            pub fn dense(self: Chunk, comptime i: usize) []types[i] {
+                return self.query.arrays[i].components.items;
+            }
+
+            pub fn get(self: Chunk, comptime i: usize, k: usize) *types[i] {
+                return &self.dense(i)[self.indices[i][k]];
+            }
+        };
+
+        fn init(arrays: ArrayPtrs) Self {
+            var driver_entities: []const Entity = arrays[0].entities.items;
+            inline for (1..types.len) |i| {
+                if (arrays[i].entities.items.len < driver_entities.len) {
+                    driver_entities = arrays[i].entities.items;
+                }
+            }
+
+            return .{
+                .arrays = arrays,
+                .driver_entities = driver_entities,
+            };
+        }
+
+        /// Finds the dense indices of all the queried components of the next matching entity.
+        fn advance(self: *Self, indices: *[types.len]u32) ?Entity {
+            outer: while (self.pos < self.driver_entities.len) {
+                const entity = self.driver_entities[self.pos];
+                self.pos += 1;
+
+                inline for (0..types.len) |i| {
+                    indices[i] = self.arrays[i].dense_idx(entity) orelse continue :outer;
+                }
+                return entity;
+            }
+            return null;
+        }
+
+        pub fn next(self: *Self) ?Item {
+            var indices: [types.len]u32 = undefined;
+            const entity = self.advance(&indices) orelse return null;
+
+            var item = Item{ .entity = entity, .components = undefined };
+            inline for (0..types.len) |i| {
+                item.components[i] = &self.arrays[i].components.items[indices[i]];
+            }
+            return item;
+        }
+
+        /// Returns up to `chunk_len` matching entities at once. The returned chunk is only valid
+        /// until the next call to `next_chunk`.
+        pub fn next_chunk(self: *Self) ?Chunk {
+            var len: usize = 0;
+            var indices: [types.len]u32 = undefined;
+            while (len < chunk_len) {
+                const entity = self.advance(&indices) orelse break;
+                self.chunk_entities[len] = entity;
+                inline for (0..types.len) |i| {
+                    self.chunk_indices[i][len] = indices[i];
+                }
+                len += 1;
+            }
+
+            if (len == 0) {
+                return null;
+            }
+
+            var chunk = Chunk{
+                .query = self,
+                .entities = self.chunk_entities[0..len],
+                .indices = undefined,
+            };
+            inline for (0..types.len) |i| {
+                chunk.indices[i] = self.chunk_indices[i][0..len];
+            }
+            return chunk;
+        }
+    };
+}
+
+/// All the components of one type, packed, along with the entities that own them.
+pub fn DenseComponents(comptime component_ty: type) type {
+    return struct {
+        /// `entities[i]` owns `components[i]`.
+        entities: []const Entity,
+        components: []component_ty,
+    };
+}
 
 pub const ComponentManager = struct {
     allocator: std.mem.Allocator,
-    component_arrays: std.StringHashMap(TypeErasedComponentArray),
+    /// Indexed by component type id, see `ComponentTypeId`. `null` for types that were registered
+    /// with another manager only.
+    component_arrays: std.ArrayList(?TypeErasedComponentArray),
 
     pub fn init(allocator: std.mem.Allocator) ComponentManager {
         return .{
             .allocator = allocator,
-            .component_arrays = std.StringHashMap(TypeErasedComponentArray).init(allocator),
+            .component_arrays = std.ArrayList(?TypeErasedComponentArray).init(allocator),
         };
     }
 
     pub fn deinit(self: *ComponentManager) void {
-        var it = self.component_arrays.iterator();
-        while (it.next()) |kv| {
-            const array_ptr = kv.value_ptr;
-            @call(.auto, array_ptr.deinit_fn, .{ array_ptr, self.allocator });
+        for (self.component_arrays.items) |*maybe_array| {
+            if (maybe_array.*) |*array_ptr| {
+                @call(.auto, array_ptr.deinit_fn, .{ array_ptr, self.allocator });
+            }
         }
         self.component_arrays.deinit();
     }
@@ -208,22 +447,43 @@ pub const ComponentManager = struct {
         comptime component_ty: type,
     ) !void {
         dutil.log("ecs", .debug, "in {s}", .{@src().fn_name});
+
+        const id = get_or_assign_component_type_id(component_ty);
+        if (id >= self.component_arrays.items.len) {
+            try self.component_arrays.appendNTimes(null, id + 1 - self.component_arrays.items.len);
+        }
+        if (self.component_arrays.items[id] != null) {
+            dutil.log(
+                "ecs",
+                .debug,
+                "{s} - type {s} is already registered",
+                .{ @src().fn_name, @typeName(component_ty) },
+            );
+            return;
+        }
+
         const component_array = try TypeErasedComponentArray.init(self.allocator, component_ty);
         dutil.log(
             "ecs",
             .debug,
-            "{s} - created component array for type {s}",
-            .{ @src().fn_name, @typeName(component_ty) },
+            "{s} - created component array for type {s} (id {d})",
+            .{ @src().fn_name, @typeName(component_ty), id },
         );
-        try self.component_arrays.put(@typeName(component_ty), component_array);
+        self.component_arrays.items[id] = component_array;
     }
 
     fn get_component_array(
         self: *ComponentManager,
         comptime component_ty: type,
     ) ?*ComponentArray(component_ty) {
-        var type_erased_array = self.component_arrays.get(@typeName(component_ty)) orelse return null;
-        return type_erased_array.cast(component_ty);
+        const id = ComponentTypeId(component_ty).id orelse return null;
+        if (id >= self.component_arrays.items.len) {
+            return null;
+        }
+        if (self.component_arrays.items[id]) |*type_erased_array| {
+            return type_erased_array.cast(component_ty);
+        }
+        return null;
     }
 
     pub fn add_component_for_entity(
@@ -243,11 +503,34 @@ pub const ComponentManager = struct {
         comptime component_ty: type,
     ) !void {
         var component_array = self.get_component_array(component_ty) orelse {
-            return .removing_unregistered_component;
+            return EcsError.removing_unregistered_component;
         };
         try component_array.remove_component_for_entity(entity);
     }
 
+    pub fn remove_all_components_for_entity(self: *ComponentManager, entity: Entity) void {
+        for (self.component_arrays.items) |*maybe_array| {
+            if (maybe_array.*) |*array_ptr| {
+                @call(.auto, array_ptr.remove_component_if_present_fn, .{ array_ptr, entity });
+            }
+        }
+    }
+
+    /// Makes room for `additional` more components of the type with the given id, see
+    /// `get_or_assign_component_type_id`. Does nothing for unregistered types.
+    pub fn reserve_components(
+        self: *ComponentManager,
+        type_id: u32,
+        additional: usize,
+    ) !void {
+        if (type_id >= self.component_arrays.items.len) {
+            return;
+        }
+        if (self.component_arrays.items[type_id]) |*array_ptr| {
+            try @call(.auto, array_ptr.reserve_fn, .{ array_ptr, additional });
+        }
+    }
+
     pub fn get_component_for_entity(
         self: *ComponentManager,
         entity: Entity,
@@ -257,14 +540,170 @@ pub const ComponentManager = struct {
         return component_array.get_component_for_entity(entity);
     }
 
-    // fn entities_with_components_iterator(
-    //     self: *const ComponentManager,
-    //     comptime components: []const type,
-    // ) EntityWithComponentsIterator {
-    //     return EntityWithComponentsIterator.init(self, components);
-    // }
+    pub fn query(
+        self: *ComponentManager,
+        comptime component_tys: anytype,
+    ) EcsError!Query(component_tys) {
+        const QueryTy = Query(component_tys);
+        var arrays: QueryTy.Arrays = undefined;
+        inline for (comptime component_types(component_tys), 0..) |component_ty, i| {
+            arrays[i] = self.get_component_array(component_ty) orelse {
+                return EcsError.querying_unregistered_component;
+            };
+        }
+        return QueryTy.init(arrays);
+    }
+
+    pub fn get_dense_components(
+        self: *ComponentManager,
+        comptime component_ty: type,
+    ) EcsError!DenseComponents(component_ty) {
+        const component_array = self.get_component_array(component_ty) orelse {
+            return EcsError.querying_unregistered_component;
+        };
+        return .{
+            .entities = component_array.entities.items,
+            .components = component_array.components.items,
+        };
+    }
 };
 
+/// A statically typed alternative to `Ecs`, for when all the component types are known up front:
+/// ```
+/// var world = World(.{ Position, Velocity }).init(allocator);
+/// ```
+/// Each component type's storage is a field, found at compile time, so there is no registration,
+/// no type erasure and no lookup at runtime. Using a type that is not part of the world is a
+/// compile error.
+pub fn World(comptime component_tys: anytype) type {
+    const types = component_types(component_tys);
+
+    const Arrays = blk: {
+        var array_types: [types.len]type = undefined;
+        for (types, 0..) |ty, i| {
+            array_types[i] = ComponentArray(ty);
+        }
+        break :blk std.meta.Tuple(&array_types);
+    };
+
+    return struct {
+        entity_manager: EntityManager,
+        arrays: Arrays,
+
+        const Self = @This();
+
+        pub fn init(allocator: std.mem.Allocator) Self {
+            var arrays: Arrays = undefined;
+            inline for (types, 0..) |ty, i| {
+                arrays[i] = ComponentArray(ty).init(allocator);
+            }
+
+            return .{
+                .entity_manager = EntityManager.init(allocator),
+                .arrays = arrays,
+            };
+        }
+
+        pub fn deinit(self: *Self) void {
+            inline for (0..types.len) |i| {
+                self.arrays[i].deinit();
+            }
+            self.entity_manager.deinit();
+        }
+
+        fn index_of(comptime component_ty: type) ?usize {
+            for (types, 0..) |ty, i| {
+                if (ty == component_ty) {
+                    return i;
+                }
+            }
+            return null;
+        }
+
+        fn get_component_array(
+            self: *Self,
+            comptime component_ty: type,
+        ) *ComponentArray(component_ty) {
+            const i = comptime index_of(component_ty) orelse @compileError(
+                "component type " ++ @typeName(component_ty) ++ " is not part of this world",
+            );
+            return &self.arrays[i];
+        }
+
+        pub fn create_entity(self: *Self) EcsError!Entity {
+            return self.entity_manager.create();
+        }
+
+        /// See `Ecs.destroy_entity`.
+        pub fn destroy_entity(self: *Self, entity: Entity) EcsError!void {
+            if (!self.entity_manager.is_alive(entity)) {
+                return EcsError.entity_not_alive;
+            }
+            inline for (0..types.len) |i| {
+                self.arrays[i].remove_component_if_present(entity);
+            }
+            try self.entity_manager.destroy(entity);
+        }
+
+        /// See `Ecs.add_component_for_entity`.
+        pub fn add_component_for_entity(
+            self: *Self,
+            entity: Entity,
+            component: anytype,
+        ) EcsError!void {
+            if (!self.entity_manager.is_alive(entity)) {
+                return EcsError.entity_not_alive;
+            }
+            try self.get_component_array(@TypeOf(component)).add_component_for_entity(
+                entity,
+                component,
+            );
+        }
+
+        /// See `Ecs.remove_component_for_entity`.
+        pub fn remove_component_for_entity(
+            self: *Self,
+            entity: Entity,
+            comptime component_ty: type,
+        ) EcsError!void {
+            if (!self.entity_manager.is_alive(entity)) {
+                return EcsError.entity_not_alive;
+            }
+            try self.get_component_array(component_ty).remove_component_for_entity(entity);
+        }
+
+        /// Returns `null` if the component is not assigned to the entity.
+        pub fn get_component_for_entity(
+            self: *Self,
+            entity: Entity,
+            comptime component_ty: type,
+        ) ?*component_ty {
+            return self.get_component_array(component_ty).get_component_for_entity(entity);
+        }
+
+        /// See `Ecs.query`. All the component types being known, this cannot fail.
+        pub fn query(self: *Self, comptime query_tys: anytype) Query(query_tys) {
+            const QueryTy = Query(query_tys);
+            var arrays: QueryTy.Arrays = undefined;
+            inline for (comptime component_types(query_tys), 0..) |component_ty, i| {
+                arrays[i] = self.get_component_array(component_ty);
+            }
+            return QueryTy.init(arrays);
+        }
+
+        pub fn get_dense_components(
+            self: *Self,
+            comptime component_ty: type,
+        ) DenseComponents(component_ty) {
+            const component_array = self.get_component_array(component_ty);
+            return .{
+                .entities = component_array.entities.items,
+                .components = component_array.components.items,
+            };
+        }
+    };
+}
+
 // ---
 
 test {
@@ -327,72 +766,225 @@ test {
     }
 }
 
-// test {
-//     const allocator = std.testing.allocator;
-
-//     var cm = ComponentManager.init(allocator);
-//     defer cm.deinit();
-
-//     const Component1 = struct {
-//         hp: u32,
-//     };
-
-//     const Component2 = struct {
-//         x: f32,
-//         y: f32,
-//     };
-
-//     const Component3 = struct {
-//         x: f32,
-//         y: f32,
-//         z: f32,
-//     };
-
-//     try cm.register_component(Component1);
-//     try cm.register_component(Component2);
-//     try cm.register_component(Component3);
-
-//     const entity1 = Entity{ .id = 1 };
-//     const entity2 = Entity{ .id = 2 };
-//     const entity3 = Entity{ .id = 3 };
-//     const entity4 = Entity{ .id = 4 };
-//     _ = entity4;
-//     const entity5 = Entity{ .id = 5 };
-//     _ = entity5;
-
-//     // We will give:
-//     // - entity1: Component1
-//     // - entity2: Component1, Component2
-//     // - entity3: Component1, Component2, Component3
-
-//     try cm.add_component_for_entity(entity1, Component1{ .hp = 100 });
-
-//     try cm.add_component_for_entity(entity2, Component1{ .hp = 200 });
-//     try cm.add_component_for_entity(entity2, Component2{ .x = 10, .y = 20 });
-
-//     try cm.add_component_for_entity(entity3, Component1{ .hp = 300 });
-//     try cm.add_component_for_entity(entity3, Component2{ .x = 30, .y = 40 });
-//     try cm.add_component_for_entity(entity3, Component3{ .x = 50, .y = 60, .z = 70 });
-
-//     // So:
-//     // - Iterating over entities with component 1 should yield entity1, entity2, entity3.
-//     // - Iterating over entities with components 1 and 2 should yield entity2, entity3.
-//     // - Iterating over entities with components 1, 2, and 3 should yield entity3.
-
-//     {
-//         const components = comptime [_]type{Component1};
-//         var it = cm.entities_with_components_iterator(&components);
-
-//         var found_entities = std.AutoHashMap(Entity, void).init(allocator);
-//         defer found_entities.deinit();
-
-//         while (it.next()) |entity| {
-//             try found_entities.put(entity, {});
-//         }
-
-//         try std.testing.expect(found_entities.count() == 3);
-//         try std.testing.expect(found_entities.contains(entity1));
-//         try std.testing.expect(found_entities.contains(entity2));
-//         try std.testing.expect(found_entities.contains(entity3));
-//     }
-// }
+test "sparse set stays consistent over many adds and removes" {
+    const allocator = std.testing.allocator;
+
+    var cm = ComponentManager.init(allocator);
+    defer cm.deinit();
+
+    const Index = struct {
+        val: u32,
+    };
+    try cm.register_component(Index);
+
+    // Enough entities to span several sparse pages, with a gap so that some pages stay
+    // unallocated.
+    const num_entities = 100_000;
+    const gap_start = 20_000;
+    const gap_end = 50_000;
+
+    var id: u32 = 0;
+    while (id < num_entities) : (id += 1) {
+        if (id >= gap_start and id < gap_end) {
+            continue;
+        }
+        try cm.add_component_for_entity(Entity{ .id = id }, Index{ .val = id });
+    }
+
+    // Remove every third entity, which moves components around in the dense array.
+    id = 0;
+    while (id < num_entities) : (id += 3) {
+        if (id >= gap_start and id < gap_end) {
+            continue;
+        }
+        try cm.remove_component_for_entity(Entity{ .id = id }, Index);
+    }
+
+    id = 0;
+    while (id < num_entities) : (id += 1) {
+        const index = cm.get_component_for_entity(Entity{ .id = id }, Index);
+        const should_exist = (id < gap_start or id >= gap_end) and id % 3 != 0;
+        if (should_exist) {
+            try std.testing.expect(index.?.val == id);
+        } else {
+            try std.testing.expect(index == null);
+        }
+    }
+}
+
+test "query" {
+    const allocator = std.testing.allocator;
+
+    var cm = ComponentManager.init(allocator);
+    defer cm.deinit();
+
+    const Component1 = struct {
+        hp: u32,
+    };
+
+    const Component2 = struct {
+        x: f32,
+        y: f32,
+    };
+
+    const Component3 = struct {
+        x: f32,
+        y: f32,
+        z: f32,
+    };
+
+    try cm.register_component(Component1);
+    try cm.register_component(Component2);
+    try cm.register_component(Component3);
+
+    const entity1 = Entity{ .id = 1 };
+    const entity2 = Entity{ .id = 2 };
+    const entity3 = Entity{ .id = 3 };
+    const entity4 = Entity{ .id = 4 };
+
+    // We will give:
+    // - entity1: Component1
+    // - entity2: Component1, Component2
+    // - entity3: Component1, Component2, Component3
+    // - entity4: Component3
+
+    try cm.add_component_for_entity(entity1, Component1{ .hp = 100 });
+
+    try cm.add_component_for_entity(entity2, Component1{ .hp = 200 });
+    try cm.add_component_for_entity(entity2, Component2{ .x = 10, .y = 20 });
+
+    try cm.add_component_for_entity(entity3, Component1{ .hp = 300 });
+    try cm.add_component_for_entity(entity3, Component2{ .x = 30, .y = 40 });
+    try cm.add_component_for_entity(entity3, Component3{ .x = 50, .y = 60, .z = 70 });
+
+    try cm.add_component_for_entity(entity4, Component3{ .x = 80, .y = 90, .z = 100 });
+
+    // So:
+    // - Querying component 1 should yield entity1, entity2, entity3.
+    // - Querying components 1 and 2 should yield entity2, entity3.
+    // - Querying components 1, 2, and 3 should yield entity3.
+
+    {
+        var it = try cm.query(.{Component1});
+
+        var found_entities = std.AutoHashMap(Entity, void).init(allocator);
+        defer found_entities.deinit();
+
+        while (it.next()) |item| {
+            try found_entities.put(item.entity, {});
+        }
+
+        try std.testing.expect(found_entities.count() == 3);
+        try std.testing.expect(found_entities.contains(entity1));
+        try std.testing.expect(found_entities.contains(entity2));
+        try std.testing.expect(found_entities.contains(entity3));
+    }
+
+    {
+        var it = try cm.query(.{ Component2, Component1 });
+
+        var num_found: usize = 0;
+        while (it.next()) |item| {
+            num_found += 1;
+            const c2 = item.components[0];
+            const c1 = item.components[1];
+            if (item.entity.id == entity2.id) {
+                try std.testing.expect(c1.hp == 200 and c2.x == 10);
+            } else {
+                try std.testing.expect(item.entity.id == entity3.id);
+                try std.testing.expect(c1.hp == 300 and c2.x == 30);
+            }
+
+            // Writes go to the stored component.
+            c1.hp += 1;
+        }
+        try std.testing.expect(num_found == 2);
+        try std.testing.expect(cm.get_component_for_entity(entity2, Component1).?.hp == 201);
+    }
+
+    {
+        var it = try cm.query(.{ Component1, Component2, Component3 });
+
+        const item = it.next().?;
+        try std.testing.expect(item.entity.id == entity3.id);
+        try std.testing.expect(item.components[2].z == 70);
+        try std.testing.expect(it.next() == null);
+    }
+
+    // The chunked form yields the same entities.
+    {
+        var it = try cm.query(.{ Component1, Component2 });
+
+        var num_found: usize = 0;
+        while (it.next_chunk()) |chunk| {
+            for (chunk.entities, 0..) |entity, k| {
+                num_found += 1;
+                try std.testing.expect(entity.id == entity2.id or entity.id == entity3.id);
+                try std.testing.expect(chunk.get(0, k) == cm.get_component_for_entity(
+                    entity,
+                    Component1,
+                ).?);
+            }
+        }
+        try std.testing.expect(num_found == 2);
+    }
+
+    {
+        const dense = try cm.get_dense_components(Component3);
+        try std.testing.expect(dense.entities.len == 2);
+        try std.testing.expect(dense.components.len == 2);
+    }
+}
+
+test "world" {
+    const allocator = std.testing.allocator;
+
+    const Health = struct {
+        hp: u32,
+    };
+
+    const Position = struct {
+        x: f32,
+        y: f32,
+    };
+
+    var world = World(.{ Health, Position }).init(allocator);
+    defer world.deinit();
+
+    const entity1 = try world.create_entity();
+    const entity2 = try world.create_entity();
+
+    try world.add_component_for_entity(entity1, Health{ .hp = 100 });
+    try world.add_component_for_entity(entity2, Health{ .hp = 200 });
+    try world.add_component_for_entity(entity2, Position{ .x = 10, .y = 20 });
+
+    try std.testing.expect(world.get_component_for_entity(entity1, Health).?.hp == 100);
+    try std.testing.expect(world.get_component_for_entity(entity1, Position) == null);
+
+    {
+        var it = world.query(.{ Health, Position });
+        const item = it.next().?;
+        try std.testing.expect(item.entity.id == entity2.id);
+        try std.testing.expect(item.components[0].hp == 200);
+        try std.testing.expect(item.components[1].y == 20);
+        try std.testing.expect(it.next() == null);
+    }
+
+    try world.remove_component_for_entity(entity2, Health);
+    try std.testing.expect(world.get_component_for_entity(entity2, Health) == null);
+    try std.testing.expect(world.get_dense_components(Health).components.len == 1);
+
+    // Destroying an entity removes all its components, and its id is recycled with a new
+    // generation.
+    try world.destroy_entity(entity2);
+    try std.testing.expect(world.get_dense_components(Position).components.len == 0);
+    const entity3 = try world.create_entity();
+    try std.testing.expect(entity3.id == entity2.id);
+    try std.testing.expect(entity3.generation != entity2.generation);
+    try world.add_component_for_entity(entity3, Position{ .x = 30, .y = 40 });
+    try std.testing.expect(world.get_component_for_entity(entity2, Position) == null);
+    try std.testing.expectError(
+        EcsError.entity_not_alive,
+        world.add_component_for_entity(entity2, Position{ .x = 0, .y = 0 }),
+    );
+}
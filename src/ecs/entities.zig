@@ -1,19 +1,58 @@
 const std = @import("std");
 
 pub const Entity = packed struct {
+    /// Ids are recycled after an entity is destroyed, so they stay dense.
     id: u32,
+    /// Incremented every time the id is recycled, so that a handle to a destroyed entity can be
+    /// told apart from the entity that reuses its id.
+    generation: u32 = 0,
 };
 
 pub const EntityManager = struct {
-    next_id: u32 = 0,
+    /// The current generation of every id handed out so far.
+    generations: std.ArrayList(u32),
+    /// Ids of destroyed entities, reused by `create` before any new id.
+    free_ids: std.ArrayList(u32),
 
-    pub fn init() EntityManager {
-        return .{};
+    pub fn init(allocator: std.mem.Allocator) EntityManager {
+        return .{
+            .generations = std.ArrayList(u32).init(allocator),
+            .free_ids = std.ArrayList(u32).init(allocator),
+        };
     }
 
-    pub fn create(self: *EntityManager) Entity {
-        const entity = Entity{ .id = self.next_id };
-        self.next_id += 1;
-        return entity;
+    pub fn deinit(self: *EntityManager) void {
+        self.generations.deinit();
+        self.free_ids.deinit();
+    }
+
+    pub fn create(self: *EntityManager) !Entity {
+        if (self.free_ids.popOrNull()) |id| {
+            return Entity{ .id = id, .generation = self.generations.items[id] };
+        }
+
+        const id: u32 = @intCast(self.generations.items.len);
+        try self.generations.append(0);
+        return Entity{ .id = id };
+    }
+
+    /// The entity must be alive.
+    pub fn destroy(self: *EntityManager, entity: Entity) !void {
+        std.debug.assert(self.is_alive(entity));
+
+        // Reserve the free list slot first, so that a failed allocation leaves the entity alive.
+        try self.free_ids.ensureUnusedCapacity(1);
+        self.generations.items[entity.id] +%= 1;
+        self.free_ids.appendAssumeCapacity(entity.id);
+    }
+
+    /// Returns `false` for destroyed entities, even if their id has been reused.
+    pub fn is_alive(self: *const EntityManager, entity: Entity) bool {
+        if (entity.id >= self.generations.items.len) {
+            return false;
+        }
+        // A destroyed entity whose id is in the free list has an out of date generation, just
+        // like one whose id has been reused.
+        return self.generations.items[entity.id] == entity.generation;
     }
 };
@@ -5,10 +5,22 @@ pub const Entity = entity_lib.Entity;
 const EntityManager = entity_lib.EntityManager;
 const component_lib = @import("./components.zig");
 const ComponentManager = component_lib.ComponentManager;
+pub const Query = component_lib.Query;
+pub const DenseComponents = component_lib.DenseComponents;
+pub const ComponentArray = component_lib.ComponentArray;
+pub const World = component_lib.World;
+const system_lib = @import("./systems.zig");
+pub const Scheduler = system_lib.Scheduler;
+pub const SystemDesc = system_lib.SystemDesc;
+const command_lib = @import("./commands.zig");
+pub const CommandBuffer = command_lib.CommandBuffer;
+pub const CreatedEntity = command_lib.CreatedEntity;
 
 pub const EcsError = error{
     adding_unregistered_component,
     removing_unregistered_component,
+    querying_unregistered_component,
+    entity_not_alive,
     component_not_assigned_to_entity,
 } || std.mem.Allocator.Error;
 
@@ -17,7 +29,7 @@ pub const Ecs = struct {
     component_manager: ComponentManager,
 
     pub fn init(allocator: std.mem.Allocator) Ecs {
-        const entity_manager = EntityManager.init();
+        const entity_manager = EntityManager.init(allocator);
         const component_manager = ComponentManager.init(allocator);
 
         dutil.log("ecs", .info, "initialized ecs", .{});
@@ -30,15 +42,32 @@ pub const Ecs = struct {
 
     pub fn deinit(self: *Ecs) void {
         self.component_manager.deinit();
+        self.entity_manager.deinit();
     }
 
-    pub fn create_entity(self: *Ecs) Entity {
+    pub fn create_entity(self: *Ecs) EcsError!Entity {
         return self.entity_manager.create();
     }
 
-    // pub fn destroy_entity(self: *Ecs, entity: Entity) void {
+    /// Removes all of the entity's components and recycles its id. Any remaining handles to the
+    /// entity become stale: getting components through them returns `null`, and adding or
+    /// removing components through them fails.
+    ///
+    /// Returns:
+    /// - `void` on success
+    /// - `.entity_not_alive` if the entity was already destroyed
+    pub fn destroy_entity(self: *Ecs, entity: Entity) EcsError!void {
+        if (!self.entity_manager.is_alive(entity)) {
+            return EcsError.entity_not_alive;
+        }
+        self.component_manager.remove_all_components_for_entity(entity);
+        try self.entity_manager.destroy(entity);
+    }
 
-    // }
+    /// Returns whether the entity has been created and not destroyed since.
+    pub fn is_alive(self: *const Ecs, entity: Entity) bool {
+        return self.entity_manager.is_alive(entity);
+    }
 
     /// Registering a component allows one to assign an instance of the component to an entity.
     ///
@@ -73,11 +102,15 @@ pub const Ecs = struct {
     /// Returns:
     /// - `void` on success
     /// - `.adding_unregistered_component` if the component is not registered
+    /// - `.entity_not_alive` if the entity was destroyed
     pub fn add_component_for_entity(
         self: *Ecs,
         entity: Entity,
         component: anytype,
     ) EcsError!void {
+        if (!self.entity_manager.is_alive(entity)) {
+            return EcsError.entity_not_alive;
+        }
         return self.component_manager.add_component_for_entity(entity, component);
     }
 
@@ -88,6 +121,9 @@ pub const Ecs = struct {
         entity: Entity,
         comptime component_ty: type,
     ) !void {
+        if (!self.entity_manager.is_alive(entity)) {
+            return EcsError.entity_not_alive;
+        }
         return self.component_manager.remove_component_for_entity(entity, component_ty);
     }
 
@@ -99,4 +135,42 @@ pub const Ecs = struct {
     ) ?*component_ty {
         return self.component_manager.get_component_for_entity(entity, component_ty);
     }
+
+    /// Returns an iterator over the entities that have all of the given components, e.g.
+    /// ```
+    /// var it = try ecs.query(.{ Position, Velocity });
+    /// while (it.next()) |item| {
+    ///     const position = item.components[0];
+    ///     const velocity = item.components[1];
+    ///     ...
+    /// }
+    /// ```
+    /// Components must not be added or removed while iterating; record such changes in a
+    /// `CommandBuffer` and apply it afterwards instead.
+    ///
+    /// Returns:
+    /// - the iterator on success
+    /// - `.querying_unregistered_component` if one of the components is not registered
+    pub fn query(
+        self: *Ecs,
+        comptime component_tys: anytype,
+    ) EcsError!Query(component_tys) {
+        return self.component_manager.query(component_tys);
+    }
+
+    /// Returns all the components of one type, packed, e.g. for systems that only need a single
+    /// component and want to loop over it directly.
+    pub fn get_dense_components(
+        self: *Ecs,
+        comptime component_ty: type,
+    ) EcsError!DenseComponents(component_ty) {
+        return self.component_manager.get_dense_components(component_ty);
+    }
 };
+
+test {
+    _ = entity_lib;
+    _ = component_lib;
+    _ = system_lib;
+    _ = command_lib;
+}
@@ -0,0 +1,439 @@
+const std = @import("std");
+const dutil = @import("debug_utils");
+const lib = @import("./lib.zig");
+const Ecs = lib.Ecs;
+const EcsError = lib.EcsError;
+const component_lib = @import("./components.zig");
+const CommandBuffer = @import("./commands.zig").CommandBuffer;
+
+/// Describes which components a system touches. The scheduler runs two systems at the same time
+/// only if neither writes a component the other reads or writes.
+pub const SystemDesc = struct {
+    name: []const u8,
+    reads: []const type = &.{},
+    writes: []const type = &.{},
+};
+
+const System = struct {
+    name: []const u8,
+    /// Component type ids, see `ComponentTypeId`.
+    reads: []const u32,
+    writes: []const u32,
+
+    context: *anyopaque,
+    /// Runs the system over `[start, end)` of the dense array returned by `dense_len_fn`, or over
+    /// everything (`start == 0`, `end == maxInt(usize)`) for systems that aren't split.
+    run_fn: *const fn (
+        context: *anyopaque,
+        ecs: *Ecs,
+        commands: *CommandBuffer,
+        start: usize,
+        end: usize,
+    ) void,
+    /// For systems that are split across the thread pool, the length of the dense component
+    /// array the system is split over.
+    dense_len_fn: ?*const fn (ecs: *Ecs) usize,
+
+    /// Systems in the same stage run concurrently; stages run in order.
+    stage: u32 = 0,
+
+    fn conflicts_with(self: System, other: System) bool {
+        for (self.writes) |id| {
+            if (std.mem.indexOfScalar(u32, other.reads, id) != null or
+                std.mem.indexOfScalar(u32, other.writes, id) != null)
+            {
+                return true;
+            }
+        }
+        for (self.reads) |id| {
+            if (std.mem.indexOfScalar(u32, other.writes, id) != null) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+fn component_ids(allocator: std.mem.Allocator, comptime tys: []const type) ![]const u32 {
+    const ids = try allocator.alloc(u32, tys.len);
+    inline for (tys, 0..) |ty, i| {
+        ids[i] = component_lib.get_or_assign_component_type_id(ty);
+    }
+    return ids;
+}
+
+/// Runs systems on a thread pool.
+///
+/// Systems are grouped into stages from their declared component access: a system goes into the
+/// stage after the last earlier-registered system it conflicts with, so conflicting systems keep
+/// their registration order, and everything within a stage runs at the same time. Systems added
+/// with `add_parallel_system` are additionally split into chunks of a dense component array,
+/// which run as separate jobs.
+///
+/// While systems run, they may read and write component values as declared, but must not add or
+/// remove components or entities on the `Ecs` directly, since that can reallocate the arrays other
+/// systems are using. Instead, every job gets its own `CommandBuffer` to record structural changes
+/// in, and the buffers are applied in job order once all systems are done.
+pub const Scheduler = struct {
+    allocator: std.mem.Allocator,
+    pool: *std.Thread.Pool,
+    systems: std.ArrayList(System),
+    /// One per job of a stage, so that jobs never share a buffer. Kept across runs to reuse their
+    /// memory.
+    command_buffers: std.ArrayList(CommandBuffer),
+    /// Number of buffers used in the current run.
+    num_command_buffers_used: usize = 0,
+    num_stages: u32 = 0,
+    are_stages_dirty: bool = false,
+    /// Number of dense array elements per job for split systems.
+    chunk_len: usize = 4096,
+
+    const Self = @This();
+
+    pub fn init(allocator: std.mem.Allocator) !Self {
+        const pool = try allocator.create(std.Thread.Pool);
+        errdefer allocator.destroy(pool);
+        try pool.init(.{ .allocator = allocator });
+
+        return .{
+            .allocator = allocator,
+            .pool = pool,
+            .systems = std.ArrayList(System).init(allocator),
+            .command_buffers = std.ArrayList(CommandBuffer).init(allocator),
+        };
+    }
+
+    pub fn deinit(self: *Self) void {
+        self.pool.deinit();
+        self.allocator.destroy(self.pool);
+        for (self.systems.items) |system| {
+            self.allocator.free(system.reads);
+            self.allocator.free(system.writes);
+        }
+        self.systems.deinit();
+        for (self.command_buffers.items) |*command_buffer| {
+            command_buffer.deinit();
+        }
+        self.command_buffers.deinit();
+    }
+
+    fn add(
+        self: *Self,
+        comptime desc: SystemDesc,
+        context: *anyopaque,
+        run_fn: *const fn (
+            context: *anyopaque,
+            ecs: *Ecs,
+            commands: *CommandBuffer,
+            start: usize,
+            end: usize,
+        ) void,
+        dense_len_fn: ?*const fn (ecs: *Ecs) usize,
+    ) !void {
+        const reads = try component_ids(self.allocator, desc.reads);
+        errdefer self.allocator.free(reads);
+        const writes = try component_ids(self.allocator, desc.writes);
+        errdefer self.allocator.free(writes);
+
+        try self.systems.append(.{
+            .name = desc.name,
+            .reads = reads,
+            .writes = writes,
+            .context = context,
+            .run_fn = run_fn,
+            .dense_len_fn = dense_len_fn,
+        });
+        self.are_stages_dirty = true;
+    }
+
+    /// Adds a system that runs as a single job, as `run_fn(context, ecs, commands)`.
+    pub fn add_system(
+        self: *Self,
+        comptime desc: SystemDesc,
+        context: anytype,
+        comptime run_fn: fn (@TypeOf(context), *Ecs, *CommandBuffer) void,
+    ) !void {
+        const Context = @TypeOf(context);
+        const Wrapper = struct {
+            fn run(
+                context_: *anyopaque,
+                ecs: *Ecs,
+                commands: *CommandBuffer,
+                start: usize,
+                end: usize,
+            ) void {
+                _ = start;
+                _ = end;
+                run_fn(@ptrCast(@alignCast(context_)), ecs, commands);
+            }
+        };
+        comptime std.debug.assert(@typeInfo(Context) == .Pointer);
+        try self.add(desc, @ptrCast(@constCast(context)), Wrapper.run, null);
+    }
+
+    /// Adds a system that is split over the dense array of `split_ty` components: it runs as
+    /// several concurrent jobs `run_fn(context, ecs, commands, start, end)`, which together cover
+    /// `[0, len)` of `ecs.get_dense_components(split_ty)`.
+    pub fn add_parallel_system(
+        self: *Self,
+        comptime desc: SystemDesc,
+        comptime split_ty: type,
+        context: anytype,
+        comptime run_fn: fn (@TypeOf(context), *Ecs, *CommandBuffer, usize, usize) void,
+    ) !void {
+        const Context = @TypeOf(context);
+        const Wrapper = struct {
+            fn run(
+                context_: *anyopaque,
+                ecs: *Ecs,
+                commands: *CommandBuffer,
+                start: usize,
+                end: usize,
+            ) void {
+                run_fn(@ptrCast(@alignCast(context_)), ecs, commands, start, end);
+            }
+
+            fn dense_len(ecs: *Ecs) usize {
+                const dense = ecs.get_dense_components(split_ty) catch return 0;
+                return dense.components.len;
+            }
+        };
+        comptime std.debug.assert(@typeInfo(Context) == .Pointer);
+        try self.add(desc, @ptrCast(@constCast(context)), Wrapper.run, Wrapper.dense_len);
+    }
+
+    fn compute_stages(self: *Self) void {
+        self.num_stages = 0;
+        for (self.systems.items, 0..) |*system, i| {
+            system.stage = 0;
+            for (self.systems.items[0..i]) |earlier| {
+                if (system.conflicts_with(earlier)) {
+                    system.stage = @max(system.stage, earlier.stage + 1);
+                }
+            }
+            self.num_stages = @max(self.num_stages, system.stage + 1);
+        }
+        self.are_stages_dirty = false;
+
+        dutil.log(
+            "ecs",
+            .debug,
+            "scheduled {d} systems in {d} stages",
+            .{ self.systems.items.len, self.num_stages },
+        );
+    }
+
+    fn run_job(
+        wait_group: *std.Thread.WaitGroup,
+        system: *const System,
+        ecs: *Ecs,
+        commands: *CommandBuffer,
+        start: usize,
+        end: usize,
+    ) void {
+        defer wait_group.finish();
+        system.run_fn(system.context, ecs, commands, start, end);
+    }
+
+    fn spawn_job(
+        self: *Self,
+        wait_group: *std.Thread.WaitGroup,
+        system: *const System,
+        ecs: *Ecs,
+        start: usize,
+        end: usize,
+    ) void {
+        const commands = &self.command_buffers.items[self.num_command_buffers_used];
+        self.num_command_buffers_used += 1;
+
+        wait_group.start();
+        self.pool.spawn(run_job, .{ wait_group, system, ecs, commands, start, end }) catch {
+            // Couldn't queue the job, so run it here instead.
+            run_job(wait_group, system, ecs, commands, start, end);
+        };
+    }
+
+    fn num_jobs(self: *const Self, system: *const System, ecs: *Ecs) usize {
+        const dense_len_fn = system.dense_len_fn orelse return 1;
+        return std.math.divCeil(usize, dense_len_fn(ecs), self.chunk_len) catch unreachable;
+    }
+
+    /// Makes sure there are command buffers for `num_jobs` more jobs, before any of the jobs
+    /// start, since growing the list moves the buffers.
+    fn reserve_command_buffers(self: *Self, num_jobs_: usize) !void {
+        const num_needed = self.num_command_buffers_used + num_jobs_;
+        while (self.command_buffers.items.len < num_needed) {
+            try self.command_buffers.append(CommandBuffer.init(self.allocator));
+        }
+    }
+
+    /// Runs all systems once, returning when they are all done and their commands are applied.
+    ///
+    /// Returns:
+    /// - `void` on success
+    /// - the first error from applying the commands, see `CommandBuffer.apply`. The remaining
+    ///   commands are dropped.
+    pub fn run(self: *Self, ecs: *Ecs) EcsError!void {
+        if (self.are_stages_dirty) {
+            self.compute_stages();
+        }
+
+        self.num_command_buffers_used = 0;
+        // Drop whatever is left in the buffers if applying them fails part way through.
+        defer for (self.command_buffers.items) |*command_buffer| command_buffer.clear();
+
+        var stage: u32 = 0;
+        while (stage < self.num_stages) : (stage += 1) {
+            var num_stage_jobs: usize = 0;
+            for (self.systems.items) |*system| {
+                if (system.stage == stage) {
+                    num_stage_jobs += self.num_jobs(system, ecs);
+                }
+            }
+            try self.reserve_command_buffers(num_stage_jobs);
+
+            var wait_group = std.Thread.WaitGroup{};
+
+            for (self.systems.items) |*system| {
+                if (system.stage != stage) {
+                    continue;
+                }
+
+                const dense_len_fn = system.dense_len_fn orelse {
+                    self.spawn_job(&wait_group, system, ecs, 0, std.math.maxInt(usize));
+                    continue;
+                };
+
+                const len = dense_len_fn(ecs);
+                var start: usize = 0;
+                while (start < len) : (start += self.chunk_len) {
+                    const end = @min(start + self.chunk_len, len);
+                    self.spawn_job(&wait_group, system, ecs, start, end);
+                }
+            }
+
+            wait_group.wait();
+        }
+
+        for (self.command_buffers.items[0..self.num_command_buffers_used]) |*command_buffer| {
+            try command_buffer.apply(ecs);
+        }
+    }
+};
+
+// ---
+
+test "scheduler" {
+    const allocator = std.testing.allocator;
+
+    const A = struct {
+        val: u32,
+    };
+    const B = struct {
+        val: u32,
+    };
+    const C = struct {
+        val: u32,
+    };
+
+    var ecs = Ecs.init(allocator);
+    defer ecs.deinit();
+    try ecs.register_component(A);
+    try ecs.register_component(B);
+    try ecs.register_component(C);
+
+    const num_entities = 10_000;
+    var i: u32 = 0;
+    while (i < num_entities) : (i += 1) {
+        const entity = try ecs.create_entity();
+        try ecs.add_component_for_entity(entity, A{ .val = i });
+        try ecs.add_component_for_entity(entity, B{ .val = 0 });
+        try ecs.add_component_for_entity(entity, C{ .val = 0 });
+    }
+
+    const Systems = struct {
+        /// Doubles every A, split across the pool.
+        fn double_a(
+            context: *void,
+            ecs_: *Ecs,
+            commands: *CommandBuffer,
+            start: usize,
+            end: usize,
+        ) void {
+            _ = context;
+            _ = commands;
+            const dense = ecs_.get_dense_components(A) catch unreachable;
+            for (dense.components[start..end]) |*a| {
+                a.val *= 2;
+            }
+        }
+
+        /// Copies A into B. Reads A, so it has to run after `double_a`. Also spawns an entity
+        /// with just a B.
+        fn copy_a_to_b(context: *void, ecs_: *Ecs, commands: *CommandBuffer) void {
+            _ = context;
+            var it = ecs_.query(.{ A, B }) catch unreachable;
+            while (it.next()) |item| {
+                item.components[1].val = item.components[0].val;
+            }
+
+            const created = commands.create_entity() catch unreachable;
+            commands.add_component_to_created(created, B{ .val = 42 }) catch unreachable;
+        }
+
+        /// Independent of the other two.
+        fn set_c(
+            context: *void,
+            ecs_: *Ecs,
+            commands: *CommandBuffer,
+            start: usize,
+            end: usize,
+        ) void {
+            _ = context;
+            _ = commands;
+            const dense = ecs_.get_dense_components(C) catch unreachable;
+            for (dense.components[start..end]) |*c| {
+                c.val = 1;
+            }
+        }
+    };
+
+    var scheduler = try Scheduler.init(allocator);
+    defer scheduler.deinit();
+    scheduler.chunk_len = 1000;
+
+    var context: void = {};
+    try scheduler.add_parallel_system(
+        .{ .name = "double_a", .writes = &.{A} },
+        A,
+        &context,
+        Systems.double_a,
+    );
+    try scheduler.add_system(
+        .{ .name = "copy_a_to_b", .reads = &.{A}, .writes = &.{B} },
+        &context,
+        Systems.copy_a_to_b,
+    );
+    try scheduler.add_parallel_system(
+        .{ .name = "set_c", .writes = &.{C} },
+        C,
+        &context,
+        Systems.set_c,
+    );
+
+    try scheduler.run(&ecs);
+
+    try std.testing.expect(scheduler.num_stages == 2);
+    try std.testing.expect(scheduler.systems.items[2].stage == 0);
+
+    var it = try ecs.query(.{ A, B, C });
+    while (it.next()) |item| {
+        try std.testing.expect(item.components[0].val == item.entity.id * 2);
+        try std.testing.expect(item.components[1].val == item.components[0].val);
+        try std.testing.expect(item.components[2].val == 1);
+    }
+
+    // The entity spawned by `copy_a_to_b` only exists once the run is done.
+    const dense_b = try ecs.get_dense_components(B);
+    try std.testing.expect(dense_b.components.len == num_entities + 1);
+}
@@ -1,6 +1,17 @@
 const std = @import("std");
 const cglm = @import("cglm");
 
+/// Hashes the bit patterns of the floats, with -0 hashed as 0 so that values that are `==` hash
+/// the same.
+fn hash_floats(values: []const f32) u64 {
+    var hasher = std.hash.Wyhash.init(0);
+    for (values) |value| {
+        const bits: u32 = @bitCast(if (value == 0) @as(f32, 0) else value);
+        hasher.update(std.mem.asBytes(&bits));
+    }
+    return hasher.final();
+}
+
 pub const Vec2f = extern struct {
     raw: cglm.vec2,
 
@@ -11,7 +22,7 @@ pub const Vec2f = extern struct {
     }
 
     pub fn hash(self: Vec2f) u64 {
-        return @as(u64, @intFromFloat(self.raw[0])) ^ (@as(u64, @intFromFloat(self.raw[1])) << 1);
+        return hash_floats(&self.raw);
     }
 
     pub fn eql(self: Vec2f, other: Vec2f) bool {
@@ -29,7 +40,7 @@ pub const Vec3f = extern struct {
     }
 
     pub fn hash(self: Vec3f) u64 {
-        return @as(u64, @intFromFloat(self.raw[0])) ^ (@as(u64, @intFromFloat(self.raw[1])) << 1) ^ (@as(u64, @intFromFloat(self.raw[2])) << 2);
+        return hash_floats(&self.raw);
     }
 
     pub fn eql(self: Vec3f, other: Vec3f) bool {
@@ -81,6 +92,13 @@ pub const Mat4f = extern struct {
         };
     }
 
+    /// Reinterprets a column-major C array as a `Mat4f` without copying, e.g. to read a matrix
+    /// owned by C code. The pointer is only valid as long as the C array is.
+    pub fn ptr_from_c_array(arr: [*c]f32) *Mat4f {
+        comptime std.debug.assert(@sizeOf(Mat4f) == 16 * @sizeOf(f32));
+        return @ptrCast(@alignCast(arr));
+    }
+
     pub fn init_identity() Mat4f {
         return init_with_cols(
             Vec4f.init(1.0, 0.0, 0.0, 0.0),
@@ -117,6 +135,12 @@ pub const Mat4f = extern struct {
         cglm.glmc_rotate(self.raw[0..].ptr, angle, axis.raw[0..].ptr);
     }
 
+    /// Rotates by a unit quaternion, stored x, y, z, w.
+    pub fn apply_rotation_quat(self: *Mat4f, rotation: *const Vec4f) void {
+        var rotation_copy: Vec4f = rotation.*;
+        cglm.glmc_quat_rotate(&self.raw, &rotation_copy.raw, &self.raw);
+    }
+
     pub fn apply_translation(self: *Mat4f, translation: *const Vec3f) void {
         // TODO: shouldn't need to do this.
         var translation_copy: Vec3f = translation.*;
@@ -129,6 +153,27 @@ pub const Mat4f = extern struct {
         cglm.glmc_scale(self.raw[0..].ptr, scale_copy.raw[0..].ptr);
     }
 
+    /// Splits an affine transform without shear into the translation, rotation (as a unit
+    /// quaternion, x, y, z, w) and scale that `apply_translation`, `apply_rotation_quat` and
+    /// `apply_scale`, in that order, would rebuild it from.
+    pub fn decompose(
+        self: *const Mat4f,
+    ) struct { translation: Vec3f, rotation: Vec4f, scale: Vec3f } {
+        var matrix_copy: Mat4f = self.*;
+        var translation: cglm.vec4 = undefined;
+        var rotation_matrix: cglm.mat4 = undefined;
+        var scale: cglm.vec3 = undefined;
+        cglm.glmc_decompose(&matrix_copy.raw, &translation, &rotation_matrix, &scale);
+        var rotation: cglm.versor = undefined;
+        cglm.glmc_mat4_quat(&rotation_matrix, &rotation);
+
+        return .{
+            .translation = Vec3f.init(translation[0], translation[1], translation[2]),
+            .rotation = .{ .raw = rotation },
+            .scale = .{ .raw = scale },
+        };
+    }
+
     comptime {
         std.debug.assert(@sizeOf(Mat4f) == @sizeOf(cglm.mat4));
         std.debug.assert(@alignOf(Mat4f) == @alignOf(cglm.mat4));
@@ -0,0 +1,149 @@
+const std = @import("std");
+const r4_core = @import("r4_core");
+
+const gltf_accessor = r4_core.gltf_accessor;
+
+/// Like the `Vertex` of the scene: three vec3s, the second of which is decoded into.
+const TestVertex = extern struct {
+    a: [3]f32,
+    b: [3]f32,
+    c: [3]f32,
+};
+
+test "float vec3s are copied, packed or strided" {
+    const source = [_]f32{ 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+    const layout = gltf_accessor.Layout{
+        .data = std.mem.sliceAsBytes(&source),
+        .count = 3,
+        .stride = 12,
+        .component_type = .f32,
+        .component_count = 3,
+    };
+
+    // Packed to packed.
+    var packed_out: [9]f32 = undefined;
+    gltf_accessor.unpack_floats(3, layout, std.mem.sliceAsBytes(&packed_out), 12);
+    try std.testing.expectEqualSlices(f32, &source, &packed_out);
+
+    // Packed to a field of vertices, leaving the other fields alone.
+    const zero = [3]f32{ 0, 0, 0 };
+    var vertices = [_]TestVertex{.{ .a = zero, .b = zero, .c = zero }} ** 3;
+    const vertex_bytes = std.mem.sliceAsBytes(&vertices);
+    gltf_accessor.unpack_floats(
+        3,
+        layout,
+        vertex_bytes[@offsetOf(TestVertex, "b")..],
+        @sizeOf(TestVertex),
+    );
+    for (vertices, 0..) |vertex, i| {
+        try std.testing.expectEqualSlices(f32, source[i * 3 ..][0..3], &vertex.b);
+        try std.testing.expectEqualSlices(f32, &.{ 0, 0, 0 }, &vertex.a);
+        try std.testing.expectEqualSlices(f32, &.{ 0, 0, 0 }, &vertex.c);
+    }
+
+    // Interleaved with another attribute in the source.
+    const interleaved = [_]f32{ 1, 2, 3, -1, -1, -1, 4, 5, 6, -1, -1, -1 };
+    const interleaved_layout = gltf_accessor.Layout{
+        .data = std.mem.sliceAsBytes(&interleaved),
+        .count = 2,
+        .stride = 24,
+        .component_type = .f32,
+        .component_count = 3,
+    };
+    gltf_accessor.unpack_floats(3, interleaved_layout, std.mem.sliceAsBytes(&packed_out), 12);
+    try std.testing.expectEqualSlices(f32, &.{ 1, 2, 3, 4, 5, 6 }, packed_out[0..6]);
+}
+
+test "integer components are converted, normalized or not" {
+    var out: [6]f32 = undefined;
+
+    const shorts = [_]i16{ -32768, -32767, 0, 32767, 16384, -2 };
+    gltf_accessor.unpack_floats(3, .{
+        .data = std.mem.sliceAsBytes(&shorts),
+        .count = 2,
+        .stride = 6,
+        .component_type = .i16,
+        .component_count = 3,
+        .is_normalized = true,
+    }, std.mem.sliceAsBytes(&out), 12);
+    try std.testing.expect(out[0] == -1 and out[1] == -1 and out[2] == 0 and out[3] == 1);
+    try std.testing.expectApproxEqAbs(@as(f32, 0.5), out[4], 1e-4);
+
+    const bytes = [_]u8{ 0, 255, 51, 1, 2, 3 };
+    gltf_accessor.unpack_floats(3, .{
+        .data = &bytes,
+        .count = 2,
+        .stride = 3,
+        .component_type = .u8,
+        .component_count = 3,
+        .is_normalized = true,
+    }, std.mem.sliceAsBytes(&out), 12);
+    try std.testing.expect(out[0] == 0 and out[1] == 1);
+    try std.testing.expectApproxEqAbs(@as(f32, 0.2), out[2], 1e-6);
+
+    gltf_accessor.unpack_floats(3, .{
+        .data = &bytes,
+        .count = 2,
+        .stride = 3,
+        .component_type = .u8,
+        .component_count = 3,
+    }, std.mem.sliceAsBytes(&out), 12);
+    try std.testing.expectEqualSlices(f32, &.{ 0, 255, 51, 1, 2, 3 }, &out);
+}
+
+test "indices of every size, packed or strided" {
+    // 19 is two full vectors of 8 for 16-bit indices, and a remainder.
+    var expected: [19]u32 = undefined;
+    for (&expected, 0..) |*index, i| {
+        index.* = @intCast(i * 3000 % 65536);
+    }
+    var out: [19]u32 = undefined;
+
+    var shorts: [19]u16 = undefined;
+    for (&shorts, expected) |*short, index| {
+        short.* = @intCast(index);
+    }
+    gltf_accessor.unpack_indices(.{
+        .data = std.mem.sliceAsBytes(&shorts),
+        .count = 19,
+        .stride = 2,
+        .component_type = .u16,
+        .component_count = 1,
+    }, &out);
+    try std.testing.expectEqualSlices(u32, &expected, &out);
+
+    // Every other short, as if interleaved with something else.
+    var interleaved: [38]u16 = undefined;
+    for (expected, 0..) |index, i| {
+        interleaved[i * 2] = @intCast(index);
+        interleaved[i * 2 + 1] = 0xffff;
+    }
+    gltf_accessor.unpack_indices(.{
+        .data = std.mem.sliceAsBytes(&interleaved),
+        .count = 19,
+        .stride = 4,
+        .component_type = .u16,
+        .component_count = 1,
+    }, &out);
+    try std.testing.expectEqualSlices(u32, &expected, &out);
+
+    gltf_accessor.unpack_indices(.{
+        .data = std.mem.sliceAsBytes(&expected),
+        .count = 19,
+        .stride = 4,
+        .component_type = .u32,
+        .component_count = 1,
+    }, &out);
+    try std.testing.expectEqualSlices(u32, &expected, &out);
+
+    const bytes = [_]u8{ 0, 1, 2, 255 };
+    var byte_out: [4]u32 = undefined;
+    gltf_accessor.unpack_indices(.{
+        .data = &bytes,
+        .count = 4,
+        .stride = 1,
+        .component_type = .u8,
+        .component_count = 1,
+    }, &byte_out);
+    try std.testing.expectEqualSlices(u32, &.{ 0, 1, 2, 255 }, &byte_out);
+}
@@ -0,0 +1,217 @@
+const std = @import("std");
+const r4_core = @import("r4_core");
+
+const mesh_cache = r4_core.mesh_cache;
+const gltf_loader = r4_core.gltf_loader;
+
+/// Stands in for a GPU vertex layout.
+const TestVertex = extern struct {
+    position: [3]f32,
+    packed_normal: u32,
+};
+
+const vertex_layout_hash = mesh_cache.layout_hash(TestVertex);
+const source_hash = 0x1234_5678_9abc_def0;
+
+const vertices = [_]TestVertex{
+    .{ .position = .{ 0, 0, 0 }, .packed_normal = 1 },
+    .{ .position = .{ 1, 0, 0 }, .packed_normal = 2 },
+    .{ .position = .{ 0, 1, 0 }, .packed_normal = 3 },
+};
+const indices = [_]u32{ 0, 1, 2, 0, 1, 2 };
+const lods = [_]r4_core.mesh_optimizer.Lod{
+    .{ .first_index = 0, .index_count = 3, .geometric_error = 0 },
+    .{ .first_index = 3, .index_count = 3, .geometric_error = 0.5 },
+};
+const bounds = mesh_cache.Bounds{
+    .min = .{ 0, 0, 0 },
+    .max = .{ 1, 1, 0 },
+    .center = .{ 0.5, 0.5, 0 },
+    .radius = 0.75,
+};
+
+/// One mesh with two primitives, the second of which has an odd number of indices, so that the
+/// blobs after it need padding, and two nodes.
+fn write_test_model(
+    allocator: std.mem.Allocator,
+    model_source_hash: u64,
+) ![]align(mesh_cache.data_alignment) u8 {
+    const primitives = [_]mesh_cache.PrimitiveData{ .{
+        .vertices = std.mem.sliceAsBytes(&vertices),
+        .vertex_count = vertices.len,
+        .indices = &indices,
+        .lods = &lods,
+        .bounds = bounds,
+        .material = 7,
+    }, .{
+        .vertices = std.mem.sliceAsBytes(vertices[0..1]),
+        .vertex_count = 1,
+        .indices = &.{0},
+        .lods = lods[0..1],
+        .bounds = bounds,
+        .material = null,
+    } };
+    const meshes = [_]mesh_cache.MeshData{
+        .{ .name = "mesh", .first_primitive = 0, .primitive_count = 2 },
+    };
+    const nodes = [_]mesh_cache.NodeData{ .{
+        .name = "root",
+        .parent = null,
+        .mesh = null,
+        .translation = .{ 1, 2, 3 },
+        .rotation = .{ 0, 0, 0, 1 },
+        .scale = .{ 1, 1, 1 },
+    }, .{
+        .name = "child",
+        .parent = 0,
+        .mesh = 0,
+        .translation = .{ 0, 0, 0 },
+        .rotation = .{ 0, 0, 0, 1 },
+        .scale = .{ 2, 2, 2 },
+    } };
+
+    return mesh_cache.write(allocator, .{
+        .vertex_size = @sizeOf(TestVertex),
+        .vertex_layout_hash = vertex_layout_hash,
+        .source_hash = model_source_hash,
+        .primitives = &primitives,
+        .meshes = &meshes,
+        .nodes = &nodes,
+    });
+}
+
+fn open(file: []align(mesh_cache.data_alignment) const u8) !mesh_cache.View {
+    return mesh_cache.View.open(file, @sizeOf(TestVertex), vertex_layout_hash, source_hash);
+}
+
+test "written models read back in place" {
+    const allocator = std.testing.allocator;
+    const file = try write_test_model(allocator, source_hash);
+    defer allocator.free(file);
+    const view = try open(file);
+
+    try std.testing.expect(view.primitives.len == 2);
+    const primitive = view.primitives[0];
+    try std.testing.expect(primitive.vertex_offset % mesh_cache.data_alignment == 0);
+    try std.testing.expect(primitive.index_offset % mesh_cache.data_alignment == 0);
+    try std.testing.expectEqualSlices(
+        u8,
+        std.mem.sliceAsBytes(&vertices),
+        view.vertices(primitive),
+    );
+    try std.testing.expectEqualSlices(u32, &indices, view.indices(primitive));
+    try std.testing.expect(primitive.lod_count == 2 and primitive.lods[1].first_index == 3);
+    try std.testing.expect(primitive.lods[1].geometric_error == 0.5);
+    try std.testing.expect(primitive.bounds.radius == 0.75);
+    try std.testing.expect(primitive.material == 7);
+    try std.testing.expect(view.primitives[1].material == mesh_cache.no_index);
+    try std.testing.expectEqualSlices(u32, &.{0}, view.indices(view.primitives[1]));
+
+    try std.testing.expect(view.meshes.len == 1);
+    try std.testing.expectEqualStrings("mesh", view.name(view.meshes[0].name));
+    try std.testing.expect(view.mesh_primitives(view.meshes[0]).len == 2);
+
+    try std.testing.expect(view.nodes.len == 2);
+    try std.testing.expectEqualStrings("root", view.name(view.nodes[0].name));
+    try std.testing.expectEqualStrings("child", view.name(view.nodes[1].name));
+    try std.testing.expect(view.nodes[0].parent == mesh_cache.no_index);
+    try std.testing.expect(view.nodes[1].parent == 0 and view.nodes[1].mesh == 0);
+    try std.testing.expect(view.nodes[0].translation[2] == 3 and view.nodes[1].scale[0] == 2);
+}
+
+test "caches for other sources, layouts or versions are rejected" {
+    const allocator = std.testing.allocator;
+    const file = try write_test_model(allocator, source_hash);
+    defer allocator.free(file);
+
+    try std.testing.expectError(
+        mesh_cache.CacheError.stale,
+        mesh_cache.View.open(file, @sizeOf(TestVertex), vertex_layout_hash, source_hash + 1),
+    );
+    try std.testing.expectError(
+        mesh_cache.CacheError.vertex_layout_mismatch,
+        mesh_cache.View.open(file, @sizeOf(TestVertex), vertex_layout_hash ^ 1, source_hash),
+    );
+    try std.testing.expect(
+        mesh_cache.layout_hash(TestVertex) != mesh_cache.layout_hash(extern struct {
+            position: [3]f32,
+            normal: u32,
+        }),
+    );
+
+    file[@offsetOf(mesh_cache.Header, "version")] +%= 1;
+    try std.testing.expectError(mesh_cache.CacheError.unsupported_version, open(file));
+    file[@offsetOf(mesh_cache.Header, "version")] -%= 1;
+    file[0] = 'X';
+    try std.testing.expectError(mesh_cache.CacheError.invalid_magic, open(file));
+    file[0] = mesh_cache.magic[0];
+    _ = try open(file);
+}
+
+test "truncated or inconsistent caches are rejected" {
+    const allocator = std.testing.allocator;
+    const file = try write_test_model(allocator, source_hash);
+    defer allocator.free(file);
+
+    try std.testing.expectError(mesh_cache.CacheError.corrupt, open(file[0..16]));
+    try std.testing.expectError(mesh_cache.CacheError.corrupt, open(file[0 .. file.len - 16]));
+
+    // The index blob of the first primitive, pointed past the end of the file.
+    const offset_of_index_offset =
+        @sizeOf(mesh_cache.Header) + @offsetOf(mesh_cache.Primitive, "index_offset");
+    const index_offset = std.mem.readIntNative(u64, file[offset_of_index_offset..][0..8]);
+    std.mem.writeIntNative(u64, file[offset_of_index_offset..][0..8], file.len);
+    try std.testing.expectError(mesh_cache.CacheError.corrupt, open(file));
+    std.mem.writeIntNative(u64, file[offset_of_index_offset..][0..8], index_offset);
+
+    // An index past the vertices of its primitive.
+    const first_index = file[index_offset..][0..4];
+    std.mem.writeIntNative(u32, first_index, vertices.len);
+    try std.testing.expectError(mesh_cache.CacheError.corrupt, open(file));
+    std.mem.writeIntNative(u32, first_index, indices[0]);
+    _ = try open(file);
+
+    // A node parented to one that doesn't exist.
+    const offset_of_parent = @sizeOf(mesh_cache.Header) +
+        2 * @sizeOf(mesh_cache.Primitive) + @sizeOf(mesh_cache.Mesh) + @sizeOf(mesh_cache.Node) +
+        @offsetOf(mesh_cache.Node, "parent");
+    std.mem.writeIntNative(u32, file[offset_of_parent..][0..4], 5);
+    try std.testing.expectError(mesh_cache.CacheError.corrupt, open(file));
+}
+
+test "editing only the buffer of a glTF file makes its cache stale" {
+    var allocator = std.testing.allocator;
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    // The buffer is referred to by a relative, escaped URI.
+    try tmp.dir.writeFile(
+        "model.gltf",
+        \\{"asset":{"version":"2.0"},"buffers":[{"uri":"model%20data.bin","byteLength":4}]}
+    );
+    try tmp.dir.writeFile("model data.bin", &.{ 0, 1, 2, 3 });
+    const dir_path = try tmp.dir.realpathAlloc(allocator, ".");
+    defer allocator.free(dir_path);
+    const path = try std.fs.path.joinZ(allocator, &.{ dir_path, "model.gltf" });
+    defer allocator.free(path);
+
+    const file = try write_test_model(allocator, try gltf_loader.hash_source(&allocator, path));
+    defer allocator.free(file);
+    _ = try mesh_cache.View.open(
+        file,
+        @sizeOf(TestVertex),
+        vertex_layout_hash,
+        try gltf_loader.hash_source(&allocator, path),
+    );
+
+    try tmp.dir.writeFile("model data.bin", &.{ 0, 1, 2, 4 });
+    try std.testing.expectError(
+        mesh_cache.CacheError.stale,
+        mesh_cache.View.open(
+            file,
+            @sizeOf(TestVertex),
+            vertex_layout_hash,
+            try gltf_loader.hash_source(&allocator, path),
+        ),
+    );
+}
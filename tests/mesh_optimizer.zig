@@ -0,0 +1,128 @@
+const std = @import("std");
+const r4_core = @import("r4_core");
+
+const math = r4_core.math;
+const mesh_optimizer = r4_core.mesh_optimizer;
+
+const Vertex = extern struct {
+    position: math.Vec3f,
+};
+
+/// A grid of `size` x `size` quads in row order, as a triangle list that isn't indexed.
+fn make_grid(allocator: std.mem.Allocator, size: usize) ![]Vertex {
+    const vertices = try allocator.alloc(Vertex, size * size * 6);
+    var count: usize = 0;
+    for (0..size) |y| {
+        for (0..size) |x| {
+            const corners = [6][2]usize{
+                .{ x, y }, .{ x + 1, y }, .{ x + 1, y + 1 },
+                .{ x, y }, .{ x + 1, y + 1 }, .{ x, y + 1 },
+            };
+            for (corners) |corner| {
+                vertices[count] = .{ .position = math.Vec3f.init(
+                    @floatFromInt(corner[0]),
+                    @floatFromInt(corner[1]),
+                    0,
+                ) };
+                count += 1;
+            }
+        }
+    }
+    return vertices;
+}
+
+test "optimizing a mesh welds vertices and keeps its triangles" {
+    const allocator = std.testing.allocator;
+
+    const size = 24;
+    const vertices = try make_grid(allocator, size);
+    defer allocator.free(vertices);
+
+    const optimized = try mesh_optimizer.optimize(Vertex, allocator, vertices, &.{});
+    defer optimized.deinit(allocator);
+
+    try std.testing.expect(optimized.vertices.len == (size + 1) * (size + 1));
+    try std.testing.expect(optimized.indices.len == vertices.len);
+    try std.testing.expect(optimized.acmr_before == 3);
+    try std.testing.expect(optimized.acmr_after < 1);
+
+    // Vertices are in order of first use.
+    var max_index: u32 = 0;
+    for (optimized.indices) |index| {
+        try std.testing.expect(index <= max_index + 1);
+        max_index = @max(max_index, index);
+    }
+
+    // The same triangles with the same winding, in some order and rotation. The signed area of
+    // each triangle is kept, and sums to that of the grid.
+    var total_area: f32 = 0;
+    var i: usize = 0;
+    while (i < optimized.indices.len) : (i += 3) {
+        const a = optimized.vertices[optimized.indices[i]].position.raw;
+        const b = optimized.vertices[optimized.indices[i + 1]].position.raw;
+        const c = optimized.vertices[optimized.indices[i + 2]].position.raw;
+        const area = ((b[0] - a[0]) * (c[1] - a[1]) - (c[0] - a[0]) * (b[1] - a[1])) * 0.5;
+        try std.testing.expectApproxEqAbs(@as(f32, 0.5), area, 1e-6);
+        total_area += area;
+    }
+    try std.testing.expectApproxEqAbs(@as(f32, size * size), total_area, 1e-3);
+
+    // Running it again on its own output changes nothing that matters.
+    const again = try mesh_optimizer.optimize(
+        Vertex,
+        allocator,
+        optimized.vertices,
+        optimized.indices,
+    );
+    defer again.deinit(allocator);
+    try std.testing.expect(again.vertices.len == optimized.vertices.len);
+    try std.testing.expect(again.acmr_before == optimized.acmr_after);
+    try std.testing.expect(again.acmr_after <= optimized.acmr_after + 0.05);
+}
+
+test "LOD chain of a flat grid" {
+    const allocator = std.testing.allocator;
+
+    const size = 32;
+    const vertices = try make_grid(allocator, size);
+    defer allocator.free(vertices);
+    const optimized = try mesh_optimizer.optimize(Vertex, allocator, vertices, &.{});
+    defer optimized.deinit(allocator);
+
+    const chain = try mesh_optimizer.build_lod_chain(
+        Vertex,
+        allocator,
+        optimized.vertices,
+        optimized.indices,
+    );
+    defer chain.deinit(allocator);
+
+    // The inside of a flat grid collapses without any error, until only about its border is left.
+    const lods = chain.lods.constSlice();
+    try std.testing.expect(lods.len >= 3);
+    try std.testing.expectEqualSlices(
+        u32,
+        optimized.indices,
+        chain.indices[lods[0].first_index..][0..lods[0].index_count],
+    );
+
+    var end: u32 = 0;
+    for (lods, 0..) |lod, i| {
+        // Back to back in one index buffer.
+        try std.testing.expect(lod.first_index == end);
+        end += lod.index_count;
+        try std.testing.expect(lod.index_count % 3 == 0);
+        try std.testing.expect(lod.geometric_error < 1e-3);
+        if (i > 0) {
+            const previous_count: f32 = @floatFromInt(lods[i - 1].index_count);
+            try std.testing.expect(
+                @as(f32, @floatFromInt(lod.index_count)) <=
+                    previous_count * mesh_optimizer.lod_min_reduction,
+            );
+        }
+    }
+    try std.testing.expect(end == chain.indices.len);
+    for (chain.indices) |index| {
+        try std.testing.expect(index < optimized.vertices.len);
+    }
+}
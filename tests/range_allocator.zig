@@ -0,0 +1,94 @@
+const std = @import("std");
+const r4_core = @import("r4_core");
+
+const RangeAllocator = r4_core.range_allocator.RangeAllocator;
+
+test "ranges are reused and merged when freed" {
+    var ranges = try RangeAllocator.init(std.testing.allocator, 100);
+    defer ranges.deinit();
+
+    const a = (try ranges.alloc(30)).?;
+    const b = (try ranges.alloc(30)).?;
+    const c = (try ranges.alloc(30)).?;
+    try std.testing.expect(a == 0 and b == 30 and c == 60);
+    try std.testing.expect((try ranges.alloc(11)) == null);
+    try std.testing.expect(ranges.free_count == 10);
+
+    // Two holes that aren't next to each other can't hold more than the longest.
+    ranges.free(a, 30);
+    ranges.free(c, 30);
+    try std.testing.expect(ranges.largest_free() == 40);
+    try std.testing.expect((try ranges.alloc(50)) == null);
+
+    // Best fit: the 30 long hole at the front, not the 40 long one at the end.
+    try std.testing.expect((try ranges.alloc(25)).? == 0);
+    ranges.free(0, 25);
+
+    // Freeing the middle merges everything back into one range.
+    ranges.free(b, 30);
+    try std.testing.expect(ranges.free_ranges.items.len == 1);
+    try std.testing.expect(ranges.free_count == 100);
+    try std.testing.expect((try ranges.alloc(100)).? == 0);
+    try std.testing.expect((try ranges.alloc(1)) == null);
+}
+
+test "random allocations never overlap" {
+    const capacity = 1000;
+    var ranges = try RangeAllocator.init(std.testing.allocator, capacity);
+    defer ranges.deinit();
+
+    var owners = [_]u8{0} ** capacity;
+    var live = std.ArrayList([2]u32).init(std.testing.allocator);
+    defer live.deinit();
+
+    var prng = std.rand.DefaultPrng.init(42);
+    const random = prng.random();
+    for (0..2000) |_| {
+        if (live.items.len > 0 and random.boolean()) {
+            const range = live.swapRemove(random.uintLessThan(usize, live.items.len));
+            for (owners[range[0]..][0..range[1]]) |*owner| {
+                owner.* -= 1;
+            }
+            ranges.free(range[0], range[1]);
+        } else {
+            const count = random.intRangeAtMost(u32, 1, 50);
+            const offset = (try ranges.alloc(count)) orelse continue;
+            for (owners[offset..][0..count]) |*owner| {
+                try std.testing.expect(owner.* == 0);
+                owner.* += 1;
+            }
+            try live.append(.{ offset, count });
+        }
+    }
+
+    for (live.items) |range| {
+        ranges.free(range[0], range[1]);
+    }
+    try std.testing.expect(ranges.free_count == capacity);
+    try std.testing.expect(ranges.free_ranges.items.len == 1);
+}
+
+test "freeing never allocates" {
+    var ranges = try RangeAllocator.init(std.testing.allocator, 100);
+    defer ranges.deinit();
+
+    var offsets: [10]u32 = undefined;
+    for (&offsets) |*offset| {
+        offset.* = (try ranges.alloc(10)).?;
+    }
+
+    // Every other range leaves as many holes as there can be, then the others merge them. The
+    // free list asserts that it has room for every hole.
+    const allocator = ranges.free_ranges.allocator;
+    ranges.free_ranges.allocator = std.testing.failing_allocator;
+    defer ranges.free_ranges.allocator = allocator;
+    for (0..2) |parity| {
+        for (offsets, 0..) |offset, i| {
+            if (i % 2 == parity) {
+                ranges.free(offset, 10);
+            }
+        }
+    }
+    try std.testing.expect(ranges.free_ranges.items.len == 1);
+    try std.testing.expect(ranges.free_count == 100);
+}
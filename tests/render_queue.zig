@@ -0,0 +1,63 @@
+const std = @import("std");
+const r4_core = @import("r4_core");
+
+const render_queue = r4_core.render_queue;
+const RenderQueue = render_queue.RenderQueue;
+
+test "radix sort matches a comparison sort" {
+    const allocator = std.testing.allocator;
+
+    var queue = RenderQueue.init(allocator);
+    defer queue.deinit();
+
+    var prng = std.rand.DefaultPrng.init(0x42);
+    const random = prng.random();
+
+    const count = 10_000;
+    var expected = try allocator.alloc(render_queue.SortKey, count);
+    defer allocator.free(expected);
+
+    for (0..count) |i| {
+        // Few materials and meshes, so that some digits are shared by all keys and skipped.
+        const key = render_queue.make_opaque_key(
+            random.uintLessThan(usize, 4),
+            random.uintLessThan(u32, 100),
+            random.float(f32) * 1000,
+        );
+        expected[i] = key;
+        try queue.push(key, @intCast(i));
+    }
+
+    const original = try allocator.dupe(render_queue.SortKey, expected);
+    defer allocator.free(original);
+
+    try queue.sort();
+    std.mem.sort(render_queue.SortKey, expected, {}, std.sort.asc(render_queue.SortKey));
+
+    try std.testing.expectEqualSlices(render_queue.SortKey, expected, queue.keys.items);
+    for (queue.keys.items, queue.items.items, 0..) |key, item, i| {
+        // The items were permuted along with the keys.
+        try std.testing.expect(original[item] == key);
+        // Equal keys keep their order.
+        if (i > 0 and queue.keys.items[i - 1] == key) {
+            try std.testing.expect(queue.items.items[i - 1] < item);
+        }
+    }
+}
+
+test "opaque keys group by material and mesh, then sort front to back" {
+    const near = render_queue.make_opaque_key(1, 7, 2.5);
+    const far = render_queue.make_opaque_key(1, 7, 40);
+    const other_mesh = render_queue.make_opaque_key(1, 8, 0.5);
+    const other_material = render_queue.make_opaque_key(2, 0, 0);
+
+    try std.testing.expect(near < far);
+    try std.testing.expect(far < other_mesh);
+    try std.testing.expect(other_mesh < other_material);
+
+    try std.testing.expect(render_queue.batch_of(near) == render_queue.batch_of(far));
+    try std.testing.expect(render_queue.batch_of(far) != render_queue.batch_of(other_mesh));
+
+    // Behind the camera sorts as depth 0.
+    try std.testing.expect(render_queue.quantize_depth(-3) == render_queue.quantize_depth(0));
+}
@@ -1,3 +1,10 @@
 comptime {
     _ = @import("./rendergraph.zig");
+    _ = @import("./render_queue.zig");
+    _ = @import("./mesh_optimizer.zig");
+    _ = @import("./vertex_formats.zig");
+    _ = @import("./range_allocator.zig");
+    _ = @import("./texture_format.zig");
+    _ = @import("./gltf_accessor.zig");
+    _ = @import("./mesh_cache.zig");
 }
@@ -0,0 +1,130 @@
+const std = @import("std");
+const r4_core = @import("r4_core");
+
+const texture_format = r4_core.texture_format;
+
+/// A `size` x `size` checkerboard of single texels, black and white, opaque.
+fn make_checkerboard(allocator: std.mem.Allocator, size: u32) ![]u8 {
+    const pixels = try allocator.alloc(u8, size * size * 4);
+    for (0..size) |y| {
+        for (0..size) |x| {
+            const value: u8 = if ((x + y) % 2 == 0) 0 else 255;
+            pixels[(y * size + x) * 4 ..][0..4].* = .{ value, value, value, 255 };
+        }
+    }
+    return pixels;
+}
+
+test "mip counts" {
+    try std.testing.expect(texture_format.mip_count_for(1, 1) == 1);
+    try std.testing.expect(texture_format.mip_count_for(256, 64) == 9);
+    try std.testing.expect(texture_format.mip_count_for(5, 3) == 3);
+}
+
+test "baked files read back, coarsest mips first" {
+    const allocator = std.testing.allocator;
+
+    const pixels = try make_checkerboard(allocator, 16);
+    defer allocator.free(pixels);
+    const file = try texture_format.bake(allocator, .rgba8_unorm, 16, 16, pixels);
+    defer allocator.free(file);
+
+    var stream = std.io.fixedBufferStream(file);
+    const info = try texture_format.TextureInfo.read(allocator, stream.reader(), file.len);
+    defer info.deinit(allocator);
+
+    try std.testing.expect(info.header.width == 16 and info.header.height == 16);
+    try std.testing.expect(info.mips.len == 5);
+    for (info.mips, 0..) |mip, level| {
+        try std.testing.expect(mip.width == @as(u32, 16) >> @intCast(level));
+        try std.testing.expect(mip.offset % texture_format.data_alignment == 0);
+        if (level > 0) {
+            try std.testing.expect(mip.offset < info.mips[level - 1].offset);
+        }
+    }
+    const mip_0 = info.mips[0];
+    try std.testing.expectEqualSlices(u8, pixels, file[mip_0.offset..][0..mip_0.size]);
+
+    // Any mip to the coarsest is one range, which ends with the finest of them.
+    const span = info.span_from(2);
+    try std.testing.expect(span.offset == info.mips[4].offset);
+    try std.testing.expect(span.offset + span.size == info.mips[2].offset + info.mips[2].size);
+    try std.testing.expect(info.first_mip_within(4) == 2);
+    try std.testing.expect(info.resident_size_from(3) == (2 * 2 + 1) * 4);
+
+    // A checkerboard averages to gray at every mip after the first.
+    for (info.mips[1..]) |mip| {
+        for (file[mip.offset..][0..mip.size], 0..) |value, i| {
+            try std.testing.expect(value == if (i % 4 == 3) 255 else 128);
+        }
+    }
+
+    // Corrupt files are rejected.
+    stream.reset();
+    try std.testing.expectError(
+        texture_format.FormatError.invalid_mips,
+        texture_format.TextureInfo.read(allocator, stream.reader(), file.len - 1),
+    );
+
+    const offset_of_offset_0 = @sizeOf(texture_format.Header) +
+        @offsetOf(texture_format.Mip, "offset");
+    const offset_0 = std.mem.readIntLittle(u64, file[offset_of_offset_0..][0..8]);
+    // Misaligned, then before the coarsest mip, then past the end of the file.
+    for ([_]u64{ offset_0 + 1, info.mips[4].offset, file.len }) |bad_offset| {
+        std.mem.writeIntLittle(u64, file[offset_of_offset_0..][0..8], bad_offset);
+        stream.reset();
+        try std.testing.expectError(
+            texture_format.FormatError.invalid_mips,
+            texture_format.TextureInfo.read(allocator, stream.reader(), file.len),
+        );
+    }
+    std.mem.writeIntLittle(u64, file[offset_of_offset_0..][0..8], offset_0);
+
+    file[0] = 'X';
+    stream.reset();
+    try std.testing.expectError(
+        texture_format.FormatError.invalid_magic,
+        texture_format.TextureInfo.read(allocator, stream.reader(), file.len),
+    );
+}
+
+test "sRGB mips are averaged in linear space" {
+    const allocator = std.testing.allocator;
+
+    const pixels = try make_checkerboard(allocator, 2);
+    defer allocator.free(pixels);
+    const file = try texture_format.bake(allocator, .rgba8_srgb, 2, 2, pixels);
+    defer allocator.free(file);
+
+    var stream = std.io.fixedBufferStream(file);
+    const info = try texture_format.TextureInfo.read(allocator, stream.reader(), file.len);
+    defer info.deinit(allocator);
+
+    // Half of the light of white is about 188 in sRGB, not 128. Alpha stays linear.
+    const texel = file[info.mips[1].offset..][0..4];
+    try std.testing.expect(texel[0] >= 187 and texel[0] <= 188);
+    try std.testing.expect(texel[0] == texel[1] and texel[1] == texel[2]);
+    try std.testing.expect(texel[3] == 255);
+}
+
+test "odd sizes repeat the last row and column" {
+    const allocator = std.testing.allocator;
+
+    // 3 x 1: red, green, blue.
+    const pixels = [_]u8{ 255, 0, 0, 255, 0, 255, 0, 255, 0, 0, 255, 255 };
+    const file = try texture_format.bake(allocator, .rgba8_unorm, 3, 1, &pixels);
+    defer allocator.free(file);
+
+    var stream = std.io.fixedBufferStream(file);
+    const info = try texture_format.TextureInfo.read(allocator, stream.reader(), file.len);
+    defer info.deinit(allocator);
+
+    try std.testing.expect(info.mips.len == 2);
+    try std.testing.expect(info.mips[1].width == 1 and info.mips[1].height == 1);
+    // The first texel of mip 1 covers red and green, both twice since there is only one row.
+    try std.testing.expectEqualSlices(
+        u8,
+        &.{ 128, 128, 0, 255 },
+        file[info.mips[1].offset..][0..4],
+    );
+}
@@ -0,0 +1,95 @@
+const std = @import("std");
+const r4_core = @import("r4_core");
+
+const math = r4_core.math;
+const vertex_formats = r4_core.vertex_formats;
+
+test "octahedral normals round trip" {
+    var prng = std.rand.DefaultPrng.init(0x42);
+    const random = prng.random();
+
+    // The axes and diagonals are the corners and edges of the octahedron, plus random normals.
+    var normals = std.ArrayList([3]f32).init(std.testing.allocator);
+    defer normals.deinit();
+    for ([_]f32{ -1, 0, 1 }) |x| {
+        for ([_]f32{ -1, 0, 1 }) |y| {
+            for ([_]f32{ -1, 0, 1 }) |z| {
+                if (x != 0 or y != 0 or z != 0) {
+                    try normals.append(.{ x, y, z });
+                }
+            }
+        }
+    }
+    for (0..1000) |_| {
+        try normals.append(.{
+            random.float(f32) * 2 - 1,
+            random.float(f32) * 2 - 1,
+            random.float(f32) * 2 - 1,
+        });
+    }
+
+    for (normals.items) |n| {
+        const length = @sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length < 1e-3) {
+            continue;
+        }
+
+        const decoded = vertex_formats.NormalOct16.encode(math.Vec3f.init(n[0], n[1], n[2]))
+            .decode();
+        // Within 0.01 degrees. For small angles, the angle in radians is about the distance
+        // between the unit vectors, which unlike its cosine is precise in f32.
+        var distance_squared: f32 = 0;
+        for (decoded, n) |a, b| {
+            distance_squared += (a - b / length) * (a - b / length);
+        }
+        try std.testing.expect(@sqrt(distance_squared) < std.math.degreesToRadians(f32, 0.01));
+    }
+}
+
+test "packed positions and colors round trip" {
+    const position = vertex_formats.PositionF16.encode(math.Vec3f.init(1.5, -0.25, 10)).decode();
+    try std.testing.expectEqualSlices(f32, &.{ 1.5, -0.25, 10 }, &position);
+
+    const color = vertex_formats.ColorUnorm8.encode(math.Vec3f.init(0, 0.5, 2)).decode();
+    try std.testing.expectApproxEqAbs(@as(f32, 0), color[0], 1e-6);
+    try std.testing.expectApproxEqAbs(@as(f32, 0.5), color[1], 0.5 / 255.0);
+    // Out of range values are clamped.
+    try std.testing.expectApproxEqAbs(@as(f32, 1), color[2], 1e-6);
+
+    try std.testing.expect(vertex_formats.attribute_format(vertex_formats.NormalOct16) ==
+        .r16g16_snorm);
+    try std.testing.expect(vertex_formats.attribute_format(math.Vec3f) == .r32g32b32_sfloat);
+}
+
+test "meshes too large for half float positions are rejected" {
+    const allocator = std.testing.allocator;
+    const MeshSystem = r4_core.Scene.MeshSystem;
+    const max_coordinate = vertex_formats.PositionF16.max_coordinate;
+
+    var vertices: [3]r4_core.Scene.Vertex = undefined;
+    for (&vertices, [_][3]f32{ .{ 0, 0, 0 }, .{ 1, 0, 0 }, .{ 0, 1, 0 } }) |*vertex, position| {
+        vertex.* = .{
+            .position = math.Vec3f.init(position[0], position[1], position[2]),
+            .normal = math.Vec3f.init(0, 0, 1),
+            .color = math.Vec3f.init(1, 1, 1),
+        };
+    }
+    const indices = [_]u32{ 0, 1, 2 };
+
+    // A triangle at the edge of the range is kept.
+    vertices[0].position = math.Vec3f.init(-max_coordinate, 0, 0);
+    const prepared = try MeshSystem.prepare(allocator, "edge", &vertices, &indices);
+    prepared.deinit(allocator);
+
+    // One a world-space or CAD-scale model could have isn't.
+    vertices[0].position = math.Vec3f.init(0, 0, 70_000);
+    try std.testing.expectError(
+        error.position_out_of_range,
+        MeshSystem.prepare(allocator, "far", &vertices, &indices),
+    );
+    vertices[0].position = math.Vec3f.init(max_coordinate * 2, 0, 0);
+    try std.testing.expectError(
+        error.position_out_of_range,
+        MeshSystem.prepare(allocator, "far", &vertices, &indices),
+    );
+}